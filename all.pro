@@ -1,5 +1,9 @@
 TEMPLATE = subdirs
-SUBDIRS += gtbase gtview gtsvce gather loader
+SUBDIRS += gtbase gtview gtsvce gather loader viewtests viewbench
 gtview.depends = gtbase
 gather.depends = gtview gtsvce
+viewtests.subdir = gtview/tests
+viewtests.depends = gtview loader
+viewbench.subdir = gtview/gtviewbench
+viewbench.depends = gtview
 backend.depends = gtbase
@@ -3,10 +3,11 @@ CONFIG += qt debug
 QT += sql widgets network
 HEADERS += gtapplication.h gtdocmanager.h gtusermanager.h \
     gtusermanager_p.h gtmainwindow.h gttabview.h gthometabview.h \
-    gtdoctabview.h gtmainsettings.h gtlogindialog.h
+    gtdoctabview.h gtmainsettings.h gtlogindialog.h gtlibrarysearch.h \
+    gtlibrarysearch_p.h
 SOURCES += gtapplication.cpp gtdocmanager.cpp gtusermanager.cpp \
     gtmainwindow.cpp gttabview.cpp gthometabview.cpp gtdoctabview.cpp \
-    gtmainsettings.cpp gtlogindialog.cpp
+    gtmainsettings.cpp gtlogindialog.cpp gtlibrarysearch.cpp
 FORMS += gtmainwindow.ui gthometabview.ui gtlogindialog.ui
 RESOURCES = gtapp.qrc
 INCLUDEPATH += $$PWD/../../gtbase/message
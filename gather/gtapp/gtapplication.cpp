@@ -3,6 +3,7 @@
  */
 #include "gtapplication.h"
 #include "gtdocmanager.h"
+#include "gtlibrarysearch.h"
 #include "gtmainsettings.h"
 #include "gtmainwindow.h"
 #include "gtusermanager.h"
@@ -45,6 +46,7 @@ protected:
     // document
     QThread *m_docThread;
     GtDocManager *m_docManager;
+    GtLibrarySearch *m_librarySearch;
 
     // network
     QThread *m_networkThread;
@@ -56,6 +58,7 @@ GtApplicationPrivate::GtApplicationPrivate(GtApplication *q)
     , m_localServer(0)
     , m_docThread(0)
     , m_docManager(0)
+    , m_librarySearch(0)
     , m_networkThread(0)
     , m_userManager(0)
 {
@@ -119,6 +122,9 @@ GtApplicationPrivate::GtApplicationPrivate(GtApplication *q)
 
 GtApplicationPrivate::~GtApplicationPrivate()
 {
+    if (m_librarySearch)
+        m_librarySearch->stop();
+
     if (m_docThread) {
         m_docThread->quit();
         m_docThread->wait();
@@ -203,6 +209,7 @@ QThread *GtApplication::docThread()
 
     if (!d->m_docThread) {
         d->m_docThread = new QThread(this);
+        d->m_docThread->setObjectName(QLatin1String("document"));
         d->m_docThread->start();
     }
 
@@ -228,12 +235,31 @@ GtDocManager *GtApplication::docManager()
     return d->m_docManager;
 }
 
+GtLibrarySearch *GtApplication::librarySearch()
+{
+    Q_D(GtApplication);
+
+    if (!d->m_librarySearch) {
+        QString docdb = dataFilePath("document.db");
+        QDir dir(QCoreApplication::applicationDirPath());
+
+        if (!dir.cd("loader"))
+            qWarning() << "can't access loaders directory";
+
+        d->m_librarySearch = new GtLibrarySearch(docdb, dir.absolutePath(), this);
+        d->m_librarySearch->start();
+    }
+
+    return d->m_librarySearch;
+}
+
 QThread *GtApplication::networkThread()
 {
     Q_D(GtApplication);
 
     if (!d->m_networkThread) {
         d->m_networkThread = new QThread(this);
+        d->m_networkThread->setObjectName(QLatin1String("network"));
         d->m_networkThread->start();
     }
 
@@ -317,6 +343,9 @@ void GtApplication::postLaunch()
 
     // new default window
     newMainWindow();
+
+    // index the document library in background
+    librarySearch();
 }
 
 void GtApplication::newLocalSocketConnection()
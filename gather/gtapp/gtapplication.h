@@ -10,6 +10,7 @@
 GT_BEGIN_NAMESPACE
 
 class GtDocManager;
+class GtLibrarySearch;
 class GtMainSettings;
 class GtMainWindow;
 class GtUserManager;
@@ -33,6 +34,7 @@ public:
 
     QThread *docThread();
     GtDocManager *docManager();
+    GtLibrarySearch *librarySearch();
 
     QThread *networkThread();
     GtUserManager *userManager();
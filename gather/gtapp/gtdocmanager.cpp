@@ -3,6 +3,8 @@
  */
 #include "gtdocmanager.h"
 #include "gtbookmarks.h"
+#include "gtdocindex.h"
+#include "gtdocindexer.h"
 #include "gtdocloader.h"
 #include "gtdocmessage.pb.h"
 #include "gtdocmeta.h"
@@ -10,8 +12,11 @@
 #include "gtdocnotes.h"
 #include "gtdocument.h"
 #include "gtserialize.h"
+#include "gttrace.h"
 #include "gtuserclient.h"
 #include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
 #include <QtCore/QTimer>
 #include <QtCore/QUuid>
 #include <QtSql/QSqlError>
@@ -33,12 +38,15 @@ public:
     void updateDatabase();
     void bookmarksChanged(GtBookmarks *bookmarks);
     void notesChanged(GtDocNotes *notes);
+    void indexDocument(GtDocModel *model);
+    QString indexFileName(const QString &fileId) const;
     bool readDocMetaFromDB(GtDocMeta *meta);
     bool readBookmarksFromDB(GtBookmarks *bookmarks);
     bool readDocNotesFromDB(GtDocNotes *notes);
     bool writeDocMetaToDB(const GtDocMeta *meta);
     bool writeBookmarksToDB(const GtBookmarks *bookmarks);
     bool writeDocNotesToDB(const GtDocNotes *notes);
+    bool writePathToDB(const QString &fileId, const QString &path);
     int cleanDocMetas();
     int cleanBookmarks();
     int cleanDocNotes();
@@ -54,6 +62,8 @@ public:
 protected:
     GtDocManager *q_ptr;
     GtDocLoader *m_docLoader;
+    GtDocIndexer *m_docIndexer;
+    QString m_indexPath;
 
     QHash<QString, QString> m_path2id;
     QHash<QString, GtDocModel*> m_docModels;
@@ -79,6 +89,7 @@ GtDocManagerPrivate::GtDocManagerPrivate(GtDocManager *q, QThread *t)
     , m_changedCount(0)
 {
     m_docLoader = new GtDocLoader(t, q);
+    m_docIndexer = new GtDocIndexer(t, q);
 }
 
 GtDocManagerPrivate::~GtDocManagerPrivate()
@@ -157,6 +168,14 @@ void GtDocManagerPrivate::openDocDatabase(const QString &docdb)
         qWarning() << "create doc notes table error:"
                    << query.lastError();
     }
+
+    // full text indexes are kept as files beside the database
+    QString indexPath(GtDocManager::docIndexPath(docdb));
+
+    if (QDir().mkpath(indexPath))
+        m_indexPath = indexPath;
+    else
+        qWarning() << "create document index directory failed:" << indexPath;
 }
 
 void GtDocManagerPrivate::updateDatabase()
@@ -207,6 +226,22 @@ void GtDocManagerPrivate::notesChanged(GtDocNotes *notes)
     updateDatabase();
 }
 
+void GtDocManagerPrivate::indexDocument(GtDocModel *model)
+{
+    GtDocIndex *index = model->index();
+    GtDocument *document = model->document();
+
+    if (!index || !document->isLoaded() || index->isComplete())
+        return;
+
+    m_docIndexer->index(document, index, indexFileName(index->id()));
+}
+
+QString GtDocManagerPrivate::indexFileName(const QString &fileId) const
+{
+    return m_indexPath + "/" + fileId + ".idx";
+}
+
 bool GtDocManagerPrivate::readDocMetaFromDB(GtDocMeta *meta)
 {
     return readFromDatabase<GtDocMeta, GtDocMetaMsg>("docmeta", *meta);
@@ -245,6 +280,45 @@ bool GtDocManagerPrivate::writeDocNotesToDB(const GtDocNotes *notes)
     return writeToDatabase<GtDocNotes, GtDocNotesMsg>("docnotes", *notes);
 }
 
+bool GtDocManagerPrivate::writePathToDB(const QString &fileId,
+                                        const QString &path)
+{
+    if (!m_docDatabase.isOpen())
+        return false;
+
+    GT_TRACE_SCOPE_ARG("database", "write", QLatin1String("id2path"));
+
+    QSqlQuery query(m_docDatabase);
+    query.prepare("SELECT uuid FROM id2path WHERE path=:path");
+    query.bindValue(":path", path);
+
+    if (!query.exec()) {
+        qWarning() << "select table id2path error:" << query.lastError();
+        return false;
+    }
+
+    if (query.first()) {
+        if (query.value(0).toString() == fileId)
+            return true;
+
+        query.prepare("UPDATE id2path SET uuid=:uuid WHERE path=:path");
+    }
+    else {
+        query.prepare("INSERT INTO id2path (uuid, path) "
+                      "VALUES(:uuid, :path)");
+    }
+
+    query.bindValue(":uuid", fileId);
+    query.bindValue(":path", path);
+
+    if (!query.exec()) {
+        qWarning() << "write table id2path error:" << query.lastError();
+        return false;
+    }
+
+    return true;
+}
+
 int GtDocManagerPrivate::cleanDocMetas()
 {
     // clean up any unreferenced doc metas
@@ -337,6 +411,7 @@ int GtDocManagerPrivate::cleanDocuments()
                 m_undoStatcks.erase(us);
             }
 
+            m_docIndexer->cancel(it.value()->document());
             delete it.value();
             it = m_docModels.erase(it);
             ++count;
@@ -355,6 +430,8 @@ bool GtDocManagerPrivate::readFromDatabase(const QString &table, T0 &dest)
     if (!m_docDatabase.isOpen())
         return false;
 
+    GT_TRACE_SCOPE_ARG("database", "read", table);
+
     QSqlQuery query(m_docDatabase);
     query.prepare("SELECT data FROM " + table + " WHERE uuid=:uuid");
     query.bindValue(":uuid", dest.id());
@@ -383,6 +460,8 @@ bool GtDocManagerPrivate::writeToDatabase(const QString &table, const T0 &src)
     if (!m_docDatabase.isOpen())
         return false;
 
+    GT_TRACE_SCOPE_ARG("database", "write", table);
+
     QSqlQuery query(m_docDatabase);
     query.prepare("SELECT uuid FROM " + table + " WHERE uuid=:uuid");
     query.bindValue(":uuid", src.id());
@@ -558,6 +637,8 @@ GtDocModel *GtDocManager::loadLocalDocument(const QString &fileName)
 {
     Q_D(GtDocManager);
 
+    GT_TRACE_SCOPE_ARG("app", "open document", fileName);
+
     QHash<QString, QString>::iterator it0;
 
     it0 = d->m_path2id.find(fileName);
@@ -585,6 +666,7 @@ GtDocModel *GtDocManager::loadLocalDocument(const QString &fileName)
 
     QString fileId(document->fileId());
     d->m_path2id.insert(fileName, fileId);
+    d->writePathToDB(fileId, QFileInfo(fileName).absoluteFilePath());
     model->ref.ref();
     d->m_docModels.insert(fileId, model);
 
@@ -628,6 +710,24 @@ GtDocModel *GtDocManager::loadLocalDocument(const QString &fileName)
     GtDocNotes *notes = loadDocNotes(notesId);
     model->setNotes(notes);
 
+    // full text index
+    if (!d->m_indexPath.isEmpty()) {
+        GtDocIndex *index = new GtDocIndex(fileId);
+
+        GtDocIndexer::loadIndex(index, d->indexFileName(fileId));
+        model->setIndex(index);
+
+        if (!index->isComplete()) {
+            if (!document->isLoaded()) {
+                connect(document, SIGNAL(loaded()),
+                        this, SLOT(documentLoaded()));
+            }
+
+            if (document->isLoaded())
+                d->indexDocument(model);
+        }
+    }
+
     return model;
 }
 
@@ -647,6 +747,12 @@ QUndoStack *GtDocManager::undoStack(GtDocModel *docModel)
     return undoStack;
 }
 
+QString GtDocManager::docIndexPath(const QString &docdb)
+{
+    QFileInfo info(docdb);
+    return info.absolutePath() + "/" + info.completeBaseName() + "-index";
+}
+
 void GtDocManager::bookmarkAdded(GtBookmark *bookmark)
 {
     Q_D(GtDocManager);
@@ -687,6 +793,18 @@ void GtDocManager::noteRemoved(GtDocNote *note)
     d->notesChanged(notes);
 }
 
+void GtDocManager::documentLoaded()
+{
+    Q_D(GtDocManager);
+
+    GtDocument *document = qobject_cast<GtDocument*>(sender());
+    QHash<QString, GtDocModel*>::iterator it;
+
+    it = d->m_docModels.find(document->fileId());
+    if (it != d->m_docModels.end() && it.value()->document() == document)
+        d->indexDocument(it.value());
+}
+
 void GtDocManager::updateDatabase()
 {
     Q_D(GtDocManager);
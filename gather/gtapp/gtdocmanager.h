@@ -41,12 +41,16 @@ public:
     GtDocModel *loadLocalDocument(const QString &fileName);
     QUndoStack *undoStack(GtDocModel *docModel);
 
+public:
+    static QString docIndexPath(const QString &docdb);
+
 private Q_SLOTS:
     void bookmarkAdded(GtBookmark *bookmark);
     void bookmarkRemoved(GtBookmark *bookmark);
     void bookmarkUpdated(GtBookmark *bookmark, int flags);
     void noteAdded(GtDocNote *note);
     void noteRemoved(GtDocNote *note);
+    void documentLoaded();
     void updateDatabase();
 
 private:
@@ -6,11 +6,15 @@
 #include "gtbookmark.h"
 #include "gtbookmarks.h"
 #include "gtdoccommand.h"
+#include "gtdocindex.h"
 #include "gtdocmodel.h"
 #include "gtdocpage.h"
+#include "gtdocprofiler.h"
+#include "gtdoctrace.h"
 #include "gtdocrange.h"
 #include "gtdocument.h"
 #include "gtdocview.h"
+#include "gtlinkdest.h"
 #include "gtmainsettings.h"
 #include "gtmainwindow.h"
 #include "gttocmodel.h"
@@ -29,6 +33,8 @@ GtDocTabView::GtDocTabView(QWidget *parent)
     : GtTabView(parent)
     , m_docModel(0)
     , m_undoStack(0)
+    , m_profiler(0)
+    , m_trace(0)
     , m_undoAction(0)
     , m_redoAction(0)
 {
@@ -73,6 +79,12 @@ GtDocTabView::GtDocTabView(QWidget *parent)
     QShortcut *shortcut = new QShortcut(QKeySequence::Delete, this);
     connect(shortcut, SIGNAL(activated()), this, SLOT(onDelete()));
 
+    shortcut = new QShortcut(QKeySequence("Ctrl+Alt+P"), this);
+    connect(shortcut, SIGNAL(activated()), this, SLOT(toggleProfiler()));
+
+    shortcut = new QShortcut(QKeySequence("Ctrl+Alt+T"), this);
+    connect(shortcut, SIGNAL(activated()), this, SLOT(toggleTrace()));
+
     // settings
     GtMainSettings *settings = application->settings();
     m_splitter->restoreState(settings->docSplitter());
@@ -204,6 +216,9 @@ void GtDocTabView::loseActive()
 {
     GtTabView::loseActive();
 
+    // the rendered pages of a background tab go first
+    m_docView->trimMemory();
+
     Ui_MainWindow &ui = mainWindow()->m_ui;
 
     if (m_undoAction && m_redoAction)  {
@@ -399,7 +414,68 @@ void GtDocTabView::setDestination()
 
 void GtDocTabView::searchSelectedText()
 {
-    qDebug() << "search selected text";
+    GtDocIndex *index = m_docModel->index();
+    if (!index)
+        return;
+
+    QString text(m_docView->selectedText());
+    if (text.isEmpty())
+        return;
+
+    // jump to the next page containing the text, wrap around at the end
+    QList<int> pages(index->findPages(text));
+    if (pages.isEmpty())
+        return;
+
+    int current = m_docModel->page();
+    int page = pages.first();
+    for (int i = 0; i < pages.size(); ++i) {
+        if (pages[i] > current) {
+            page = pages[i];
+            break;
+        }
+    }
+
+    m_docView->scrollTo(GtLinkDest(page, QPointF(), 0));
+}
+
+void GtDocTabView::toggleProfiler()
+{
+    if (!m_profiler) {
+        m_profiler = new GtDocProfiler(this);
+        m_profiler->setOverlayVisible(true);
+        m_docView->setProfiler(m_profiler);
+        return;
+    }
+
+    // save the frames recorded while the overlay was shown
+    QString fileName(GtApplication::dataFilePath("profile.csv"));
+
+    if (m_profiler->save(fileName))
+        qDebug() << "frame profile saved:" << fileName;
+
+    m_docView->setProfiler(0);
+    delete m_profiler;
+    m_profiler = 0;
+}
+
+void GtDocTabView::toggleTrace()
+{
+    if (!m_trace) {
+        m_trace = new GtDocTrace(this);
+        m_docView->setTrace(m_trace);
+        return;
+    }
+
+    // only the navigation is recorded, never the document contents
+    QString fileName(GtApplication::dataFilePath("navigation.trace"));
+
+    if (m_trace->save(fileName))
+        qDebug() << "navigation trace saved:" << fileName;
+
+    m_docView->setTrace(0);
+    delete m_trace;
+    m_trace = 0;
 }
 
 GT_END_NAMESPACE
@@ -15,6 +15,8 @@ GT_BEGIN_NAMESPACE
 
 class GtBookmark;
 class GtDocModel;
+class GtDocProfiler;
+class GtDocTrace;
 class GtDocument;
 class GtDocView;
 class GtTocModel;
@@ -54,6 +56,8 @@ private Q_SLOTS:
     void addBookmark();
     void setDestination();
     void searchSelectedText();
+    void toggleProfiler();
+    void toggleTrace();
 
 private:
     // model
@@ -66,6 +70,8 @@ private:
     QSplitter *m_splitter;
     GtDocView *m_docView;
     GtTocView *m_tocView;
+    GtDocProfiler *m_profiler;
+    GtDocTrace *m_trace;
 
     // undo/redo
     QAction *m_undoAction;
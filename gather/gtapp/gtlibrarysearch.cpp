@@ -0,0 +1,862 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#include "gtlibrarysearch_p.h"
+#include "gtdocindex.h"
+#include "gtdocindexer.h"
+#include "gtdocloader.h"
+#include "gtdocmanager.h"
+#include "gtdocpage.h"
+#include "gtdocument.h"
+#include "gttrace.h"
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFileSystemWatcher>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+#include <QtSql/QSqlError>
+#include <QtSql/QSqlQuery>
+#include <algorithm>
+#include <math.h>
+
+GT_BEGIN_NAMESPACE
+
+class GtLibrarySearchPrivate
+{
+    Q_DECLARE_PUBLIC(GtLibrarySearch)
+
+public:
+    struct Document
+    {
+        QString fileId;
+        QString path;
+        QStringList terms;
+        bool live;
+    };
+
+    struct Entry
+    {
+        int doc;
+        int page;
+        int count;
+    };
+
+    struct Term
+    {
+        Term() : docs(0) {}
+
+        QVector<Entry> entries;
+        int docs;
+    };
+
+    struct Candidate
+    {
+        int doc;
+        int page;
+        double score;
+    };
+
+public:
+    GtLibrarySearchPrivate(GtLibrarySearch *q);
+    ~GtLibrarySearchPrivate();
+
+public:
+    QString indexFileName(const QString &fileId) const;
+    bool hasDocument(const QString &path, const QString &fileId) const;
+    void addDocument(const QString &path, const GtDocIndex *index);
+    void removeDocument(const QString &path);
+    void documentsUpdated();
+
+    static bool termLessThan(const Term *t1, const Term *t2);
+    static bool candidateGreaterThan(const Candidate &c1, const Candidate &c2);
+
+private:
+    void removeDocumentLocked(const QString &path);
+    void compactLocked();
+
+public:
+    GtLibrarySearch *q_ptr;
+    QString m_docdb;
+    QString m_indexPath;
+    QString m_loaderDir;
+    QThread *m_thread;
+    GtLibraryWorker *m_worker;
+
+    mutable QMutex m_mutex;
+    QVector<Document> m_docs;
+    QHash<QString, int> m_paths;
+    QHash<QString, Term> m_terms;
+    int m_liveCount;
+    int m_deadCount;
+    qint64 m_throttle;
+};
+
+GtLibraryWorker::GtLibraryWorker(GtLibrarySearchPrivate *p)
+    : d(p)
+    , m_docLoader(0)
+    , m_watcher(0)
+    , m_scanTimer(0)
+    , m_scheduled(false)
+    , m_bytes(0)
+    , m_document(0)
+    , m_index(0)
+    , m_dirty(false)
+{
+}
+
+GtLibraryWorker::~GtLibraryWorker()
+{
+    Q_ASSERT(0 == m_document && 0 == m_index);
+}
+
+void GtLibraryWorker::initialize()
+{
+    // the connection belongs to this thread, the document
+    // manager keeps its own one in the GUI thread
+    QString name(QString("librarydb_%1").arg(quintptr(this), 0, 16));
+
+    m_database = QSqlDatabase::addDatabase("QSQLITE", name);
+    m_database.setDatabaseName(d->m_docdb);
+    m_database.setConnectOptions("QSQLITE_BUSY_TIMEOUT=2000");
+
+    if (!m_database.open()) {
+        qWarning() << "open library database error:"
+                   << m_database.lastError();
+        return;
+    }
+
+    QSqlQuery query(m_database);
+
+    // indexed file states, to detect changed files cheaply
+    QString sql = "CREATE TABLE IF NOT EXISTS libfiles "
+                  "(id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                  "uuid VARCHAR(64), "
+                  "path VARCHAR(256), "
+                  "size INTEGER, "
+                  "mtime INTEGER)";
+
+    if (!query.exec(sql)) {
+        qWarning() << "create library files table error:"
+                   << query.lastError();
+    }
+
+    if (query.exec("SELECT uuid, path, size, mtime FROM libfiles")) {
+        while (query.next()) {
+            FileState state;
+
+            state.fileId = query.value(0).toString();
+            state.size = query.value(2).toLongLong();
+            state.mtime = query.value(3).toUInt();
+            m_states.insert(query.value(1).toString(), state);
+        }
+    }
+    else {
+        qWarning() << "select table libfiles error:" << query.lastError();
+    }
+
+    m_docLoader = new GtDocLoader(0, this);
+    m_docLoader->registerLoaders(d->m_loaderDir);
+
+    m_watcher = new QFileSystemWatcher(this);
+    connect(m_watcher, SIGNAL(fileChanged(QString)),
+            this, SLOT(fileChanged(QString)));
+
+    const int scanInterval = 60000;
+    m_scanTimer = new QTimer(this);
+    m_scanTimer->setInterval(scanInterval);
+    connect(m_scanTimer, SIGNAL(timeout()), this, SLOT(scan()));
+    m_scanTimer->start();
+
+    m_clock.start();
+    scan();
+}
+
+void GtLibraryWorker::finalize()
+{
+    delete m_document;
+    m_document = 0;
+
+    delete m_index;
+    m_index = 0;
+
+    if (m_scanTimer)
+        m_scanTimer->stop();
+
+    m_pending.clear();
+    m_pendingSet.clear();
+
+    if (m_database.isValid()) {
+        QString name(m_database.connectionName());
+
+        m_database.close();
+        m_database = QSqlDatabase();
+        QSqlDatabase::removeDatabase(name);
+    }
+}
+
+void GtLibraryWorker::scan()
+{
+    if (!m_database.isOpen())
+        return;
+
+    QSqlQuery query(m_database);
+    if (!query.exec("SELECT uuid, path FROM id2path")) {
+        qWarning() << "select table id2path error:" << query.lastError();
+        return;
+    }
+
+    QSet<QString> paths;
+    while (query.next()) {
+        QString path(query.value(1).toString());
+
+        if (paths.contains(path))
+            continue;
+
+        paths.insert(path);
+
+        QFileInfo info(path);
+        if (!info.exists()) {
+            m_failed.remove(path);
+            d->removeDocument(path);
+            continue;
+        }
+
+        if (!m_watched.contains(path) && m_watcher->addPath(path))
+            m_watched.insert(path);
+
+        if (hasFailed(path, info))
+            continue;
+
+        QString fileId(upToDateId(path, info));
+        if (fileId.isEmpty() || !d->hasDocument(path, fileId))
+            enqueue(path);
+    }
+}
+
+void GtLibraryWorker::indexNext()
+{
+    m_scheduled = false;
+
+    if (m_document) {
+        int page = m_index->indexedCount();
+
+        if (page < m_index->pageCount()) {
+            GtDocTextPointer text(m_document->page(page)->text());
+            m_index->addPage(page, text.data());
+            m_bytes += m_fileInfo.size() / m_index->pageCount();
+            m_dirty = true;
+        }
+
+        if (m_index->indexedCount() >= m_index->pageCount())
+            endDocument();
+    }
+    else if (!m_pending.isEmpty()) {
+        QString path(m_pending.takeFirst());
+        m_pendingSet.remove(path);
+
+        QFileInfo info(path);
+        if (!info.exists()) {
+            d->removeDocument(path);
+        }
+        else {
+            QString fileId(upToDateId(path, info));
+            bool loaded = false;
+
+            // unchanged since it was indexed, the index file is enough
+            if (!fileId.isEmpty()) {
+                if (d->hasDocument(path, fileId)) {
+                    loaded = true;
+                }
+                else {
+                    QString fileName(d->indexFileName(fileId));
+                    GtDocIndex index(fileId);
+
+                    m_bytes += QFileInfo(fileName).size();
+                    if (GtDocIndexer::loadIndex(&index, fileName) &&
+                        index.isComplete())
+                    {
+                        d->addDocument(path, &index);
+                        loaded = true;
+                    }
+                }
+            }
+
+            if (!loaded && !hasFailed(path, info))
+                beginDocument(path);
+        }
+    }
+
+    if (m_document || !m_pending.isEmpty()) {
+        schedule();
+    }
+    else {
+        m_bytes = 0;
+        m_clock.restart();
+        d->documentsUpdated();
+    }
+}
+
+void GtLibraryWorker::fileChanged(const QString &path)
+{
+    // editors often replace the file, which drops the watch
+    if (QFile::exists(path)) {
+        if (!m_watcher->files().contains(path))
+            m_watcher->addPath(path);
+    }
+    else {
+        m_watched.remove(path);
+    }
+
+    enqueue(path);
+}
+
+void GtLibraryWorker::enqueue(const QString &path)
+{
+    if (m_pendingSet.contains(path))
+        return;
+
+    m_pending.append(path);
+    m_pendingSet.insert(path);
+    schedule();
+}
+
+void GtLibraryWorker::schedule()
+{
+    if (m_scheduled)
+        return;
+
+    // keep the average read rate under the throttle
+    qint64 throttle = d->q_ptr->throttle();
+    qint64 delay = 0;
+
+    if (throttle > 0) {
+        delay = m_bytes * 1000 / throttle - m_clock.elapsed();
+        delay = CLAMP(delay, 0, 10000);
+    }
+
+    m_scheduled = true;
+    QTimer::singleShot(int(delay), this, SLOT(indexNext()));
+}
+
+bool GtLibraryWorker::beginDocument(const QString &path)
+{
+    QFileInfo info(path);
+
+    GT_TRACE_SCOPE_ARG("library", "begin document", path);
+
+    // file id hashing reads the whole file
+    m_bytes += info.size();
+
+    GtDocument *document = m_docLoader->loadDocument(path);
+    if (!document) {
+        setFailed(path, info);
+        return false;
+    }
+
+    if (!document->isLoaded() || document->pageCount() == 0) {
+        qWarning() << "library load document failed:" << path;
+        setFailed(path, info);
+        delete document;
+        return false;
+    }
+
+    QString fileId(document->fileId());
+    GtDocIndex *index = new GtDocIndex(fileId);
+
+    GtDocIndexer::loadIndex(index, d->indexFileName(fileId));
+    if (index->pageCount() != document->pageCount()) {
+        index->clear();
+        index->setPageCount(document->pageCount());
+    }
+
+    m_document = document;
+    m_index = index;
+    m_path = path;
+    m_fileInfo = info;
+    m_dirty = false;
+
+    if (m_index->isComplete())
+        endDocument();
+
+    return true;
+}
+
+void GtLibraryWorker::endDocument()
+{
+    QString fileId(m_index->id());
+
+    if (m_dirty)
+        GtDocIndexer::saveIndex(m_index, d->indexFileName(fileId));
+
+    writeFileState(m_path, fileId, m_fileInfo);
+    d->addDocument(m_path, m_index);
+
+    delete m_document;
+    m_document = 0;
+
+    delete m_index;
+    m_index = 0;
+}
+
+QString GtLibraryWorker::upToDateId(const QString &path,
+                                    const QFileInfo &info) const
+{
+    QHash<QString, FileState>::const_iterator it = m_states.find(path);
+
+    if (it == m_states.end() ||
+        it->size != info.size() ||
+        it->mtime != info.lastModified().toTime_t())
+    {
+        return QString();
+    }
+
+    return it->fileId;
+}
+
+bool GtLibraryWorker::hasFailed(const QString &path,
+                                const QFileInfo &info) const
+{
+    QHash<QString, FileState>::const_iterator it = m_failed.find(path);
+
+    return (it != m_failed.end() &&
+            it->size == info.size() &&
+            it->mtime == info.lastModified().toTime_t());
+}
+
+void GtLibraryWorker::setFailed(const QString &path, const QFileInfo &info)
+{
+    // not retried until the file changes, the failures
+    // are kept in memory only and retried on next start
+    FileState state;
+    state.size = info.size();
+    state.mtime = info.lastModified().toTime_t();
+    m_failed.insert(path, state);
+}
+
+void GtLibraryWorker::writeFileState(const QString &path,
+                                     const QString &fileId,
+                                     const QFileInfo &info)
+{
+    FileState state;
+    state.fileId = fileId;
+    state.size = info.size();
+    state.mtime = info.lastModified().toTime_t();
+
+    bool exists = m_states.contains(path);
+    m_states.insert(path, state);
+    m_failed.remove(path);
+
+    if (!m_database.isOpen())
+        return;
+
+    QSqlQuery query(m_database);
+
+    if (exists) {
+        query.prepare("UPDATE libfiles SET uuid=:uuid, size=:size, "
+                      "mtime=:mtime WHERE path=:path");
+    }
+    else {
+        query.prepare("INSERT INTO libfiles (uuid, path, size, mtime) "
+                      "VALUES(:uuid, :path, :size, :mtime)");
+    }
+
+    query.bindValue(":uuid", fileId);
+    query.bindValue(":path", path);
+    query.bindValue(":size", state.size);
+    query.bindValue(":mtime", state.mtime);
+
+    if (!query.exec())
+        qWarning() << "write table libfiles error:" << query.lastError();
+
+    // the file changed on disk, follow it with its new id
+    query.prepare("UPDATE id2path SET uuid=:uuid WHERE path=:path");
+    query.bindValue(":uuid", fileId);
+    query.bindValue(":path", path);
+
+    if (!query.exec())
+        qWarning() << "update table id2path error:" << query.lastError();
+}
+
+GtLibrarySearchPrivate::GtLibrarySearchPrivate(GtLibrarySearch *q)
+    : q_ptr(q)
+    , m_liveCount(0)
+    , m_deadCount(0)
+    , m_throttle(4 * 1024 * 1024)
+{
+    m_thread = new QThread();
+    m_thread->setObjectName(QLatin1String("library"));
+    m_worker = new GtLibraryWorker(this);
+    m_worker->moveToThread(m_thread);
+}
+
+GtLibrarySearchPrivate::~GtLibrarySearchPrivate()
+{
+    delete m_worker;
+    delete m_thread;
+}
+
+QString GtLibrarySearchPrivate::indexFileName(const QString &fileId) const
+{
+    return m_indexPath + "/" + fileId + ".idx";
+}
+
+bool GtLibrarySearchPrivate::hasDocument(const QString &path,
+                                         const QString &fileId) const
+{
+    QMutexLocker locker(&m_mutex);
+
+    QHash<QString, int>::const_iterator it = m_paths.find(path);
+    if (it == m_paths.end())
+        return false;
+
+    return m_docs[it.value()].fileId == fileId;
+}
+
+void GtLibrarySearchPrivate::addDocument(const QString &path,
+                                         const GtDocIndex *index)
+{
+    // collapse the postings to per page term counts
+    // before taking the lock, queries are not held up
+    QStringList terms(index->terms());
+    QVector<QVector<Entry> > entries(terms.size());
+
+    for (int i = 0; i < terms.size(); ++i) {
+        QVector<GtDocIndex::Posting> postings(index->find(terms[i]));
+        QVector<Entry> &list = entries[i];
+
+        for (int j = 0; j < postings.size(); ++j) {
+            if (list.size() > 0 && list.last().page == postings[j].page) {
+                ++list.last().count;
+            }
+            else {
+                Entry entry;
+                entry.doc = 0;
+                entry.page = postings[j].page;
+                entry.count = 1;
+                list.append(entry);
+            }
+        }
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    removeDocumentLocked(path);
+
+    // new documents get increasing numbers, so all
+    // entry lists stay sorted by document and page
+    Document document;
+    document.fileId = index->id();
+    document.path = path;
+    document.terms = terms;
+    document.live = true;
+
+    int doc = m_docs.size();
+    m_docs.append(document);
+    m_paths.insert(path, doc);
+    ++m_liveCount;
+
+    for (int i = 0; i < terms.size(); ++i) {
+        QVector<Entry> &list = entries[i];
+        Term &term = m_terms[terms[i]];
+
+        for (int j = 0; j < list.size(); ++j)
+            list[j].doc = doc;
+
+        term.entries += list;
+        ++term.docs;
+    }
+
+    const int minDeadCount = 64;
+    if (m_deadCount > minDeadCount && m_deadCount > m_liveCount)
+        compactLocked();
+}
+
+void GtLibrarySearchPrivate::removeDocument(const QString &path)
+{
+    QMutexLocker locker(&m_mutex);
+    removeDocumentLocked(path);
+}
+
+void GtLibrarySearchPrivate::documentsUpdated()
+{
+    int count;
+
+    m_mutex.lock();
+    count = m_liveCount;
+    m_mutex.unlock();
+
+    emit q_ptr->updated(count);
+}
+
+bool GtLibrarySearchPrivate::termLessThan(const Term *t1, const Term *t2)
+{
+    return t1->entries.size() < t2->entries.size();
+}
+
+bool GtLibrarySearchPrivate::candidateGreaterThan(const Candidate &c1,
+                                                  const Candidate &c2)
+{
+    if (c1.score != c2.score)
+        return c1.score > c2.score;
+
+    if (c1.doc != c2.doc)
+        return c1.doc < c2.doc;
+
+    return c1.page < c2.page;
+}
+
+void GtLibrarySearchPrivate::removeDocumentLocked(const QString &path)
+{
+    // entries of a removed document are skipped by queries
+    // and dropped by the next compaction, the document counts
+    // of its terms are updated now to keep the idf right
+    QHash<QString, int>::iterator it = m_paths.find(path);
+    if (it == m_paths.end())
+        return;
+
+    Document &document = m_docs[it.value()];
+    for (int i = 0; i < document.terms.size(); ++i) {
+        QHash<QString, Term>::iterator term = m_terms.find(document.terms[i]);
+        if (term != m_terms.end())
+            --term->docs;
+    }
+
+    document.terms.clear();
+    document.live = false;
+    m_paths.erase(it);
+    --m_liveCount;
+    ++m_deadCount;
+}
+
+void GtLibrarySearchPrivate::compactLocked()
+{
+    QVector<int> remap(m_docs.size());
+    QVector<Document> docs;
+
+    docs.reserve(m_liveCount);
+    m_paths.clear();
+
+    for (int i = 0; i < m_docs.size(); ++i) {
+        if (m_docs[i].live) {
+            remap[i] = docs.size();
+            m_paths.insert(m_docs[i].path, docs.size());
+            docs.append(m_docs[i]);
+        }
+        else {
+            remap[i] = -1;
+        }
+    }
+
+    QHash<QString, Term>::iterator it;
+    for (it = m_terms.begin(); it != m_terms.end();) {
+        QVector<Entry> &entries = it->entries;
+        int count = 0;
+        int docCount = 0;
+        int lastDoc = -1;
+
+        for (int i = 0; i < entries.size(); ++i) {
+            int doc = remap[entries[i].doc];
+            if (-1 == doc)
+                continue;
+
+            if (doc != lastDoc) {
+                lastDoc = doc;
+                ++docCount;
+            }
+
+            entries[count] = entries[i];
+            entries[count].doc = doc;
+            ++count;
+        }
+
+        if (0 == count) {
+            it = m_terms.erase(it);
+        }
+        else {
+            entries.resize(count);
+            it->docs = docCount;
+            ++it;
+        }
+    }
+
+    m_docs = docs;
+    m_deadCount = 0;
+}
+
+GtLibrarySearch::GtLibrarySearch(const QString &docdb,
+                                 const QString &loaderDir,
+                                 QObject *parent)
+    : QObject(parent)
+    , d_ptr(new GtLibrarySearchPrivate(this))
+{
+    d_ptr->m_docdb = docdb;
+    d_ptr->m_indexPath = GtDocManager::docIndexPath(docdb);
+    d_ptr->m_loaderDir = loaderDir;
+}
+
+GtLibrarySearch::~GtLibrarySearch()
+{
+    stop();
+}
+
+void GtLibrarySearch::start()
+{
+    Q_D(GtLibrarySearch);
+
+    if (d->m_thread->isRunning())
+        return;
+
+    QDir().mkpath(d->m_indexPath);
+
+    d->m_thread->start(QThread::LowestPriority);
+    QMetaObject::invokeMethod(d->m_worker, "initialize", Qt::QueuedConnection);
+}
+
+void GtLibrarySearch::stop()
+{
+    Q_D(GtLibrarySearch);
+
+    if (!d->m_thread->isRunning())
+        return;
+
+    QMetaObject::invokeMethod(d->m_worker, "finalize",
+                              Qt::BlockingQueuedConnection);
+    d->m_thread->quit();
+    d->m_thread->wait();
+}
+
+qint64 GtLibrarySearch::throttle() const
+{
+    Q_D(const GtLibrarySearch);
+
+    QMutexLocker locker(&d->m_mutex);
+    return d->m_throttle;
+}
+
+void GtLibrarySearch::setThrottle(qint64 bytesPerSecond)
+{
+    Q_D(GtLibrarySearch);
+
+    QMutexLocker locker(&d->m_mutex);
+    d->m_throttle = bytesPerSecond;
+}
+
+int GtLibrarySearch::documentCount() const
+{
+    Q_D(const GtLibrarySearch);
+
+    QMutexLocker locker(&d->m_mutex);
+    return d->m_liveCount;
+}
+
+QList<GtLibrarySearch::Hit> GtLibrarySearch::search(const QString &text,
+                                                    int maxHits) const
+{
+    Q_D(const GtLibrarySearch);
+
+    typedef GtLibrarySearchPrivate::Term Term;
+    typedef GtLibrarySearchPrivate::Entry Entry;
+    typedef GtLibrarySearchPrivate::Candidate Candidate;
+
+    QStringList terms(GtDocIndex::tokenize(text));
+    QList<Hit> hits;
+
+    if (terms.isEmpty() || maxHits <= 0)
+        return hits;
+
+    QMutexLocker locker(&d->m_mutex);
+
+    // every term must match, start from the rarest one
+    QVector<const Term*> lists;
+    for (int i = 0; i < terms.size(); ++i) {
+        QHash<QString, Term>::const_iterator it = d->m_terms.find(terms[i]);
+        if (it == d->m_terms.end())
+            return hits;
+
+        lists.append(&it.value());
+    }
+
+    std::sort(lists.begin(), lists.end(), GtLibrarySearchPrivate::termLessThan);
+
+    double docCount = MAX(d->m_liveCount, 1);
+    QVector<Candidate> candidates;
+
+    for (int i = 0; i < lists.size(); ++i) {
+        const QVector<Entry> &entries = lists[i]->entries;
+        double idf = log(1.0 + docCount / MAX(lists[i]->docs, 1));
+
+        if (0 == i) {
+            candidates.reserve(entries.size());
+
+            for (int j = 0; j < entries.size(); ++j) {
+                if (!d->m_docs[entries[j].doc].live)
+                    continue;
+
+                Candidate c;
+                c.doc = entries[j].doc;
+                c.page = entries[j].page;
+                c.score = (1.0 + log(double(entries[j].count))) * idf;
+                candidates.append(c);
+            }
+
+            continue;
+        }
+
+        // both lists are sorted by document and page
+        QVector<Candidate> merged;
+        int a = 0;
+        int b = 0;
+
+        while (a < candidates.size() && b < entries.size()) {
+            const Candidate &c = candidates[a];
+            const Entry &e = entries[b];
+
+            if (c.doc < e.doc || (c.doc == e.doc && c.page < e.page)) {
+                ++a;
+            }
+            else if (e.doc < c.doc || e.page < c.page) {
+                ++b;
+            }
+            else {
+                merged.append(c);
+                merged.last().score += (1.0 + log(double(e.count))) * idf;
+                ++a;
+                ++b;
+            }
+        }
+
+        candidates = merged;
+        if (candidates.isEmpty())
+            return hits;
+    }
+
+    int count = MIN(maxHits, candidates.size());
+    std::partial_sort(candidates.begin(),
+                      candidates.begin() + count,
+                      candidates.end(),
+                      GtLibrarySearchPrivate::candidateGreaterThan);
+
+    for (int i = 0; i < count; ++i) {
+        const GtLibrarySearchPrivate::Document &doc =
+                d->m_docs[candidates[i].doc];
+
+        Hit hit;
+        hit.fileId = doc.fileId;
+        hit.path = doc.path;
+        hit.page = candidates[i].page;
+        hit.score = candidates[i].score;
+        hits.append(hit);
+    }
+
+    return hits;
+}
+
+void GtLibrarySearch::rescan()
+{
+    Q_D(GtLibrarySearch);
+    QMetaObject::invokeMethod(d->m_worker, "scan", Qt::QueuedConnection);
+}
+
+GT_END_NAMESPACE
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#ifndef __GT_LIBRARY_SEARCH_H__
+#define __GT_LIBRARY_SEARCH_H__
+
+#include "gtobject.h"
+#include <QtCore/QObject>
+
+GT_BEGIN_NAMESPACE
+
+class GtLibrarySearchPrivate;
+
+class GT_APP_EXPORT GtLibrarySearch : public QObject, public GtObject
+{
+    Q_OBJECT
+
+public:
+    struct Hit
+    {
+        QString fileId;
+        QString path;
+        int page;
+        double score;
+    };
+
+public:
+    explicit GtLibrarySearch(const QString &docdb,
+                             const QString &loaderDir,
+                             QObject *parent = 0);
+    ~GtLibrarySearch();
+
+public:
+    void start();
+    void stop();
+
+    qint64 throttle() const;
+    void setThrottle(qint64 bytesPerSecond);
+
+    int documentCount() const;
+    QList<Hit> search(const QString &text, int maxHits = 100) const;
+
+public Q_SLOTS:
+    void rescan();
+
+Q_SIGNALS:
+    void updated(int documentCount);
+
+private:
+    QScopedPointer<GtLibrarySearchPrivate> d_ptr;
+
+private:
+    Q_DISABLE_COPY(GtLibrarySearch)
+    Q_DECLARE_PRIVATE(GtLibrarySearch)
+};
+
+GT_END_NAMESPACE
+
+#endif  /* __GT_LIBRARY_SEARCH_H__ */
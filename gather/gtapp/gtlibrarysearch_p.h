@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#ifndef __GT_LIBRARY_SEARCH_P_H__
+#define __GT_LIBRARY_SEARCH_P_H__
+
+#include "gtlibrarysearch.h"
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSet>
+#include <QtCore/QStringList>
+#include <QtSql/QSqlDatabase>
+
+class QFileSystemWatcher;
+class QTimer;
+
+GT_BEGIN_NAMESPACE
+
+class GtDocIndex;
+class GtDocLoader;
+class GtDocument;
+
+class GtLibraryWorker : public QObject, public GtObject
+{
+    Q_OBJECT
+
+public:
+    explicit GtLibraryWorker(GtLibrarySearchPrivate *d);
+    ~GtLibraryWorker();
+
+public Q_SLOTS:
+    void initialize();
+    void finalize();
+    void scan();
+    void indexNext();
+    void fileChanged(const QString &path);
+
+private:
+    void enqueue(const QString &path);
+    void schedule();
+    bool beginDocument(const QString &path);
+    void endDocument();
+    QString upToDateId(const QString &path, const QFileInfo &info) const;
+    bool hasFailed(const QString &path, const QFileInfo &info) const;
+    void setFailed(const QString &path, const QFileInfo &info);
+    void writeFileState(const QString &path, const QString &fileId,
+                        const QFileInfo &info);
+
+private:
+    struct FileState
+    {
+        QString fileId;
+        qint64 size;
+        uint mtime;
+    };
+
+    GtLibrarySearchPrivate *d;
+    QSqlDatabase m_database;
+    GtDocLoader *m_docLoader;
+    QFileSystemWatcher *m_watcher;
+    QTimer *m_scanTimer;
+    QHash<QString, FileState> m_states;
+    QHash<QString, FileState> m_failed;
+    QSet<QString> m_watched;
+    QStringList m_pending;
+    QSet<QString> m_pendingSet;
+    bool m_scheduled;
+
+    // throttle
+    QElapsedTimer m_clock;
+    qint64 m_bytes;
+
+    // document in progress
+    GtDocument *m_document;
+    GtDocIndex *m_index;
+    QString m_path;
+    QFileInfo m_fileInfo;
+    bool m_dirty;
+};
+
+GT_END_NAMESPACE
+
+#endif  /* __GT_LIBRARY_SEARCH_P_H__ */
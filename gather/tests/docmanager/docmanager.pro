@@ -1,6 +1,6 @@
 CONFIG += testcase
 TARGET = test_docmanager
-QT = core testlib
+QT = core sql testlib
 SOURCES = test_docmanager.cpp
 DEFINES += 'TEST_PDF_FILE=\'\"$$PWD/../../../gtbase/tests/test.pdf\"\''
 
@@ -3,10 +3,14 @@
  */
 #include "gtdocmanager.h"
 #include "gtbookmarks.h"
+#include "gtdocindex.h"
 #include "gtdocmeta.h"
 #include "gtdocmodel.h"
 #include "gtdocnotes.h"
 #include "gtdocument.h"
+#include "gtlibrarysearch.h"
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
 #include <QtTest/QtTest>
 
 using namespace Gather;
@@ -17,6 +21,8 @@ class test_docmanager : public QObject
 
 private Q_SLOTS:
     void testLocalFile();
+    void testLibrarySearch();
+    void benchLibrarySearch();
     void cleanupTestCase();
 };
 
@@ -80,6 +86,158 @@ void test_docmanager::testLocalFile()
     QVERIFY(manager.loadDocNotes(meta->notesId()) != notes);
 }
 
+void test_docmanager::testLibrarySearch()
+{
+    QDir dir(QCoreApplication::applicationDirPath());
+    QVERIFY(dir.cd("loader"));
+
+    QString docdb(QDir::temp().filePath("test_library.db"));
+    QString indexPath(GtDocManager::docIndexPath(docdb));
+    QString fileId;
+    QString term;
+
+    QFile::remove(docdb);
+    QDir(indexPath).removeRecursively();
+
+    {
+        // index is built synchronously without a thread
+        GtDocManager manager(docdb);
+        QVERIFY(manager.registerLoaders(dir.absolutePath()) == 1);
+
+        GtDocModel *model = manager.loadLocalDocument(TEST_PDF_FILE);
+        QVERIFY(model);
+        QVERIFY(model->index());
+        QVERIFY(model->index()->isComplete());
+        QVERIFY(model->index()->termCount() > 0);
+
+        fileId = model->document()->fileId();
+        term = model->index()->terms().first();
+    }
+
+    GtLibrarySearch library(docdb, dir.absolutePath());
+    QSignalSpy spy(&library, SIGNAL(updated(int)));
+
+    QVERIFY(library.documentCount() == 0);
+    QVERIFY(library.search(term).isEmpty());
+
+    library.start();
+    QTRY_VERIFY(spy.count() > 0);
+    QVERIFY(library.documentCount() == 1);
+
+    QList<GtLibrarySearch::Hit> hits(library.search(term));
+    QVERIFY(hits.size() > 0);
+    QVERIFY(hits[0].fileId == fileId);
+    QVERIFY(hits[0].path == QFileInfo(TEST_PDF_FILE).absoluteFilePath());
+    QVERIFY(hits[0].score > 0);
+    QVERIFY(library.search(term, 1).size() == 1);
+    QVERIFY(library.search(term + " xyzzyplugh").isEmpty());
+    QVERIFY(library.search("").isEmpty());
+
+    library.stop();
+
+    QFile::remove(docdb);
+    QDir(indexPath).removeRecursively();
+}
+
+void test_docmanager::benchLibrarySearch()
+{
+    QDir dir(QCoreApplication::applicationDirPath());
+    QVERIFY(dir.cd("loader"));
+
+    QString docdb(QDir::temp().filePath("test_library_bench.db"));
+    QString indexPath(GtDocManager::docIndexPath(docdb));
+    QDir files(QDir::temp().filePath("test_library_bench"));
+    QString fileId;
+    QStringList terms;
+
+    QFile::remove(docdb);
+    QDir(indexPath).removeRecursively();
+    files.removeRecursively();
+    QVERIFY(QDir().mkpath(files.absolutePath()));
+
+    {
+        GtDocManager manager(docdb);
+        QVERIFY(manager.registerLoaders(dir.absolutePath()) == 1);
+
+        GtDocModel *model = manager.loadLocalDocument(TEST_PDF_FILE);
+        QVERIFY(model);
+        QVERIFY(model->index()->isComplete());
+
+        fileId = model->document()->fileId();
+        terms = model->index()->terms();
+    }
+
+    // a library of 3000 documents with the test document, the others
+    // share its index and their file states are up to date, so the
+    // worker reads only the index file for each of them
+    const int docCount = 3000;
+
+    {
+        QSqlDatabase database(QSqlDatabase::addDatabase("QSQLITE",
+                                                        "test_library"));
+        database.setDatabaseName(docdb);
+        QVERIFY(database.open());
+
+        QSqlQuery query(database);
+        QVERIFY(query.exec("CREATE TABLE IF NOT EXISTS libfiles "
+                           "(id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                           "uuid VARCHAR(64), "
+                           "path VARCHAR(256), "
+                           "size INTEGER, "
+                           "mtime INTEGER)"));
+        QVERIFY(database.transaction());
+
+        for (int i = 1; i < docCount; ++i) {
+            QString path(files.absoluteFilePath(QString("%1.pdf").arg(i)));
+            QFile file(path);
+
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            file.close();
+
+            QFileInfo info(path);
+
+            query.prepare("INSERT INTO id2path (uuid, path) "
+                          "VALUES(:uuid, :path)");
+            query.bindValue(":uuid", fileId);
+            query.bindValue(":path", path);
+            QVERIFY(query.exec());
+
+            query.prepare("INSERT INTO libfiles (uuid, path, size, mtime) "
+                          "VALUES(:uuid, :path, :size, :mtime)");
+            query.bindValue(":uuid", fileId);
+            query.bindValue(":path", path);
+            query.bindValue(":size", info.size());
+            query.bindValue(":mtime", info.lastModified().toTime_t());
+            QVERIFY(query.exec());
+        }
+
+        QVERIFY(database.commit());
+        database.close();
+    }
+
+    QSqlDatabase::removeDatabase("test_library");
+
+    GtLibrarySearch library(docdb, dir.absolutePath());
+    library.setThrottle(0);
+    library.start();
+    QTRY_VERIFY_WITH_TIMEOUT(library.documentCount() == docCount, 120000);
+
+    // every document has the term, the hits are cut to the maximum
+    QVERIFY(library.search(terms.first()).size() == 100);
+
+    QString text(QStringList(terms.mid(0, 3)).join(" "));
+
+    QBENCHMARK {
+        library.search(text);
+    }
+
+    library.stop();
+
+    QFile::remove(docdb);
+    QDir(indexPath).removeRecursively();
+    files.removeRecursively();
+}
+
 void test_docmanager::cleanupTestCase()
 {
 #ifdef GT_DEBUG
@@ -1,2 +1,2 @@
 TEMPLATE = subdirs
-SUBDIRS = message gtbase tests
+SUBDIRS = message gtbase tests gtraster
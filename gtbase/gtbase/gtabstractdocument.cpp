@@ -51,4 +51,14 @@ GtAbstractOutline* GtAbstractDocument::loadOutline()
     return 0;
 }
 
+qint64 GtAbstractDocument::cacheSize()
+{
+    return 0;
+}
+
+void GtAbstractDocument::shrinkCache(int percent)
+{
+    Q_UNUSED(percent);
+}
+
 GT_END_NAMESPACE
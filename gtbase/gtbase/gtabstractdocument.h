@@ -56,6 +56,11 @@ public:
     virtual int countPages() = 0;
     virtual GtAbstractPage* loadPage(int index) = 0;
     virtual GtAbstractOutline* loadOutline();
+
+    // bytes held by the loader for the document, and a hint to give
+    // back the part that can be built again, e.g. decoded resources
+    virtual qint64 cacheSize();
+    virtual void shrinkCache(int percent);
 };
 
 #define GT_DEFINE_DOCUMENT_LOADER(constructor) \
@@ -6,11 +6,13 @@ HEADERS += gtcommon.h gtobject.h gtserialize.h gtabstractdocument.h \
     gtdocument.h gtdocument_p.h gtdocmeta.h gtdocpage.h gtdocpage_p.h \
     gtdocmodel.h gtdocloader.h gtdocloader_p.h gtdocpoint.h \
     gtdocrange.h gtlinkdest.h gtbookmark.h gtbookmarks.h gtdocnote.h \
-    gtdocnotes.h
+    gtdocnotes.h gtdocindex.h gtdocindexer.h gtdocindexer_p.h \
+    gttrace.h gtmemorygovernor.h
 SOURCES += gtobject.cpp gtabstractdocument.cpp gtdocument.cpp \
     gtdocmeta.cpp gtdocpage.cpp gtdocmodel.cpp gtdocloader.cpp \
     gtdocpoint.cpp gtdocrange.cpp gtlinkdest.cpp gtbookmark.cpp \
-    gtbookmarks.cpp gtdocnote.cpp gtdocnotes.cpp
+    gtbookmarks.cpp gtdocnote.cpp gtdocnotes.cpp gtdocindex.cpp \
+    gtdocindexer.cpp gttrace.cpp gtmemorygovernor.cpp
 
 CONFIG(debug, debug|release) {
     DESTDIR = ../../build/debug
@@ -0,0 +1,346 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#include "gtdocindex.h"
+#include "gtdocmessage.pb.h"
+#include "gtdocpage.h"
+#include "gtdocpoint.h"
+#include "gtserialize.h"
+#include <QtCore/QDebug>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+
+GT_BEGIN_NAMESPACE
+
+class GtDocIndexPrivate
+{
+    Q_DECLARE_PUBLIC(GtDocIndex)
+
+public:
+    explicit GtDocIndexPrivate(GtDocIndex *q);
+    ~GtDocIndexPrivate();
+
+public:
+    enum { MaxTermLength = 64 };
+
+    inline static bool isTermChar(const QChar &c)
+    {
+        return !GtDocPoint::isSpace(c) && !GtDocPoint::isWordSeparator(c);
+    }
+
+protected:
+    GtDocIndex *q_ptr;
+    QString m_id;
+    int m_pageCount;
+    int m_indexedCount;
+    QHash<QString, QVector<GtDocIndex::Posting> > m_terms;
+    mutable QMutex m_mutex;
+};
+
+GtDocIndexPrivate::GtDocIndexPrivate(GtDocIndex *q)
+    : q_ptr(q)
+    , m_pageCount(0)
+    , m_indexedCount(0)
+{
+}
+
+GtDocIndexPrivate::~GtDocIndexPrivate()
+{
+}
+
+GtDocIndex::GtDocIndex(const QString &id, QObject *parent)
+    : QObject(parent)
+    , d_ptr(new GtDocIndexPrivate(this))
+{
+    d_ptr->m_id = id;
+}
+
+GtDocIndex::~GtDocIndex()
+{
+}
+
+QString GtDocIndex::id() const
+{
+    Q_D(const GtDocIndex);
+    return d->m_id;
+}
+
+int GtDocIndex::pageCount() const
+{
+    Q_D(const GtDocIndex);
+
+    QMutexLocker locker(&d->m_mutex);
+    return d->m_pageCount;
+}
+
+void GtDocIndex::setPageCount(int count)
+{
+    Q_D(GtDocIndex);
+
+    QMutexLocker locker(&d->m_mutex);
+    d->m_pageCount = count;
+}
+
+int GtDocIndex::indexedCount() const
+{
+    Q_D(const GtDocIndex);
+
+    QMutexLocker locker(&d->m_mutex);
+    return d->m_indexedCount;
+}
+
+bool GtDocIndex::isComplete() const
+{
+    Q_D(const GtDocIndex);
+
+    QMutexLocker locker(&d->m_mutex);
+    return d->m_pageCount > 0 && d->m_indexedCount >= d->m_pageCount;
+}
+
+bool GtDocIndex::addPage(int page, const GtDocText *text)
+{
+    Q_D(GtDocIndex);
+
+    // pages are indexed in order, so the posting lists stay
+    // sorted by page and a partial index can be resumed
+    QMutexLocker locker(&d->m_mutex);
+    if (page != d->m_indexedCount || page >= d->m_pageCount) {
+        qWarning() << "index page out of order:" << page
+                   << d->m_indexedCount;
+        return false;
+    }
+
+    if (text && text->length() > 0) {
+        GtDocIndex::Posting posting;
+        QString term;
+        int pos = 0;
+
+        posting.page = page;
+        while ((posting.offset = nextTerm(text->texts(), text->length(),
+                                          &pos, &term)) != -1)
+        {
+            d->m_terms[term].append(posting);
+        }
+    }
+
+    int indexedCount = ++d->m_indexedCount;
+    locker.unlock();
+
+    emit updated(indexedCount);
+    return true;
+}
+
+void GtDocIndex::clear()
+{
+    Q_D(GtDocIndex);
+
+    QMutexLocker locker(&d->m_mutex);
+    d->m_terms.clear();
+    d->m_indexedCount = 0;
+}
+
+int GtDocIndex::termCount() const
+{
+    Q_D(const GtDocIndex);
+
+    QMutexLocker locker(&d->m_mutex);
+    return d->m_terms.size();
+}
+
+QStringList GtDocIndex::terms() const
+{
+    Q_D(const GtDocIndex);
+
+    QMutexLocker locker(&d->m_mutex);
+    return d->m_terms.keys();
+}
+
+QVector<GtDocIndex::Posting> GtDocIndex::find(const QString &term) const
+{
+    Q_D(const GtDocIndex);
+
+    QMutexLocker locker(&d->m_mutex);
+    return d->m_terms.value(term.toLower());
+}
+
+QList<int> GtDocIndex::findPages(const QString &text) const
+{
+    Q_D(const GtDocIndex);
+
+    QStringList terms(tokenize(text));
+    QList<int> result;
+
+    QMutexLocker locker(&d->m_mutex);
+    for (int i = 0; i < terms.size(); ++i) {
+        QHash<QString, QVector<Posting> >::const_iterator it;
+
+        it = d->m_terms.find(terms[i]);
+        if (it == d->m_terms.end())
+            return QList<int>();
+
+        // unique pages of this term, postings are sorted by page
+        QList<int> pages;
+        const QVector<Posting> &postings = it.value();
+        for (int j = 0; j < postings.size(); ++j) {
+            if (pages.isEmpty() || pages.last() != postings[j].page)
+                pages.append(postings[j].page);
+        }
+
+        if (0 == i) {
+            result = pages;
+            continue;
+        }
+
+        // intersect with the pages of the previous terms
+        QList<int> merged;
+        QList<int>::const_iterator a = result.begin();
+        QList<int>::const_iterator b = pages.begin();
+        while (a != result.end() && b != pages.end()) {
+            if (*a < *b) {
+                ++a;
+            }
+            else if (*b < *a) {
+                ++b;
+            }
+            else {
+                merged.append(*a);
+                ++a;
+                ++b;
+            }
+        }
+
+        result = merged;
+        if (result.isEmpty())
+            break;
+    }
+
+    return result;
+}
+
+void GtDocIndex::serialize(GtDocIndexMsg &msg) const
+{
+    Q_D(const GtDocIndex);
+
+    QMutexLocker locker(&d->m_mutex);
+
+    msg.set_id(d->m_id.toUtf8());
+    msg.set_page_count(d->m_pageCount);
+    msg.set_indexed_count(d->m_indexedCount);
+
+    QHash<QString, QVector<Posting> >::const_iterator it;
+    for (it = d->m_terms.begin(); it != d->m_terms.end(); ++it) {
+        GtDocIndexTermMsg *termMsg = msg.add_terms();
+        const QVector<Posting> &postings = it.value();
+        int lastPage = 0;
+
+        termMsg->set_term(it.key().toUtf8());
+        for (int i = 0; i < postings.size(); ++i) {
+            // pages are delta encoded to keep the varints short
+            termMsg->add_pages(postings[i].page - lastPage);
+            termMsg->add_offsets(postings[i].offset);
+            lastPage = postings[i].page;
+        }
+    }
+}
+
+bool GtDocIndex::deserialize(const GtDocIndexMsg &msg)
+{
+    Q_D(GtDocIndex);
+
+    if (d->m_id != msg.id().c_str())
+        return false;
+
+    if (msg.page_count() < 0 || msg.indexed_count() < 0 ||
+        msg.indexed_count() > msg.page_count())
+    {
+        return false;
+    }
+
+    QHash<QString, QVector<Posting> > terms;
+    int count = msg.terms_size();
+
+    terms.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        const GtDocIndexTermMsg &termMsg = msg.terms(i);
+        int size = termMsg.pages_size();
+
+        if (size != termMsg.offsets_size())
+            return false;
+
+        QVector<Posting> postings(size);
+        int page = 0;
+
+        for (int j = 0; j < size; ++j) {
+            page += termMsg.pages(j);
+            if (page < 0 || page >= msg.indexed_count())
+                return false;
+
+            postings[j].page = page;
+            postings[j].offset = termMsg.offsets(j);
+        }
+
+        terms.insert(QString::fromUtf8(termMsg.term().c_str()), postings);
+    }
+
+    QMutexLocker locker(&d->m_mutex);
+    d->m_pageCount = msg.page_count();
+    d->m_indexedCount = msg.indexed_count();
+    d->m_terms.swap(terms);
+    return true;
+}
+
+QStringList GtDocIndex::tokenize(const QString &text)
+{
+    QStringList terms;
+    QString term;
+    int pos = 0;
+
+    while (nextTerm(text.constData(), text.length(), &pos, &term) != -1) {
+        if (!terms.contains(term))
+            terms.append(term);
+    }
+
+    return terms;
+}
+
+int GtDocIndex::nextTerm(const QChar *texts, int length,
+                         int *pos, QString *term)
+{
+    int begin = *pos;
+
+    while (begin < length) {
+        while (begin < length && !GtDocIndexPrivate::isTermChar(texts[begin]))
+            ++begin;
+
+        int end = begin;
+        while (end < length && GtDocIndexPrivate::isTermChar(texts[end]))
+            ++end;
+
+        if (end > begin && end - begin <= GtDocIndexPrivate::MaxTermLength) {
+            *term = QString(texts + begin, end - begin).toLower();
+            *pos = end;
+            return begin;
+        }
+
+        begin = end;
+    }
+
+    *pos = length;
+    return -1;
+}
+
+#ifndef QT_NO_DATASTREAM
+
+QDataStream &operator<<(QDataStream &s, const GtDocIndex &i)
+{
+    return GtSerialize::serialize<GtDocIndex, GtDocIndexMsg>(s, i);
+}
+
+QDataStream &operator>>(QDataStream &s, GtDocIndex &i)
+{
+    return GtSerialize::deserialize<GtDocIndex, GtDocIndexMsg>(s, i);
+}
+
+#endif // QT_NO_DATASTREAM
+
+GT_END_NAMESPACE
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#ifndef __GT_DOC_INDEX_H__
+#define __GT_DOC_INDEX_H__
+
+#include "gtobject.h"
+#include <QtCore/QObject>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+GT_BEGIN_NAMESPACE
+
+class GtDocText;
+class GtDocIndexMsg;
+class GtDocIndexPrivate;
+
+class GT_BASE_EXPORT GtDocIndex : public QObject, public GtSharedObject
+{
+    Q_OBJECT
+
+public:
+    struct Posting
+    {
+        int page;
+        int offset;
+    };
+
+public:
+    explicit GtDocIndex(const QString &id, QObject *parent = 0);
+    ~GtDocIndex();
+
+public:
+    QString id() const;
+
+    int pageCount() const;
+    void setPageCount(int count);
+
+    int indexedCount() const;
+    bool isComplete() const;
+
+    bool addPage(int page, const GtDocText *text);
+    void clear();
+
+    int termCount() const;
+    QStringList terms() const;
+    QVector<Posting> find(const QString &term) const;
+    QList<int> findPages(const QString &text) const;
+
+    void serialize(GtDocIndexMsg &msg) const;
+    bool deserialize(const GtDocIndexMsg &msg);
+
+public:
+    static QStringList tokenize(const QString &text);
+    static int nextTerm(const QChar *texts, int length,
+                        int *pos, QString *term);
+
+Q_SIGNALS:
+    void updated(int indexedCount);
+
+protected:
+    QScopedPointer<GtDocIndexPrivate> d_ptr;
+
+private:
+    Q_DISABLE_COPY(GtDocIndex)
+    Q_DECLARE_PRIVATE(GtDocIndex)
+};
+
+#ifndef QT_NO_DATASTREAM
+GT_BASE_EXPORT QDataStream &operator<<(QDataStream &, const GtDocIndex &);
+GT_BASE_EXPORT QDataStream &operator>>(QDataStream &, GtDocIndex &);
+#endif
+
+GT_END_NAMESPACE
+
+Q_DECLARE_TYPEINFO(Gather::GtDocIndex::Posting, Q_PRIMITIVE_TYPE);
+
+#endif  /* __GT_DOC_INDEX_H__ */
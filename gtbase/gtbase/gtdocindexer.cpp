@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#include "gtdocindexer_p.h"
+#include "gtdocindex.h"
+#include "gtdocmessage.pb.h"
+#include "gtdocpage.h"
+#include "gtdocument.h"
+#include "gtserialize.h"
+#include "gttrace.h"
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QTemporaryFile>
+
+GT_BEGIN_NAMESPACE
+
+class GtDocIndexerPrivate
+{
+    Q_DECLARE_PUBLIC(GtDocIndexer)
+
+public:
+    GtDocIndexerPrivate(GtDocIndexer *q, QThread *t);
+    ~GtDocIndexerPrivate();
+
+public:
+    GtDocIndexer *q_ptr;
+    QThread *m_thread;
+    GtDocIndexerProxy *m_proxy;
+};
+
+static bool writeIndex(const QByteArray &data, const QString &fileName)
+{
+    // write aside and rename, a crash never leaves a torn index and
+    // concurrent writers of the same index never share a temp file
+    QTemporaryFile file(fileName + ".XXXXXX");
+
+    if (!file.open()) {
+        qWarning() << "open index file failed:" << file.fileTemplate();
+        return false;
+    }
+
+    if (file.write(data) != data.size()) {
+        qWarning() << "write index file failed:" << file.fileName();
+        return false;
+    }
+
+    file.close();
+    QFile::remove(fileName);
+    if (!file.rename(fileName)) {
+        qWarning() << "rename index file failed:" << fileName;
+        return false;
+    }
+
+    file.setAutoRemove(false);
+    return true;
+}
+
+GtDocIndexerProxy::GtDocIndexerProxy()
+{
+}
+
+GtDocIndexerProxy::~GtDocIndexerProxy()
+{
+}
+
+void GtDocIndexerProxy::index(GtDocument *document, GtDocIndex *index,
+                              const QString &fileName, bool queued)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QList<Task>::iterator it;
+    for (it = m_tasks.begin(); it != m_tasks.end(); ++it) {
+        if (it->document == document)
+            return;
+    }
+
+    // a stale index of another revision is rebuilt from scratch,
+    // a partial one is resumed from its last indexed page
+    if (index->pageCount() != document->pageCount()) {
+        index->clear();
+        index->setPageCount(document->pageCount());
+    }
+
+    if (index->isComplete())
+        return;
+
+    Task task;
+    task.document = document;
+    task.index = index;
+    task.fileName = fileName;
+    task.saveTimer.start();
+
+    bool idle = m_tasks.isEmpty();
+    m_tasks.push_back(task);
+
+    if (queued && idle)
+        QMetaObject::invokeMethod(this, "indexDocument", Qt::QueuedConnection);
+}
+
+void GtDocIndexerProxy::cancel(GtDocument *document)
+{
+    // blocks until the page in progress is done, so the
+    // document can be destroyed safely after return
+    QMutexLocker locker(&m_mutex);
+
+    QList<Task>::iterator it;
+    for (it = m_tasks.begin(); it != m_tasks.end(); ++it) {
+        if (it->document == document) {
+            m_tasks.erase(it);
+            break;
+        }
+    }
+}
+
+bool GtDocIndexerProxy::indexNext()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_tasks.isEmpty())
+        return false;
+
+    Task &task = m_tasks.front();
+    int page = task.index->indexedCount();
+
+    if (page < task.index->pageCount()) {
+        GT_TRACE_SCOPE("index", "index page");
+        GtDocTextPointer text(task.document->page(page)->text());
+        task.index->addPage(page, text.data());
+    }
+
+    bool complete = task.index->isComplete();
+    QString fileName;
+    QByteArray data;
+
+    if (!task.fileName.isEmpty() &&
+        (complete || task.saveTimer.elapsed() >= SaveInterval))
+    {
+        GT_TRACE_SCOPE("index", "serialize index");
+
+        if (GtSerialize::serialize<GtDocIndex, GtDocIndexMsg>(*task.index, data))
+            fileName = task.fileName;
+        else
+            qWarning() << "serialize document index error:" << task.index->id();
+
+        task.saveTimer.restart();
+    }
+
+    if (complete)
+        m_tasks.pop_front();
+
+    bool more = !m_tasks.isEmpty();
+    locker.unlock();
+
+    // the file is written out of the lock, a cancel
+    // doesn't wait for the disk
+    if (!fileName.isEmpty()) {
+        GT_TRACE_SCOPE("index", "save index");
+        writeIndex(data, fileName);
+    }
+
+    return more;
+}
+
+void GtDocIndexerProxy::indexDocument()
+{
+    // one page per event, other work of the document thread
+    // such as rendering is not blocked by a long document
+    if (indexNext())
+        QMetaObject::invokeMethod(this, "indexDocument", Qt::QueuedConnection);
+}
+
+GtDocIndexerPrivate::GtDocIndexerPrivate(GtDocIndexer *q, QThread *t)
+    : q_ptr(q)
+    , m_thread(t)
+{
+    m_proxy = new GtDocIndexerProxy();
+    if (t)
+        m_proxy->moveToThread(t);
+}
+
+GtDocIndexerPrivate::~GtDocIndexerPrivate()
+{
+    delete m_proxy;
+}
+
+GtDocIndexer::GtDocIndexer(QThread *thread, QObject *parent)
+    : QObject(parent)
+    , d_ptr(new GtDocIndexerPrivate(this, thread))
+{
+}
+
+GtDocIndexer::~GtDocIndexer()
+{
+}
+
+void GtDocIndexer::index(GtDocument *document, GtDocIndex *index,
+                         const QString &fileName)
+{
+    Q_D(GtDocIndexer);
+
+    if (!document->isLoaded()) {
+        qWarning() << "index document not loaded";
+        return;
+    }
+
+    if (document->fileId() != index->id()) {
+        qWarning() << "index id mismatch:" << index->id();
+        return;
+    }
+
+    if (d->m_thread) {
+        d->m_proxy->index(document, index, fileName, true);
+    }
+    else {
+        d->m_proxy->index(document, index, fileName, false);
+        while (d->m_proxy->indexNext());
+    }
+}
+
+void GtDocIndexer::cancel(GtDocument *document)
+{
+    Q_D(GtDocIndexer);
+    d->m_proxy->cancel(document);
+}
+
+bool GtDocIndexer::loadIndex(GtDocIndex *index, const QString &fileName)
+{
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    if (!GtSerialize::deserialize<GtDocIndex, GtDocIndexMsg>(*index,
+                                                             file.readAll()))
+    {
+        qWarning() << "deserialize document index error:" << fileName;
+        return false;
+    }
+
+    return true;
+}
+
+bool GtDocIndexer::saveIndex(const GtDocIndex *index, const QString &fileName)
+{
+    QByteArray data;
+
+    if (!GtSerialize::serialize<GtDocIndex, GtDocIndexMsg>(*index, data)) {
+        qWarning() << "serialize document index error:" << index->id();
+        return false;
+    }
+
+    return writeIndex(data, fileName);
+}
+
+GT_END_NAMESPACE
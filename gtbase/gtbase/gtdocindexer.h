@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#ifndef __GT_DOC_INDEXER_H__
+#define __GT_DOC_INDEXER_H__
+
+#include "gtobject.h"
+#include <QtCore/QObject>
+
+GT_BEGIN_NAMESPACE
+
+class GtDocIndex;
+class GtDocument;
+class GtDocIndexerPrivate;
+
+class GT_BASE_EXPORT GtDocIndexer : public QObject, public GtObject
+{
+    Q_OBJECT
+
+public:
+    explicit GtDocIndexer(QThread *thread = 0, QObject *parent = 0);
+    ~GtDocIndexer();
+
+public:
+    void index(GtDocument *document, GtDocIndex *index,
+               const QString &fileName = QString());
+    void cancel(GtDocument *document);
+
+public:
+    static bool loadIndex(GtDocIndex *index, const QString &fileName);
+    static bool saveIndex(const GtDocIndex *index, const QString &fileName);
+
+private:
+    QScopedPointer<GtDocIndexerPrivate> d_ptr;
+
+private:
+    Q_DISABLE_COPY(GtDocIndexer)
+    Q_DECLARE_PRIVATE(GtDocIndexer)
+};
+
+GT_END_NAMESPACE
+
+#endif  /* __GT_DOC_INDEXER_H__ */
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#ifndef __GT_DOC_INDEXER_P_H__
+#define __GT_DOC_INDEXER_P_H__
+
+#include "gtdocindexer.h"
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMutex>
+
+GT_BEGIN_NAMESPACE
+
+class GtDocIndexerProxy : public QObject, public GtObject
+{
+    Q_OBJECT
+
+public:
+    explicit GtDocIndexerProxy();
+    ~GtDocIndexerProxy();
+
+public:
+    void index(GtDocument *document, GtDocIndex *index,
+               const QString &fileName, bool queued);
+    void cancel(GtDocument *document);
+    bool indexNext();
+
+private Q_SLOTS:
+    void indexDocument();
+
+private:
+    struct Task
+    {
+        GtDocument *document;
+        GtDocIndex *index;
+        QString fileName;
+        QElapsedTimer saveTimer;
+    };
+
+    enum {
+        // the partial index is saved after the time, each save
+        // writes the whole index, so a page count would make the
+        // writes grow with the square of the pages
+        SaveInterval = 5000
+    };
+
+    QMutex m_mutex;
+    QList<Task> m_tasks;
+};
+
+GT_END_NAMESPACE
+
+#endif  /* __GT_DOC_INDEXER_P_H__ */
@@ -3,6 +3,7 @@
  */
 #include "gtdocloader_p.h"
 #include "gtdocument_p.h"
+#include "gttrace.h"
 #include <QtCore/QDebug>
 #include <QtCore/QDir>
 #include <QtCore/QLibrary>
@@ -111,6 +112,7 @@ GtDocLoaderPrivate::~GtDocLoaderPrivate()
 GtDocument* GtDocLoaderPrivate::loadDocument(LoaderInfo &info,
                                              const QString &fileName)
 {
+    GT_TRACE_SCOPE_ARG("loader", "open", fileName);
     GtDocument *document = NULL;
 
     if (!info.lib->isLoaded()) {
@@ -4,6 +4,7 @@
 #include "gtdocmodel.h"
 #include "gtbookmark.h"
 #include "gtbookmarks.h"
+#include "gtdocindex.h"
 #include "gtdocmeta.h"
 #include "gtdocnotes.h"
 #include "gtdocument.h"
@@ -26,6 +27,7 @@ protected:
     GtDocument *m_document;
     GtBookmarks *m_bookmarks;
     GtDocNotes *m_notes;
+    GtDocIndex *m_index;
     int m_pageCount;
     int m_page;
     double m_scale;
@@ -44,6 +46,7 @@ GtDocModelPrivate::GtDocModelPrivate(GtDocModel *q)
     , m_document(0)
     , m_bookmarks(0)
     , m_notes(0)
+    , m_index(0)
     , m_pageCount(-1)
     , m_page(-1)
     , m_scale(1.)
@@ -70,6 +73,9 @@ GtDocModelPrivate::~GtDocModelPrivate()
 
     if (m_notes)
         m_notes->release();
+
+    if (m_index)
+        m_index->release();
 }
 
 GtDocModel::GtDocModel(QObject *parent)
@@ -188,6 +194,30 @@ void GtDocModel::setNotes(GtDocNotes *notes)
     emit notesChanged(d->m_notes);
 }
 
+GtDocIndex* GtDocModel::index() const
+{
+    Q_D(const GtDocModel);
+    return d->m_index;
+}
+
+void GtDocModel::setIndex(GtDocIndex *index)
+{
+    Q_D(GtDocModel);
+
+    if (index == d->m_index)
+        return;
+
+    if (d->m_index)
+        d->m_index->release();
+
+    d->m_index = index;
+
+    if (d->m_index)
+        d->m_index->ref.ref();
+
+    emit indexChanged(d->m_index);
+}
+
 int GtDocModel::page() const
 {
     Q_D(const GtDocModel);
@@ -13,6 +13,7 @@ class GtDocMeta;
 class GtDocument;
 class GtBookmarks;
 class GtDocNotes;
+class GtDocIndex;
 class GtDocModelPrivate;
 
 class GT_BASE_EXPORT GtDocModel : public QObject, public GtSharedObject
@@ -36,6 +37,9 @@ public:
     GtDocNotes* notes() const;
     void setNotes(GtDocNotes *notes);
 
+    GtDocIndex* index() const;
+    void setIndex(GtDocIndex *index);
+
     int page() const;
     void setPage(int page);
 
@@ -89,6 +93,7 @@ Q_SIGNALS:
     void documentChanged(GtDocument *document);
     void bookmarksChanged(GtBookmarks *bookmarks);
     void notesChanged(GtDocNotes *notes);
+    void indexChanged(GtDocIndex *index);
     void pageChanged(int page);
     void scaleChanged(double scale);
     void rotationChanged(int rotation);
@@ -3,10 +3,13 @@
  */
 #include "gtdocpage_p.h"
 #include "gtabstractdocument.h"
+#include "gtdocpoint.h"
 #include "gtdocument_p.h"
 #include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QMutex>
 #include <QtCore/QRectF>
+#include <math.h>
 
 GT_BEGIN_NAMESPACE
 
@@ -14,7 +17,12 @@ GtDocText::GtDocText(QChar *texts, QRectF *rects, int length)
     : m_texts(texts)
     , m_rects(rects)
     , m_length(length)
+    , m_columns(0)
+    , m_rows(0)
+    , m_cellWidth(0)
+    , m_cellHeight(0)
 {
+    buildIndex();
 }
 
 GtDocText::GtDocText(const GtDocText &o)
@@ -30,6 +38,236 @@ GtDocText::~GtDocText()
     delete[] m_rects;
 }
 
+qint64 GtDocText::byteCount() const
+{
+    qint64 count = m_boxCells.size() + m_boxGlyphs.size() +
+                   m_centerCells.size() + m_centerGlyphs.size() +
+                   m_wordBegins.size() + m_wordEnds.size();
+
+    return sizeof(GtDocText) + count * sizeof(int) +
+            (sizeof(QChar) + sizeof(QRectF)) * m_length;
+}
+
+int GtDocText::hitTest(const QPointF &point) const
+{
+    if (m_length <= 0 ||
+        point.x() < m_bounds.left() || point.x() >= m_bounds.right() ||
+        point.y() < m_bounds.top() || point.y() >= m_bounds.bottom())
+    {
+        return -1;
+    }
+
+    // glyphs of a cell are in text order, the first hit wins
+    int cell = row(point.y()) * m_columns + column(point.x());
+    const int *it = m_boxGlyphs.constData() + m_boxCells[cell];
+    const int *end = m_boxGlyphs.constData() + m_boxCells[cell + 1];
+
+    for (; it != end; ++it) {
+        const QRectF &rect = m_rects[*it];
+
+        if (point.x() >= rect.left() && point.x() < rect.right() &&
+            point.y() >= rect.top() && point.y() < rect.bottom())
+        {
+            return *it;
+        }
+    }
+
+    return -1;
+}
+
+int GtDocText::nearest(const QPointF &point) const
+{
+    if (m_length <= 0)
+        return -1;
+
+    // search the rings of cells around the point, until no
+    // glyph outside can be nearer than the nearest one found
+    qreal x = CLAMP(point.x(), m_bounds.left(), m_bounds.right());
+    qreal y = CLAMP(point.y(), m_bounds.top(), m_bounds.bottom());
+    int cx = column(x);
+    int cy = row(y);
+    int maxRing = MAX(MAX(cx, m_columns - 1 - cx), MAX(cy, m_rows - 1 - cy));
+    qreal cellSize = MIN(m_cellWidth, m_cellHeight);
+    double dist, minDist = -1;
+    int result = -1;
+
+    for (int r = 0; r <= maxRing; ++r) {
+        int top = MAX(cy - r, 0);
+        int bottom = MIN(cy + r, m_rows - 1);
+
+        for (int j = top; j <= bottom; ++j) {
+            bool edge = (j == cy - r || j == cy + r);
+            int step = (edge || 0 == r) ? 1 : 2 * r;
+
+            for (int i = cx - r; i <= cx + r; i += step) {
+                if (i < 0 || i >= m_columns)
+                    continue;
+
+                int cell = j * m_columns + i;
+                const int *it = m_centerGlyphs.constData() + m_centerCells[cell];
+                const int *end = m_centerGlyphs.constData() + m_centerCells[cell + 1];
+
+                for (; it != end; ++it) {
+                    const QRectF &rect = m_rects[*it];
+
+                    dist = hypot(point.x() - rect.x() - rect.width() / 2.0,
+                                 point.y() - rect.y() - rect.height() / 2.0);
+                    if (minDist < 0 || dist < minDist ||
+                        (dist == minDist && *it < result))
+                    {
+                        minDist = dist;
+                        result = *it;
+                    }
+                }
+            }
+        }
+
+        if (result != -1 && minDist < r * cellSize)
+            break;
+    }
+
+    return result;
+}
+
+int GtDocText::beginOfWord(int pos) const
+{
+    Q_ASSERT(pos >= 0 && pos < m_length);
+    return m_wordBegins[pos];
+}
+
+int GtDocText::endOfWord(int pos) const
+{
+    Q_ASSERT(pos >= 0 && pos < m_length);
+    return m_wordEnds[pos];
+}
+
+void GtDocText::buildIndex()
+{
+    if (m_length <= 0)
+        return;
+
+    // word boundaries, spaces and separators are runs of their own
+    m_wordBegins.resize(m_length);
+    m_wordEnds.resize(m_length);
+
+    int begin = 0;
+    int lastType = -1;
+    for (int i = 0; i <= m_length; ++i) {
+        int type = -1;
+
+        if (i < m_length) {
+            if (GtDocPoint::isSpace(m_texts[i]))
+                type = 0;
+            else if (GtDocPoint::isWordSeparator(m_texts[i]))
+                type = 1;
+            else
+                type = 2;
+        }
+
+        if (i > 0 && type != lastType) {
+            for (int j = begin; j < i; ++j) {
+                m_wordBegins[j] = begin;
+                m_wordEnds[j] = i;
+            }
+
+            begin = i;
+        }
+
+        lastType = type;
+    }
+
+    // about one glyph per cell
+    const int maxGridSize = 256;
+    qreal left = m_rects[0].left();
+    qreal top = m_rects[0].top();
+    qreal right = m_rects[0].right();
+    qreal bottom = m_rects[0].bottom();
+
+    for (int i = 1; i < m_length; ++i) {
+        left = MIN(left, m_rects[i].left());
+        top = MIN(top, m_rects[i].top());
+        right = MAX(right, m_rects[i].right());
+        bottom = MAX(bottom, m_rects[i].bottom());
+    }
+
+    m_bounds.setCoords(left, top, right, bottom);
+
+    qreal width = MAX(m_bounds.width(), 1.0);
+    qreal height = MAX(m_bounds.height(), 1.0);
+
+    m_columns = sqrt(m_length * width / height) + 0.5;
+    m_columns = CLAMP(m_columns, 1, maxGridSize);
+    m_rows = (m_length + m_columns - 1) / m_columns;
+    m_rows = CLAMP(m_rows, 1, maxGridSize);
+    m_cellWidth = width / m_columns;
+    m_cellHeight = height / m_rows;
+
+    // compressed cell lists, count first and then fill
+    int cellCount = m_columns * m_rows;
+    QVector<int> fill(cellCount + 1, 0);
+
+    m_boxCells.fill(0, cellCount + 1);
+    m_centerCells.fill(0, cellCount + 1);
+    m_centerGlyphs.resize(m_length);
+
+    for (int i = 0; i < m_length; ++i) {
+        const QRectF &rect = m_rects[i];
+        int c0 = column(rect.left());
+        int c1 = column(rect.right());
+        int r0 = row(rect.top());
+        int r1 = row(rect.bottom());
+
+        for (int r = r0; r <= r1; ++r) {
+            for (int c = c0; c <= c1; ++c)
+                ++m_boxCells[r * m_columns + c + 1];
+        }
+
+        int cell = row(rect.center().y()) * m_columns + column(rect.center().x());
+        ++m_centerCells[cell + 1];
+    }
+
+    for (int i = 0; i < cellCount; ++i) {
+        m_boxCells[i + 1] += m_boxCells[i];
+        m_centerCells[i + 1] += m_centerCells[i];
+    }
+
+    m_boxGlyphs.resize(m_boxCells[cellCount]);
+
+    for (int i = 0; i < m_length; ++i) {
+        const QRectF &rect = m_rects[i];
+        int c0 = column(rect.left());
+        int c1 = column(rect.right());
+        int r0 = row(rect.top());
+        int r1 = row(rect.bottom());
+
+        for (int r = r0; r <= r1; ++r) {
+            for (int c = c0; c <= c1; ++c) {
+                int cell = r * m_columns + c;
+                m_boxGlyphs[m_boxCells[cell] + fill[cell]++] = i;
+            }
+        }
+    }
+
+    fill.fill(0);
+    for (int i = 0; i < m_length; ++i) {
+        const QRectF &rect = m_rects[i];
+        int cell = row(rect.center().y()) * m_columns + column(rect.center().x());
+        m_centerGlyphs[m_centerCells[cell] + fill[cell]++] = i;
+    }
+}
+
+int GtDocText::column(qreal x) const
+{
+    int c = (x - m_bounds.left()) / m_cellWidth;
+    return CLAMP(c, 0, m_columns - 1);
+}
+
+int GtDocText::row(qreal y) const
+{
+    int r = (y - m_bounds.top()) / m_cellHeight;
+    return CLAMP(r, 0, m_rows - 1);
+}
+
 GtDocPagePrivate::GtDocPagePrivate()
     : abstractPage(0)
     , document(0)
@@ -134,10 +372,19 @@ GtDocTextPointer GtDocPage::text()
 {
     Q_D(GtDocPage);
 
-    GtDocTextPointer r(d->text);
+    // the governor drops the text from any thread
+    GtDocTextPointer r;
+    if (1) {
+        QMutexLocker lock(d->document->d_ptr->mutex());
+        r = d->text;
+    }
+
     if (!r) {
         QChar *texts = 0;
         QRectF *rects = 0;
+        QElapsedTimer timer;
+
+        timer.start();
         GtAbstractPage *abstractPage = d->document->d_ptr->lockPage(d->index);
 
         if (-1 == d->textLength)
@@ -151,7 +398,7 @@ GtDocTextPointer GtDocPage::text()
 
         d->document->d_ptr->unlockPage(d->index);
         r = new GtDocText(texts, rects, d->textLength);
-        d->document->d_ptr->cacheText(d->index, r);
+        d->document->d_ptr->cacheText(d->index, r, timer.nsecsElapsed() / 1000);
     }
 
     return r;
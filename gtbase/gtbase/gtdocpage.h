@@ -6,8 +6,10 @@
 
 #include "gtobject.h"
 #include <QtCore/QObject>
+#include <QtCore/QRectF>
 #include <QtCore/QSharedDataPointer>
 #include <QtCore/QSize>
+#include <QtCore/QVector>
 
 class QPaintDevice;
 
@@ -29,13 +31,40 @@ public:
     inline const QRectF* rects() const { return m_rects; }
     inline int length() const { return m_length; }
 
+    // memory held by the text and its index
+    qint64 byteCount() const;
+
+    int hitTest(const QPointF &point) const;
+    int nearest(const QPointF &point) const;
+    int beginOfWord(int pos) const;
+    int endOfWord(int pos) const;
+
 private:
     GtDocText &operator=(const GtDocText &);
+    void buildIndex();
+    int column(qreal x) const;
+    int row(qreal y) const;
 
 private:
     QChar *m_texts;
     QRectF *m_rects;
     int m_length;
+
+    // uniform grid over the glyphs, every glyph is listed in
+    // the cells its box overlaps and in the cell of its center
+    QRectF m_bounds;
+    int m_columns;
+    int m_rows;
+    qreal m_cellWidth;
+    qreal m_cellHeight;
+    QVector<int> m_boxCells;
+    QVector<int> m_boxGlyphs;
+    QVector<int> m_centerCells;
+    QVector<int> m_centerGlyphs;
+
+    // run of the same character class around each glyph
+    QVector<int> m_wordBegins;
+    QVector<int> m_wordEnds;
 };
 
 typedef QExplicitlySharedDataPointer<GtDocText> GtDocTextPointer;
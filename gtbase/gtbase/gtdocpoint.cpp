@@ -7,7 +7,6 @@
 #include <QtCore/QDebug>
 #include <QtCore/QPoint>
 #include <QtCore/QRect>
-#include <math.h>
 
 GT_BEGIN_NAMESPACE
 
@@ -51,36 +50,18 @@ int GtDocPoint::text(GtDocument *document, bool inside) const
 
     GtDocPage *page = document->page(m_page);
     GtDocTextPointer text(page->text());
-    const QRectF *rect = text->rects();
-    int i, result = -1;
-
-    if (inside) {
-        for (i = 0; i < text->length(); ++i, ++rect) {
-            if (m_point.x() >= rect->left() && m_point.x() < rect->right() &&
-                m_point.y() >= rect->top() && m_point.y() < rect->bottom())
-            {
-                result = i;
-                break;
-            }
-        }
-    }
-    else {
-        double dist, maxDist = -1;
-
-        for (i = 0; i < text->length(); ++i, ++rect) {
-            dist = hypot(m_point.x() - rect->x() - rect->width() / 2.0,
-                         m_point.y() - rect->y() - rect->height() / 2.0);
-            if (maxDist < 0 || dist < maxDist) {
-                maxDist = dist;
-                result = i;
-            }
-        }
-    }
+    int result;
+
+    // both are answered by the glyph grid of the page text
+    if (inside)
+        result = text->hitTest(m_point);
+    else
+        result = text->nearest(m_point);
 
     // check if point is inside right half of the char
     if (result != -1) {
         if (text->texts()[result] != '\n') {
-            rect = text->rects() + result;
+            const QRectF *rect = text->rects() + result;
 
             if (m_point.x() > rect->x() + rect->width() / 2.0)
                 ++result;
@@ -100,30 +81,11 @@ GtDocPoint GtDocPoint::beginOfWord(GtDocument *document, bool inside) const
 
     GtDocPage *page = document->page(m_page);
     GtDocTextPointer text(page->text());
-    const QChar *texts = text->texts();
-    int len = text->length();
 
-    if (pos == len)
+    if (pos == text->length())
         --pos;
 
-    if (isSpace(texts[pos])) {
-        while (pos && isSpace(texts[pos - 1]))
-            --pos;
-    }
-    else if (isWordSeparator(texts[pos])) {
-        while (pos && isWordSeparator(texts[pos - 1]))
-            --pos;
-    }
-    else {
-        while (pos &&
-               !isSpace(texts[pos - 1]) &&
-               !isWordSeparator(texts[pos - 1]))
-        {
-            --pos;
-        }
-    }
-
-    return GtDocPoint(page, pos);
+    return GtDocPoint(page, text->beginOfWord(pos));
 }
 
 GtDocPoint GtDocPoint::endOfWord(GtDocument *document, bool inside) const
@@ -134,30 +96,9 @@ GtDocPoint GtDocPoint::endOfWord(GtDocument *document, bool inside) const
 
     GtDocPage *page = document->page(m_page);
     GtDocTextPointer text(page->text());
-    const QChar *texts = text->texts();
-    int len = text->length();
-
-    if (pos < len) {
-        if (isSpace(texts[pos])) {
-            ++pos;
-            while (pos < len && isSpace(texts[pos]))
-                ++pos;
-        }
-        else if (isWordSeparator(texts[pos])) {
-            ++pos;
-            while (pos < len && isWordSeparator(texts[pos]))
-                ++pos;
-        }
-        else {
-            ++pos;
-            while (pos < len &&
-                   !isSpace(texts[pos]) &&
-                   !isWordSeparator(texts[pos]))
-            {
-                ++pos;
-            }
-        }
-    }
+
+    if (pos < text->length())
+        pos = text->endOfWord(pos);
 
     return GtDocPoint(page, pos);
 }
@@ -5,8 +5,10 @@
 #include "gtabstractdocument.h"
 #include "gtbookmark.h"
 #include "gtdocpage_p.h"
+#include "gttrace.h"
 #include <QtCore/QCryptographicHash>
 #include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
 
 GT_BEGIN_NAMESPACE
 
@@ -23,12 +25,22 @@ GtDocumentPrivate::GtDocumentPrivate(GtAbstractDocument *a,
     , m_uniform(false)
     , m_loaded(false)
     , m_destroyed(false)
+    , m_lockedPage(-1)
+    , m_lockedHeap(0)
+    , m_pageBytes(0)
+    , m_heapCharged(0)
+    , m_heapCost(0)
+    , m_heapBase(0)
+    , m_heapUse(0)
     , m_abstractDoc(a)
 {
+    GtMemoryGovernor::instance()->addClient(this);
 }
 
 GtDocumentPrivate::~GtDocumentPrivate()
 {
+    GtMemoryGovernor::instance()->removeClient(this);
+
     for (int i = 0; i < m_pageCount; ++i)
         delete m_pages[i];
 
@@ -57,66 +69,226 @@ GtAbstractPage* GtDocumentPrivate::lockPage(int index)
 
     m_mutex.lock();
 
+    qint64 now = GtMemoryGovernor::now();
+    m_lockedPage = -1;
+    m_lockedHeap = m_abstractDoc->cacheSize();
+
     if (0 == m_pages[index]->d_ptr->abstractPage) {
+        QElapsedTimer timer;
+        timer.start();
+
         m_pages[index]->d_ptr->abstractPage = m_abstractDoc->loadPage(index);
-        m_cachedPage.append(index);
 
+        // the pages go by the memory governor, they are in the
+        // loader heap; a loader without one keeps a few pages
         const int pageCacheSize = 16;
-        if (m_cachedPage.size() > pageCacheSize) {
-            GtDocPage *temp = m_pages[m_cachedPage.front()];
-
-            if (temp->d_ptr->abstractPage) {
-                delete temp->d_ptr->abstractPage;
-                temp->d_ptr->abstractPage = 0;
-            }
+        if (0 == m_lockedHeap && m_cachedPage.size() >= pageCacheSize) {
+            GtDocPage *temp = m_pages[m_cachedPage.front().index];
 
+            delete temp->d_ptr->abstractPage;
+            temp->d_ptr->abstractPage = 0;
             m_cachedPage.pop_front();
         }
+
+        CachedEntry cached;
+        cached.index = index;
+        cached.bytes = 0;
+        cached.cost = timer.nsecsElapsed() / 1000;
+        cached.lastUse = now;
+
+        m_cachedPage.append(cached);
+        m_heapCost += cached.cost;
+        m_lockedPage = m_cachedPage.size() - 1;
+    }
+    else {
+        for (int i = 0; i < m_cachedPage.size(); ++i) {
+            if (m_cachedPage[i].index == index) {
+                m_cachedPage[i].lastUse = now;
+                m_lockedPage = i;
+                break;
+            }
+        }
     }
 
+    m_heapUse = now;
     return m_pages[index]->d_ptr->abstractPage;
 }
 
 void GtDocumentPrivate::unlockPage(int index)
 {
     Q_ASSERT(index >= 0 && index < m_pageCount);
+
+    qint64 heapSize = m_abstractDoc->cacheSize();
+    qint64 delta = heapSize - m_heapCharged;
+
+    // the content loaded by the paint or the text of the page
+    if (m_lockedPage >= 0 && heapSize > m_lockedHeap) {
+        m_cachedPage[m_lockedPage].bytes += heapSize - m_lockedHeap;
+        m_pageBytes += heapSize - m_lockedHeap;
+    }
+
+    m_lockedPage = -1;
+
+    m_heapCharged = heapSize;
     m_mutex.unlock();
+
+    // never charge with the lock held, the governor may
+    // evict from this document
+    if (delta)
+        GtMemoryGovernor::instance()->charge(this, delta);
 }
 
-void GtDocumentPrivate::cacheText(int index, const GtDocTextPointer &text)
+void GtDocumentPrivate::cacheText(int index, const GtDocTextPointer &text,
+                                  qint64 cost)
 {
     Q_ASSERT(index >= 0 && index < m_pageCount);
 
-    QMutexLocker lock(&m_mutex);
-    if (!m_pages[index]->d_ptr->text) {
+    CachedEntry cached;
+
+    cached.index = index;
+    cached.bytes = text->byteCount();
+    cached.cost = cost;
+    cached.lastUse = GtMemoryGovernor::now();
+
+    if (1) {
+        QMutexLocker lock(&m_mutex);
+        if (m_pages[index]->d_ptr->text) {
+            qWarning() << "page text already cached:" << index;
+            return;
+        }
+
         m_pages[index]->d_ptr->text = text;
-        m_cachedText.append(index);
-
-        const int textCacheSize = 16;
-        if (m_cachedText.size() > textCacheSize) {
-            int removeCount = m_cachedText.size() - textCacheSize;
-
-            QList<int>::iterator it = m_cachedText.begin();
-            while (removeCount > 0 && it != m_cachedText.end()) {
-                if (*it != index &&
-                    m_pages[*it]->d_ptr->text->ref.load() <= 1)
-                {
-                    m_pages[*it]->d_ptr->text = 0;
-                    it = m_cachedText.erase(it);
-                    --removeCount;
-                }
-                else {
-                    ++it;
-                }
-            }
+        m_cachedText.append(cached);
+    }
+
+    GtMemoryGovernor::instance()->charge(this, cached.bytes);
+}
 
-            if (removeCount > 0)
-                qWarning() << "page text cache surpass:" << removeCount;
+GtDocumentPrivate::VictimType GtDocumentPrivate::victim(Candidate *candidate,
+                                                       int *index)
+{
+    qint64 now = GtMemoryGovernor::now();
+    double score = 0;
+    VictimType result = NoVictim;
+
+    // the text in use by others can't go
+    for (int i = 0; i < m_cachedText.size(); ++i) {
+        const CachedEntry &cached = m_cachedText[i];
+        if (m_pages[cached.index]->d_ptr->text->ref.load() > 1)
+            continue;
+
+        Candidate c = { cached.bytes, cached.cost, cached.lastUse };
+        double s = GtMemoryGovernor::score(c, now);
+        if (NoVictim == result || s < score) {
+            *candidate = c;
+            *index = i;
+            score = s;
+            result = TextVictim;
         }
     }
-    else {
-        qWarning() << "page text already cached:" << index;
+
+    // the pages with the content they loaded, the lock
+    // is held so none of them is in use
+    for (int i = 0; i < m_cachedPage.size(); ++i) {
+        const CachedEntry &cached = m_cachedPage[i];
+        if (cached.bytes <= 0)
+            continue;
+
+        Candidate c = { cached.bytes, cached.cost, cached.lastUse };
+        double s = GtMemoryGovernor::score(c, now);
+        if (NoVictim == result || s < score) {
+            *candidate = c;
+            *index = i;
+            score = s;
+            result = PageVictim;
+        }
+    }
+
+    // the loader heap beyond what the document itself
+    // and its pages keep
+    const qint64 minHeap = 256 * 1024;
+    qint64 heap = m_abstractDoc->cacheSize() - m_heapBase - m_pageBytes;
+    if (heap > minHeap) {
+        Candidate c = { heap, m_heapCost, m_heapUse };
+        double s = GtMemoryGovernor::score(c, now);
+        if (NoVictim == result || s < score) {
+            *candidate = c;
+            result = HeapVictim;
+        }
+    }
+
+    return result;
+}
+
+bool GtDocumentPrivate::candidate(Candidate *candidate)
+{
+    // the lock is held by a render of a page, a trim for the
+    // charge of another document doesn't wait for it
+    if (!m_mutex.tryLock())
+        return false;
+
+    int index;
+    bool result = m_loaded && victim(candidate, &index) != NoVictim;
+    m_mutex.unlock();
+    return result;
+}
+
+qint64 GtDocumentPrivate::evict()
+{
+    if (!m_mutex.tryLock())
+        return 0;
+
+    qint64 bytes = evictLocked();
+    m_mutex.unlock();
+    return bytes;
+}
+
+qint64 GtDocumentPrivate::evictLocked()
+{
+    Candidate candidate;
+    int i = -1;
+    VictimType type = m_loaded ? victim(&candidate, &i) : NoVictim;
+
+    if (TextVictim == type) {
+        m_pages[m_cachedText[i].index]->d_ptr->text = 0;
+        m_cachedText.removeAt(i);
+        return candidate.bytes;
     }
+
+    if (PageVictim == type) {
+        GtDocPage *page = m_pages[m_cachedPage[i].index];
+
+        delete page->d_ptr->abstractPage;
+        page->d_ptr->abstractPage = 0;
+        m_pageBytes -= m_cachedPage[i].bytes;
+        m_cachedPage.removeAt(i);
+        return heapFreed();
+    }
+
+    if (HeapVictim == type) {
+        foreach (const CachedEntry &cached, m_cachedPage) {
+            delete m_pages[cached.index]->d_ptr->abstractPage;
+            m_pages[cached.index]->d_ptr->abstractPage = 0;
+        }
+
+        m_cachedPage.clear();
+        m_pageBytes = 0;
+        m_abstractDoc->shrinkCache(0);
+        m_heapCost = 0;
+        return heapFreed();
+    }
+
+    return 0;
+}
+
+qint64 GtDocumentPrivate::heapFreed()
+{
+    // the governor takes off the bytes returned
+    qint64 heapSize = m_abstractDoc->cacheSize();
+    qint64 freed = m_heapCharged - heapSize;
+
+    m_heapCharged = heapSize;
+    return freed;
 }
 
 int GtDocumentPrivate::loadOutline(GtAbstractOutline *outline,
@@ -251,6 +423,8 @@ QString GtDocument::makeFileId(QIODevice *device)
     if (!device->isOpen() || !device->isReadable())
         return QString();
 
+    GT_TRACE_SCOPE("document", "hash");
+
     QCryptographicHash hash(QCryptographicHash::Sha1);
     char buffer[1024];
     int length;
@@ -279,6 +453,8 @@ void GtDocument::loadDocument()
 
     Q_ASSERT(!d->m_loaded && d->m_device);
 
+    GT_TRACE_SCOPE_ARG("document", "load", d->m_title);
+
     if (!d->m_abstractDoc->load(d->m_device)) {
         emit loaded(this);
         return;
@@ -286,6 +462,7 @@ void GtDocument::loadDocument()
 
     d->m_pageCount = d->m_abstractDoc->countPages();
     if (d->m_pageCount > 0) {
+        GT_TRACE_SCOPE("document", "scan pages");
         double pageWidth, pageHeight;
         double uniformWidth, uniformHeight;
 
@@ -336,7 +513,20 @@ void GtDocument::loadDocument()
     if (!title.isNull())
         d->m_title = title;
 
-    d->m_loaded = true;
+    // the heap of the loaded document, the rest is cache
+    qint64 heapSize = d->m_abstractDoc->cacheSize();
+    qint64 delta;
+
+    if (1) {
+        QMutexLocker locker(&d->m_mutex);
+
+        d->m_heapBase = heapSize;
+        delta = heapSize - d->m_heapCharged;
+        d->m_heapCharged = heapSize;
+        d->m_loaded = true;
+    }
+
+    GtMemoryGovernor::instance()->charge(d, delta);
 
     emit loaded(this);
 }
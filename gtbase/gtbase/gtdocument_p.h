@@ -6,6 +6,7 @@
 
 #include "gtdocument.h"
 #include "gtdocpage.h"
+#include "gtmemorygovernor.h"
 #include <QtCore/QMutex>
 #include <QtCore/QSharedDataPointer>
 
@@ -16,7 +17,7 @@ GT_BEGIN_NAMESPACE
 class GtAbstractPage;
 class GtAbstractOutline;
 
-class GtDocumentPrivate
+class GtDocumentPrivate : public GtMemoryClient
 {
     Q_DECLARE_PUBLIC(GtDocument)
 
@@ -29,13 +30,39 @@ public:
     void setDevice(const QString &title, QIODevice *device);
     GtAbstractPage* lockPage(int index);
     void unlockPage(int index);
-    void cacheText(int index, const GtDocTextPointer &text);
+    void cacheText(int index, const GtDocTextPointer &text, qint64 cost);
     inline QMutex* mutex() { return &m_mutex; }
 
+public:
+    bool candidate(Candidate *candidate);
+    qint64 evict();
+
 protected:
     int loadOutline(GtAbstractOutline *outline,
                     GtBookmark *parent, void *it);
 
+    enum VictimType {
+        NoVictim,
+        TextVictim,
+        PageVictim,
+        HeapVictim
+    };
+
+    // the entry to evict, index is the position in m_cachedText
+    // or m_cachedPage
+    VictimType victim(Candidate *candidate, int *index);
+    qint64 evictLocked();
+    qint64 heapFreed();
+
+protected:
+    struct CachedEntry
+    {
+        int index;
+        qint64 bytes;
+        qint64 cost;
+        qint64 lastUse;
+    };
+
 protected:
     GtDocument *q_ptr;
     QIODevice *m_device;
@@ -51,8 +78,21 @@ protected:
     bool m_loaded;
     bool m_destroyed;
     QMutex m_mutex;
-    QList<int> m_cachedPage;
-    QList<int> m_cachedText;
+    QList<CachedEntry> m_cachedPage;
+    QList<CachedEntry> m_cachedText;
+
+    // the loader heap grown by the page locked, it goes
+    // to the bytes of the page
+    int m_lockedPage;
+    qint64 m_lockedHeap;
+    qint64 m_pageBytes;
+
+    // the loader cache as charged to the memory governor, the
+    // load time of its pages and the part kept since load
+    qint64 m_heapCharged;
+    qint64 m_heapCost;
+    qint64 m_heapBase;
+    qint64 m_heapUse;
     QScopedPointer<GtAbstractDocument> m_abstractDoc;
 };
 
@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#include "gtmemorygovernor.h"
+#include "gttrace.h"
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+
+GT_BEGIN_NAMESPACE
+
+class GtMemoryGovernorPrivate
+{
+public:
+    GtMemoryGovernorPrivate();
+    ~GtMemoryGovernorPrivate();
+
+public:
+    qint64 trimLocked(qint64 target);
+
+public:
+    mutable QMutex m_mutex;
+    QMutex m_trimMutex;
+    QElapsedTimer m_clock;
+    QHash<GtMemoryClient*, qint64> m_clients;
+    qint64 m_budget;
+    qint64 m_usage;
+};
+
+GtMemoryGovernorPrivate::GtMemoryGovernorPrivate()
+    : m_budget(512 * 1024 * 1024)
+    , m_usage(0)
+{
+    m_clock.start();
+}
+
+GtMemoryGovernorPrivate::~GtMemoryGovernorPrivate()
+{
+}
+
+qint64 GtMemoryGovernorPrivate::trimLocked(qint64 target)
+{
+    GT_TRACE_SCOPE("memory", "trim");
+
+    qint64 freed = 0;
+    qint64 now = GtMemoryGovernor::now();
+
+    // the clients busy on the eviction, the others go instead
+    QList<GtMemoryClient*> busy;
+
+    forever {
+        QList<GtMemoryClient*> clients;
+
+        if (1) {
+            QMutexLocker locker(&m_mutex);
+
+            if (m_usage <= target)
+                break;
+
+            clients = m_clients.keys();
+        }
+
+        GtMemoryClient *victim = 0;
+        double victimScore = 0;
+
+        foreach (GtMemoryClient *client, clients) {
+            GtMemoryClient::Candidate candidate;
+            if (busy.contains(client) ||
+                !client->candidate(&candidate) || candidate.bytes <= 0)
+                continue;
+
+            double score = GtMemoryGovernor::score(candidate, now);
+
+            if (!victim || score < victimScore) {
+                victim = client;
+                victimScore = score;
+            }
+        }
+
+        if (!victim)
+            break;
+
+        qint64 bytes = victim->evict();
+        if (bytes <= 0) {
+            busy.append(victim);
+            continue;
+        }
+
+        QMutexLocker locker(&m_mutex);
+        QHash<GtMemoryClient*, qint64>::iterator it = m_clients.find(victim);
+        if (it != m_clients.end()) {
+            it.value() -= bytes;
+            m_usage -= bytes;
+        }
+
+        freed += bytes;
+    }
+
+    return freed;
+}
+
+GtMemoryClient::GtMemoryClient()
+{
+}
+
+GtMemoryClient::~GtMemoryClient()
+{
+}
+
+qint64 GtMemoryClient::evictAll()
+{
+    qint64 freed = 0;
+    qint64 bytes;
+    Candidate entry;
+
+    while (candidate(&entry) && (bytes = evict()) > 0)
+        freed += bytes;
+
+    return freed;
+}
+
+GtMemoryGovernor::GtMemoryGovernor()
+    : d(new GtMemoryGovernorPrivate())
+{
+}
+
+GtMemoryGovernor::~GtMemoryGovernor()
+{
+    delete d;
+}
+
+GtMemoryGovernor* GtMemoryGovernor::instance()
+{
+    static GtMemoryGovernor governor;
+    return &governor;
+}
+
+qint64 GtMemoryGovernor::budget() const
+{
+    QMutexLocker locker(&d->m_mutex);
+    return d->m_budget;
+}
+
+void GtMemoryGovernor::setBudget(qint64 budget)
+{
+    if (1) {
+        QMutexLocker locker(&d->m_mutex);
+        d->m_budget = MAX(budget, 0);
+    }
+
+    QMutexLocker locker(&d->m_trimMutex);
+    d->trimLocked(budget);
+}
+
+qint64 GtMemoryGovernor::usage() const
+{
+    QMutexLocker locker(&d->m_mutex);
+    return d->m_usage;
+}
+
+qint64 GtMemoryGovernor::usage(GtMemoryClient *client) const
+{
+    QMutexLocker locker(&d->m_mutex);
+    return d->m_clients.value(client, 0);
+}
+
+void GtMemoryGovernor::addClient(GtMemoryClient *client)
+{
+    QMutexLocker locker(&d->m_mutex);
+
+    if (!d->m_clients.contains(client))
+        d->m_clients.insert(client, 0);
+}
+
+void GtMemoryGovernor::removeClient(GtMemoryClient *client)
+{
+    // a trim in progress may be using the client
+    QMutexLocker trimLocker(&d->m_trimMutex);
+    QMutexLocker locker(&d->m_mutex);
+
+    QHash<GtMemoryClient*, qint64>::iterator it = d->m_clients.find(client);
+    if (it != d->m_clients.end()) {
+        d->m_usage -= it.value();
+        d->m_clients.erase(it);
+    }
+}
+
+void GtMemoryGovernor::charge(GtMemoryClient *client, qint64 bytes)
+{
+    qint64 budget;
+
+    if (!bytes)
+        return;
+
+    if (1) {
+        QMutexLocker locker(&d->m_mutex);
+
+        QHash<GtMemoryClient*, qint64>::iterator it = d->m_clients.find(client);
+        if (it == d->m_clients.end()) {
+            qWarning() << "charge of unknown memory client";
+            return;
+        }
+
+        it.value() += bytes;
+        d->m_usage += bytes;
+
+        if (bytes < 0 || d->m_usage <= d->m_budget)
+            return;
+
+        budget = d->m_budget;
+    }
+
+    // trim a little below the budget, so that the caches don't
+    // evict on every charge. One trim at a time is enough.
+    if (d->m_trimMutex.tryLock()) {
+        d->trimLocked(budget - budget / 8);
+        d->m_trimMutex.unlock();
+    }
+
+    GT_TRACE_COUNTER("memory", "usage", usage());
+}
+
+qint64 GtMemoryGovernor::trim(qint64 target)
+{
+    QMutexLocker locker(&d->m_trimMutex);
+    return d->trimLocked(target);
+}
+
+qint64 GtMemoryGovernor::trim(GtMemoryClient *client)
+{
+    QMutexLocker trimLocker(&d->m_trimMutex);
+
+    if (1) {
+        QMutexLocker locker(&d->m_mutex);
+        if (!d->m_clients.contains(client))
+            return 0;
+    }
+
+    qint64 bytes = client->evictAll();
+
+    QMutexLocker locker(&d->m_mutex);
+    d->m_clients[client] -= bytes;
+    d->m_usage -= bytes;
+    return bytes;
+}
+
+qint64 GtMemoryGovernor::trimNow()
+{
+    return trim(budget() / 4);
+}
+
+qint64 GtMemoryGovernor::now()
+{
+    return instance()->d->m_clock.elapsed();
+}
+
+double GtMemoryGovernor::score(const GtMemoryClient::Candidate &candidate,
+                               qint64 now)
+{
+    double age = MAX(now - candidate.lastUse, 0) / 1000.0;
+
+    return double(MAX(candidate.cost, 1)) /
+            MAX(candidate.bytes, 1) / (1.0 + age);
+}
+
+GT_END_NAMESPACE
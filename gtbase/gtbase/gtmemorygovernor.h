@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#ifndef __GT_MEMORY_GOVERNOR_H__
+#define __GT_MEMORY_GOVERNOR_H__
+
+#include "gtcommon.h"
+
+GT_BEGIN_NAMESPACE
+
+class GtMemoryGovernorPrivate;
+
+// A cache whose memory counts against the process budget. The
+// governor calls candidate() and evict() from any thread, so both
+// must lock the cache. A client must not charge while holding its
+// own lock, an eviction of another cache could wait on it. A cache
+// busy for long, e.g. rendering, may offer nothing rather than wait.
+class GT_BASE_EXPORT GtMemoryClient
+{
+public:
+    struct Candidate
+    {
+        qint64 bytes;    // freed by the eviction
+        qint64 cost;     // microseconds to build it again
+        qint64 lastUse;  // GtMemoryGovernor::now() of the last use
+    };
+
+public:
+    GtMemoryClient();
+    virtual ~GtMemoryClient();
+
+public:
+    // the entry the client gives up first, false if nothing can go
+    virtual bool candidate(Candidate *candidate) = 0;
+
+    // evicts that entry, returns the bytes freed
+    virtual qint64 evict() = 0;
+
+    // evicts everything that can go, returns the bytes freed
+    virtual qint64 evictAll();
+};
+
+class GT_BASE_EXPORT GtMemoryGovernor
+{
+public:
+    static GtMemoryGovernor* instance();
+
+public:
+    qint64 budget() const;
+    void setBudget(qint64 budget);
+
+    qint64 usage() const;
+    qint64 usage(GtMemoryClient *client) const;
+
+    void addClient(GtMemoryClient *client);
+    void removeClient(GtMemoryClient *client);
+
+    // bytes added to or removed from a client, trims when the
+    // usage goes over the budget
+    void charge(GtMemoryClient *client, qint64 bytes);
+
+    // evicts by cost and benefit until the usage is at most
+    // the target, returns the bytes freed
+    qint64 trim(qint64 target);
+
+    // evicts the client as much as possible, e.g. of a tab in
+    // the background
+    qint64 trim(GtMemoryClient *client);
+
+    // drops the caches to a quarter of the budget, e.g. when the
+    // system is low on memory
+    qint64 trimNow();
+
+    // milliseconds since the start, for Candidate::lastUse
+    static qint64 now();
+
+    // the lower the score, the sooner the entry goes: the cost per
+    // byte, fading with the seconds since the last use
+    static double score(const GtMemoryClient::Candidate &candidate,
+                        qint64 now);
+
+private:
+    GtMemoryGovernor();
+    ~GtMemoryGovernor();
+
+private:
+    GtMemoryGovernorPrivate *d;
+
+private:
+    Q_DISABLE_COPY(GtMemoryGovernor)
+};
+
+GT_END_NAMESPACE
+
+#endif  /* __GT_MEMORY_GOVERNOR_H__ */
@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#include "gttrace.h"
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+
+GT_BEGIN_NAMESPACE
+
+QAtomicInt GtTrace::s_enabled(0);
+
+class GtTraceData
+{
+public:
+    struct Event
+    {
+        const char *category;
+        const char *name;
+        qint64 begin;
+        qint64 duration;  // -1 for counters
+        qint64 value;
+        int thread;
+        QString arg;
+    };
+
+public:
+    GtTraceData();
+
+public:
+    int currentThread();
+    bool write();
+
+    static QString escape(const QString &s);
+
+public:
+    QMutex m_mutex;
+    QElapsedTimer m_clock;
+    QString m_fileName;
+    QVector<Event> m_events;
+    QHash<Qt::HANDLE, int> m_threads;
+    QStringList m_threadNames;
+};
+
+static void flushTrace()
+{
+    // the events of the process started by GT_TRACE, written
+    // while the application and the file system are still up
+    GtTrace::stop();
+}
+
+GtTraceData::GtTraceData()
+{
+    m_clock.start();
+
+    QByteArray fileName(qgetenv("GT_TRACE"));
+    if (!fileName.isEmpty() &&
+        GtTrace::start(QString::fromLocal8Bit(fileName)))
+    {
+        qAddPostRoutine(flushTrace);
+    }
+}
+
+int GtTraceData::currentThread()
+{
+    Qt::HANDLE handle = QThread::currentThreadId();
+
+    QHash<Qt::HANDLE, int>::const_iterator it = m_threads.find(handle);
+    if (it != m_threads.end())
+        return it.value();
+
+    // the name of the thread when it first shows up
+    QThread *thread = QThread::currentThread();
+    QString name(thread ? thread->objectName() : QString());
+
+    if (name.isEmpty()) {
+        if (QCoreApplication::instance() &&
+            thread == QCoreApplication::instance()->thread())
+        {
+            name = QLatin1String("main");
+        }
+        else {
+            name = QString("thread %1").arg(m_threadNames.size());
+        }
+    }
+
+    int id = m_threadNames.size();
+    m_threads.insert(handle, id);
+    m_threadNames.append(name);
+    return id;
+}
+
+bool GtTraceData::write()
+{
+    QFile file(m_fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "open trace file failed:" << m_fileName;
+        return false;
+    }
+
+    QTextStream stream(&file);
+    qint64 pid = QCoreApplication::applicationPid();
+
+    stream << "{\"traceEvents\":[\n";
+
+    for (int i = 0; i < m_threadNames.size(); ++i) {
+        stream << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << pid
+               << ",\"tid\":" << i
+               << ",\"args\":{\"name\":\"" << escape(m_threadNames[i]) << "\"}},\n";
+    }
+
+    QVector<Event>::const_iterator it;
+    for (it = m_events.begin(); it != m_events.end(); ++it) {
+        if (it != m_events.begin())
+            stream << ",\n";
+
+        stream << "{\"cat\":\"" << it->category
+               << "\",\"name\":\"" << it->name
+               << "\",\"pid\":" << pid
+               << ",\"tid\":" << it->thread
+               << ",\"ts\":" << it->begin;
+
+        if (-1 == it->duration) {
+            stream << ",\"ph\":\"C\",\"args\":{\"value\":" << it->value << "}}";
+            continue;
+        }
+
+        stream << ",\"ph\":\"X\",\"dur\":" << it->duration;
+        if (!it->arg.isNull())
+            stream << ",\"args\":{\"arg\":\"" << escape(it->arg) << "\"}";
+
+        stream << "}";
+    }
+
+    stream << "\n]}\n";
+    stream.flush();
+    return file.error() == QFile::NoError;
+}
+
+QString GtTraceData::escape(const QString &s)
+{
+    QString result;
+
+    result.reserve(s.size());
+    for (int i = 0; i < s.size(); ++i) {
+        QChar c(s[i]);
+
+        if (c == QLatin1Char('"') || c == QLatin1Char('\\'))
+            result += QLatin1Char('\\');
+        else if (c.unicode() < 0x20)
+            c = QLatin1Char(' ');
+
+        result += c;
+    }
+
+    return result;
+}
+
+static GtTraceData traceData;
+
+bool GtTrace::start(const QString &fileName)
+{
+    QMutexLocker locker(&traceData.m_mutex);
+
+    if (s_enabled.load())
+        return false;
+
+    traceData.m_fileName = fileName;
+    traceData.m_events.clear();
+    s_enabled.store(1);
+    return true;
+}
+
+bool GtTrace::stop()
+{
+    QMutexLocker locker(&traceData.m_mutex);
+
+    if (!s_enabled.load())
+        return false;
+
+    s_enabled.store(0);
+
+    bool result = traceData.write();
+    traceData.m_events.clear();
+    return result;
+}
+
+qint64 GtTrace::now()
+{
+    return traceData.m_clock.nsecsElapsed() / 1000;
+}
+
+void GtTrace::complete(const char *category, const char *name,
+                       qint64 begin, qint64 end, const QString &arg)
+{
+    QMutexLocker locker(&traceData.m_mutex);
+
+    if (!s_enabled.load())
+        return;
+
+    GtTraceData::Event event;
+
+    event.category = category;
+    event.name = name;
+    event.begin = begin;
+    event.duration = end - begin;
+    event.value = 0;
+    event.thread = traceData.currentThread();
+    event.arg = arg;
+    traceData.m_events.append(event);
+}
+
+void GtTrace::counter(const char *category, const char *name, qint64 value)
+{
+    QMutexLocker locker(&traceData.m_mutex);
+
+    if (!s_enabled.load())
+        return;
+
+    GtTraceData::Event event;
+
+    event.category = category;
+    event.name = name;
+    event.begin = now();
+    event.duration = -1;
+    event.value = value;
+    event.thread = traceData.currentThread();
+    traceData.m_events.append(event);
+}
+
+GT_END_NAMESPACE
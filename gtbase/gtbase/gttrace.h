@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#ifndef __GT_TRACE_H__
+#define __GT_TRACE_H__
+
+#include "gtcommon.h"
+#include <QtCore/QAtomicInt>
+#include <QtCore/QString>
+
+GT_BEGIN_NAMESPACE
+
+// Trace events in the Chrome trace-event JSON format, load the
+// file in chrome://tracing or Perfetto. Tracing starts with the
+// process when GT_TRACE names the output file, or with start().
+// The events are written by stop(), or when the application quits
+// for the tracing started by GT_TRACE.
+class GT_BASE_EXPORT GtTrace
+{
+public:
+    static inline bool isEnabled() { return s_enabled.load() != 0; }
+
+    static bool start(const QString &fileName);
+    static bool stop();
+
+    static qint64 now();
+    static void complete(const char *category, const char *name,
+                         qint64 begin, qint64 end, const QString &arg);
+    static void counter(const char *category, const char *name,
+                        qint64 value);
+
+private:
+    static QAtomicInt s_enabled;
+};
+
+class GtTraceScope
+{
+public:
+    inline GtTraceScope(const char *category, const char *name)
+        : m_category(category)
+        , m_name(name)
+        , m_begin(GtTrace::isEnabled() ? GtTrace::now() : -1)
+    {
+    }
+
+    inline GtTraceScope(const char *category, const char *name,
+                        const QString &arg)
+        : m_category(category)
+        , m_name(name)
+        , m_begin(GtTrace::isEnabled() ? GtTrace::now() : -1)
+        , m_arg(arg)
+    {
+    }
+
+    inline ~GtTraceScope()
+    {
+        if (m_begin != -1 && GtTrace::isEnabled())
+            GtTrace::complete(m_category, m_name, m_begin, GtTrace::now(), m_arg);
+    }
+
+private:
+    const char *m_category;
+    const char *m_name;
+    qint64 m_begin;
+    QString m_arg;
+
+private:
+    Q_DISABLE_COPY(GtTraceScope)
+};
+
+#define GT_TRACE_CONCAT_(a, b) a##b
+#define GT_TRACE_CONCAT(a, b) GT_TRACE_CONCAT_(a, b)
+
+// category and name must be string literals, the argument is
+// only evaluated when tracing is enabled
+#define GT_TRACE_SCOPE(category, name) \
+    Gather::GtTraceScope GT_TRACE_CONCAT(gtTraceScope, __LINE__)(category, name)
+
+#define GT_TRACE_SCOPE_ARG(category, name, arg) \
+    Gather::GtTraceScope GT_TRACE_CONCAT(gtTraceScope, __LINE__)( \
+        category, name, \
+        Gather::GtTrace::isEnabled() ? QString(arg) : QString())
+
+#define GT_TRACE_COUNTER(category, name, value) \
+    do { \
+        if (Gather::GtTrace::isEnabled()) \
+            Gather::GtTrace::counter(category, name, value); \
+    } while (0)
+
+GT_END_NAMESPACE
+
+#endif  /* __GT_TRACE_H__ */
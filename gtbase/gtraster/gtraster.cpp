@@ -0,0 +1,520 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#include "gtdocloader.h"
+#include "gtdocpage.h"
+#include "gtdocument.h"
+#include <QtArg/Arg>
+#include <QtArg/CmdLine>
+#include <QtArg/Help>
+#include <QtArg/MultiArg>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMutex>
+#include <QtCore/QTextStream>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+#include <QtGui/QColor>
+#include <QtGui/QGuiApplication>
+#include <QtGui/QImage>
+#include <QtGui/QImageWriter>
+#include <limits>
+
+using namespace Gather;
+
+typedef QPair<int, int> PageRange;
+
+struct Job
+{
+    int file;
+    int begin;
+    int end;
+};
+
+// Hands out the pages of the documents in chunks, the page count of
+// a document is only known after a worker loaded it, until then only
+// one chunk of it is out
+class RasterQueue
+{
+public:
+    RasterQueue(const QStringList &fileNames,
+                const QList<PageRange> &ranges,
+                int chunkSize);
+
+public:
+    bool take(Job *job);
+    void done(const Job &job, int pageCount);
+    bool contains(int page) const;
+
+public:
+    QStringList fileNames;
+    QStringList baseNames;  // output prefix of each file
+    QMutex loaderMutex;
+
+    // statistics
+    QMutex statsMutex;
+    int pages;
+    int failures;
+    qint64 pixels;
+    qint64 bytes;
+
+private:
+    struct FileState
+    {
+        int next;
+        int pageCount;  // -1 if unknown
+        int pending;
+    };
+
+    QList<PageRange> m_ranges;
+    int m_chunkSize;
+    QVector<FileState> m_files;
+    QMutex m_mutex;
+    QWaitCondition m_changed;
+};
+
+RasterQueue::RasterQueue(const QStringList &fileNames,
+                         const QList<PageRange> &ranges,
+                         int chunkSize)
+    : fileNames(fileNames)
+    , pages(0)
+    , failures(0)
+    , pixels(0)
+    , bytes(0)
+    , m_ranges(ranges)
+    , m_chunkSize(chunkSize)
+    , m_files(fileNames.size())
+{
+    int first = std::numeric_limits<int>::max();
+    for (int i = 0; i < m_ranges.size(); ++i)
+        first = MIN(first, m_ranges[i].first);
+
+    for (int i = 0; i < m_files.size(); ++i) {
+        m_files[i].next = first;
+        m_files[i].pageCount = -1;
+        m_files[i].pending = 0;
+    }
+
+    // inputs of the same name from different directories get
+    // their index appended, so their pages don't overwrite
+    QStringList names;
+    for (int i = 0; i < fileNames.size(); ++i)
+        names.append(QFileInfo(fileNames[i]).completeBaseName());
+
+    for (int i = 0; i < names.size(); ++i) {
+        if (names.count(names[i]) > 1)
+            baseNames.append(QString("%1-%2").arg(names[i]).arg(i + 1));
+        else
+            baseNames.append(names[i]);
+    }
+}
+
+bool RasterQueue::take(Job *job)
+{
+    QMutexLocker locker(&m_mutex);
+
+    int last = 0;
+    for (int i = 0; i < m_ranges.size(); ++i)
+        last = MAX(last, m_ranges[i].second);
+
+    forever {
+        bool waiting = false;
+
+        for (int i = 0; i < m_files.size(); ++i) {
+            FileState &state = m_files[i];
+            int end = state.pageCount == -1 ? last : MIN(last, state.pageCount);
+
+            if (state.next >= end) {
+                if (state.pending > 0)
+                    waiting = true;
+
+                continue;
+            }
+
+            if (state.pageCount == -1 && state.pending > 0) {
+                waiting = true;
+                continue;
+            }
+
+            job->file = i;
+            job->begin = state.next;
+            job->end = MIN(state.next + m_chunkSize, end);
+            state.next = job->end;
+            state.pending++;
+            return true;
+        }
+
+        if (!waiting)
+            return false;
+
+        m_changed.wait(&m_mutex);
+    }
+}
+
+void RasterQueue::done(const Job &job, int pageCount)
+{
+    QMutexLocker locker(&m_mutex);
+
+    FileState &state = m_files[job.file];
+
+    // a document failed to load has no pages left
+    state.pageCount = MAX(pageCount, 0);
+    state.pending--;
+    m_changed.wakeAll();
+}
+
+bool RasterQueue::contains(int page) const
+{
+    for (int i = 0; i < m_ranges.size(); ++i) {
+        if (page >= m_ranges[i].first && page < m_ranges[i].second)
+            return true;
+    }
+
+    return false;
+}
+
+class RasterThread : public QThread
+{
+public:
+    RasterThread(RasterQueue *queue, GtDocLoader *docLoader,
+                 const QDir &outputDir, double scale,
+                 QImage::Format format);
+    ~RasterThread();
+
+protected:
+    void run();
+
+private:
+    bool open(int file);
+    bool render(GtDocPage *page, const QString &fileName);
+
+private:
+    RasterQueue *m_queue;
+    GtDocLoader *m_docLoader;
+    QDir m_outputDir;
+    double m_scale;
+    QImage::Format m_format;
+
+    // the document of the last job, chunks of a document
+    // usually follow each other
+    GtDocument *m_document;
+    int m_file;
+};
+
+RasterThread::RasterThread(RasterQueue *queue, GtDocLoader *docLoader,
+                           const QDir &outputDir, double scale,
+                           QImage::Format format)
+    : m_queue(queue)
+    , m_docLoader(docLoader)
+    , m_outputDir(outputDir)
+    , m_scale(scale)
+    , m_format(format)
+    , m_document(0)
+    , m_file(-1)
+{
+}
+
+RasterThread::~RasterThread()
+{
+    delete m_document;
+}
+
+void RasterThread::run()
+{
+    Job job;
+
+    while (m_queue->take(&job)) {
+        if (!open(job.file)) {
+            m_queue->done(job, -1);
+            continue;
+        }
+
+        int pageCount = m_document->pageCount();
+        const QString &baseName = m_queue->baseNames[job.file];
+
+        for (int i = job.begin; i < job.end && i < pageCount; ++i) {
+            if (!m_queue->contains(i))
+                continue;
+
+            QString fileName(m_outputDir.filePath(
+                                 QString("%1-%2.png").arg(baseName)
+                                 .arg(i + 1, 4, 10, QChar('0'))));
+
+            bool result = render(m_document->page(i), fileName);
+
+            QMutexLocker locker(&m_queue->statsMutex);
+            if (result)
+                m_queue->pages++;
+            else
+                m_queue->failures++;
+        }
+
+        m_queue->done(job, pageCount);
+    }
+
+    delete m_document;
+    m_document = 0;
+}
+
+bool RasterThread::open(int file)
+{
+    if (file == m_file)
+        return m_document != 0;
+
+    delete m_document;
+    m_document = 0;
+    m_file = file;
+
+    // the loader resolves its plugins on first use
+    GtDocument *document;
+    if (1) {
+        QMutexLocker locker(&m_queue->loaderMutex);
+        document = m_docLoader->loadDocument(m_queue->fileNames[file]);
+    }
+
+    if (!document || !document->isLoaded()) {
+        qWarning() << "load document failed:" << m_queue->fileNames[file];
+        delete document;
+
+        QMutexLocker locker(&m_queue->statsMutex);
+        m_queue->failures++;
+        return false;
+    }
+
+    m_document = document;
+    return true;
+}
+
+bool RasterThread::render(GtDocPage *page, const QString &fileName)
+{
+    QSize size = page->size(m_scale, 0);
+    QImage image(size, QImage::Format_ARGB32);
+
+    image.fill(QColor(255, 255, 255));
+    page->paint(&image, m_scale, 0);
+
+    if (m_format != QImage::Format_ARGB32)
+        image = image.convertToFormat(m_format);
+
+    // encode straight into the file, only the page being
+    // written is held by a worker
+    QImageWriter writer(fileName, "png");
+    if (!writer.write(image)) {
+        qWarning() << "write image failed:" << fileName << writer.errorString();
+        return false;
+    }
+
+    QMutexLocker locker(&m_queue->statsMutex);
+    m_queue->pixels += qint64(size.width()) * size.height();
+    m_queue->bytes += QFileInfo(fileName).size();
+    return true;
+}
+
+static bool parseRanges(const QString &text, QList<PageRange> &ranges)
+{
+    QStringList parts(text.split(QLatin1Char(','), QString::SkipEmptyParts));
+
+    // 1-based and inclusive, "5-" runs to the end of the document
+    for (int i = 0; i < parts.size(); ++i) {
+        QStringList bounds(parts[i].split(QLatin1Char('-')));
+        bool ok = true;
+        int begin = 0;
+        int end = 0;
+
+        if (bounds.size() == 1) {
+            begin = bounds[0].toInt(&ok);
+            end = begin;
+        }
+        else if (bounds.size() == 2) {
+            begin = bounds[0].isEmpty() ? 1 : bounds[0].toInt(&ok);
+            if (ok) {
+                end = bounds[1].isEmpty() ?
+                      std::numeric_limits<int>::max() : bounds[1].toInt(&ok);
+            }
+        }
+        else {
+            ok = false;
+        }
+
+        if (!ok || begin < 1 || end < begin) {
+            qWarning() << "invalid page range:" << parts[i];
+            return false;
+        }
+
+        ranges.append(PageRange(begin - 1, end));
+    }
+
+    return !ranges.isEmpty();
+}
+
+static bool parseFormat(const QString &text, QImage::Format *format)
+{
+    if (text == QLatin1String("argb32"))
+        *format = QImage::Format_ARGB32;
+    else if (text == QLatin1String("rgb32"))
+        *format = QImage::Format_RGB32;
+    else if (text == QLatin1String("rgb888"))
+        *format = QImage::Format_RGB888;
+    else if (text == QLatin1String("rgb16"))
+        *format = QImage::Format_RGB16;
+    else
+        return false;
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    // images only, no windows
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty())
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QGuiApplication app(argc, argv);
+    QtArgCmdLine cmd(app.arguments());
+
+    QtMultiArg argFile(QLatin1Char('f'),
+                       QLatin1String("file"),
+                       QLatin1String("Document to rasterize, can be repeated"),
+                       true, true);
+    QtArg argOutput(QLatin1Char('o'),
+                    QLatin1String("output"),
+                    QLatin1String("Output directory"),
+                    false, true);
+    QtArg argLoader(QLatin1Char('l'),
+                    QLatin1String("loader"),
+                    QLatin1String("Loader plugin path"),
+                    false, true);
+    QtArg argPages(QLatin1Char('p'),
+                   QLatin1String("pages"),
+                   QLatin1String("Page ranges, e.g. 1-10,20,30-"),
+                   false, true);
+    QtArg argScale(QLatin1Char('s'),
+                   QLatin1String("scale"),
+                   QLatin1String("Render scale"),
+                   false, true);
+    QtArg argFormat(QLatin1Char('x'),
+                    QLatin1String("format"),
+                    QLatin1String("Pixel format: argb32, rgb32, rgb888 or rgb16"),
+                    false, true);
+    QtArg argThread(QLatin1Char('t'),
+                    QLatin1String("thread"),
+                    QLatin1String("Worker thread count"),
+                    false, true);
+    QtArg argChunk(QLatin1Char('c'),
+                   QLatin1String("chunk"),
+                   QLatin1String("Pages per work item"),
+                   false, true);
+    cmd.addArg(argFile);
+    cmd.addArg(argOutput);
+    cmd.addArg(argLoader);
+    cmd.addArg(argPages);
+    cmd.addArg(argScale);
+    cmd.addArg(argFormat);
+    cmd.addArg(argThread);
+    cmd.addArg(argChunk);
+
+    QtArgHelp help(&cmd);
+    help.printer()->setProgramDescription(QLatin1String("Gather document rasterizer."));
+    help.printer()->setExecutableName(QLatin1String(argv[0]));
+
+    cmd.addArg(help);
+
+    try {
+        cmd.parse();
+    }
+    catch (const QtArgHelpHasPrintedEx &x)
+    {
+        return 0;
+    }
+    catch (const QtArgBaseException &x)
+    {
+        qDebug() << x.what();
+        return -1;
+    }
+
+    QStringList fileNames;
+    QList<QVariant> values(argFile.value().toList());
+    for (int i = 0; i < values.size(); ++i)
+        fileNames.append(values[i].toString());
+
+    QList<PageRange> ranges;
+    if (argPages.value().isNull())
+        ranges.append(PageRange(0, std::numeric_limits<int>::max()));
+    else if (!parseRanges(argPages.value().toString(), ranges))
+        return -1;
+
+    QImage::Format format = QImage::Format_RGB32;
+    if (!argFormat.value().isNull() &&
+        !parseFormat(argFormat.value().toString(), &format))
+    {
+        qWarning() << "unknown pixel format:" << argFormat.value().toString();
+        return -1;
+    }
+
+    double scale = argScale.value().isNull() ?
+                   1.0 : argScale.value().toDouble();
+    int threadCount = argThread.value().isNull() ?
+                      QThread::idealThreadCount() : argThread.value().toInt();
+    int chunkSize = argChunk.value().isNull() ?
+                    16 : argChunk.value().toInt();
+
+    if (scale <= 0 || threadCount < 1 || chunkSize < 1) {
+        qWarning() << "invalid scale, thread or chunk count";
+        return -1;
+    }
+
+    QDir outputDir(argOutput.value().isNull() ?
+                   QDir::currentPath() : argOutput.value().toString());
+    if (!outputDir.exists() && !outputDir.mkpath(".")) {
+        qWarning() << "create output directory failed:" << outputDir.path();
+        return -1;
+    }
+
+    QString loaderPath(QDir(app.applicationDirPath()).filePath("loader"));
+    if (!argLoader.value().isNull())
+        loaderPath = argLoader.value().toString();
+
+    GtDocLoader docLoader(0);
+    if (docLoader.registerLoaders(loaderPath) == 0) {
+        qWarning() << "no loader found:" << loaderPath;
+        return -1;
+    }
+
+    RasterQueue queue(fileNames, ranges, chunkSize);
+    QList<RasterThread*> threads;
+    QElapsedTimer clock;
+
+    clock.start();
+
+    for (int i = 0; i < threadCount; ++i) {
+        RasterThread *thread = new RasterThread(&queue, &docLoader,
+                                                outputDir, scale, format);
+        thread->start();
+        threads.append(thread);
+    }
+
+    foreach (RasterThread *thread, threads) {
+        thread->wait();
+        delete thread;
+    }
+
+    double seconds = clock.nsecsElapsed() / 1e9;
+
+    QTextStream out(stdout);
+    out << QString("%1 documents, %2 pages, %3 failures, %4 threads\n")
+           .arg(fileNames.size())
+           .arg(queue.pages)
+           .arg(queue.failures)
+           .arg(threadCount);
+    out << QString("%1 s, %2 pages/s, %3 Mpixels/s, %4 MB written\n")
+           .arg(seconds, 0, 'f', 2)
+           .arg(seconds > 0 ? queue.pages / seconds : 0.0, 0, 'f', 1)
+           .arg(seconds > 0 ? queue.pixels / seconds / 1e6 : 0.0, 0, 'f', 1)
+           .arg(queue.bytes / 1e6, 0, 'f', 1);
+    out.flush();
+
+    return queue.failures ? 1 : 0;
+}
@@ -0,0 +1,16 @@
+TEMPLATE = app
+TARGET = gtraster
+CONFIG += qt debug
+QT += gui
+HEADERS +=
+SOURCES += gtraster.cpp
+INCLUDEPATH += $$PWD/../gtbase
+INCLUDEPATH += $$PWD/../../
+
+CONFIG(debug, debug|release) {
+    DESTDIR = ../../build/debug
+} else {
+    DESTDIR = ../../build/release
+}
+
+unix: LIBS += -L$$DESTDIR -lgtbase -lgtbase-message -lprotobuf
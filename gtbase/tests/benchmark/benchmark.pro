@@ -0,0 +1,8 @@
+CONFIG += testcase
+TARGET = test_benchmark
+QT = core gui testlib
+HEADERS = ../testpdf.h
+SOURCES = test_benchmark.cpp ../testpdf.cpp
+INCLUDEPATH += ..
+
+include(../tests.pri)
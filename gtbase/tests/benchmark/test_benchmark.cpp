@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#include "gtbookmark.h"
+#include "gtdocloader.h"
+#include "gtdocpage.h"
+#include "gtdocpoint.h"
+#include "gtdocument.h"
+#include "testpdf.h"
+#include <QtGui/QImage>
+#include <QtTest/QtTest>
+
+using namespace Gather;
+
+// Benchmarks of the document operations on generated documents, run
+// with "-csv" or "-o results.xml,xml" for results to track across
+// versions
+class test_benchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void benchLoadDocument_data();
+    void benchLoadDocument();
+    void benchScanPages_data();
+    void benchScanPages();
+    void benchFileId_data();
+    void benchFileId();
+    void benchPaint_data();
+    void benchPaint();
+    void benchText();
+    void benchHitTest();
+    void benchOutline_data();
+    void benchOutline();
+    void cleanupTestCase();
+
+private:
+    QString fileName(const QString &name) const;
+    bool generate(const QString &name, const TestPdf::Spec &spec);
+    void addDocumentRows();
+
+private:
+    GtDocLoader *m_docLoader;
+    QHash<QString, GtDocument*> m_documents;
+    QStringList m_fileNames;
+};
+
+QString test_benchmark::fileName(const QString &name) const
+{
+    return QDir::temp().filePath(QString("test_benchmark_%1.pdf").arg(name));
+}
+
+bool test_benchmark::generate(const QString &name, const TestPdf::Spec &spec)
+{
+    QString path(fileName(name));
+
+    if (!TestPdf::write(path, spec))
+        return false;
+
+    m_fileNames.append(path);
+    return true;
+}
+
+void test_benchmark::addDocumentRows()
+{
+    QTest::addColumn<QString>("name");
+
+    QTest::newRow("small") << "small";
+    QTest::newRow("large") << "large";
+    QTest::newRow("image") << "image";
+    QTest::newRow("text") << "text";
+}
+
+void test_benchmark::initTestCase()
+{
+    m_docLoader = new GtDocLoader(0, this);
+
+    QDir dir(QCoreApplication::applicationDirPath());
+    QVERIFY(dir.cd("loader"));
+    QVERIFY(m_docLoader->registerLoaders(dir.absolutePath()) == 1);
+
+    TestPdf::Spec spec;
+
+    spec.pageCount = 1;
+    spec.textLines = 20;
+    QVERIFY(generate("small", spec));
+
+    spec.pageCount = 10000;
+    spec.textLines = 1;
+    spec.outlineDepth = 1;
+    spec.outlineBreadth = 1000;
+    QVERIFY(generate("large", spec));
+
+    // nested outline over mixed page sizes
+    spec.pageCount = 1000;
+    spec.mixedSizes = true;
+    spec.outlineDepth = 4;
+    spec.outlineBreadth = 10;
+    QVERIFY(generate("deep", spec));
+
+    spec.pageCount = 40;
+    spec.mixedSizes = false;
+    spec.textLines = 1;
+    spec.images = 4;
+    spec.outlineDepth = 0;
+    QVERIFY(generate("image", spec));
+
+    spec.pageCount = 200;
+    spec.textLines = 60;
+    spec.images = 0;
+    QVERIFY(generate("text", spec));
+
+    // documents of empty pages, only the page count differs
+    spec.textLines = 0;
+    for (int i = 1000; i <= 100000; i *= 10) {
+        spec.pageCount = i;
+        QVERIFY(generate(QString("pages%1").arg(i), spec));
+    }
+
+    QStringList names;
+    names << "small" << "large" << "deep" << "image" << "text";
+
+    foreach (const QString &name, names) {
+        GtDocument *doc = m_docLoader->loadDocument(fileName(name));
+        QVERIFY(doc && doc->isLoaded());
+        m_documents.insert(name, doc);
+    }
+}
+
+void test_benchmark::benchLoadDocument_data()
+{
+    addDocumentRows();
+}
+
+void test_benchmark::benchLoadDocument()
+{
+    QFETCH(QString, name);
+
+    QString path(fileName(name));
+
+    QBENCHMARK {
+        GtDocument *doc = m_docLoader->loadDocument(path);
+        QVERIFY(doc && doc->isLoaded());
+        delete doc;
+    }
+}
+
+void test_benchmark::benchScanPages_data()
+{
+    QTest::addColumn<int>("pageCount");
+
+    QTest::newRow("1k") << 1000;
+    QTest::newRow("10k") << 10000;
+    QTest::newRow("100k") << 100000;
+}
+
+void test_benchmark::benchScanPages()
+{
+    QFETCH(int, pageCount);
+
+    // loading scans the size of every page, the growth
+    // over the page count is the cost of the scan
+    QString path(fileName(QString("pages%1").arg(pageCount)));
+
+    QBENCHMARK {
+        GtDocument *doc = m_docLoader->loadDocument(path);
+        QVERIFY(doc && doc->pageCount() == pageCount);
+        delete doc;
+    }
+}
+
+void test_benchmark::benchFileId_data()
+{
+    addDocumentRows();
+}
+
+void test_benchmark::benchFileId()
+{
+    QFETCH(QString, name);
+
+    QFile file(fileName(name));
+    QVERIFY(file.open(QIODevice::ReadOnly));
+
+    QBENCHMARK {
+        QVERIFY(file.seek(0));
+        QVERIFY(!GtDocument::makeFileId(&file).isEmpty());
+    }
+}
+
+void test_benchmark::benchPaint_data()
+{
+    QTest::addColumn<QString>("name");
+    QTest::addColumn<double>("scale");
+
+    QStringList names;
+    names << "text" << "image";
+
+    foreach (const QString &name, names) {
+        QTest::newRow(qPrintable(name + "@0.5")) << name << 0.5;
+        QTest::newRow(qPrintable(name + "@1")) << name << 1.0;
+        QTest::newRow(qPrintable(name + "@2")) << name << 2.0;
+        QTest::newRow(qPrintable(name + "@4")) << name << 4.0;
+    }
+}
+
+void test_benchmark::benchPaint()
+{
+    QFETCH(QString, name);
+    QFETCH(double, scale);
+
+    GtDocPage *page = m_documents.value(name)->page(0);
+    QImage image(page->size(scale, 0), QImage::Format_ARGB32);
+
+    QBENCHMARK {
+        image.fill(Qt::white);
+        page->paint(&image, scale, 0);
+    }
+}
+
+void test_benchmark::benchText()
+{
+    // a fresh document, the text of the pages is cached
+    GtDocument *doc = m_docLoader->loadDocument(fileName("text"));
+    QVERIFY(doc && doc->isLoaded());
+
+    int length = 0;
+
+    QBENCHMARK_ONCE {
+        for (int i = 0; i < doc->pageCount(); ++i)
+            length += doc->page(i)->text()->length();
+    }
+
+    QVERIFY(length > 0);
+    delete doc;
+}
+
+void test_benchmark::benchHitTest()
+{
+    GtDocument *doc = m_documents.value("text");
+    GtDocPage *page = doc->page(0);
+    QSize size(page->size());
+
+    QVector<GtDocPoint> points;
+    for (int y = 0; y < 50; ++y) {
+        for (int x = 0; x < 50; ++x)
+            points.append(GtDocPoint(0, size.width() * x / 50.0, size.height() * y / 50.0));
+    }
+
+    // keep the text of the page cached
+    GtDocTextPointer text(page->text());
+    int hits = 0;
+
+    QBENCHMARK {
+        hits = 0;
+        for (int i = 0; i < points.size(); ++i) {
+            if (points[i].text(doc, true) != -1)
+                ++hits;
+        }
+    }
+
+    QVERIFY(hits > 0);
+}
+
+void test_benchmark::benchOutline_data()
+{
+    QTest::addColumn<QString>("name");
+    QTest::addColumn<int>("itemCount");
+
+    QTest::newRow("flat") << "large" << 1000;
+    QTest::newRow("deep") << "deep" << 11110;
+}
+
+void test_benchmark::benchOutline()
+{
+    QFETCH(QString, name);
+    QFETCH(int, itemCount);
+
+    GtDocument *doc = m_documents.value(name);
+    int count = 0;
+
+    QBENCHMARK {
+        GtBookmark root;
+        count = doc->loadOutline(&root);
+    }
+
+    QVERIFY(count == itemCount);
+}
+
+void test_benchmark::cleanupTestCase()
+{
+    qDeleteAll(m_documents);
+    m_documents.clear();
+
+    foreach (const QString &path, m_fileNames)
+        QFile::remove(path);
+
+    delete m_docLoader;
+
+#ifdef GT_DEBUG
+    QVERIFY(GtObject::dumpObjects() == 0);
+#endif
+}
+
+QTEST_MAIN(test_benchmark)
+#include "test_benchmark.moc"
@@ -3,14 +3,20 @@
  */
 #include "gtbookmark.h"
 #include "gtbookmarks.h"
+#include "gtdocindex.h"
+#include "gtdocindexer.h"
 #include "gtdocloader.h"
 #include "gtdocmessage.pb.h"
 #include "gtdocmeta.h"
 #include "gtdocnote.h"
 #include "gtdocnotes.h"
 #include "gtdocpage.h"
+#include "gtdocpoint.h"
 #include "gtdocument.h"
+#include "gtmemorygovernor.h"
+#include "gttrace.h"
 #include <QtTest/QtTest>
+#include <math.h>
 
 using namespace Gather;
 
@@ -22,6 +28,10 @@ private Q_SLOTS:
     void initTestCase();
     void testSerialize();
     void testDocument();
+    void testDocIndex();
+    void testDocText();
+    void testTrace();
+    void testMemoryGovernor();
     void cleanupTestCase();
 
 private:
@@ -216,6 +226,216 @@ void test_document::testDocument()
     delete doc;
 }
 
+void test_document::testDocIndex()
+{
+    GtDocument *doc = m_docLoader->loadDocument(TEST_PDF_FILE);
+    QVERIFY(doc && doc->isLoaded());
+
+    QStringList terms(GtDocIndex::tokenize("Hello, hello world-wide"));
+    QVERIFY(terms.size() == 3);
+    QVERIFY(terms[0] == "hello");
+    QVERIFY(terms[1] == "world");
+    QVERIFY(terms[2] == "wide");
+
+    GtDocIndexer indexer;
+    GtDocIndex index(doc->fileId());
+    QVERIFY(!index.isComplete());
+
+    indexer.index(doc, &index);
+    QVERIFY(index.isComplete());
+    QVERIFY(index.pageCount() == 16);
+    QVERIFY(index.indexedCount() == 16);
+    QVERIFY(index.termCount() > 0);
+
+    // the first term of the first page
+    GtDocTextPointer text(doc->page(0)->text());
+    QString term;
+    int pos = 0;
+    int offset = GtDocIndex::nextTerm(text->texts(), text->length(),
+                                      &pos, &term);
+    QVERIFY(offset != -1);
+
+    QVector<GtDocIndex::Posting> postings(index.find(term));
+    QVERIFY(postings.size() > 0);
+    QVERIFY(postings[0].page == 0);
+    QVERIFY(postings[0].offset == offset);
+    QVERIFY(index.find(term.toUpper()).size() == postings.size());
+    QVERIFY(index.findPages(term).first() == 0);
+    QVERIFY(index.find("nosuchtermhere").size() == 0);
+    QVERIFY(index.findPages(term + " nosuchtermhere").size() == 0);
+
+    // persistent
+    QString fileName(QDir::temp().absoluteFilePath("test_document.idx"));
+    QVERIFY(GtDocIndexer::saveIndex(&index, fileName));
+
+    GtDocIndex other(doc->fileId());
+    QVERIFY(GtDocIndexer::loadIndex(&other, fileName));
+    QVERIFY(other.isComplete());
+    QVERIFY(other.termCount() == index.termCount());
+    QVERIFY(other.findPages(term) == index.findPages(term));
+
+    postings = other.find(term);
+    QVERIFY(postings.size() == index.find(term).size());
+    QVERIFY(postings[0].page == 0);
+    QVERIFY(postings[0].offset == offset);
+
+    GtDocIndex wrong("wrong");
+    QVERIFY(!GtDocIndexer::loadIndex(&wrong, fileName));
+    QVERIFY(QFile::remove(fileName));
+
+    // a complete index is not rebuilt
+    indexer.index(doc, &other);
+    QVERIFY(other.indexedCount() == 16);
+
+    delete doc;
+}
+
+void test_document::testDocText()
+{
+    GtDocument *doc = m_docLoader->loadDocument(TEST_PDF_FILE);
+    QVERIFY(doc && doc->isLoaded());
+
+    GtDocTextPointer text(doc->page(0)->text());
+    const QChar *texts = text->texts();
+    const QRectF *rects = text->rects();
+    int len = text->length();
+    QVERIFY(len > 0);
+
+    QRectF bounds(rects[0]);
+    for (int i = 1; i < len; ++i)
+        bounds |= rects[i];
+
+    // the grid answers the same as a linear scan
+    for (int i = -2; i < 42; ++i) {
+        for (int j = -2; j < 42; ++j) {
+            QPointF point(bounds.left() + bounds.width() * i / 40,
+                          bounds.top() + bounds.height() * j / 40);
+            int inside = -1;
+            int nearest = -1;
+            double minDist = -1;
+
+            for (int k = 0; k < len; ++k) {
+                const QRectF &r = rects[k];
+
+                if (-1 == inside && r.contains(point) &&
+                    point.x() < r.right() && point.y() < r.bottom())
+                {
+                    inside = k;
+                }
+
+                double dist = hypot(point.x() - r.x() - r.width() / 2.0,
+                                    point.y() - r.y() - r.height() / 2.0);
+                if (minDist < 0 || dist < minDist) {
+                    minDist = dist;
+                    nearest = k;
+                }
+            }
+
+            QCOMPARE(text->hitTest(point), inside);
+            QCOMPARE(text->nearest(point), nearest);
+        }
+    }
+
+    // the glyph itself is hit at its center
+    for (int i = 0; i < len; i += 7) {
+        if (rects[i].width() > 0 && rects[i].height() > 0) {
+            int hit = text->hitTest(rects[i].center());
+            QVERIFY(hit != -1 && hit <= i);
+            QVERIFY(rects[hit].contains(rects[i].center()));
+        }
+    }
+
+    // word boundaries
+    for (int i = 0; i < len; ++i) {
+        int begin = text->beginOfWord(i);
+        int end = text->endOfWord(i);
+
+        QVERIFY(begin <= i && i < end && end <= len);
+        QVERIFY(text->beginOfWord(end - 1) == begin);
+        QVERIFY(begin == 0 || GtDocPoint::isSpace(texts[begin - 1]) !=
+                GtDocPoint::isSpace(texts[begin]) ||
+                GtDocPoint::isWordSeparator(texts[begin - 1]) !=
+                GtDocPoint::isWordSeparator(texts[begin]));
+    }
+
+    QVERIFY(text->hitTest(bounds.topLeft() - QPointF(1, 1)) == -1);
+    QVERIFY(text->nearest(bounds.topLeft() - QPointF(1000, 1000)) != -1);
+
+    delete doc;
+}
+
+void test_document::testTrace()
+{
+    QString fileName(QDir::temp().filePath("test_document_trace.json"));
+
+    QVERIFY(GtTrace::start(fileName));
+    QVERIFY(GtTrace::isEnabled());
+
+    // open and scan the pages of a document
+    GtDocument *doc = m_docLoader->loadDocument(TEST_PDF_FILE);
+    QVERIFY(doc && doc->isLoaded());
+    delete doc;
+
+    GT_TRACE_COUNTER("test", "counter", 42);
+    QVERIFY(GtTrace::stop());
+    QVERIFY(!GtTrace::isEnabled());
+
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+
+    QJsonDocument json(QJsonDocument::fromJson(file.readAll()));
+    QJsonArray events(json.object().value("traceEvents").toArray());
+    QSet<QString> names;
+
+    for (int i = 0; i < events.size(); ++i) {
+        QJsonObject event(events[i].toObject());
+
+        if (event.value("ph").toString() == "X")
+            QVERIFY(event.value("dur").toDouble() >= 0);
+
+        names.insert(event.value("name").toString());
+    }
+
+    QVERIFY(names.contains("thread_name"));
+    QVERIFY(names.contains("open"));
+    QVERIFY(names.contains("hash"));
+    QVERIFY(names.contains("load"));
+    QVERIFY(names.contains("scan pages"));
+    QVERIFY(names.contains("counter"));
+
+    file.close();
+    QVERIFY(QFile::remove(fileName));
+}
+
+void test_document::testMemoryGovernor()
+{
+    GtMemoryGovernor *governor = GtMemoryGovernor::instance();
+    qint64 usage = governor->usage();
+
+    GtDocument *doc = m_docLoader->loadDocument(TEST_PDF_FILE);
+    QVERIFY(doc && doc->isLoaded());
+    QVERIFY(governor->usage() >= usage);
+
+    // the text in use stays, the rest goes
+    GtDocTextPointer text(doc->page(0)->text());
+    for (int i = 1; i < doc->pageCount(); ++i)
+        doc->page(i)->text();
+
+    qint64 loaded = governor->usage();
+    QVERIFY(loaded > usage);
+
+    governor->trim(0);
+    QVERIFY(governor->usage() < loaded);
+    QVERIFY(doc->page(0)->text().data() == text.data());
+
+    // the page loads again after the eviction
+    QVERIFY(doc->page(doc->pageCount() - 1)->text());
+
+    text = 0;
+    delete doc;
+    QVERIFY(governor->usage() == usage);
+}
+
 void test_document::cleanupTestCase()
 {
     delete m_docLoader;
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#include "gtbookmark.h"
+#include "gtbookmarks.h"
+#include "gtdocmessage.pb.h"
+#include "gtdocnote.h"
+#include "gtdocnotes.h"
+#include "gtlinkdest.h"
+#include "gtserialize.h"
+#include "testpdf.h"
+#include <QtArg/Arg>
+#include <QtArg/CmdLine>
+#include <QtArg/Help>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+
+using namespace Gather;
+
+// same tree and the same pages as the outline of the document
+static int addBookmarks(GtBookmark *parent, const TestPdf::Spec &spec,
+                        int level, int *next)
+{
+    int count = 0;
+
+    for (int i = 0; i < spec.outlineBreadth; ++i) {
+        int page = (*next)++ % spec.pageCount;
+        QString title(QString("Section %1.%2").arg(level + 1).arg(i + 1));
+        GtBookmark *bookmark = new GtBookmark(title, GtLinkDest(page, QPointF(0, 0), 0));
+
+        parent->append(bookmark);
+        ++count;
+
+        if (level + 1 < spec.outlineDepth)
+            count += addBookmarks(bookmark, spec, level + 1, next);
+    }
+
+    return count;
+}
+
+static void addNotes(GtDocNotes *notes, const TestPdf::Spec &spec, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        int page = int(qint64(i) * 7919 % spec.pageCount);
+        QSizeF size(TestPdf::pageSize(spec, page));
+        qreal y = 40 + (i * 37) % int(size.height() - 80);
+
+        // text notes over a line, or rectangles
+        if (i % 2 == 0) {
+            GtDocRange range(GtDocPoint(page, QPointF(54, y)),
+                             GtDocPoint(page, QPointF(size.width() - 54, y + 10)),
+                             GtDocRange::TextRange);
+            notes->addNote(new GtDocNote(GtDocNote::Highlight, range));
+        }
+        else {
+            GtDocRange range(GtDocPoint(page, QPointF(72, y)),
+                             GtDocPoint(page, QPointF(272, y + 60)),
+                             GtDocRange::GeomRange);
+            notes->addNote(new GtDocNote(GtDocNote::Underline, range));
+        }
+    }
+}
+
+template<typename T0, typename T1>
+static bool writeBlob(const T0 &src, const QString &fileName)
+{
+    QByteArray data;
+    if (!GtSerialize::serialize<T0, T1>(src, data)) {
+        qWarning() << "serialize failed:" << fileName;
+        return false;
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "open file failed:" << fileName;
+        return false;
+    }
+
+    return file.write(data) == data.size();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QtArgCmdLine cmd(app.arguments());
+
+    QtArg argOutput(QLatin1Char('o'),
+                    QLatin1String("output"),
+                    QLatin1String("Output PDF file"),
+                    true, true);
+    QtArg argPages(QLatin1Char('p'),
+                   QLatin1String("pages"),
+                   QLatin1String("Page count"),
+                   false, true);
+    QtArg argMixed(QLatin1Char('m'),
+                   QLatin1String("mixed"),
+                   QLatin1String("Mixed page sizes"),
+                   false, false);
+    QtArg argLines(QLatin1Char('t'),
+                   QLatin1String("text"),
+                   QLatin1String("Lines of text per page"),
+                   false, true);
+    QtArg argImages(QLatin1Char('i'),
+                    QLatin1String("images"),
+                    QLatin1String("Images per page"),
+                    false, true);
+    QtArg argImageSize(QLatin1Char('s'),
+                       QLatin1String("image-size"),
+                       QLatin1String("Width and height of the images"),
+                       false, true);
+    QtArg argDepth(QLatin1Char('d'),
+                   QLatin1String("depth"),
+                   QLatin1String("Outline depth"),
+                   false, true);
+    QtArg argBreadth(QLatin1Char('b'),
+                     QLatin1String("breadth"),
+                     QLatin1String("Outline items of each level"),
+                     false, true);
+    QtArg argNotes(QLatin1Char('n'),
+                   QLatin1String("notes"),
+                   QLatin1String("Note count of the notes blob"),
+                   false, true);
+    cmd.addArg(argOutput);
+    cmd.addArg(argPages);
+    cmd.addArg(argMixed);
+    cmd.addArg(argLines);
+    cmd.addArg(argImages);
+    cmd.addArg(argImageSize);
+    cmd.addArg(argDepth);
+    cmd.addArg(argBreadth);
+    cmd.addArg(argNotes);
+
+    QtArgHelp help(&cmd);
+    help.printer()->setProgramDescription(QLatin1String("Synthetic PDF generator."));
+    help.printer()->setExecutableName(QLatin1String(argv[0]));
+
+    cmd.addArg(help);
+
+    try {
+        cmd.parse();
+    }
+    catch (const QtArgHelpHasPrintedEx &x)
+    {
+        return 0;
+    }
+    catch (const QtArgBaseException &x)
+    {
+        qDebug() << x.what();
+        return -1;
+    }
+
+    TestPdf::Spec spec;
+
+    spec.pageCount = argPages.value().isNull() ? 1000 : argPages.value().toInt();
+    spec.mixedSizes = argMixed.isDefined();
+    spec.textLines = argLines.value().isNull() ? 1 : argLines.value().toInt();
+    spec.images = argImages.value().isNull() ? 0 : argImages.value().toInt();
+    spec.imageSize = argImageSize.value().isNull() ? 256 : argImageSize.value().toInt();
+    spec.outlineDepth = argDepth.value().isNull() ? 0 : argDepth.value().toInt();
+    spec.outlineBreadth = argBreadth.value().isNull() ? 10 : argBreadth.value().toInt();
+
+    int noteCount = argNotes.value().isNull() ? 0 : argNotes.value().toInt();
+
+    if (spec.pageCount < 1 || spec.textLines < 0 || spec.images < 0 ||
+        spec.imageSize < 1 || spec.outlineDepth < 0 ||
+        spec.outlineBreadth < 1 || noteCount < 0)
+    {
+        qWarning() << "invalid document shape";
+        return -1;
+    }
+
+    QString fileName(argOutput.value().toString());
+    if (!TestPdf::write(fileName, spec)) {
+        qWarning() << "write document failed:" << fileName;
+        return -1;
+    }
+
+    // blobs of the data column of the bookmarks and notes tables
+    QFileInfo info(fileName);
+    QString baseName(info.path() + "/" + info.completeBaseName());
+    int bookmarkCount = 0;
+
+    if (spec.outlineDepth > 0) {
+        GtBookmarks bookmarks(info.completeBaseName());
+        int next = 0;
+
+        bookmarkCount = addBookmarks(bookmarks.root(), spec, 0, &next);
+        if (!writeBlob<GtBookmarks, GtBookmarksMsg>(bookmarks, baseName + ".bookmarks"))
+            return -1;
+    }
+
+    if (noteCount > 0) {
+        GtDocNotes notes(info.completeBaseName());
+
+        addNotes(&notes, spec, noteCount);
+        if (!writeBlob<GtDocNotes, GtDocNotesMsg>(notes, baseName + ".notes"))
+            return -1;
+    }
+
+    qDebug() << fileName << spec.pageCount << "pages"
+             << TestPdf::outlineCount(spec) << "outline items"
+             << bookmarkCount << "bookmarks" << noteCount << "notes";
+    return 0;
+}
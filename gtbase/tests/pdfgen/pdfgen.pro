@@ -0,0 +1,11 @@
+TEMPLATE = app
+TARGET = gtpdfgen
+QT -= gui
+HEADERS = ../testpdf.h
+SOURCES = gtpdfgen.cpp ../testpdf.cpp
+INCLUDEPATH += ..
+INCLUDEPATH += $$PWD/../../../
+
+include(../tests.pri)
+
+unix: LIBS += -lgtbase-message
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#include "testpdf.h"
+#include <QtCore/QFile>
+
+static QByteArray ref(int id)
+{
+    return QByteArray::number(id) + " 0 R";
+}
+
+TestPdf::Spec::Spec()
+    : pageCount(1)
+    , mixedSizes(false)
+    , textLines(1)
+    , images(0)
+    , imageSize(256)
+    , outlineDepth(0)
+    , outlineBreadth(0)
+{
+}
+
+QSizeF TestPdf::pageSize(const Spec &spec, int page)
+{
+    if (!spec.mixedSizes)
+        return QSizeF(612, 792);
+
+    switch (page % 4) {
+    case 1:
+        return QSizeF(595, 842);
+
+    case 2:
+        return QSizeF(792, 612);
+
+    case 3:
+        return QSizeF(420, 595);
+
+    default:
+        return QSizeF(612, 792);
+    }
+}
+
+int TestPdf::outlineCount(const Spec &spec)
+{
+    int count = 0;
+    int items = 1;
+
+    for (int i = 0; i < spec.outlineDepth; ++i) {
+        items *= spec.outlineBreadth;
+        count += items;
+    }
+
+    return count;
+}
+
+TestPdf::TestPdf()
+    : m_data("%PDF-1.4\n")
+{
+}
+
+int TestPdf::reserve()
+{
+    m_offsets.append(-1);
+    return m_offsets.size();
+}
+
+void TestPdf::object(int id, const QByteArray &body)
+{
+    m_offsets[id - 1] = m_data.size();
+    m_data += QByteArray::number(id) + " 0 obj\n" + body + "\nendobj\n";
+}
+
+void TestPdf::stream(int id, const QByteArray &dict, const QByteArray &data)
+{
+    m_offsets[id - 1] = m_data.size();
+    m_data += QByteArray::number(id) + " 0 obj\n<< " + dict +
+              " /Length " + QByteArray::number(data.size()) +
+              " >>\nstream\n" + data + "\nendstream\nendobj\n";
+}
+
+QByteArray TestPdf::finish(int root)
+{
+    qint64 xref = m_data.size();
+
+    m_data += "xref\n0 " + QByteArray::number(m_offsets.size() + 1) +
+              "\n0000000000 65535 f \n";
+
+    for (int i = 0; i < m_offsets.size(); ++i) {
+        Q_ASSERT(m_offsets[i] != -1);
+        m_data += QString("%1 00000 n \n").arg(m_offsets[i], 10, 10, QChar('0')).toLatin1();
+    }
+
+    m_data += "trailer\n<< /Size " + QByteArray::number(m_offsets.size() + 1) +
+              " /Root " + ref(root) + " >>\nstartxref\n" +
+              QByteArray::number(xref) + "\n%%EOF\n";
+
+    return m_data;
+}
+
+int TestPdf::outline(const Spec &spec, const QVector<int> &pageIds,
+                     int parent, int level, int *next,
+                     int *first, int *last)
+{
+    QVector<int> items(spec.outlineBreadth);
+    for (int i = 0; i < items.size(); ++i)
+        items[i] = reserve();
+
+    int count = items.size();
+
+    for (int i = 0; i < items.size(); ++i) {
+        int page = (*next)++ % spec.pageCount;
+        QByteArray body("<< /Title (Section " + QByteArray::number(level + 1) +
+                        "." + QByteArray::number(i + 1) + ") /Parent " + ref(parent) +
+                        " /Dest [" + ref(pageIds[page]) + " /XYZ 0 " +
+                        QByteArray::number(pageSize(spec, page).height()) + " 0]");
+
+        if (i > 0)
+            body += " /Prev " + ref(items[i - 1]);
+
+        if (i + 1 < items.size())
+            body += " /Next " + ref(items[i + 1]);
+
+        // all the levels are open
+        if (level + 1 < spec.outlineDepth) {
+            int childFirst, childLast;
+            int children = outline(spec, pageIds, items[i], level + 1,
+                                   next, &childFirst, &childLast);
+
+            body += " /First " + ref(childFirst) + " /Last " + ref(childLast) +
+                    " /Count " + QByteArray::number(children);
+            count += children;
+        }
+
+        object(items[i], body + " >>");
+    }
+
+    *first = items.first();
+    *last = items.last();
+    return count;
+}
+
+bool TestPdf::write(const QString &fileName, const Spec &spec)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    TestPdf pdf;
+    int catalog = pdf.reserve();
+    int pages = pdf.reserve();
+    int font = pdf.reserve();
+    int outlines = outlineCount(spec) > 0 ? pdf.reserve() : 0;
+
+    QVector<int> pageIds(spec.pageCount);
+    for (int i = 0; i < spec.pageCount; ++i)
+        pageIds[i] = pdf.reserve();
+
+    // catalog and page tree
+    QByteArray body("<< /Type /Catalog /Pages " + ref(pages));
+    if (outlines)
+        body += " /Outlines " + ref(outlines) + " /PageMode /UseOutlines";
+
+    pdf.object(catalog, body + " >>");
+
+    body = "<< /Type /Pages /Count " + QByteArray::number(spec.pageCount) + " /Kids [";
+    for (int i = 0; i < spec.pageCount; ++i)
+        body += ref(pageIds[i]) + " ";
+
+    pdf.object(pages, body + "] >>");
+    pdf.object(font, "<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica >>");
+
+    // pages, each with its own content and images
+    const char *words[] = {
+        "lorem", "ipsum", "dolor", "sit", "amet", "consectetur",
+        "adipiscing", "elit", "sed", "do", "eiusmod", "tempor"
+    };
+    const int wordCount = sizeof(words) / sizeof(words[0]);
+
+    for (int i = 0; i < spec.pageCount; ++i) {
+        QByteArray content;
+        QByteArray xobjects;
+
+        for (int j = 0; j < spec.images; ++j) {
+            QByteArray pixels(spec.imageSize * spec.imageSize, 0);
+            for (int k = 0; k < pixels.size(); ++k)
+                pixels[k] = char((k * (i + j + 1)) ^ (k / spec.imageSize));
+
+            int image = pdf.reserve();
+            pdf.stream(image, "/Type /XObject /Subtype /Image /Width " +
+                       QByteArray::number(spec.imageSize) + " /Height " +
+                       QByteArray::number(spec.imageSize) +
+                       " /ColorSpace /DeviceGray /BitsPerComponent 8", pixels);
+
+            xobjects += "/Im" + QByteArray::number(j) + " " + ref(image) + " ";
+            content += "q 200 0 0 200 " + QByteArray::number(72 + (j % 2) * 240) +
+                       " " + QByteArray::number(500 - (j / 2 % 2) * 240) +
+                       " cm /Im" + QByteArray::number(j) + " Do Q\n";
+        }
+
+        if (spec.textLines > 0)
+            content += "BT /F1 10 Tf 12 TL 54 760 Td\n";
+
+        for (int j = 0; j < spec.textLines; ++j) {
+            QByteArray line("(");
+            for (int k = 0; k < 12; ++k) {
+                line += words[(i * 7 + j * 5 + k) % wordCount];
+                line += ' ';
+            }
+
+            content += line + ") Tj T*\n";
+        }
+
+        if (spec.textLines > 0)
+            content += "ET\n";
+
+        int contents = pdf.reserve();
+        pdf.stream(contents, "", content);
+
+        QSizeF size(pageSize(spec, i));
+
+        body = "<< /Type /Page /Parent " + ref(pages) +
+               " /MediaBox [0 0 " + QByteArray::number(size.width()) + " " +
+               QByteArray::number(size.height()) + "] /Contents " + ref(contents) +
+               " /Resources << /Font << /F1 " + ref(font) + " >>";
+        if (!xobjects.isEmpty())
+            body += " /XObject << " + xobjects + ">>";
+
+        pdf.object(pageIds[i], body + " >> >>");
+    }
+
+    // outline tree, the items point to the pages in turn
+    if (outlines) {
+        int next = 0;
+        int first, last;
+        int count = pdf.outline(spec, pageIds, outlines, 0, &next, &first, &last);
+
+        pdf.object(outlines, "<< /Type /Outlines /First " + ref(first) +
+                   " /Last " + ref(last) +
+                   " /Count " + QByteArray::number(count) + " >>");
+    }
+
+    QByteArray data(pdf.finish(catalog));
+    return file.write(data) == data.size();
+}
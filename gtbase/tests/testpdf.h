@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#ifndef __GT_TEST_PDF_H__
+#define __GT_TEST_PDF_H__
+
+#include <QtCore/QByteArray>
+#include <QtCore/QSizeF>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+// Writes PDF files of the given shape for tests and benchmarks, the
+// files are uncompressed so the content costs show up in the loader
+class TestPdf
+{
+public:
+    struct Spec
+    {
+        Spec();
+
+        int pageCount;
+        bool mixedSizes;     // letter, A4, landscape and A5 pages in turn
+        int textLines;       // lines of text per page
+        int images;          // distinct images per page
+        int imageSize;       // width and height of the images
+        int outlineDepth;    // levels of the outline, 0 for none
+        int outlineBreadth;  // items of each outline level
+    };
+
+public:
+    static bool write(const QString &fileName, const Spec &spec);
+    static QSizeF pageSize(const Spec &spec, int page);
+    static int outlineCount(const Spec &spec);
+
+private:
+    TestPdf();
+
+    int reserve();
+    int outline(const Spec &spec, const QVector<int> &pageIds,
+                int parent, int level, int *next,
+                int *first, int *last);
+    void object(int id, const QByteArray &body);
+    void stream(int id, const QByteArray &dict, const QByteArray &data);
+    QByteArray finish(int root);
+
+private:
+    QByteArray m_data;
+    QVector<qint64> m_offsets;
+};
+
+#endif  /* __GT_TEST_PDF_H__ */
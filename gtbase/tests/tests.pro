@@ -1,2 +1,2 @@
 TEMPLATE = subdirs
-SUBDIRS = document
+SUBDIRS = document benchmark pdfgen
@@ -1,25 +1,48 @@
 /*
  * Copyright (C) 2013 Tom Wong. All rights reserved.
  */
+#include "gtftchunkcache.h"
 #include "gtftserver.h"
+#include "gtftstorage.h"
 #include <QtArg/Arg>
 #include <QtArg/CmdLine>
 #include <QtArg/Help>
 #include <QtCore/QCoreApplication>
+#include <QtCore/QTimer>
 
 using namespace Gather;
 
-class FastDFS : public GtFTServer
+class StorageServer : public GtFTServer
 {
 public:
     void upload(const QString &fileId, QIODevice *device)
     {
+        if (!storage.store(fileId, device))
+            qWarning() << "store file failed:" << fileId;
     }
 
     QIODevice* download(const QString &fileId)
     {
-        return 0;
+        return storage.openFile(fileId);
+    }
+
+    bool link(const QString &fileId)
+    {
+        return (storage.ref(fileId) > 0);
     }
+
+    bool readBlock(const QByteArray &hash, QByteArray *data)
+    {
+        return storage.readBlock(hash, data);
+    }
+
+    int release(const QString &fileId)
+    {
+        return storage.unref(fileId);
+    }
+
+public:
+    GtFTStorage storage;
 };
 
 int main(int argc, char *argv[])
@@ -43,10 +66,41 @@ int main(int argc, char *argv[])
                     QLatin1String("thread"),
                     QLatin1String("Max thread count"),
                     false, true);
+    QtArg argMessage(QLatin1Char('s'),
+                     QLatin1String("message"),
+                     QLatin1String("Max message size in bytes"),
+                     false, true);
+    QtArg argStorage(QLatin1Char('d'),
+                     QLatin1String("storage"),
+                     QLatin1String("Storage path"),
+                     false, true);
+    QtArg argCapacity(QLatin1Char('c'),
+                      QLatin1String("capacity"),
+                      QLatin1String("Storage capacity in MB"),
+                      false, true);
+    QtArg argCollect(QLatin1Char('g'),
+                     QLatin1String("collect"),
+                     QLatin1String("Minutes between the removals of the "
+                                   "released files, 60 by default, 0 to "
+                                   "remove them only for the space"),
+                     false, true);
+    QtArg argCache(QLatin1Char('k'),
+                   QLatin1String("cache"),
+                   QLatin1String("Chunk cache size in MB, 0 (the default) to disable. "
+                                 "The cache saves disk reads of files downloaded "
+                                 "by many sessions, but the data is copied to the "
+                                 "sockets instead of sent from the files by the "
+                                 "kernel"),
+                   false, true);
     cmd.addArg(argHost);
     cmd.addArg(argPort);
     cmd.addArg(argTemp);
     cmd.addArg(argThread);
+    cmd.addArg(argMessage);
+    cmd.addArg(argStorage);
+    cmd.addArg(argCapacity);
+    cmd.addArg(argCollect);
+    cmd.addArg(argCache);
 
     QtArgHelp help(&cmd);
     help.printer()->setProgramDescription(QLatin1String("Gather file transfer server."));
@@ -67,7 +121,7 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-    FastDFS server;
+    StorageServer server;
     QHostAddress host(QHostAddress::AnyIPv4);
     quint16 port = argPort.value().isNull() ?
                    9001 : argPort.value().toInt();
@@ -81,6 +135,37 @@ int main(int argc, char *argv[])
     if (!argThread.value().isNull())
         server.setMaxThread(argThread.value().toInt());
 
+    if (!argMessage.value().isNull())
+        server.setMaxMessageSize(argMessage.value().toUInt());
+
+    if (!argCapacity.value().isNull())
+        server.storage.setCapacity(argCapacity.value().toLongLong() * 1024 * 1024);
+
+    // the popular files are read once for all the sessions
+    qint64 cacheSize = argCache.value().isNull() ?
+                       0 : argCache.value().toLongLong();
+    server.chunkCache()->setCapacity(cacheSize * 1024 * 1024);
+
+    QString storagePath(QLatin1String("storage"));
+    if (!argStorage.value().isNull())
+        storagePath = argStorage.value().toString();
+
+    if (!server.storage.open(storagePath)) {
+        qWarning() << "open storage failed:" << storagePath;
+        return -1;
+    }
+
+    // the files released by all the uploads
+    QTimer collectTimer;
+    int collectInterval = argCollect.value().isNull() ?
+                          60 : argCollect.value().toInt();
+
+    if (collectInterval > 0) {
+        QObject::connect(&collectTimer, SIGNAL(timeout()),
+                         &server.storage, SLOT(collect()));
+        collectTimer.start(collectInterval * 60 * 1000);
+    }
+
     if (!server.listen(host, port)) {
         qWarning() << "listen failed:" << host << port;
         return -1;
@@ -0,0 +1,392 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#include "gtftchunkcache.h"
+#include <QtCore/QDebug>
+#include <QtCore/QHash>
+#include <QtCore/QIODevice>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <QtCore/QPair>
+#include <QtCore/QWaitCondition>
+
+GT_BEGIN_NAMESPACE
+
+// the id of the file and the begin of the chunk
+typedef QPair<QString, qint64> GtFTChunkKey;
+
+class GtFTChunk
+{
+public:
+    GtFTChunk()
+        : tick(0)
+        , loading(true)
+    {
+    }
+
+public:
+    QByteArray data;
+    quint64 tick;
+    bool loading;
+};
+
+class GtFTChunkCachePrivate
+{
+public:
+    GtFTChunkCachePrivate();
+    ~GtFTChunkCachePrivate();
+
+public:
+    bool chunk(const QString &fileId, QIODevice *device,
+               qint64 begin, qint64 size, qint64 fileSize,
+               QByteArray *data);
+    bool load(QIODevice *device, qint64 pos, QByteArray *data);
+    void touch(const GtFTChunkKey &key, GtFTChunk *chunk);
+    void evict();
+    void clear();
+
+public:
+    qint64 capacity;
+    int chunkSize;
+    int readAhead;
+    qint64 cachedSize;
+    quint64 hits;
+    quint64 misses;
+
+    // the chunks by the time of the last use, the first
+    // one goes first when the cache is full
+    QHash<GtFTChunkKey, GtFTChunk*> chunks;
+    QMap<quint64, GtFTChunkKey> lru;
+    quint64 tick;
+
+    mutable QMutex mutex;
+    QWaitCondition loaded;
+};
+
+GtFTChunkCachePrivate::GtFTChunkCachePrivate()
+    : capacity(0)
+    , chunkSize(GtFTChunkCache::DefaultChunkSize)
+    , readAhead(GtFTChunkCache::DefaultReadAhead)
+    , cachedSize(0)
+    , hits(0)
+    , misses(0)
+    , tick(0)
+{
+}
+
+GtFTChunkCachePrivate::~GtFTChunkCachePrivate()
+{
+    clear();
+}
+
+bool GtFTChunkCachePrivate::chunk(const QString &fileId,
+                                  QIODevice *device,
+                                  qint64 begin,
+                                  qint64 size,
+                                  qint64 fileSize,
+                                  QByteArray *data)
+{
+    QMutexLocker locker(&mutex);
+
+    GtFTChunkKey key(fileId, begin);
+    GtFTChunk *chunk;
+
+    // another session is reading the chunk from the disk
+    while ((chunk = chunks.value(key)) && chunk->loading)
+        loaded.wait(&mutex);
+
+    if (chunk) {
+        hits += 1;
+        touch(key, chunk);
+
+        // the data is shared, the copy is out of the lock
+        *data = chunk->data;
+        return true;
+    }
+
+    misses += 1;
+
+    // the chunks after it not cached are read together
+    QList<GtFTChunk*> loads;
+
+    for (int i = 0; i <= readAhead && begin + i * size < fileSize; ++i) {
+        GtFTChunkKey next(fileId, begin + i * size);
+        if (chunks.contains(next))
+            break;
+
+        chunk = new GtFTChunk();
+        chunks.insert(next, chunk);
+        loads.append(chunk);
+    }
+
+    locker.unlock();
+
+    qint64 length = MIN(fileSize - begin, loads.size() * size);
+    QByteArray buffer(length, -1);
+    bool result = load(device, begin, &buffer);
+
+    locker.relock();
+
+    for (int i = 0; i < loads.size(); ++i) {
+        GtFTChunkKey next(fileId, begin + i * size);
+        chunk = loads[i];
+
+        if (result) {
+            chunk->data = buffer.mid(i * size, size);
+            chunk->loading = false;
+            cachedSize += chunk->data.size();
+            touch(next, chunk);
+        }
+        else {
+            chunks.remove(next);
+            delete chunk;
+        }
+    }
+
+    if (result)
+        *data = loads.first()->data;
+
+    loaded.wakeAll();
+    evict();
+
+    return result;
+}
+
+bool GtFTChunkCachePrivate::load(QIODevice *device, qint64 pos, QByteArray *data)
+{
+    if (!device->seek(pos))
+        return false;
+
+    qint64 bytesRead = 0;
+    while (bytesRead < data->size()) {
+        qint64 length = device->read(data->data() + bytesRead,
+                                     data->size() - bytesRead);
+        if (length <= 0) {
+            qWarning() << "read cache chunk failed:" << pos + bytesRead;
+            return false;
+        }
+
+        bytesRead += length;
+    }
+
+    return true;
+}
+
+void GtFTChunkCachePrivate::touch(const GtFTChunkKey &key, GtFTChunk *chunk)
+{
+    if (chunk->tick)
+        lru.remove(chunk->tick);
+
+    chunk->tick = ++tick;
+    lru.insert(chunk->tick, key);
+}
+
+void GtFTChunkCachePrivate::evict()
+{
+    while (cachedSize > capacity && !lru.isEmpty()) {
+        QMap<quint64, GtFTChunkKey>::iterator it = lru.begin();
+        GtFTChunk *chunk = chunks.take(it.value());
+
+        // the sessions reading it keep the shared data
+        cachedSize -= chunk->data.size();
+        lru.erase(it);
+        delete chunk;
+    }
+}
+
+void GtFTChunkCachePrivate::clear()
+{
+    QHash<GtFTChunkKey, GtFTChunk*>::iterator it = chunks.begin();
+
+    // the chunks being read are still waited for
+    while (it != chunks.end()) {
+        if (it.value()->loading) {
+            ++it;
+        }
+        else {
+            delete it.value();
+            it = chunks.erase(it);
+        }
+    }
+
+    lru.clear();
+    cachedSize = 0;
+}
+
+GtFTChunkCache::GtFTChunkCache()
+    : d_ptr(new GtFTChunkCachePrivate())
+{
+}
+
+GtFTChunkCache::~GtFTChunkCache()
+{
+}
+
+qint64 GtFTChunkCache::capacity() const
+{
+    Q_D(const GtFTChunkCache);
+    QMutexLocker locker(&d->mutex);
+    return d->capacity;
+}
+
+void GtFTChunkCache::setCapacity(qint64 size)
+{
+    Q_D(GtFTChunkCache);
+    QMutexLocker locker(&d->mutex);
+    d->capacity = MAX(size, (qint64)0);
+    d->evict();
+}
+
+int GtFTChunkCache::chunkSize() const
+{
+    Q_D(const GtFTChunkCache);
+    QMutexLocker locker(&d->mutex);
+    return d->chunkSize;
+}
+
+void GtFTChunkCache::setChunkSize(int size)
+{
+    Q_D(GtFTChunkCache);
+    QMutexLocker locker(&d->mutex);
+
+    size = MAX(size, 1);
+    if (size != d->chunkSize) {
+        d->chunkSize = size;
+        d->clear();
+    }
+}
+
+int GtFTChunkCache::readAhead() const
+{
+    Q_D(const GtFTChunkCache);
+    QMutexLocker locker(&d->mutex);
+    return d->readAhead;
+}
+
+void GtFTChunkCache::setReadAhead(int count)
+{
+    Q_D(GtFTChunkCache);
+    QMutexLocker locker(&d->mutex);
+    d->readAhead = MAX(count, 0);
+}
+
+qint64 GtFTChunkCache::cachedSize() const
+{
+    Q_D(const GtFTChunkCache);
+    QMutexLocker locker(&d->mutex);
+    return d->cachedSize;
+}
+
+int GtFTChunkCache::count() const
+{
+    Q_D(const GtFTChunkCache);
+    QMutexLocker locker(&d->mutex);
+    return d->lru.size();
+}
+
+qint64 GtFTChunkCache::read(const QString &fileId,
+                            QIODevice *device,
+                            qint64 pos,
+                            char *data,
+                            qint64 maxlen)
+{
+    Q_D(GtFTChunkCache);
+
+    qint64 fileSize = device->size();
+    qint64 chunkSize = this->chunkSize();
+
+    if (pos < 0 || fileSize < 0)
+        return -1;
+
+    maxlen = MIN(maxlen, fileSize - pos);
+
+    qint64 bytesRead = 0;
+    QByteArray chunk;
+
+    // a chunk of the size before a change has the data of
+    // its begin, the read stops at the end of it
+    while (bytesRead < maxlen) {
+        qint64 offset = (pos + bytesRead) % chunkSize;
+        qint64 begin = pos + bytesRead - offset;
+
+        if (!d->chunk(fileId, device, begin, chunkSize, fileSize, &chunk))
+            return bytesRead > 0 ? bytesRead : -1;
+
+        qint64 length = MIN(maxlen - bytesRead, chunk.size() - offset);
+        if (length <= 0)
+            break;
+
+        memcpy(data + bytesRead, chunk.constData() + offset, length);
+        bytesRead += length;
+    }
+
+    return bytesRead;
+}
+
+QByteArray GtFTChunkCache::chunk(const QString &fileId,
+                                 QIODevice *device,
+                                 qint64 pos,
+                                 qint64 *offset)
+{
+    Q_D(GtFTChunkCache);
+
+    qint64 fileSize = device->size();
+    qint64 chunkSize = this->chunkSize();
+    QByteArray data;
+
+    if (pos < 0 || pos >= fileSize)
+        return data;
+
+    *offset = pos % chunkSize;
+    if (!d->chunk(fileId, device, pos - *offset, chunkSize, fileSize, &data))
+        return QByteArray();
+
+    // a chunk of the size before a change ends before pos
+    if (*offset >= data.size())
+        return QByteArray();
+
+    return data;
+}
+
+void GtFTChunkCache::clear()
+{
+    Q_D(GtFTChunkCache);
+    QMutexLocker locker(&d->mutex);
+    d->clear();
+}
+
+quint64 GtFTChunkCache::hits() const
+{
+    Q_D(const GtFTChunkCache);
+    QMutexLocker locker(&d->mutex);
+    return d->hits;
+}
+
+quint64 GtFTChunkCache::misses() const
+{
+    Q_D(const GtFTChunkCache);
+    QMutexLocker locker(&d->mutex);
+    return d->misses;
+}
+
+double GtFTChunkCache::hitRate() const
+{
+    Q_D(const GtFTChunkCache);
+    QMutexLocker locker(&d->mutex);
+
+    quint64 total = d->hits + d->misses;
+    if (0 == total)
+        return 0;
+
+    return (double)d->hits / total;
+}
+
+void GtFTChunkCache::resetStats()
+{
+    Q_D(GtFTChunkCache);
+    QMutexLocker locker(&d->mutex);
+    d->hits = 0;
+    d->misses = 0;
+}
+
+GT_END_NAMESPACE
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#ifndef __GT_FT_CHUNK_CACHE_H__
+#define __GT_FT_CHUNK_CACHE_H__
+
+#include "gtcommon.h"
+#include <QtCore/QByteArray>
+#include <QtCore/QScopedPointer>
+
+class QIODevice;
+
+GT_BEGIN_NAMESPACE
+
+class GtFTChunkCachePrivate;
+
+// Chunks of the downloaded files shared by all the sessions of a
+// server. The id of a file is the hash of the data, so a chunk is
+// never out of date. A chunk read by a session is waited for by
+// the others, the least recently used chunks go over the capacity.
+class GT_SVCE_EXPORT GtFTChunkCache
+{
+public:
+    enum {
+        DefaultChunkSize = 256 * 1024,
+        DefaultReadAhead = 4
+    };
+
+public:
+    GtFTChunkCache();
+    ~GtFTChunkCache();
+
+public:
+    // the memory for the chunks, 0 disables the cache
+    qint64 capacity() const;
+    void setCapacity(qint64 size);
+
+    // the chunks cached are dropped
+    int chunkSize() const;
+    void setChunkSize(int size);
+
+    // the chunks after a miss read together with it
+    int readAhead() const;
+    void setReadAhead(int count);
+
+    qint64 cachedSize() const;
+    int count() const;
+
+    // reads the file from pos, the chunks not cached are read from
+    // device. The position of device is undefined after it.
+    qint64 read(const QString &fileId,
+                QIODevice *device,
+                qint64 pos,
+                char *data,
+                qint64 maxlen);
+
+    // the chunk with pos shared with the cache, offset is the
+    // position of pos in it. Empty if the chunk can't be read.
+    QByteArray chunk(const QString &fileId,
+                     QIODevice *device,
+                     qint64 pos,
+                     qint64 *offset);
+
+    void clear();
+
+    // the chunks found and not found by the reads
+    quint64 hits() const;
+    quint64 misses() const;
+    double hitRate() const;
+    void resetStats();
+
+private:
+    QScopedPointer<GtFTChunkCachePrivate> d_ptr;
+
+private:
+    Q_DISABLE_COPY(GtFTChunkCache)
+    Q_DECLARE_PRIVATE(GtFTChunkCache)
+};
+
+GT_END_NAMESPACE
+
+#endif  /* __GT_FT_CHUNK_CACHE_H__ */
@@ -3,13 +3,12 @@
  */
 #include "gtftclient.h"
 #include "gtftmessage.pb.h"
-#include "gtfttemp.h"
+#include "gtrecvbuffer.h"
 #include "gtsvcutil.h"
 #include <QtCore/QDebug>
 #include <QtCore/qendian.h>
 #include <QtNetwork/QHostAddress>
 #include <QtNetwork/QTcpSocket>
-#include <limits>
 
 GT_BEGIN_NAMESPACE
 
@@ -26,23 +25,80 @@ public:
     void close(bool disconnect);
     void disconnect();
 
+    template<typename T>
+    bool request(int requestType,
+                 const ::google::protobuf::Message *request,
+                 int responseType,
+                 T *response,
+                 int bufferSize = 0);
+
+    bool nextStreamMessage();
+    qint64 readStream(char *data, qint64 maxlen);
+    bool stopStream();
+    void resetStream();
+
+    bool sendUpload(qint64 pos, const char *data, qint64 len);
+    bool readAck(bool *sync);
+    bool syncUpload();
+    bool stopUpload();
+
+    inline bool stopTransfer() { return stopStream() && stopUpload(); }
+
 protected:
     GtFTClient *q_ptr;
     QTcpSocket *socket;
-    QList<GtFTTempData*> temps;
+    GtFTRanges temps;
     QHostAddress address;
     QString session;
     QString fileId;
     int error;
+    int framing;
+    int maxDataSize;
     quint16 port;
     bool opened;
+
+    // the server had the file of the upload at the open
+    bool exists;
+
+    // position of the server, after the data handed to QIODevice
+    qint64 offset;
+
+    // stream data received and not yet read, the bytes read
+    // since the last credit
+    GtRecvBuffer streamBuffer;
+    QByteArray streamData;
+    int streamRead;
+    qint64 streamWindow;
+    qint64 streamConsumed;
+    bool streaming;
+
+    // the writes sent and acknowledged since the upload request
+    GtRecvBuffer ackBuffer;
+    qint64 uploadWindow;
+    qint64 uploadSent;
+    qint64 uploadAcked;
+    int uploadError;
+    bool uploading;
 };
 
 GtFTClientPrivate::GtFTClientPrivate(GtFTClient *q)
     : q_ptr(q)
     , error(GtFTClient::NoError)
+    , framing(GtSvcUtil::FramingVersion1)
+    , maxDataSize(0)
     , port(0)
     , opened(false)
+    , exists(false)
+    , offset(0)
+    , streamRead(0)
+    , streamWindow(0)
+    , streamConsumed(0)
+    , streaming(false)
+    , uploadWindow(0)
+    , uploadSent(0)
+    , uploadAcked(0)
+    , uploadError(GtFTClient::NoError)
+    , uploading(false)
 {
     socket = new QTcpSocket(q);
     q->connect(socket, SIGNAL(error(QAbstractSocket::SocketError)),
@@ -67,29 +123,53 @@ bool GtFTClientPrivate::open(QIODevice::OpenMode mode)
         return false;
     }
 
+    // a new connection starts with the first framing
+    framing = GtSvcUtil::FramingVersion1;
+    offset = 0;
+    resetStream();
+    ackBuffer.clear();
+    uploading = false;
+
     GtFTOpenRequest request;
     request.set_session(session.toUtf8().constData());
     request.set_fileid(fileId.toUtf8().constData());
     request.set_mode(mode);
+    request.set_framing(GtSvcUtil::FramingVersion);
+    request.set_dedup(true);
 
+    // the ranges of a fragmented upload may be many, the
+    // response is in the first framing
     GtFTOpenResponse response;
-    if (!GtSvcUtil::syncRequest<GtFTOpenResponse>(socket,
-                                                  GT_FT_OPEN_REQUEST,
-                                                  &request,
-                                                  GT_FT_OPEN_RESPONSE,
-                                                  &response))
+    if (!this->request<GtFTOpenResponse>(GT_FT_OPEN_REQUEST,
+                                         &request,
+                                         GT_FT_OPEN_RESPONSE,
+                                         &response,
+                                         GtSvcUtil::maxMessageSize(framing)))
     {
         error = GtFTClient::RequestFailed;
         return false;
     }
 
+    // old servers don't answer the framing
+    if (response.has_framing())
+        framing = response.framing();
+
+    qint64 maxSize = GtSvcUtil::maxMessageSize(framing);
+    if (response.has_max_message_size())
+        maxSize = MIN(maxSize, (qint64)response.max_message_size());
+
+    maxDataSize = maxSize - GtFTClient::MessageOverhead;
+    streamBuffer.setFraming(framing);
+    ackBuffer.setFraming(framing);
+
     error = response.error();
     opened = (GtFTClient::NoError == error);
+    exists = opened && response.exists();
 
     if (opened) {
         for (int i = 0; i < response.temps_size(); ++i) {
-            GtFTTempData *p = new GtFTTempData(response.temps(i));
-            temps.push_back(p);
+            const GtFTTempData &p = response.temps(i);
+            temps.insert(p.offset(), p.offset() + p.size());
         }
     }
 
@@ -105,8 +185,11 @@ void GtFTClientPrivate::close(bool disconnect)
         this->disconnect();
 
     opened = false;
-    qDeleteAll(temps);
+    exists = false;
     temps.clear();
+    resetStream();
+    ackBuffer.clear();
+    uploading = false;
 }
 
 void GtFTClientPrivate::disconnect()
@@ -116,6 +199,302 @@ void GtFTClientPrivate::disconnect()
         socket->waitForDisconnected();
 }
 
+template<typename T>
+bool GtFTClientPrivate::request(int requestType,
+                                const ::google::protobuf::Message *request,
+                                int responseType,
+                                T *response,
+                                int bufferSize)
+{
+    return GtSvcUtil::syncRequest<T>(socket, requestType, request,
+                                     responseType, response,
+                                     bufferSize, framing);
+}
+
+bool GtFTClientPrivate::nextStreamMessage()
+{
+    int result;
+
+    do {
+        result = streamBuffer.read(socket, true);
+    } while (0 == result);
+
+    if (result != GtRecvBuffer::ReadMessage ||
+        streamBuffer.size() < sizeof(quint16))
+    {
+        error = GtFTClient::RequestFailed;
+        streaming = false;
+        return false;
+    }
+
+    const char *data = streamBuffer.buffer() + sizeof(quint16);
+    int size = streamBuffer.size() - sizeof(quint16);
+    int type = qFromBigEndian<quint16>((const uchar*)streamBuffer.buffer());
+
+    streamBuffer.clear();
+
+    switch (type) {
+    case GT_FT_STREAM_DATA:
+        {
+            GtFTStreamData msg;
+            if (!msg.ParseFromArray(data, size))
+                break;
+
+            streamData.remove(0, streamRead);
+            streamData.append(msg.data().data(), msg.data().size());
+            streamRead = 0;
+        }
+        return true;
+
+    case GT_FT_STREAM_RAW:
+        {
+            GtFTStreamRaw msg;
+            if (!msg.ParseFromArray(data, size))
+                break;
+
+            // the data follows the message, never more than the window
+            if (msg.size() <= 0 || msg.size() > streamWindow)
+                break;
+
+            int length = streamData.size() - streamRead;
+
+            streamData.remove(0, streamRead);
+            streamData.resize(length + msg.size());
+            streamRead = 0;
+
+            if (!GtSvcUtil::readData(socket, streamData.data() + length,
+                                     msg.size()))
+            {
+                error = GtFTClient::RequestFailed;
+                streaming = false;
+                return false;
+            }
+        }
+        return true;
+
+    case GT_FT_STREAM_END:
+        {
+            GtFTStreamEnd msg;
+            if (!msg.ParseFromArray(data, size))
+                break;
+
+            error = msg.error();
+            streaming = false;
+        }
+        return true;
+
+    default:
+        break;
+    }
+
+    qWarning() << "Invalid FT stream message:" << type;
+    error = GtFTClient::RequestFailed;
+    streaming = false;
+    return false;
+}
+
+qint64 GtFTClientPrivate::readStream(char *data, qint64 maxlen)
+{
+    while (streamRead == streamData.size() && streaming) {
+        if (!nextStreamMessage())
+            return -1;
+    }
+
+    qint64 length = MIN(maxlen, (qint64)(streamData.size() - streamRead));
+    if (0 == length && error != GtFTClient::NoError)
+        return -1;
+
+    memcpy(data, streamData.constData() + streamRead, length);
+    streamRead += length;
+    offset += length;
+
+    // more credit once half of the window is read
+    streamConsumed += length;
+    if (streaming && streamConsumed >= streamWindow / 2) {
+        GtFTStreamCredit credit;
+        credit.set_size(streamConsumed);
+
+        if (!GtSvcUtil::sendMessage(socket, GT_FT_STREAM_CREDIT,
+                                    &credit, framing))
+        {
+            error = GtFTClient::RequestFailed;
+            return -1;
+        }
+
+        streamConsumed = 0;
+    }
+
+    return length;
+}
+
+bool GtFTClientPrivate::stopStream()
+{
+    if (!streaming && streamRead == streamData.size())
+        return true;
+
+    if (streaming) {
+        if (!GtSvcUtil::sendMessage(socket, GT_FT_STREAM_CANCEL, 0, framing))
+            return false;
+
+        // the data on the way is dropped
+        while (streaming) {
+            if (!nextStreamMessage())
+                return false;
+        }
+    }
+
+    resetStream();
+
+    // the server is past the data read
+    GtFTSeekRequest request;
+    request.set_pos(offset);
+
+    GtFTSeekResponse response;
+    if (!this->request<GtFTSeekResponse>(GT_FT_SEEK_REQUEST,
+                                         &request,
+                                         GT_FT_SEEK_RESPONSE,
+                                         &response))
+    {
+        error = GtFTClient::RequestFailed;
+        return false;
+    }
+
+    error = response.error();
+    return (GtFTClient::NoError == error);
+}
+
+void GtFTClientPrivate::resetStream()
+{
+    streamBuffer.clear();
+    streamData.clear();
+    streamRead = 0;
+    streamConsumed = 0;
+    streaming = false;
+}
+
+bool GtFTClientPrivate::sendUpload(qint64 pos, const char *data, qint64 len)
+{
+    // wait for room in the window
+    while (uploadSent - uploadAcked + len > uploadWindow &&
+           uploadSent > uploadAcked &&
+           GtFTClient::NoError == uploadError)
+    {
+        bool sync;
+        if (!readAck(&sync))
+            return false;
+    }
+
+    // the server drops the writes after an error
+    if (uploadError != GtFTClient::NoError) {
+        error = uploadError;
+        return false;
+    }
+
+    GtFTUploadData msg;
+    msg.set_offset(pos);
+    msg.set_data(data, len);
+
+    if (!GtSvcUtil::sendMessage(socket, GT_FT_UPLOAD_DATA, &msg, framing)) {
+        error = GtFTClient::RequestFailed;
+        return false;
+    }
+
+    uploadSent += len;
+    temps.insert(pos, pos + len);
+    return true;
+}
+
+bool GtFTClientPrivate::readAck(bool *sync)
+{
+    int result;
+
+    do {
+        result = ackBuffer.read(socket, true);
+    } while (0 == result);
+
+    if (result != GtRecvBuffer::ReadMessage ||
+        ackBuffer.size() < sizeof(quint16))
+    {
+        error = GtFTClient::RequestFailed;
+        return false;
+    }
+
+    const char *data = ackBuffer.buffer() + sizeof(quint16);
+    int size = ackBuffer.size() - sizeof(quint16);
+    int type = qFromBigEndian<quint16>((const uchar*)ackBuffer.buffer());
+
+    ackBuffer.clear();
+
+    GtFTUploadAck msg;
+    if (type != GT_FT_UPLOAD_ACK || !msg.ParseFromArray(data, size)) {
+        qWarning() << "Invalid FT upload message:" << type;
+        error = GtFTClient::RequestFailed;
+        return false;
+    }
+
+    uploadAcked = msg.size();
+    uploadError = msg.error();
+    *sync = msg.sync();
+    return true;
+}
+
+bool GtFTClientPrivate::syncUpload()
+{
+    GtFTUploadData msg;
+    msg.set_ack(true);
+
+    if (!GtSvcUtil::sendMessage(socket, GT_FT_UPLOAD_DATA, &msg, framing)) {
+        error = GtFTClient::RequestFailed;
+        return false;
+    }
+
+    // the acknowledgements before the one asked for
+    bool sync = false;
+    while (!sync) {
+        if (!readAck(&sync))
+            return false;
+    }
+
+    if (uploadError != GtFTClient::NoError) {
+        error = uploadError;
+        return false;
+    }
+
+    if (uploadAcked != uploadSent) {
+        error = GtFTClient::InvalidDataSize;
+        return false;
+    }
+
+    return true;
+}
+
+bool GtFTClientPrivate::stopUpload()
+{
+    if (!uploading)
+        return true;
+
+    uploading = false;
+    if (!syncUpload())
+        return false;
+
+    // the writes at other positions moved the server
+    GtFTSeekRequest request;
+    request.set_pos(offset);
+
+    GtFTSeekResponse response;
+    if (!this->request<GtFTSeekResponse>(GT_FT_SEEK_REQUEST,
+                                         &request,
+                                         GT_FT_SEEK_RESPONSE,
+                                         &response))
+    {
+        error = GtFTClient::RequestFailed;
+        return false;
+    }
+
+    error = response.error();
+    return (GtFTClient::NoError == error);
+}
+
 GtFTClient::GtFTClient(QObject *parent)
     : QIODevice(parent)
     , d_ptr(new GtFTClientPrivate(this))
@@ -176,6 +555,10 @@ void GtFTClient::close()
 {
     Q_D(GtFTClient);
 
+    // the server keeps the writes received before the close
+    if (d->uploading && d->opened)
+        d->stopUpload();
+
     d->close(true);
     QIODevice::close();
 }
@@ -201,12 +584,14 @@ qint64 GtFTClient::size()
         return -1;
     }
 
+    if (!d->stopTransfer())
+        return -1;
+
     GtFTSizeResponse response;
-    if (!GtSvcUtil::syncRequest<GtFTSizeResponse>(d->socket,
-                                                  GT_FT_SIZE_REQUEST,
-                                                  0,
-                                                  GT_FT_SIZE_RESPONSE,
-                                                  &response))
+    if (!d->request<GtFTSizeResponse>(GT_FT_SIZE_REQUEST,
+                                      0,
+                                      GT_FT_SIZE_RESPONSE,
+                                      &response))
     {
         d->error = GtFTClient::RequestFailed;
         return -1;
@@ -224,15 +609,17 @@ bool GtFTClient::seek(qint64 pos)
         return false;
     }
 
+    if (!d->stopTransfer())
+        return false;
+
     GtFTSeekRequest request;
     request.set_pos(pos);
 
     GtFTSeekResponse response;
-    if (!GtSvcUtil::syncRequest<GtFTSeekResponse>(d->socket,
-                                                  GT_FT_SEEK_REQUEST,
-                                                  &request,
-                                                  GT_FT_SEEK_RESPONSE,
-                                                  &response))
+    if (!d->request<GtFTSeekResponse>(GT_FT_SEEK_REQUEST,
+                                      &request,
+                                      GT_FT_SEEK_RESPONSE,
+                                      &response))
     {
         d->error = GtFTClient::RequestFailed;
         return -1;
@@ -242,16 +629,105 @@ bool GtFTClient::seek(qint64 pos)
     if (d->error != GtFTClient::NoError)
         return false;
 
+    d->offset = pos;
     return QIODevice::seek(pos);
 }
 
+const GtFTRanges& GtFTClient::ranges() const
+{
+    Q_D(const GtFTClient);
+    return d->temps;
+}
+
 qint64 GtFTClient::complete(qint64 begin) const
 {
     Q_D(const GtFTClient);
-    return GtFTTemp::complete(d->temps, begin);
+    return d->temps.complete(begin);
+}
+
+bool GtFTClient::exists() const
+{
+    Q_D(const GtFTClient);
+    return d->exists;
+}
+
+qint64 GtFTClient::copyBlocks(const QList<QByteArray> &hashes)
+{
+    Q_D(GtFTClient);
+
+    // old servers drop the request without an answer
+    if (!d->opened || d->exists ||
+        d->framing < GtSvcUtil::FramingVersion2)
+    {
+        d->error = GtFTClient::InvalidState;
+        return -1;
+    }
+
+    if (!d->stopTransfer())
+        return -1;
+
+    GtFTBlocksRequest request;
+    foreach (const QByteArray &hash, hashes)
+        request.add_hashes(hash.constData(), hash.size());
+
+    // all the ranges of the temp are in the response
+    int bufferSize = MIN(d->maxDataSize + GtFTClient::MessageOverhead,
+                         (int)GtSvcUtil::MaxMessageSize);
+
+    GtFTBlocksResponse response;
+    if (!d->request<GtFTBlocksResponse>(GT_FT_BLOCKS_REQUEST,
+                                        &request,
+                                        GT_FT_BLOCKS_RESPONSE,
+                                        &response,
+                                        bufferSize))
+    {
+        d->error = GtFTClient::RequestFailed;
+        return -1;
+    }
+
+    // the ranges written by the other sessions are there too
+    for (int i = 0; i < response.temps_size(); ++i) {
+        const GtFTTempData &p = response.temps(i);
+        d->temps.insert(p.offset(), p.offset() + p.size());
+    }
+
+    d->error = response.error();
+    if (d->error != GtFTClient::NoError)
+        return -1;
+
+    return response.size();
+}
+
+int GtFTClient::release()
+{
+    Q_D(GtFTClient);
+
+    if (!d->opened || d->framing < GtSvcUtil::FramingVersion2) {
+        d->error = GtFTClient::InvalidState;
+        return -1;
+    }
+
+    if (!d->stopTransfer())
+        return -1;
+
+    GtFTReleaseResponse response;
+    if (!d->request<GtFTReleaseResponse>(GT_FT_RELEASE_REQUEST,
+                                         0,
+                                         GT_FT_RELEASE_RESPONSE,
+                                         &response))
+    {
+        d->error = GtFTClient::RequestFailed;
+        return -1;
+    }
+
+    d->error = response.error();
+    if (d->error != GtFTClient::NoError)
+        return -1;
+
+    return response.refs();
 }
 
-bool GtFTClient::finish()
+bool GtFTClient::finish(const QByteArray &merkleRoot)
 {
     Q_D(GtFTClient);
 
@@ -260,12 +736,18 @@ bool GtFTClient::finish()
         return false;
     }
 
+    if (!d->stopTransfer())
+        return false;
+
+    GtFTFinishRequest request;
+    if (!merkleRoot.isEmpty())
+        request.set_merkle_root(merkleRoot.constData(), merkleRoot.size());
+
     GtFTFinishResponse response;
-    if (!GtSvcUtil::syncRequest<GtFTFinishResponse>(d->socket,
-                                                    GT_FT_FINISH_REQUEST,
-                                                    0,
-                                                    GT_FT_FINISH_RESPONSE,
-                                                    &response))
+    if (!d->request<GtFTFinishResponse>(GT_FT_FINISH_REQUEST,
+                                        &request,
+                                        GT_FT_FINISH_RESPONSE,
+                                        &response))
     {
         d->error = GtFTClient::RequestFailed;
         return -1;
@@ -275,6 +757,123 @@ bool GtFTClient::finish()
     return (GtFTClient::NoError == d->error);
 }
 
+bool GtFTClient::stream(qint64 size, int window, int chunkSize, bool raw)
+{
+    Q_D(GtFTClient);
+
+    // the server sends nothing without a window, and old
+    // servers drop the request without an answer
+    if (!d->opened || !(openMode() & QIODevice::ReadOnly) ||
+        window <= 0 || d->framing < GtSvcUtil::FramingVersion2)
+    {
+        d->error = GtFTClient::InvalidState;
+        return false;
+    }
+
+    if (!d->stopTransfer())
+        return false;
+
+    GtFTStreamRequest request;
+    request.set_offset(d->offset);
+    request.set_size(size);
+    request.set_chunk_size(MIN(chunkSize, d->maxDataSize));
+    request.set_window(window);
+    request.set_raw(raw);
+
+    if (!GtSvcUtil::sendMessage(d->socket, GT_FT_STREAM_REQUEST,
+                                &request, d->framing))
+    {
+        d->error = GtFTClient::RequestFailed;
+        return false;
+    }
+
+    d->streamWindow = window;
+    d->streaming = true;
+    return true;
+}
+
+bool GtFTClient::isStreaming() const
+{
+    Q_D(const GtFTClient);
+    return d->streaming;
+}
+
+bool GtFTClient::upload(int window, int ackSize, bool partial)
+{
+    Q_D(GtFTClient);
+
+    if (!d->opened || d->exists || !(openMode() & QIODevice::WriteOnly) ||
+        window <= 0 || d->framing < GtSvcUtil::FramingVersion2)
+    {
+        d->error = GtFTClient::InvalidState;
+        return false;
+    }
+
+    if (!d->stopTransfer())
+        return false;
+
+    GtFTUploadRequest request;
+    request.set_ack_size(MIN(ackSize, window / 2));
+    request.set_partial(partial);
+
+    if (!GtSvcUtil::sendMessage(d->socket, GT_FT_UPLOAD_REQUEST,
+                                &request, d->framing))
+    {
+        d->error = GtFTClient::RequestFailed;
+        return false;
+    }
+
+    d->uploadWindow = MAX(window, d->maxDataSize);
+    d->uploadSent = 0;
+    d->uploadAcked = 0;
+    d->uploadError = GtFTClient::NoError;
+    d->uploading = true;
+    return true;
+}
+
+bool GtFTClient::isUploading() const
+{
+    Q_D(const GtFTClient);
+    return d->uploading;
+}
+
+qint64 GtFTClient::writeAt(qint64 pos, const char *data, qint64 len)
+{
+    Q_D(GtFTClient);
+
+    if (!d->opened || !d->uploading) {
+        d->error = GtFTClient::InvalidState;
+        return -1;
+    }
+
+    qint64 written = 0;
+    while (written < len) {
+        qint64 size = MIN(len - written, (qint64)d->maxDataSize);
+
+        if (!d->sendUpload(pos + written, data + written, size))
+            return -1;
+
+        written += size;
+    }
+
+    return written;
+}
+
+bool GtFTClient::sync()
+{
+    Q_D(GtFTClient);
+
+    if (!d->opened) {
+        d->error = GtFTClient::InvalidState;
+        return false;
+    }
+
+    if (!d->uploading)
+        return true;
+
+    return d->syncUpload();
+}
+
 qint64 GtFTClient::readData(char *data, qint64 maxlen)
 {
     Q_D(GtFTClient);
@@ -284,18 +883,30 @@ qint64 GtFTClient::readData(char *data, qint64 maxlen)
         return -1;
     }
 
-    Q_ASSERT(maxlen <= std::numeric_limits<int>::max());
+    if (d->streaming || d->streamRead < d->streamData.size()) {
+        qint64 length = d->readStream(data, maxlen);
+        if (length != 0)
+            return length;
+
+        // the stream is over, read on request
+        d->resetStream();
+    }
+
+    if (!d->stopUpload())
+        return -1;
+
+    // bigger reads are cut short by the framing
+    maxlen = MIN(maxlen, (qint64)d->maxDataSize);
 
     GtFTReadRequest request;
     request.set_size(maxlen);
 
     GtFTReadResponse response;
-    if (!GtSvcUtil::syncRequest<GtFTReadResponse>(d->socket,
-                                                  GT_FT_READ_REQUEST,
-                                                  &request,
-                                                  GT_FT_READ_RESPONSE,
-                                                  &response,
-                                                  maxlen + 256))
+    if (!d->request<GtFTReadResponse>(GT_FT_READ_REQUEST,
+                                      &request,
+                                      GT_FT_READ_RESPONSE,
+                                      &response,
+                                      maxlen + 256))
     {
         d->error = GtFTClient::RequestFailed;
         return -1;
@@ -307,6 +918,7 @@ qint64 GtFTClient::readData(char *data, qint64 maxlen)
     }
 
     memcpy(data, response.data().data(), response.data().size());
+    d->offset += response.data().size();
     return response.data().size();
 }
 
@@ -314,22 +926,32 @@ qint64 GtFTClient::writeData(const char *data, qint64 len)
 {
     Q_D(GtFTClient);
 
-    if (!d->opened) {
+    if (!d->opened || d->exists) {
         d->error = GtFTClient::InvalidState;
         return -1;
     }
 
-    Q_ASSERT(len <= std::numeric_limits<int>::max());
+    if (d->uploading) {
+        len = writeAt(d->offset, data, len);
+        if (len > 0)
+            d->offset += len;
+
+        return len;
+    }
+
+    if (!d->stopStream())
+        return -1;
+
+    len = MIN(len, (qint64)d->maxDataSize);
 
     GtFTWriteRequest request;
     request.set_data(data, len);
 
     GtFTWriteResponse response;
-    if (!GtSvcUtil::syncRequest<GtFTWriteResponse>(d->socket,
-                                                   GT_FT_WRITE_REQUEST,
-                                                   &request,
-                                                   GT_FT_WRITE_RESPONSE,
-                                                   &response))
+    if (!d->request<GtFTWriteResponse>(GT_FT_WRITE_REQUEST,
+                                       &request,
+                                       GT_FT_WRITE_RESPONSE,
+                                       &response))
     {
         d->error = GtFTClient::RequestFailed;
         return -1;
@@ -341,7 +963,8 @@ qint64 GtFTClient::writeData(const char *data, qint64 len)
     }
 
     qint64 pos = this->pos();
-    GtFTTemp::append(d->temps, pos, pos + response.size());
+    d->temps.insert(pos, pos + response.size());
+    d->offset += response.size();
     return response.size();
 }
 
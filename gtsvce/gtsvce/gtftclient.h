@@ -4,6 +4,7 @@
 #ifndef __GT_FT_CLIENT_H__
 #define __GT_FT_CLIENT_H__
 
+#include "gtftranges.h"
 #include "gtobject.h"
 #include <QtCore/QIODevice>
 #include <QtNetwork/QAbstractSocket>
@@ -31,6 +32,21 @@ public:
         UnknownError = -1
     };
 
+    // bytes of a data message besides the data
+    enum {
+        MessageOverhead = 16
+    };
+
+    enum {
+        DefaultStreamWindow = 4 * 1024 * 1024,
+        DefaultStreamChunk = 256 * 1024
+    };
+
+    enum {
+        DefaultUploadWindow = 4 * 1024 * 1024,
+        DefaultUploadAck = 1024 * 1024
+    };
+
 public:
     explicit GtFTClient(QObject *parent = 0);
     GtFTClient(const QString &fileId,
@@ -56,8 +72,54 @@ public:
     qint64 size();
     bool seek(qint64 pos);
 
+    // the ranges the server has, from the open and the writes
+    const GtFTRanges& ranges() const;
+
     qint64 complete(qint64 begin = 0) const;
-    bool finish();
+
+    // the server had the file of an upload, it is not written again
+    bool exists() const;
+
+    // the server copies the blocks of the upload it has in other
+    // files, hashes are the leaves of GtFTTemp for the file. Returns
+    // the bytes copied, the ranges have the blocks after it.
+    qint64 copyBlocks(const QList<QByteArray> &hashes);
+
+    // drops a reference of an upload of the file the server has,
+    // returns the references left, -1 on an error
+    int release();
+
+    // the merkle root of GtFTTemp for the file, the server rejects
+    // a broken upload with it before reading the data for the id
+    bool finish(const QByteArray &merkleRoot = QByteArray());
+
+    // downloads size bytes from the current position, -1 for the rest
+    // of the file. The server pushes chunks ahead of the reads, up to
+    // window bytes not yet read. Any other request ends the stream.
+    // With raw the server may send the data straight from the file,
+    // outside of the messages.
+    bool stream(qint64 size = -1,
+                int window = DefaultStreamWindow,
+                int chunkSize = DefaultStreamChunk,
+                bool raw = true);
+    bool isStreaming() const;
+
+    // the writes go without waiting for the server, up to window
+    // bytes not yet acknowledged. The server acknowledges every
+    // ackSize bytes. Any other request waits for all the writes.
+    // A partial upload is a part of a parallel one, the server
+    // doesn't finish the file on the close.
+    bool upload(int window = DefaultUploadWindow,
+                int ackSize = DefaultUploadAck,
+                bool partial = false);
+    bool isUploading() const;
+
+    // writes at pos of the file in an upload, the position
+    // of the device is unchanged
+    qint64 writeAt(qint64 pos, const char *data, qint64 len);
+
+    // waits until the server has all the writes of the upload
+    bool sync();
 
 protected:
     qint64 readData(char *data, qint64 maxlen);
@@ -0,0 +1,446 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#include "gtftparallel.h"
+#include "gtftclient.h"
+#include "gtfttemp.h"
+#include <QtCore/QDebug>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtNetwork/QHostAddress>
+
+GT_BEGIN_NAMESPACE
+
+typedef QPair<qint64, qint64> GtFTRange;
+
+class GtFTParallelPrivate
+{
+    Q_DECLARE_PUBLIC(GtFTParallel)
+
+public:
+    explicit GtFTParallelPrivate(GtFTParallel *q);
+    ~GtFTParallelPrivate();
+
+public:
+    void schedule(const GtFTRanges &temps, qint64 size);
+    bool run(QIODevice *device, bool uploading);
+    bool takeRange(qint64 *begin, qint64 *end);
+    void setError(int error);
+
+    bool readSource(qint64 pos, char *data, qint64 size);
+    bool writeTarget(qint64 pos, const char *data, qint64 size);
+
+    void uploadRanges();
+    void downloadRanges();
+
+protected:
+    enum {
+        ChunkSize = 256 * 1024
+    };
+
+protected:
+    GtFTParallel *q_ptr;
+    QString fileId;
+    QHostAddress address;
+    QString session;
+    quint16 port;
+    int connections;
+    int rangeSize;
+
+    // shared by the connections
+    QMutex mutex;
+    QList<GtFTRange> ranges;
+    QIODevice *device;
+    bool uploading;
+    int error;
+
+    friend class GtFTParallelWorker;
+};
+
+class GtFTParallelWorker : public QThread
+{
+public:
+    explicit GtFTParallelWorker(GtFTParallelPrivate *d)
+        : d(d)
+    {
+    }
+
+protected:
+    void run()
+    {
+        if (d->uploading)
+            d->uploadRanges();
+        else
+            d->downloadRanges();
+    }
+
+private:
+    GtFTParallelPrivate *d;
+};
+
+GtFTParallelPrivate::GtFTParallelPrivate(GtFTParallel *q)
+    : q_ptr(q)
+    , port(0)
+    , connections(GtFTParallel::DefaultConnections)
+    , rangeSize(GtFTParallel::DefaultRangeSize)
+    , device(0)
+    , uploading(false)
+    , error(GtFTClient::NoError)
+{
+}
+
+GtFTParallelPrivate::~GtFTParallelPrivate()
+{
+}
+
+void GtFTParallelPrivate::schedule(const GtFTRanges &temps, qint64 size)
+{
+    QList<GtFTRange> holes;
+    qint64 pos = 0;
+
+    GtFTRanges::const_iterator it;
+    for (it = temps.begin(); it != temps.end(); ++it) {
+        if (it.key() > pos)
+            holes.append(qMakePair(pos, MIN(it.key(), size)));
+
+        pos = MAX(pos, it.value());
+    }
+
+    if (pos < size)
+        holes.append(qMakePair(pos, size));
+
+    // the holes are cut to ranges for the connections
+    ranges.clear();
+    foreach (const GtFTRange &hole, holes) {
+        qint64 begin = hole.first;
+
+        while (begin < hole.second) {
+            qint64 end = MIN(hole.second, begin + rangeSize);
+            ranges.append(qMakePair(begin, end));
+            begin = end;
+        }
+    }
+}
+
+bool GtFTParallelPrivate::run(QIODevice *device, bool uploading)
+{
+    this->device = device;
+    this->uploading = uploading;
+
+    QList<GtFTParallelWorker*> workers;
+    int count = MIN(connections, ranges.size());
+
+    for (int i = 0; i < count; ++i) {
+        GtFTParallelWorker *worker = new GtFTParallelWorker(this);
+        worker->start();
+        workers.append(worker);
+    }
+
+    foreach (GtFTParallelWorker *worker, workers)
+        worker->wait();
+
+    qDeleteAll(workers);
+
+    this->device = 0;
+    return (GtFTClient::NoError == error);
+}
+
+bool GtFTParallelPrivate::takeRange(qint64 *begin, qint64 *end)
+{
+    QMutexLocker locker(&mutex);
+
+    // the other connections stop after an error
+    if (ranges.isEmpty() || error != GtFTClient::NoError)
+        return false;
+
+    GtFTRange range(ranges.takeFirst());
+    *begin = range.first;
+    *end = range.second;
+    return true;
+}
+
+void GtFTParallelPrivate::setError(int error)
+{
+    QMutexLocker locker(&mutex);
+
+    if (GtFTClient::NoError == this->error) {
+        if (GtFTClient::NoError == error)
+            error = GtFTClient::UnknownError;
+
+        this->error = error;
+    }
+}
+
+bool GtFTParallelPrivate::readSource(qint64 pos, char *data, qint64 size)
+{
+    QMutexLocker locker(&mutex);
+
+    if (!device->seek(pos))
+        return false;
+
+    qint64 bytesRead = 0;
+    while (bytesRead < size) {
+        qint64 length = device->read(data + bytesRead, size - bytesRead);
+        if (length <= 0)
+            return false;
+
+        bytesRead += length;
+    }
+
+    return true;
+}
+
+bool GtFTParallelPrivate::writeTarget(qint64 pos, const char *data, qint64 size)
+{
+    QMutexLocker locker(&mutex);
+
+    if (!device->seek(pos))
+        return false;
+
+    return (device->write(data, size) == size);
+}
+
+void GtFTParallelPrivate::uploadRanges()
+{
+    GtFTClient client(fileId, address, port, session);
+
+    if (!client.open(QIODevice::WriteOnly) ||
+        !client.upload(GtFTClient::DefaultUploadWindow,
+                       GtFTClient::DefaultUploadAck, true))
+    {
+        setError(client.error());
+        return;
+    }
+
+    QByteArray buffer(ChunkSize, -1);
+    qint64 begin, end;
+
+    while (takeRange(&begin, &end)) {
+        while (begin < end) {
+            qint64 size = MIN(end - begin, (qint64)buffer.size());
+
+            if (!readSource(begin, buffer.data(), size)) {
+                qWarning() << "read upload source failed:" << begin;
+                setError(GtFTClient::InvalidDataSize);
+                return;
+            }
+
+            if (client.writeAt(begin, buffer.constData(), size) != size) {
+                setError(client.error());
+                return;
+            }
+
+            begin += size;
+        }
+    }
+
+    // the server saves the ranges for the finish
+    if (!client.sync())
+        setError(client.error());
+
+    client.close();
+}
+
+void GtFTParallelPrivate::downloadRanges()
+{
+    GtFTClient client(fileId, address, port, session);
+
+    if (!client.open(QIODevice::ReadOnly)) {
+        setError(client.error());
+        return;
+    }
+
+    QByteArray buffer(ChunkSize, -1);
+    qint64 begin, end;
+
+    while (takeRange(&begin, &end)) {
+        if (!client.seek(begin) || !client.stream(end - begin)) {
+            setError(client.error());
+            return;
+        }
+
+        while (begin < end) {
+            qint64 size = MIN(end - begin, (qint64)buffer.size());
+
+            size = client.read(buffer.data(), size);
+            if (size <= 0) {
+                setError(client.error());
+                return;
+            }
+
+            if (!writeTarget(begin, buffer.constData(), size)) {
+                qWarning() << "write download target failed:" << begin;
+                setError(GtFTClient::InvalidDataSize);
+                return;
+            }
+
+            begin += size;
+        }
+    }
+
+    client.close();
+}
+
+GtFTParallel::GtFTParallel(QObject *parent)
+    : QObject(parent)
+    , d_ptr(new GtFTParallelPrivate(this))
+{
+}
+
+GtFTParallel::GtFTParallel(const QString &fileId,
+                           const QHostAddress &address,
+                           quint16 port,
+                           const QString &session,
+                           QObject *parent)
+    : QObject(parent)
+    , d_ptr(new GtFTParallelPrivate(this))
+{
+    setFileInfo(fileId, address, port, session);
+}
+
+GtFTParallel::~GtFTParallel()
+{
+}
+
+QString GtFTParallel::fileId() const
+{
+    Q_D(const GtFTParallel);
+    return d->fileId;
+}
+
+void GtFTParallel::setFileInfo(const QString &fileId,
+                               const QHostAddress &address,
+                               quint16 port,
+                               const QString &session)
+{
+    Q_D(GtFTParallel);
+
+    d->fileId = fileId;
+    d->address = address;
+    d->port = port;
+    d->session = session;
+}
+
+int GtFTParallel::connections() const
+{
+    Q_D(const GtFTParallel);
+    return d->connections;
+}
+
+void GtFTParallel::setConnections(int count)
+{
+    Q_D(GtFTParallel);
+    d->connections = MAX(count, 1);
+}
+
+int GtFTParallel::rangeSize() const
+{
+    Q_D(const GtFTParallel);
+    return d->rangeSize;
+}
+
+void GtFTParallel::setRangeSize(int size)
+{
+    Q_D(GtFTParallel);
+    d->rangeSize = MAX(size, 1);
+}
+
+int GtFTParallel::error() const
+{
+    Q_D(const GtFTParallel);
+    return d->error;
+}
+
+bool GtFTParallel::upload(QIODevice *source)
+{
+    Q_D(GtFTParallel);
+
+    d->error = GtFTClient::NoError;
+
+    if (!source->isReadable() || source->isSequential()) {
+        d->error = GtFTClient::InvalidState;
+        return false;
+    }
+
+    // the ranges the server has from the uploads before
+    GtFTClient client(d->fileId, d->address, d->port, d->session);
+    if (!client.open(QIODevice::WriteOnly)) {
+        d->error = client.error();
+        return false;
+    }
+
+    // the server has the file already
+    if (client.exists()) {
+        client.close();
+        return true;
+    }
+
+    // the blocks the server has in the other files are copied,
+    // only the rest is sent
+    QList<QByteArray> leaves(GtFTTemp::blockHashes(source));
+    if (leaves.isEmpty() && source->size() > 0) {
+        d->error = GtFTClient::InvalidDataSize;
+        return false;
+    }
+
+    if (client.copyBlocks(leaves) < 0) {
+        d->error = client.error();
+        return false;
+    }
+
+    d->schedule(client.ranges(), source->size());
+    client.close();
+
+    if (!d->run(source, true))
+        return false;
+
+    // a new session has the ranges of all the connections, the
+    // hashes of the blocks are checked with the root of the source
+    QByteArray merkleRoot(GtFTTemp::merkleRoot(leaves));
+
+    if (!client.open(QIODevice::WriteOnly)) {
+        d->error = client.error();
+        return false;
+    }
+
+    bool finished = client.finish(merkleRoot);
+    d->error = client.error();
+    client.close();
+
+    return finished;
+}
+
+bool GtFTParallel::download(QIODevice *target)
+{
+    Q_D(GtFTParallel);
+
+    d->error = GtFTClient::NoError;
+
+    if (!target->isWritable() || target->isSequential()) {
+        d->error = GtFTClient::InvalidState;
+        return false;
+    }
+
+    GtFTClient client(d->fileId, d->address, d->port, d->session);
+    if (!client.open(QIODevice::ReadOnly)) {
+        d->error = client.error();
+        return false;
+    }
+
+    qint64 size = client.size();
+    d->error = client.error();
+    client.close();
+
+    if (size < 0)
+        return false;
+
+    GtFTRanges temps;
+    GtFTTemp *temp = qobject_cast<GtFTTemp*>(target);
+    if (temp)
+        temps = temp->ranges();
+
+    d->schedule(temps, size);
+    return d->run(target, false);
+}
+
+GT_END_NAMESPACE
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#ifndef __GT_FT_PARALLEL_H__
+#define __GT_FT_PARALLEL_H__
+
+#include "gtobject.h"
+#include <QtCore/QObject>
+
+class QHostAddress;
+class QIODevice;
+
+GT_BEGIN_NAMESPACE
+
+class GtFTParallelPrivate;
+
+// Transfers a file over several connections at once, each connection
+// takes the next range of the file until none is left
+class GT_SVCE_EXPORT GtFTParallel : public QObject, public GtObject
+{
+    Q_OBJECT
+
+public:
+    enum {
+        DefaultConnections = 4,
+        DefaultRangeSize = 4 * 1024 * 1024
+    };
+
+public:
+    explicit GtFTParallel(QObject *parent = 0);
+    GtFTParallel(const QString &fileId,
+                 const QHostAddress &address,
+                 quint16 port,
+                 const QString &session,
+                 QObject *parent = 0);
+    ~GtFTParallel();
+
+public:
+    QString fileId() const;
+    void setFileInfo(const QString &fileId,
+                     const QHostAddress &address,
+                     quint16 port,
+                     const QString &session);
+
+    int connections() const;
+    void setConnections(int count);
+
+    int rangeSize() const;
+    void setRangeSize(int size);
+
+    int error() const;
+
+    // uploads the ranges of source the server doesn't have and
+    // finishes the file, source must be open and not sequential.
+    // Nothing is sent for a file the server has, the blocks of
+    // it in the other files are copied by the server.
+    bool upload(QIODevice *source);
+
+    // downloads the file to target, the ranges a GtFTTemp target
+    // already has are skipped
+    bool download(QIODevice *target);
+
+private:
+    QScopedPointer<GtFTParallelPrivate> d_ptr;
+
+private:
+    Q_DISABLE_COPY(GtFTParallel)
+    Q_DECLARE_PRIVATE(GtFTParallel)
+};
+
+GT_END_NAMESPACE
+
+#endif  /* __GT_FT_PARALLEL_H__ */
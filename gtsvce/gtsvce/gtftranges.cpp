@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#include "gtftranges.h"
+
+GT_BEGIN_NAMESPACE
+
+GtFTRanges::GtFTRanges()
+{
+}
+
+GtFTRanges::~GtFTRanges()
+{
+}
+
+void GtFTRanges::insert(qint64 begin, qint64 end)
+{
+    if (begin >= end)
+        return;
+
+    QMap<qint64, qint64>::iterator it = m_ranges.upperBound(begin);
+
+    // the range before it reaching begin
+    if (it != m_ranges.begin()) {
+        QMap<qint64, qint64>::iterator prev = it;
+
+        --prev;
+        if (prev.value() >= begin) {
+            begin = prev.key();
+            end = MAX(end, prev.value());
+            it = m_ranges.erase(prev);
+        }
+    }
+
+    // the ranges after it up to end
+    while (it != m_ranges.end() && it.key() <= end) {
+        end = MAX(end, it.value());
+        it = m_ranges.erase(it);
+    }
+
+    m_ranges.insert(begin, end);
+}
+
+void GtFTRanges::insert(const GtFTRanges &other)
+{
+    const_iterator it;
+    for (it = other.begin(); it != other.end(); ++it)
+        insert(it.key(), it.value());
+}
+
+qint64 GtFTRanges::complete(qint64 begin) const
+{
+    const_iterator it = m_ranges.upperBound(begin);
+    if (it == m_ranges.constBegin())
+        return begin;
+
+    --it;
+    return MAX(it.value(), begin);
+}
+
+bool GtFTRanges::contains(qint64 begin, qint64 end) const
+{
+    return complete(begin) >= end;
+}
+
+GT_END_NAMESPACE
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#ifndef __GT_FT_RANGES_H__
+#define __GT_FT_RANGES_H__
+
+#include "gtcommon.h"
+#include <QtCore/QMap>
+
+GT_BEGIN_NAMESPACE
+
+// Byte ranges [begin, end) of a file, the ranges overlapping or
+// touching each other are merged, so a lookup is one search of
+// the map and a write adds at most one entry
+class GT_SVCE_EXPORT GtFTRanges
+{
+public:
+    typedef QMap<qint64, qint64>::const_iterator const_iterator;
+
+public:
+    GtFTRanges();
+    ~GtFTRanges();
+
+public:
+    inline int count() const { return m_ranges.size(); }
+    inline bool isEmpty() const { return m_ranges.isEmpty(); }
+    inline void clear() { m_ranges.clear(); }
+
+    // the begin of the range is the key, the end is the value
+    inline const_iterator begin() const { return m_ranges.constBegin(); }
+    inline const_iterator end() const { return m_ranges.constEnd(); }
+
+    void insert(qint64 begin, qint64 end);
+    void insert(const GtFTRanges &other);
+
+    // end of the data from begin, begin if there is none
+    qint64 complete(qint64 begin = 0) const;
+    bool contains(qint64 begin, qint64 end) const;
+
+private:
+    QMap<qint64, qint64> m_ranges;
+};
+
+GT_END_NAMESPACE
+
+#endif  /* __GT_FT_RANGES_H__ */
@@ -2,6 +2,7 @@
  * Copyright (C) 2013 Tom Wong. All rights reserved.
  */
 #include "gtftserver.h"
+#include "gtftchunkcache.h"
 #include "gtftsession.h"
 #include <QtCore/QDebug>
 #include <QtCore/QDir>
@@ -19,11 +20,13 @@ public:
 protected:
     GtFTServer *q_ptr;
     QString tempPath;
+    QScopedPointer<GtFTChunkCache> chunkCache;
 };
 
 GtFTServerPrivate::GtFTServerPrivate(GtFTServer *q)
     : q_ptr(q)
     , tempPath(QDir::tempPath())
+    , chunkCache(new GtFTChunkCache())
 {
 }
 
@@ -53,6 +56,31 @@ QString GtFTServer::tempPath() const
     return d->tempPath;
 }
 
+GtFTChunkCache* GtFTServer::chunkCache() const
+{
+    Q_D(const GtFTServer);
+    return d->chunkCache.data();
+}
+
+bool GtFTServer::link(const QString &fileId)
+{
+    Q_UNUSED(fileId);
+    return false;
+}
+
+bool GtFTServer::readBlock(const QByteArray &hash, QByteArray *data)
+{
+    Q_UNUSED(hash);
+    Q_UNUSED(data);
+    return false;
+}
+
+int GtFTServer::release(const QString &fileId)
+{
+    Q_UNUSED(fileId);
+    return -1;
+}
+
 GtSession* GtFTServer::createSession()
 {
     return new GtFTSession();
@@ -8,6 +8,7 @@
 
 GT_BEGIN_NAMESPACE
 
+class GtFTChunkCache;
 class GtFTSession;
 class GtFTServerPrivate;
 
@@ -23,10 +24,26 @@ public:
     void setTempPath(const QString &path);
     QString tempPath() const;
 
+    // the chunks of the downloads shared by the sessions,
+    // disabled until a capacity is set
+    GtFTChunkCache* chunkCache() const;
+
 public:
     virtual void upload(const QString &fileId, QIODevice *device) = 0;
     virtual QIODevice* download(const QString &fileId) = 0;
 
+    // an upload of a file the server has, adds the reference
+    // of the upload, false to upload the file again
+    virtual bool link(const QString &fileId);
+
+    // the data of a block of the stored files with the SHA-1
+    // hash, the uploads only send the blocks not found
+    virtual bool readBlock(const QByteArray &hash, QByteArray *data);
+
+    // drops a reference of an upload, the file without a reference
+    // may be removed. Returns the references left, -1 if not found.
+    virtual int release(const QString &fileId);
+
 protected:
     GtSession* createSession();
 
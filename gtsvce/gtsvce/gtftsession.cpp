@@ -2,15 +2,15 @@
  * Copyright (C) 2013 Tom Wong. All rights reserved.
  */
 #include "gtftsession.h"
-#include "gtdocument.h"
+#include "gtftchunkcache.h"
 #include "gtftclient.h"
 #include "gtftmessage.pb.h"
 #include "gtftserver.h"
 #include "gtfttemp.h"
 #include "gtsvcutil.h"
 #include <QtCore/QDebug>
+#include <QtCore/QFile>
 #include <QtCore/qendian.h>
-#include <limits>
 
 GT_BEGIN_NAMESPACE
 
@@ -23,8 +23,9 @@ public:
     ~GtFTSessionPrivate();
 
 public:
-    bool finish();
+    bool finish(const QByteArray &merkleRoot = QByteArray());
     void close();
+    int maxDataSize();
 
 public:
     void handleOpenRequest(GtFTOpenRequest &msg);
@@ -32,19 +33,65 @@ public:
     void handleSizeRequest();
     void handleReadRequest(GtFTReadRequest &msg);
     void handleWriteRequest(GtFTWriteRequest &msg);
-    void handleFinishRequest();
+    void handleFinishRequest(GtFTFinishRequest &msg);
+    void handleStreamRequest(GtFTStreamRequest &msg);
+    void handleStreamCredit(GtFTStreamCredit &msg);
+    void handleStreamCancel();
+    void handleUploadRequest(GtFTUploadRequest &msg);
+    void handleUploadData(GtFTUploadData &msg);
+    void handleBlocksRequest(GtFTBlocksRequest &msg);
+    void handleReleaseRequest();
+
+protected:
+    void pumpStream();
+    qint64 readDevice(char *data, qint64 maxlen);
+    GtFTChunkCache* chunkCache();
+    bool sendRaw(int fd, qint64 size);
+    bool sendRaw(const char *data, qint64 size);
+    void endStream(int error);
+    void sendAck(bool sync);
+    int fileHandle() const;
 
 protected:
     GtFTSession *q_ptr;
     GtFTTemp temp;
     QIODevice *device;
+    QString fileId;
     bool opened;
+
+    // the stream being pushed to the client, the credit
+    // is what the client can take before it asks for more
+    bool streaming;
+    qint64 streamPos;
+    qint64 streamEnd;
+    qint64 streamCredit;
+    int streamChunk;
+    bool streamRaw;
+
+    // the writes of an upload are acknowledged every ack size
+    // bytes, an error drops the writes after it
+    qint64 uploadAck;
+    qint64 uploadSize;
+    qint64 uploadUnacked;
+    int uploadError;
+    bool uploadPartial;
 };
 
 GtFTSessionPrivate::GtFTSessionPrivate(GtFTSession *q)
     : q_ptr(q)
     , device(0)
     , opened(false)
+    , streaming(false)
+    , streamPos(0)
+    , streamEnd(0)
+    , streamCredit(0)
+    , streamChunk(0)
+    , streamRaw(false)
+    , uploadAck(0)
+    , uploadSize(0)
+    , uploadUnacked(0)
+    , uploadError(GtFTClient::NoError)
+    , uploadPartial(false)
 {
 }
 
@@ -53,18 +100,23 @@ GtFTSessionPrivate::~GtFTSessionPrivate()
     close();
 }
 
-bool GtFTSessionPrivate::finish()
+bool GtFTSessionPrivate::finish(const QByteArray &merkleRoot)
 {
     if (device != &temp)
         return true;
 
-    qint64 pos = temp.pos();
-    temp.seek(0);
+    return temp.verify(merkleRoot);
+}
+
+int GtFTSessionPrivate::maxDataSize()
+{
+    Q_Q(GtFTSession);
 
-    QString fileId(GtDocument::makeFileId(&temp));
+    qint64 size = GtSvcUtil::maxMessageSize(q->framing());
+    if (q->maxMessageSize() > 0)
+        size = MIN(size, (qint64)q->maxMessageSize());
 
-    temp.seek(pos);
-    return (temp.fileId() == fileId);
+    return size - GtFTClient::MessageOverhead;
 }
 
 void GtFTSessionPrivate::close()
@@ -72,7 +124,9 @@ void GtFTSessionPrivate::close()
     Q_Q(GtFTSession);
 
     if (opened) {
-        if (&temp == device && finish()) {
+        // a session of a parallel upload has only a part of
+        // the file, another session finishes it
+        if (&temp == device && !uploadPartial && finish()) {
             GtFTServer *server = qobject_cast<GtFTServer*>(q->server());
             server->upload(temp.fileId(), device);
         }
@@ -87,6 +141,8 @@ void GtFTSessionPrivate::close()
 
         device = 0;
     }
+
+    fileId.clear();
 }
 
 void GtFTSessionPrivate::handleOpenRequest(GtFTOpenRequest &msg)
@@ -96,6 +152,7 @@ void GtFTSessionPrivate::handleOpenRequest(GtFTOpenRequest &msg)
     QString session = QString::fromUtf8(msg.session().c_str());
     QString fileId = QString::fromUtf8(msg.fileid().c_str());
     GtFTClient::ErrorCode result;
+    bool exists = false;
 
     if (opened) {
         result = GtFTClient::InvalidState;
@@ -115,15 +172,33 @@ void GtFTSessionPrivate::handleOpenRequest(GtFTOpenRequest &msg)
             device = server->download(fileId);
         }
         else {
+            // a file the server has is not uploaded again, the
+            // session reads the stored file
+            if (msg.dedup()) {
+                device = server->download(fileId);
+
+                if (device && server->link(fileId)) {
+                    mode = QIODevice::ReadOnly;
+                    exists = true;
+                }
+                else {
+                    delete device;
+                    device = 0;
+                }
+            }
+
             // upload
-            temp.setPath(server->tempPath(), fileId);
-            device = &temp;
+            if (!device) {
+                temp.setPath(server->tempPath(), fileId);
+                device = &temp;
+            }
         }
 
         if (device) {
             opened = device->open(mode);
 
             if (opened) {
+                this->fileId = fileId;
                 result = GtFTClient::NoError;
             }
             else {
@@ -136,9 +211,25 @@ void GtFTSessionPrivate::handleOpenRequest(GtFTOpenRequest &msg)
         }
     }
 
+    // the messages after the response use the agreed framing,
+    // old clients don't ask and keep the first version
+    int framing = GtSvcUtil::FramingVersion1;
+    if (msg.has_framing())
+        framing = CLAMP(msg.framing(), GtSvcUtil::FramingVersion1, GtSvcUtil::FramingVersion);
+
     GtFTOpenResponse response;
     response.set_error(result);
 
+    if (exists && GtFTClient::NoError == result)
+        response.set_exists(true);
+
+    if (msg.has_framing()) {
+        response.set_framing(framing);
+
+        if (q->maxMessageSize() > 0)
+            response.set_max_message_size(q->maxMessageSize());
+    }
+
     if (GtFTClient::NoError == result) {
         if (&temp == device) {
             for (int i = 0; i < temp.temps_size(); ++i) {
@@ -152,7 +243,9 @@ void GtFTSessionPrivate::handleOpenRequest(GtFTOpenRequest &msg)
         }
     }
 
-    GtSvcUtil::sendMessage(q->socket(), GT_FT_OPEN_RESPONSE, &response);
+    GtSvcUtil::sendMessage(q->socket(), GT_FT_OPEN_RESPONSE,
+                           &response, q->framing());
+    q->setFraming(framing);
 }
 
 void GtFTSessionPrivate::handleSeekRequest(GtFTSeekRequest &msg)
@@ -171,7 +264,8 @@ void GtFTSessionPrivate::handleSeekRequest(GtFTSeekRequest &msg)
         response.set_error(GtFTClient::InvalidState);
     }
 
-    GtSvcUtil::sendMessage(q->socket(), GT_FT_SEEK_RESPONSE, &response);
+    GtSvcUtil::sendMessage(q->socket(), GT_FT_SEEK_RESPONSE,
+                           &response, q->framing());
 }
 
 void GtFTSessionPrivate::handleSizeRequest()
@@ -187,28 +281,31 @@ void GtFTSessionPrivate::handleSizeRequest()
         response.set_size(-1);
     }
 
-    GtSvcUtil::sendMessage(q->socket(), GT_FT_SIZE_RESPONSE, &response);
+    GtSvcUtil::sendMessage(q->socket(), GT_FT_SIZE_RESPONSE,
+                           &response, q->framing());
 }
 
 void GtFTSessionPrivate::handleReadRequest(GtFTReadRequest &msg)
 {
     Q_Q(GtFTSession);
 
-    int size = msg.size();
-    if (size + sizeof(quint16) > std::numeric_limits<quint16>::max()) {
-        qWarning() << "Invalid FT read size:" << size;
-        size = 0;
-    }
-
+    // a bigger read is cut short, the client asks for the rest
+    int size = CLAMP(msg.size(), 0, maxDataSize());
     QByteArray bytes(size, -1);
 
-    if (size > 0)
-        size = device->read(bytes.data(), size);
+    if (size > 0 && opened)
+        size = readDevice(bytes.data(), size);
+    else
+        size = 0;
+
+    if (size < 0)
+        size = 0;
 
     GtFTReadResponse response;
     response.set_data(bytes.constData(), size);
 
-    GtSvcUtil::sendMessage(q->socket(), GT_FT_READ_RESPONSE, &response);
+    GtSvcUtil::sendMessage(q->socket(), GT_FT_READ_RESPONSE,
+                           &response, q->framing());
 }
 
 void GtFTSessionPrivate::handleWriteRequest(GtFTWriteRequest &msg)
@@ -224,17 +321,95 @@ void GtFTSessionPrivate::handleWriteRequest(GtFTWriteRequest &msg)
         response.set_size(-1);
     }
 
-    GtSvcUtil::sendMessage(q->socket(), GT_FT_WRITE_RESPONSE, &response);
+    GtSvcUtil::sendMessage(q->socket(), GT_FT_WRITE_RESPONSE,
+                           &response, q->framing());
 }
 
-void GtFTSessionPrivate::handleFinishRequest()
+void GtFTSessionPrivate::handleBlocksRequest(GtFTBlocksRequest &msg)
+{
+    Q_Q(GtFTSession);
+
+    GtFTBlocksResponse response;
+    qint64 copied = 0;
+    int error = GtFTClient::NoError;
+
+    if (opened && &temp == device) {
+        GtFTServer *server = qobject_cast<GtFTServer*>(q->server());
+        QByteArray data;
+
+        for (int i = 0; i < msg.hashes_size(); ++i) {
+            qint64 pos = (qint64)i * GtFTTemp::BlockSize;
+
+            // the blocks uploaded before are not copied again
+            if (temp.ranges().contains(pos, pos + GtFTTemp::BlockSize))
+                continue;
+
+            QByteArray hash(msg.hashes(i).data(), msg.hashes(i).size());
+            if (!server->readBlock(hash, &data) ||
+                temp.ranges().contains(pos, pos + data.size()))
+            {
+                continue;
+            }
+
+            // the block hashes of the temp are of the data copied,
+            // the finish reads them again for the id
+            if (!temp.seek(pos) || temp.write(data) != data.size()) {
+                error = GtFTClient::InvalidDataSize;
+                break;
+            }
+
+            copied += data.size();
+        }
+
+        for (int i = 0; i < temp.temps_size(); ++i)
+            *response.add_temps() = temp.temps(i);
+    }
+    else {
+        error = GtFTClient::InvalidState;
+    }
+
+    response.set_error(error);
+    response.set_size(copied);
+
+    GtSvcUtil::sendMessage(q->socket(), GT_FT_BLOCKS_RESPONSE,
+                           &response, q->framing());
+}
+
+void GtFTSessionPrivate::handleReleaseRequest()
+{
+    Q_Q(GtFTSession);
+
+    GtFTReleaseResponse response;
+
+    // only a file the server has, not an upload going on
+    if (opened && device != &temp) {
+        GtFTServer *server = qobject_cast<GtFTServer*>(q->server());
+        int refs = server->release(fileId);
+
+        response.set_error(refs < 0 ? GtFTClient::InvalidState :
+                           GtFTClient::NoError);
+        response.set_refs(refs);
+    }
+    else {
+        response.set_error(GtFTClient::InvalidState);
+        response.set_refs(-1);
+    }
+
+    GtSvcUtil::sendMessage(q->socket(), GT_FT_RELEASE_RESPONSE,
+                           &response, q->framing());
+}
+
+void GtFTSessionPrivate::handleFinishRequest(GtFTFinishRequest &msg)
 {
     Q_Q(GtFTSession);
 
     GtFTFinishResponse response;
 
     if (opened) {
-        if (finish())
+        QByteArray merkleRoot(msg.merkle_root().data(),
+                              msg.merkle_root().size());
+
+        if (finish(merkleRoot))
             response.set_error(GtFTClient::NoError);
         else
             response.set_error(GtFTClient::InvalidState);
@@ -243,7 +418,315 @@ void GtFTSessionPrivate::handleFinishRequest()
         response.set_error(GtFTClient::InvalidState);
     }
 
-    GtSvcUtil::sendMessage(q->socket(), GT_FT_FINISH_RESPONSE, &response);
+    GtSvcUtil::sendMessage(q->socket(), GT_FT_FINISH_RESPONSE,
+                           &response, q->framing());
+}
+
+void GtFTSessionPrivate::handleStreamRequest(GtFTStreamRequest &msg)
+{
+    if (!opened || device == &temp) {
+        endStream(GtFTClient::InvalidState);
+        return;
+    }
+
+    if (streaming) {
+        endStream(GtFTClient::InvalidState);
+        return;
+    }
+
+    // nothing could ever be sent without credit
+    if (msg.window() <= 0) {
+        endStream(GtFTClient::InvalidState);
+        return;
+    }
+
+    if (!device->seek(msg.offset())) {
+        endStream(GtFTClient::SeekFailed);
+        return;
+    }
+
+    streamPos = msg.offset();
+    streamEnd = device->size();
+    if (msg.size() >= 0)
+        streamEnd = MIN(streamEnd, streamPos + msg.size());
+
+    streamChunk = CLAMP(msg.chunk_size(), 1, maxDataSize());
+    streamCredit = msg.window();
+    streamRaw = msg.raw() && GtSvcUtil::canSendFile();
+    streaming = true;
+
+    pumpStream();
+}
+
+void GtFTSessionPrivate::handleStreamCredit(GtFTStreamCredit &msg)
+{
+    // credit of a stream already ended
+    if (!streaming)
+        return;
+
+    streamCredit += msg.size();
+    pumpStream();
+}
+
+void GtFTSessionPrivate::handleStreamCancel()
+{
+    // the end is on the way to the client
+    if (!streaming)
+        return;
+
+    endStream(GtFTClient::NoError);
+}
+
+void GtFTSessionPrivate::pumpStream()
+{
+    Q_Q(GtFTSession);
+
+    GT_TRACE_SCOPE("network", "pump stream");
+
+    // raw data goes from the file to the socket without copies
+    // in the session, only for the devices backed by a file. The
+    // sessions share the chunks of the cache instead if enabled.
+    GtFTChunkCache *cache = chunkCache();
+    int fd = (streamRaw && !cache) ? fileHandle() : -1;
+    if (fd != -1) {
+        while (streamPos < streamEnd && streamCredit > 0) {
+            qint64 size = MIN(streamEnd - streamPos, streamCredit);
+
+            size = MIN(size, (qint64)streamChunk);
+            if (!sendRaw(fd, size)) {
+                streaming = false;
+                return;
+            }
+
+            streamPos += size;
+            streamCredit -= size;
+        }
+
+        // the buffer of the device is behind the file
+        device->seek(streamPos);
+
+        if (streamPos >= streamEnd)
+            endStream(GtFTClient::NoError);
+
+        return;
+    }
+
+    QByteArray bytes;
+    GtFTStreamData data;
+
+    while (streamPos < streamEnd && streamCredit > 0) {
+        qint64 size = MIN(streamEnd - streamPos, streamCredit);
+
+        size = MIN(size, (qint64)streamChunk);
+
+        // the chunks of the cache go raw, not copied into messages
+        if (streamRaw && cache) {
+            qint64 offset = 0;
+            QByteArray chunk(cache->chunk(fileId, device, streamPos, &offset));
+
+            if (!chunk.isEmpty()) {
+                size = MIN(size, chunk.size() - offset);
+                if (!sendRaw(chunk.constData() + offset, size)) {
+                    streaming = false;
+                    return;
+                }
+
+                streamPos += size;
+                streamCredit -= size;
+                continue;
+            }
+
+            if (device->pos() != streamPos && !device->seek(streamPos))
+                break;
+        }
+
+        if (bytes.isEmpty())
+            bytes.resize(streamChunk);
+
+        size = readDevice(bytes.data(), size);
+        if (size <= 0)
+            break;
+
+        data.set_offset(streamPos);
+        data.set_data(bytes.constData(), size);
+
+        if (!GtSvcUtil::sendMessage(q->socket(), GT_FT_STREAM_DATA,
+                                    &data, q->framing()))
+        {
+            streaming = false;
+            return;
+        }
+
+        streamPos += size;
+        streamCredit -= size;
+    }
+
+    // the reads after the stream go on from its position
+    if (streamRaw && cache && device->pos() != streamPos)
+        device->seek(streamPos);
+
+    // the end, or no more data in the device
+    if (streamPos >= streamEnd || streamCredit > 0)
+        endStream(GtFTClient::NoError);
+}
+
+qint64 GtFTSessionPrivate::readDevice(char *data, qint64 maxlen)
+{
+    GtFTChunkCache *cache = chunkCache();
+    if (!cache)
+        return device->read(data, maxlen);
+
+    qint64 pos = device->pos();
+    qint64 size = cache->read(fileId, device, pos, data, maxlen);
+
+    // the cache moves the device on a miss
+    device->seek(size > 0 ? pos + size : pos);
+    return size;
+}
+
+GtFTChunkCache* GtFTSessionPrivate::chunkCache()
+{
+    Q_Q(GtFTSession);
+
+    // the uploads change the data of the id
+    if (device == &temp)
+        return 0;
+
+    GtFTServer *server = qobject_cast<GtFTServer*>(q->server());
+    GtFTChunkCache *cache = server->chunkCache();
+
+    if (cache->capacity() > 0)
+        return cache;
+
+    return 0;
+}
+
+void GtFTSessionPrivate::handleUploadRequest(GtFTUploadRequest &msg)
+{
+    uploadAck = MAX(msg.ack_size(), (qint64)1);
+    uploadSize = 0;
+    uploadUnacked = 0;
+    uploadError = GtFTClient::NoError;
+    uploadPartial = msg.partial();
+
+    if (!opened || device != &temp) {
+        uploadError = GtFTClient::InvalidState;
+        sendAck(false);
+    }
+}
+
+void GtFTSessionPrivate::handleUploadData(GtFTUploadData &msg)
+{
+    GT_TRACE_SCOPE("network", "upload data");
+
+    if (msg.data().size() > 0 && GtFTClient::NoError == uploadError) {
+        if (!opened || device != &temp) {
+            uploadError = GtFTClient::InvalidState;
+        }
+        else if (temp.pos() != msg.offset() && !temp.seek(msg.offset())) {
+            uploadError = GtFTClient::SeekFailed;
+        }
+        else {
+            qint64 size = msg.data().size();
+            qint64 len = temp.write(msg.data().data(), size);
+
+            if (len > 0) {
+                uploadSize += len;
+                uploadUnacked += len;
+            }
+
+            if (len != size)
+                uploadError = GtFTClient::InvalidDataSize;
+        }
+
+        if (uploadError != GtFTClient::NoError) {
+            sendAck(false);
+            return;
+        }
+    }
+
+    // the writes asked about are on the disk for the other sessions
+    if (msg.ack() && GtFTClient::NoError == uploadError &&
+        opened && device == &temp && !temp.checkpoint())
+    {
+        uploadError = GtFTClient::InvalidDataSize;
+    }
+
+    if (msg.ack() || uploadUnacked >= uploadAck)
+        sendAck(msg.ack());
+}
+
+void GtFTSessionPrivate::sendAck(bool sync)
+{
+    Q_Q(GtFTSession);
+
+    GtFTUploadAck ack;
+    ack.set_error(uploadError);
+    ack.set_size(uploadSize);
+    ack.set_sync(sync);
+
+    uploadUnacked = 0;
+    GtSvcUtil::sendMessage(q->socket(), GT_FT_UPLOAD_ACK,
+                           &ack, q->framing());
+}
+
+bool GtFTSessionPrivate::sendRaw(int fd, qint64 size)
+{
+    Q_Q(GtFTSession);
+
+    GtFTStreamRaw raw;
+    raw.set_offset(streamPos);
+    raw.set_size(size);
+
+    QByteArray header(GtSvcUtil::packMessage(GT_FT_STREAM_RAW,
+                                             &raw, q->framing()));
+    if (header.isEmpty())
+        return false;
+
+    return GtSvcUtil::sendFile(q->socket(), header, fd, streamPos, size);
+}
+
+bool GtFTSessionPrivate::sendRaw(const char *data, qint64 size)
+{
+    Q_Q(GtFTSession);
+
+    GtFTStreamRaw raw;
+    raw.set_offset(streamPos);
+    raw.set_size(size);
+
+    QByteArray header(GtSvcUtil::packMessage(GT_FT_STREAM_RAW,
+                                             &raw, q->framing()));
+    if (header.isEmpty())
+        return false;
+
+    return (GtSvcUtil::syncWrite(q->socket(), header.constData(), header.size()) &&
+            GtSvcUtil::syncWrite(q->socket(), data, size));
+}
+
+int GtFTSessionPrivate::fileHandle() const
+{
+    GtFTTemp *temp = qobject_cast<GtFTTemp*>(device);
+    if (temp)
+        return temp->handle();
+
+    QFile *file = qobject_cast<QFile*>(device);
+    if (file)
+        return file->handle();
+
+    return -1;
+}
+
+void GtFTSessionPrivate::endStream(int error)
+{
+    Q_Q(GtFTSession);
+
+    GtFTStreamEnd end;
+    end.set_error(error);
+    end.set_offset(streamPos);
+
+    streaming = false;
+    GtSvcUtil::sendMessage(q->socket(), GT_FT_STREAM_END,
+                           &end, q->framing());
 }
 
 GtFTSession::GtFTSession(QObject *parent)
@@ -328,11 +811,92 @@ void GtFTSession::message(const char *data, int size)
         break;
 
     case GT_FT_FINISH_REQUEST:
+        {
+            GtFTFinishRequest msg;
+            if (msg.ParseFromArray(data, size)) {
+                d->handleFinishRequest(msg);
+            }
+            else {
+                qWarning() << "Invalid FT finish request";
+            }
+        }
+        break;
+
+    case GT_FT_STREAM_REQUEST:
+        {
+            GtFTStreamRequest msg;
+            if (msg.ParseFromArray(data, size)) {
+                d->handleStreamRequest(msg);
+            }
+            else {
+                qWarning() << "Invalid FT stream request";
+            }
+        }
+        break;
+
+    case GT_FT_STREAM_CREDIT:
+        {
+            GtFTStreamCredit msg;
+            if (msg.ParseFromArray(data, size)) {
+                d->handleStreamCredit(msg);
+            }
+            else {
+                qWarning() << "Invalid FT stream credit";
+            }
+        }
+        break;
+
+    case GT_FT_STREAM_CANCEL:
+        if (0 == size) {
+            d->handleStreamCancel();
+        }
+        else {
+            qWarning() << "Invalid FT stream cancel";
+        }
+        break;
+
+    case GT_FT_UPLOAD_REQUEST:
+        {
+            GtFTUploadRequest msg;
+            if (msg.ParseFromArray(data, size)) {
+                d->handleUploadRequest(msg);
+            }
+            else {
+                qWarning() << "Invalid FT upload request";
+            }
+        }
+        break;
+
+    case GT_FT_UPLOAD_DATA:
+        {
+            GtFTUploadData msg;
+            if (msg.ParseFromArray(data, size)) {
+                d->handleUploadData(msg);
+            }
+            else {
+                qWarning() << "Invalid FT upload data";
+            }
+        }
+        break;
+
+    case GT_FT_BLOCKS_REQUEST:
+        {
+            GtFTBlocksRequest msg;
+            if (msg.ParseFromArray(data, size)) {
+                d->handleBlocksRequest(msg);
+            }
+            else {
+                qWarning() << "Invalid FT blocks request";
+            }
+        }
+        break;
+
+    case GT_FT_RELEASE_REQUEST:
         if (0 == size) {
-            d->handleFinishRequest();
+            d->handleReleaseRequest();
         }
         else {
-            qWarning() << "Invalid FT finish request";
+            qWarning() << "Invalid FT release request";
         }
         break;
 
@@ -0,0 +1,826 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#include "gtftstorage.h"
+#include "gtftmessage.pb.h"
+#include "gtfttemp.h"
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QDirIterator>
+#include <QtCore/QFileInfo>
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <QtCore/QPair>
+#include <QtCore/QSaveFile>
+
+GT_BEGIN_NAMESPACE
+
+// reads of a stored file come from the mapping, the file handle
+// is still there for sending the file to a socket
+class GtFTStorageFile : public QFile
+{
+public:
+    explicit GtFTStorageFile(const QString &name)
+        : QFile(name)
+        , map(0)
+    {
+    }
+
+    ~GtFTStorageFile()
+    {
+        close();
+    }
+
+public:
+    bool open(OpenMode mode)
+    {
+        if (!QFile::open(mode | QIODevice::Unbuffered))
+            return false;
+
+        // an empty file can't be mapped, read it as usual
+        if ((mode & QIODevice::ReadOnly) && QFile::size() > 0) {
+            map = QFile::map(0, QFile::size());
+            if (0 == map)
+                qWarning() << "map storage file failed:" << fileName();
+        }
+
+        return true;
+    }
+
+    void close()
+    {
+        if (map) {
+            unmap(map);
+            map = 0;
+        }
+
+        QFile::close();
+    }
+
+protected:
+    qint64 readData(char *data, qint64 maxlen)
+    {
+        if (0 == map)
+            return QFile::readData(data, maxlen);
+
+        qint64 p = pos();
+        qint64 length = MIN(maxlen, QFile::size() - p);
+        if (length <= 0)
+            return 0;
+
+        memcpy(data, map + p, length);
+        return length;
+    }
+
+private:
+    uchar *map;
+};
+
+// a block of a stored file, the id and the index
+typedef QPair<QString, qint64> GtFTStorageBlock;
+
+class GtFTStorageItem
+{
+public:
+    GtFTStorageItem()
+        : size(0)
+        , refs(0)
+        , access(0)
+    {
+    }
+
+public:
+    qint64 size;
+    int refs;
+    qint64 access;
+    QList<QByteArray> blocks;
+};
+
+class GtFTStoragePrivate
+{
+    Q_DECLARE_PUBLIC(GtFTStorage)
+
+public:
+    explicit GtFTStoragePrivate(GtFTStorage *q);
+    ~GtFTStoragePrivate();
+
+public:
+    bool loadIndex();
+    bool saveIndex();
+    bool appendIndex(const QString &fileId, int refs);
+    void scan();
+
+    QString blocksPath(const QString &fileId) const;
+    void loadBlocks(const QString &fileId, GtFTStorageItem *item);
+    bool saveBlocks(const QString &fileId, const QList<QByteArray> &blocks);
+    void insertBlocks(const QString &fileId, const QList<QByteArray> &blocks);
+
+    QString stagingPath(const QString &fileId);
+    bool copy(QIODevice *device, const QString &fileName);
+    bool reserve(qint64 size);
+    bool commit(const QString &fileId,
+                const QString &staging,
+                qint64 size,
+                const QList<QByteArray> &blocks);
+    void remove(const QString &fileId);
+
+protected:
+    enum {
+        // the least records appended before the index is written again
+        MinJournal = 64
+    };
+
+protected:
+    GtFTStorage *q_ptr;
+    QString path;
+    QString indexPath;
+    QString stagingDir;
+    qint64 capacity;
+    qint64 usedSize;
+
+    // the size of the files being moved to the storage
+    qint64 reservedSize;
+    int stagingCount;
+    bool opened;
+
+    // the entries appended since the index was written, it is
+    // written again once they are as many as the files
+    int journalCount;
+
+    QHash<QString, GtFTStorageItem> items;
+
+    // the blocks of the files by the SHA-1 of the data, the
+    // uploads copy them instead of sending them again
+    QMultiHash<QByteArray, GtFTStorageBlock> blocks;
+    mutable QMutex mutex;
+};
+
+GtFTStoragePrivate::GtFTStoragePrivate(GtFTStorage *q)
+    : q_ptr(q)
+    , capacity(0)
+    , usedSize(0)
+    , reservedSize(0)
+    , stagingCount(0)
+    , opened(false)
+    , journalCount(0)
+{
+}
+
+GtFTStoragePrivate::~GtFTStoragePrivate()
+{
+}
+
+bool GtFTStoragePrivate::loadIndex()
+{
+    QFile file(indexPath);
+    if (!file.exists())
+        return true;
+
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QByteArray data = file.readAll();
+    GtFTStorageIndex index;
+
+    if (!index.ParseFromArray(data.constData(), data.size()))
+        return false;
+
+    // the appended entries parse as one message, in order
+    journalCount = index.entries_size();
+
+    for (int i = 0; i < index.entries_size(); ++i) {
+        const GtFTStorageEntry &p = index.entries(i);
+        QString fileId(QString::fromUtf8(p.file_id().c_str()));
+
+        // the file removed outside of the storage
+        QHash<QString, GtFTStorageItem>::iterator it = items.find(fileId);
+        if (it != items.end())
+            it->refs = p.refs();
+    }
+
+    return true;
+}
+
+bool GtFTStoragePrivate::saveIndex()
+{
+    GtFTStorageIndex index;
+
+    QHash<QString, GtFTStorageItem>::const_iterator it;
+    for (it = items.begin(); it != items.end(); ++it) {
+        if (it->refs > 0) {
+            GtFTStorageEntry *p = index.add_entries();
+            p->set_file_id(it.key().toUtf8());
+            p->set_refs(it->refs);
+        }
+    }
+
+    int size = index.ByteSize();
+
+    QByteArray bytes(size, -1);
+    char *data = bytes.data();
+
+    if (!index.SerializeToArray(data, size))
+        return false;
+
+    // the old index is kept until the new one is written
+    QSaveFile file(indexPath);
+
+    if (!file.open(QIODevice::WriteOnly) ||
+        file.write(data, size) != size ||
+        !file.commit())
+    {
+        qWarning() << "save storage index failed:" << indexPath;
+        return false;
+    }
+
+    journalCount = 0;
+    return true;
+}
+
+bool GtFTStoragePrivate::appendIndex(const QString &fileId, int refs)
+{
+    if (journalCount >= MAX((int)MinJournal, items.size()))
+        return saveIndex();
+
+    GtFTStorageIndex index;
+    GtFTStorageEntry *p = index.add_entries();
+    p->set_file_id(fileId.toUtf8());
+    p->set_refs(refs);
+
+    int size = index.ByteSize();
+
+    QByteArray bytes(size, -1);
+    char *data = bytes.data();
+
+    if (!index.SerializeToArray(data, size))
+        return false;
+
+    QFile file(indexPath);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append) ||
+        file.write(data, size) != size ||
+        !file.flush())
+    {
+        qWarning() << "append storage index failed:" << indexPath;
+        return false;
+    }
+
+    journalCount += 1;
+    return true;
+}
+
+void GtFTStoragePrivate::scan()
+{
+    Q_Q(GtFTStorage);
+
+    QDirIterator it(path, QDir::Files, QDirIterator::Subdirectories);
+
+    while (it.hasNext()) {
+        it.next();
+
+        QFileInfo info(it.fileInfo());
+        QString fileId(info.fileName());
+
+        if (!GtFTStorage::isValidId(fileId) ||
+            QDir::cleanPath(info.absoluteFilePath()) != q->filePath(fileId))
+        {
+            continue;
+        }
+
+        GtFTStorageItem item;
+        item.size = info.size();
+        item.access = info.lastModified().toMSecsSinceEpoch();
+        loadBlocks(fileId, &item);
+        insertBlocks(fileId, item.blocks);
+        items.insert(fileId, item);
+        usedSize += item.size;
+    }
+}
+
+QString GtFTStoragePrivate::blocksPath(const QString &fileId) const
+{
+    Q_Q(const GtFTStorage);
+    return q->filePath(fileId) + ".blocks";
+}
+
+void GtFTStoragePrivate::loadBlocks(const QString &fileId, GtFTStorageItem *item)
+{
+    QFile file(blocksPath(fileId));
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    // the hashes one after another, the file without it
+    // or of another size has its blocks ignored
+    const int hashSize = 20;
+    QByteArray data = file.readAll();
+    qint64 count = (item->size + GtFTTemp::BlockSize - 1) / GtFTTemp::BlockSize;
+
+    if (data.size() != count * hashSize) {
+        qWarning() << "invalid storage blocks:" << fileId;
+        return;
+    }
+
+    for (int i = 0; i < data.size(); i += hashSize)
+        item->blocks.append(data.mid(i, hashSize));
+}
+
+bool GtFTStoragePrivate::saveBlocks(const QString &fileId,
+                                    const QList<QByteArray> &blocks)
+{
+    QSaveFile file(blocksPath(fileId));
+
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    foreach (const QByteArray &hash, blocks) {
+        if (file.write(hash) != hash.size())
+            return false;
+    }
+
+    return file.commit();
+}
+
+void GtFTStoragePrivate::insertBlocks(const QString &fileId,
+                                      const QList<QByteArray> &blocks)
+{
+    for (int i = 0; i < blocks.size(); ++i)
+        this->blocks.insert(blocks[i], GtFTStorageBlock(fileId, i));
+}
+
+QString GtFTStoragePrivate::stagingPath(const QString &fileId)
+{
+    QMutexLocker locker(&mutex);
+
+    QString name(QString("%1.%2").arg(fileId).arg(stagingCount++));
+    return QDir(stagingDir).filePath(name);
+}
+
+bool GtFTStoragePrivate::copy(QIODevice *device, const QString &fileName)
+{
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    if (!device->isSequential() && !device->seek(0))
+        return false;
+
+    char buffer[64 * 1024];
+    qint64 length;
+
+    while ((length = device->read(buffer, sizeof(buffer))) > 0) {
+        if (file.write(buffer, length) != length)
+            return false;
+    }
+
+    return (length == 0 && file.flush());
+}
+
+bool GtFTStoragePrivate::reserve(qint64 size)
+{
+    if (capacity <= 0 || usedSize + reservedSize + size <= capacity) {
+        reservedSize += size;
+        return true;
+    }
+
+    // the files without a reference used the longest time ago
+    QMultiMap<qint64, QString> unused;
+
+    QHash<QString, GtFTStorageItem>::const_iterator it;
+    for (it = items.begin(); it != items.end(); ++it) {
+        if (0 == it->refs)
+            unused.insert(it->access, it.key());
+    }
+
+    QMultiMap<qint64, QString>::const_iterator uit = unused.begin();
+    while (usedSize + reservedSize + size > capacity && uit != unused.end()) {
+        remove(uit.value());
+        ++uit;
+    }
+
+    if (usedSize + reservedSize + size > capacity) {
+        qWarning() << "storage capacity exceeded:" << size << capacity;
+        return false;
+    }
+
+    reservedSize += size;
+    return true;
+}
+
+bool GtFTStoragePrivate::commit(const QString &fileId,
+                                const QString &staging,
+                                qint64 size,
+                                const QList<QByteArray> &blocks)
+{
+    Q_Q(GtFTStorage);
+
+    QHash<QString, GtFTStorageItem>::iterator it = items.find(fileId);
+
+    // stored by another session at the same time
+    if (it != items.end()) {
+        QFile::remove(staging);
+        it->refs += 1;
+        it->access = QDateTime::currentMSecsSinceEpoch();
+        return appendIndex(fileId, it->refs);
+    }
+
+    // the file appears only once the data is all there
+    QString fileName(q->filePath(fileId));
+
+    if (!QDir().mkpath(QFileInfo(fileName).path()) ||
+        !QFile::rename(staging, fileName))
+    {
+        qWarning() << "move storage file failed:" << fileName;
+        QFile::remove(staging);
+        return false;
+    }
+
+    GtFTStorageItem item;
+    item.size = size;
+    item.refs = 1;
+    item.access = QDateTime::currentMSecsSinceEpoch();
+
+    // a file without the blocks is only not deduplicated
+    if (saveBlocks(fileId, blocks)) {
+        item.blocks = blocks;
+        insertBlocks(fileId, blocks);
+    }
+    else {
+        qWarning() << "save storage blocks failed:" << fileId;
+    }
+
+    items.insert(fileId, item);
+    usedSize += size;
+
+    return appendIndex(fileId, item.refs);
+}
+
+void GtFTStoragePrivate::remove(const QString &fileId)
+{
+    Q_Q(GtFTStorage);
+
+    QHash<QString, GtFTStorageItem>::iterator it = items.find(fileId);
+    if (it == items.end())
+        return;
+
+    // the sessions reading the file keep the data until closed
+    if (!QFile::remove(q->filePath(fileId)))
+        qWarning() << "remove storage file failed:" << fileId;
+
+    QFile::remove(blocksPath(fileId));
+
+    for (int i = 0; i < it->blocks.size(); ++i)
+        blocks.remove(it->blocks[i], GtFTStorageBlock(fileId, i));
+
+    usedSize -= it->size;
+    items.erase(it);
+}
+
+GtFTStorage::GtFTStorage(QObject *parent)
+    : QObject(parent)
+    , d_ptr(new GtFTStoragePrivate(this))
+{
+}
+
+GtFTStorage::~GtFTStorage()
+{
+}
+
+bool GtFTStorage::open(const QString &path)
+{
+    Q_D(GtFTStorage);
+
+    close();
+
+    QMutexLocker locker(&d->mutex);
+
+    QDir dir(path);
+    if (!dir.mkpath(".")) {
+        qWarning() << "create storage failed:" << path;
+        return false;
+    }
+
+    d->path = QDir::cleanPath(dir.absolutePath());
+    d->indexPath = dir.filePath("index");
+    d->stagingDir = dir.filePath(".staging");
+
+    // the files not moved before the last exit
+    QDir staging(d->stagingDir);
+    if (staging.exists() && !staging.removeRecursively())
+        qWarning() << "clean storage staging failed:" << d->stagingDir;
+
+    if (!dir.mkpath(".staging")) {
+        qWarning() << "create storage staging failed:" << d->stagingDir;
+        return false;
+    }
+
+    d->scan();
+
+    if (!d->loadIndex())
+        qWarning() << "invalid storage index:" << d->indexPath;
+
+    d->opened = true;
+    return true;
+}
+
+void GtFTStorage::close()
+{
+    Q_D(GtFTStorage);
+
+    QMutexLocker locker(&d->mutex);
+
+    d->items.clear();
+    d->blocks.clear();
+    d->usedSize = 0;
+    d->reservedSize = 0;
+    d->journalCount = 0;
+    d->opened = false;
+}
+
+bool GtFTStorage::isOpen() const
+{
+    Q_D(const GtFTStorage);
+    QMutexLocker locker(&d->mutex);
+    return d->opened;
+}
+
+QString GtFTStorage::path() const
+{
+    Q_D(const GtFTStorage);
+    QMutexLocker locker(&d->mutex);
+    return d->path;
+}
+
+qint64 GtFTStorage::capacity() const
+{
+    Q_D(const GtFTStorage);
+    QMutexLocker locker(&d->mutex);
+    return d->capacity;
+}
+
+void GtFTStorage::setCapacity(qint64 size)
+{
+    Q_D(GtFTStorage);
+    QMutexLocker locker(&d->mutex);
+    d->capacity = MAX(size, (qint64)0);
+}
+
+qint64 GtFTStorage::usedSize() const
+{
+    Q_D(const GtFTStorage);
+    QMutexLocker locker(&d->mutex);
+    return d->usedSize;
+}
+
+int GtFTStorage::count() const
+{
+    Q_D(const GtFTStorage);
+    QMutexLocker locker(&d->mutex);
+    return d->items.size();
+}
+
+QString GtFTStorage::filePath(const QString &fileId) const
+{
+    Q_D(const GtFTStorage);
+
+    // the first two levels of the id spread the files
+    return QString("%1/%2/%3/%4").arg(d->path)
+        .arg(fileId.left(2)).arg(fileId.mid(2, 2)).arg(fileId);
+}
+
+bool GtFTStorage::contains(const QString &fileId) const
+{
+    Q_D(const GtFTStorage);
+    QMutexLocker locker(&d->mutex);
+    return d->items.contains(fileId);
+}
+
+qint64 GtFTStorage::size(const QString &fileId) const
+{
+    Q_D(const GtFTStorage);
+    QMutexLocker locker(&d->mutex);
+
+    QHash<QString, GtFTStorageItem>::const_iterator it = d->items.find(fileId);
+    if (it == d->items.end())
+        return -1;
+
+    return it->size;
+}
+
+bool GtFTStorage::store(const QString &fileId, QIODevice *device)
+{
+    Q_D(GtFTStorage);
+
+    if (!isValidId(fileId)) {
+        qWarning() << "invalid storage file id:" << fileId;
+        return false;
+    }
+
+    GtFTTemp *temp = qobject_cast<GtFTTemp*>(device);
+    qint64 size = device->size();
+
+    {
+        QMutexLocker locker(&d->mutex);
+
+        if (!d->opened)
+            return false;
+
+        // the same id is the same data
+        QHash<QString, GtFTStorageItem>::iterator it = d->items.find(fileId);
+        if (it != d->items.end()) {
+            it->refs += 1;
+            it->access = QDateTime::currentMSecsSinceEpoch();
+
+            bool saved = d->appendIndex(fileId, it->refs);
+            locker.unlock();
+
+            if (temp) {
+                temp->close();
+                temp->remove();
+            }
+
+            return saved;
+        }
+
+        if (!d->reserve(size))
+            return false;
+    }
+
+    QString staging(d->stagingPath(fileId));
+    QList<QByteArray> blocks;
+    bool moved;
+
+    if (temp) {
+        // the ranges are of no use once the data is moved
+        blocks = temp->blockHashes();
+        temp->close();
+        moved = QFile::rename(temp->dataPath(), staging);
+
+        if (moved)
+            QFile::remove(temp->metaPath());
+    }
+    else {
+        blocks = GtFTTemp::blockHashes(device);
+        moved = d->copy(device, staging);
+    }
+
+    QMutexLocker locker(&d->mutex);
+
+    d->reservedSize -= size;
+
+    if (!moved) {
+        qWarning() << "move file to storage failed:" << fileId;
+        QFile::remove(staging);
+        return false;
+    }
+
+    return d->commit(fileId, staging, QFileInfo(staging).size(), blocks);
+}
+
+QIODevice* GtFTStorage::openFile(const QString &fileId)
+{
+    Q_D(GtFTStorage);
+
+    QMutexLocker locker(&d->mutex);
+
+    QHash<QString, GtFTStorageItem>::iterator it = d->items.find(fileId);
+    if (it == d->items.end())
+        return 0;
+
+    it->access = QDateTime::currentMSecsSinceEpoch();
+    return new GtFTStorageFile(filePath(fileId));
+}
+
+bool GtFTStorage::readBlock(const QByteArray &hash, QByteArray *data)
+{
+    Q_D(GtFTStorage);
+
+    QString fileName;
+    qint64 pos = 0;
+    qint64 size = 0;
+
+    {
+        QMutexLocker locker(&d->mutex);
+
+        QHash<QByteArray, GtFTStorageBlock>::const_iterator it = d->blocks.find(hash);
+        if (it == d->blocks.end())
+            return false;
+
+        qint64 fileSize = d->items.value(it->first).size;
+
+        pos = it->second * GtFTTemp::BlockSize;
+        size = MIN(fileSize - pos, (qint64)GtFTTemp::BlockSize);
+        fileName = filePath(it->first);
+    }
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly) || !file.seek(pos))
+        return false;
+
+    *data = file.read(size);
+
+    // the file changed on the disk
+    if (data->size() != size ||
+        QCryptographicHash::hash(*data, QCryptographicHash::Sha1) != hash)
+    {
+        qWarning() << "invalid storage block:" << fileName << pos;
+        data->clear();
+        return false;
+    }
+
+    return true;
+}
+
+int GtFTStorage::ref(const QString &fileId)
+{
+    Q_D(GtFTStorage);
+
+    QMutexLocker locker(&d->mutex);
+
+    QHash<QString, GtFTStorageItem>::iterator it = d->items.find(fileId);
+    if (it == d->items.end())
+        return -1;
+
+    int refs = ++it->refs;
+    d->appendIndex(fileId, refs);
+    return refs;
+}
+
+int GtFTStorage::unref(const QString &fileId)
+{
+    Q_D(GtFTStorage);
+
+    QMutexLocker locker(&d->mutex);
+
+    QHash<QString, GtFTStorageItem>::iterator it = d->items.find(fileId);
+    if (it == d->items.end())
+        return -1;
+
+    // removed by the collection or for the space
+    if (it->refs > 0) {
+        it->refs -= 1;
+        d->appendIndex(fileId, it->refs);
+    }
+
+    return it->refs;
+}
+
+int GtFTStorage::refCount(const QString &fileId) const
+{
+    Q_D(const GtFTStorage);
+
+    QMutexLocker locker(&d->mutex);
+
+    QHash<QString, GtFTStorageItem>::const_iterator it = d->items.find(fileId);
+    if (it == d->items.end())
+        return -1;
+
+    return it->refs;
+}
+
+qint64 GtFTStorage::collect()
+{
+    Q_D(GtFTStorage);
+
+    QMutexLocker locker(&d->mutex);
+
+    QStringList unused;
+
+    QHash<QString, GtFTStorageItem>::const_iterator it;
+    for (it = d->items.begin(); it != d->items.end(); ++it) {
+        if (0 == it->refs)
+            unused.append(it.key());
+    }
+
+    qint64 size = d->usedSize;
+
+    foreach (const QString &fileId, unused)
+        d->remove(fileId);
+
+    // the journal is folded into the index between the uploads
+    if (d->opened && d->journalCount > 0)
+        d->saveIndex();
+
+    return size - d->usedSize;
+}
+
+bool GtFTStorage::isValidId(const QString &fileId)
+{
+    // the hex of the hash from GtDocument::makeFileId
+    if (fileId.size() < 4)
+        return false;
+
+    for (int i = 0; i < fileId.size(); ++i) {
+        QChar c(fileId.at(i));
+
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+            return false;
+    }
+
+    return true;
+}
+
+GT_END_NAMESPACE
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#ifndef __GT_FT_STORAGE_H__
+#define __GT_FT_STORAGE_H__
+
+#include "gtobject.h"
+#include <QtCore/QObject>
+
+class QIODevice;
+
+GT_BEGIN_NAMESPACE
+
+class GtFTStoragePrivate;
+
+// Files kept on the local disk by their id, the SHA-1 of the
+// data. The files are under directories of the first characters
+// of the id, the files without a reference are removed by the
+// collection or when more space is needed for a new file.
+class GT_SVCE_EXPORT GtFTStorage : public QObject, public GtObject
+{
+    Q_OBJECT
+
+public:
+    explicit GtFTStorage(QObject *parent = 0);
+    ~GtFTStorage();
+
+public:
+    // loads the files and the references under path
+    bool open(const QString &path);
+    void close();
+    bool isOpen() const;
+    QString path() const;
+
+    // the total size of the files, 0 for no limit
+    qint64 capacity() const;
+    void setCapacity(qint64 size);
+    qint64 usedSize() const;
+
+    int count() const;
+    QString filePath(const QString &fileId) const;
+    bool contains(const QString &fileId) const;
+    qint64 size(const QString &fileId) const;
+
+    // moves the data of device to the file of the id, a GtFTTemp is
+    // closed and renamed, others are copied. The stored file has a
+    // reference for the upload.
+    bool store(const QString &fileId, QIODevice *device);
+
+    // the file mapped to the memory, 0 if not stored
+    QIODevice* openFile(const QString &fileId);
+
+    // the data of a block of the stored files with the hash,
+    // the blocks are of the size of GtFTTemp::BlockSize
+    bool readBlock(const QByteArray &hash, QByteArray *data);
+
+    int ref(const QString &fileId);
+    int unref(const QString &fileId);
+    int refCount(const QString &fileId) const;
+
+    static bool isValidId(const QString &fileId);
+
+public Q_SLOTS:
+    // removes the files without a reference, returns the bytes freed
+    qint64 collect();
+
+private:
+    QScopedPointer<GtFTStoragePrivate> d_ptr;
+
+private:
+    Q_DISABLE_COPY(GtFTStorage)
+    Q_DECLARE_PRIVATE(GtFTStorage)
+};
+
+GT_END_NAMESPACE
+
+#endif  /* __GT_FT_STORAGE_H__ */
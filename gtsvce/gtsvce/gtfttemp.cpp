@@ -3,11 +3,36 @@
  */
 #include "gtfttemp.h"
 #include "gtftmessage.pb.h"
+#include <QtCore/QCryptographicHash>
 #include <QtCore/QDebug>
 #include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QVector>
 
 GT_BEGIN_NAMESPACE
 
+// the sessions of a parallel upload share the meta file
+static QMutex metaMutex;
+
+typedef QMap<qint64, QByteArray> GtFTTempBlocks;
+
+// a block being written in order from its begin
+class GtFTTempBlockHash
+{
+public:
+    GtFTTempBlockHash(qint64 next)
+        : hash(QCryptographicHash::Sha1)
+        , next(next)
+    {
+    }
+
+public:
+    QCryptographicHash hash;
+    qint64 next;
+};
+
 class GtFTTempPrivate
 {
     Q_DECLARE_PUBLIC(GtFTTemp)
@@ -17,7 +42,28 @@ public:
     ~GtFTTempPrivate();
 
 public:
+    bool loadMeta(GtFTRanges *ranges, GtFTTempBlocks *blocks);
+    bool writeMeta(const GtFTRanges &ranges,
+                   const GtFTTempBlocks &blocks,
+                   bool append);
     bool saveMeta();
+    bool checkpoint();
+
+    void hashWrite(qint64 pos, const char *data, qint64 size);
+    void hashBlock(qint64 index, qint64 pos, const char *data, qint64 size);
+    bool hashData(qint64 size);
+    bool hashFile(QCryptographicHash *hash, qint64 begin, qint64 end);
+    QByteArray blockHash(qint64 index, qint64 size);
+    void resetHash();
+    QByteArray leaf(qint64 index, qint64 size);
+    bool knownLeaves(qint64 size, QList<QByteArray> *leaves);
+    QList<QByteArray> leaves(qint64 size);
+
+protected:
+    enum {
+        // records appended before the meta is written again
+        MaxJournal = 64
+    };
 
 protected:
     GtFTTemp *q_ptr;
@@ -26,37 +72,413 @@ protected:
     QString dataPath;
     QFile metaFile;
     QFile dataFile;
-    GtFTTempMeta tempMeta;
-    QList<GtFTTempData*> tempDatas;
+    GtFTRanges ranges;
+
+    // the ranges written since the last checkpoint, they are
+    // appended to the meta after the size or the interval
+    GtFTRanges pending;
+    qint64 pendingBytes;
+    qint64 checkpointSize;
+    int checkpointInterval;
+    int journalCount;
+    QElapsedTimer checkpointTimer;
+
+    mutable QVector<GtFTTempData> temps;
+    mutable bool tempsDirty;
+
+    // SHA-1 of the data written in order from the begin, it is
+    // the file id without reading the file again
+    QCryptographicHash fileHash;
+    qint64 hashPos;
+    bool verified;
+
+    // SHA-1 of the whole blocks for the merkle root, saved with
+    // the ranges, the blocks written in order are hashed on the way
+    GtFTTempBlocks blocks;
+    GtFTTempBlocks pendingBlocks;
+    QHash<qint64, GtFTTempBlockHash*> blockHashes;
 };
 
 GtFTTempPrivate::GtFTTempPrivate(GtFTTemp *q)
     : q_ptr(q)
+    , pendingBytes(0)
+    , checkpointSize(GtFTTemp::DefaultCheckpointSize)
+    , checkpointInterval(GtFTTemp::DefaultCheckpointInterval)
+    , journalCount(0)
+    , tempsDirty(true)
+    , fileHash(QCryptographicHash::Sha1)
+    , hashPos(0)
+    , verified(false)
 {
 }
 
 GtFTTempPrivate::~GtFTTempPrivate()
 {
+    qDeleteAll(blockHashes);
 }
 
-bool GtFTTempPrivate::saveMeta()
+bool GtFTTempPrivate::loadMeta(GtFTRanges *ranges, GtFTTempBlocks *blocks)
+{
+    if (!metaFile.seek(0))
+        return false;
+
+    QByteArray data = metaFile.readAll();
+    if (data.isEmpty())
+        return true;
+
+    // the records appended to a protobuf message parse as one
+    // message, the ranges of all of them are in the datas
+    GtFTTempMeta meta;
+
+    if (!meta.ParseFromArray(data.constData(), data.size()) ||
+        QString::fromUtf8(meta.file_id().c_str()) != fileId)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < meta.datas_size(); ++i) {
+        const GtFTTempData &p = meta.datas(i);
+        ranges->insert(p.offset(), p.offset() + p.size());
+    }
+
+    // a block hashed again is in a later record
+    for (int i = 0; i < meta.blocks_size(); ++i) {
+        const GtFTTempBlock &p = meta.blocks(i);
+        blocks->insert(p.index(), QByteArray(p.hash().data(), p.hash().size()));
+    }
+
+    return true;
+}
+
+bool GtFTTempPrivate::writeMeta(const GtFTRanges &ranges,
+                                const GtFTTempBlocks &blocks,
+                                bool append)
 {
-    tempMeta.clear_datas();
-    foreach(GtFTTempData *p, tempDatas) {
-        *tempMeta.add_datas() = *p;
+    GtFTTempMeta meta;
+    meta.set_file_id(fileId.toUtf8());
+
+    GtFTRanges::const_iterator it;
+    for (it = ranges.begin(); it != ranges.end(); ++it) {
+        GtFTTempData *p = meta.add_datas();
+        p->set_offset(it.key());
+        p->set_size(it.value() - it.key());
+    }
+
+    GtFTTempBlocks::const_iterator bit;
+    for (bit = blocks.begin(); bit != blocks.end(); ++bit) {
+        GtFTTempBlock *p = meta.add_blocks();
+        p->set_index(bit.key());
+        p->set_hash(bit.value().constData(), bit.value().size());
     }
 
-    int size = tempMeta.ByteSize();
+    int size = meta.ByteSize();
 
     QByteArray bytes(size, -1);
     char *data = bytes.data();
 
-    if (tempMeta.SerializeToArray(data, size)) {
-        if (metaFile.resize(0))
-            return (metaFile.write(data, size) == size);
+    if (!meta.SerializeToArray(data, size))
+        return false;
+
+    // the meta file is opened to append
+    if (!append && !metaFile.resize(0))
+        return false;
+
+    return (metaFile.write(data, size) == size && metaFile.flush());
+}
+
+bool GtFTTempPrivate::saveMeta()
+{
+    QMutexLocker locker(&metaMutex);
+
+    // the data goes to the disk before the ranges saying it's there
+    if ((dataFile.openMode() & QIODevice::WriteOnly) && !dataFile.flush())
+        return false;
+
+    // the ranges other sessions saved are kept, the ranges
+    // in memory are still the ones of this session
+    GtFTRanges saved(ranges);
+    GtFTTempBlocks savedBlocks;
+    loadMeta(&saved, &savedBlocks);
+
+    GtFTTempBlocks::const_iterator it;
+    for (it = blocks.begin(); it != blocks.end(); ++it)
+        savedBlocks.insert(it.key(), it.value());
+
+    if (!writeMeta(saved, savedBlocks, false))
+        return false;
+
+    pending.clear();
+    pendingBlocks.clear();
+    pendingBytes = 0;
+    journalCount = 0;
+    checkpointTimer.restart();
+    return true;
+}
+
+bool GtFTTempPrivate::checkpoint()
+{
+    if (pending.isEmpty() && pendingBlocks.isEmpty())
+        return true;
+
+    // too many records to parse on the open
+    if (journalCount >= MaxJournal)
+        return saveMeta();
+
+    QMutexLocker locker(&metaMutex);
+
+    if (!dataFile.flush() || !writeMeta(pending, pendingBlocks, true))
+        return false;
+
+    pending.clear();
+    pendingBlocks.clear();
+    pendingBytes = 0;
+    journalCount += 1;
+    checkpointTimer.restart();
+    return true;
+}
+
+void GtFTTempPrivate::hashWrite(qint64 pos, const char *data, qint64 size)
+{
+    verified = false;
+
+    if (pos == hashPos) {
+        fileHash.addData(data, size);
+        hashPos += size;
+    }
+    else if (pos < hashPos) {
+        // the data hashed is written again
+        fileHash.reset();
+        hashPos = 0;
     }
 
-    return false;
+    qint64 end = pos + size;
+    while (pos < end) {
+        qint64 index = pos / GtFTTemp::BlockSize;
+        qint64 length = MIN(end, (index + 1) * GtFTTemp::BlockSize) - pos;
+
+        hashBlock(index, pos, data, length);
+        data += length;
+        pos += length;
+    }
+}
+
+void GtFTTempPrivate::hashBlock(qint64 index, qint64 pos,
+                                const char *data, qint64 size)
+{
+    qint64 begin = index * GtFTTemp::BlockSize;
+    qint64 end = begin + GtFTTemp::BlockSize;
+    GtFTTempBlockHash *block = blockHashes.value(index);
+
+    if (pos == begin) {
+        delete block;
+        block = new GtFTTempBlockHash(begin);
+        blockHashes.insert(index, block);
+    }
+
+    if (block) {
+        if (pos == block->next) {
+            block->hash.addData(data, size);
+            block->next += size;
+        }
+        else {
+            delete block;
+            blockHashes.remove(index);
+            block = 0;
+        }
+    }
+
+    // a block written out of order is hashed by the read of
+    // the verify, not read back here
+    if (!block) {
+        blocks.remove(index);
+        return;
+    }
+
+    if (block->next != end)
+        return;
+
+    QByteArray hash(block->hash.result());
+    blocks.insert(index, hash);
+    pendingBlocks.insert(index, hash);
+
+    delete block;
+    blockHashes.remove(index);
+}
+
+bool GtFTTempPrivate::hashData(qint64 size)
+{
+    // one read from the block of the first byte not hashed in
+    // order, or of the first block without a hash, finishes the
+    // SHA-1 and hashes the blocks on the way
+    qint64 begin = hashPos;
+    qint64 count = (size + GtFTTemp::BlockSize - 1) / GtFTTemp::BlockSize;
+
+    for (qint64 i = 0; i < count && i * GtFTTemp::BlockSize < begin; ++i) {
+        if (leaf(i, size).isEmpty()) {
+            begin = i * GtFTTemp::BlockSize;
+            break;
+        }
+    }
+
+    if ((dataFile.openMode() & QIODevice::WriteOnly) && !dataFile.flush())
+        return false;
+
+    qint64 oldPos = dataFile.pos();
+    qint64 index = begin / GtFTTemp::BlockSize;
+    QByteArray buffer(GtFTTemp::BlockSize, -1);
+    bool result = dataFile.seek(index * GtFTTemp::BlockSize);
+
+    for (; result && index < count; ++index) {
+        qint64 pos = index * GtFTTemp::BlockSize;
+        qint64 length = MIN(size - pos, (qint64)GtFTTemp::BlockSize);
+        qint64 bytesRead = 0;
+
+        while (bytesRead < length) {
+            qint64 n = dataFile.read(buffer.data() + bytesRead,
+                                     length - bytesRead);
+            if (n <= 0)
+                break;
+
+            bytesRead += n;
+        }
+
+        if (bytesRead < length) {
+            result = false;
+            break;
+        }
+
+        if (pos + length > hashPos) {
+            qint64 skip = MAX(hashPos - pos, (qint64)0);
+            fileHash.addData(buffer.constData() + skip, length - skip);
+        }
+
+        if (!leaf(index, size).isEmpty())
+            continue;
+
+        if (length == GtFTTemp::BlockSize) {
+            QByteArray hash(QCryptographicHash::hash(buffer,
+                                                     QCryptographicHash::Sha1));
+            blocks.insert(index, hash);
+            pendingBlocks.insert(index, hash);
+        }
+        else {
+            // the last block, it goes on if the file grows
+            GtFTTempBlockHash *block = new GtFTTempBlockHash(pos);
+            block->hash.addData(buffer.constData(), length);
+            block->next = size;
+            delete blockHashes.value(index);
+            blockHashes.insert(index, block);
+        }
+    }
+
+    if (result)
+        hashPos = size;
+
+    return dataFile.seek(oldPos) && result;
+}
+
+bool GtFTTempPrivate::hashFile(QCryptographicHash *hash, qint64 begin, qint64 end)
+{
+    if ((dataFile.openMode() & QIODevice::WriteOnly) && !dataFile.flush())
+        return false;
+
+    qint64 pos = dataFile.pos();
+    if (!dataFile.seek(begin))
+        return false;
+
+    QByteArray buffer(64 * 1024, -1);
+    bool result = true;
+
+    while (begin < end) {
+        qint64 length = dataFile.read(buffer.data(), MIN(end - begin, (qint64)buffer.size()));
+        if (length <= 0) {
+            result = false;
+            break;
+        }
+
+        hash->addData(buffer.constData(), length);
+        begin += length;
+    }
+
+    return dataFile.seek(pos) && result;
+}
+
+QByteArray GtFTTempPrivate::blockHash(qint64 index, qint64 size)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+
+    qint64 begin = index * GtFTTemp::BlockSize;
+    if (!hashFile(&hash, begin, begin + size))
+        return QByteArray();
+
+    return hash.result();
+}
+
+void GtFTTempPrivate::resetHash()
+{
+    fileHash.reset();
+    hashPos = 0;
+    verified = false;
+
+    qDeleteAll(blockHashes);
+    blockHashes.clear();
+    blocks.clear();
+    pendingBlocks.clear();
+}
+
+QByteArray GtFTTempPrivate::leaf(qint64 index, qint64 size)
+{
+    qint64 length = MIN(size - index * GtFTTemp::BlockSize,
+                        (qint64)GtFTTemp::BlockSize);
+
+    if (length == GtFTTemp::BlockSize)
+        return blocks.value(index);
+
+    // the last block is hashed once the size is known
+    GtFTTempBlockHash *block = blockHashes.value(index);
+    if (block && block->next == size)
+        return block->hash.result();
+
+    return QByteArray();
+}
+
+bool GtFTTempPrivate::knownLeaves(qint64 size, QList<QByteArray> *leaves)
+{
+    qint64 count = (size + GtFTTemp::BlockSize - 1) / GtFTTemp::BlockSize;
+
+    leaves->clear();
+    for (qint64 i = 0; i < count; ++i) {
+        QByteArray hash(leaf(i, size));
+        if (hash.isEmpty())
+            return false;
+
+        leaves->append(hash);
+    }
+
+    return true;
+}
+
+QList<QByteArray> GtFTTempPrivate::leaves(qint64 size)
+{
+    QList<QByteArray> leaves;
+    qint64 count = (size + GtFTTemp::BlockSize - 1) / GtFTTemp::BlockSize;
+
+    for (qint64 i = 0; i < count; ++i) {
+        qint64 length = MIN(size - i * GtFTTemp::BlockSize,
+                            (qint64)GtFTTemp::BlockSize);
+        QByteArray hash(leaf(i, size));
+
+        // the blocks other sessions wrote
+        if (hash.isEmpty())
+            hash = blockHash(i, length);
+
+        if (hash.isEmpty())
+            return QList<QByteArray>();
+
+        leaves.append(hash);
+    }
+
+    return leaves;
 }
 
 GtFTTemp::GtFTTemp(QObject *parent)
@@ -115,33 +537,38 @@ bool GtFTTemp::open(OpenMode mode)
 {
     Q_D(GtFTTemp);
 
-    OpenMode metaMode = QIODevice::ReadWrite;
+    d->resetHash();
 
-    if (mode & QIODevice::Truncate)
-        metaMode |= QIODevice::Truncate;
-
-    if (!d->metaFile.open(metaMode))
+    // the checkpoints are appended to the meta
+    if (!d->metaFile.open(QIODevice::ReadWrite | QIODevice::Append))
         return false;
 
-    if (d->metaFile.size() > 0) {
-        QByteArray data = d->metaFile.readAll();
+    // the meta is read whole, not in the middle of a save
+    // of another session
+    QMutexLocker locker(&metaMutex);
 
-        if (d->tempMeta.ParseFromArray(data.constData(), data.size()) &&
-            QString(d->tempMeta.file_id().c_str()) == d->fileId)
-        {
-            int count = d->tempMeta.datas_size();
-            for (int i = 0; i < count; ++i) {
-                GtFTTempData *p = new GtFTTempData(d->tempMeta.datas(i));
-                d->tempDatas.push_back(p);
-            }
-        }
-        else {
-            mode |= QIODevice::Truncate;
-            qWarning() << "invalid FTTemp meta file:" << d->metaPath;
-        }
+    if (mode & QIODevice::Truncate) {
+        if (!d->metaFile.resize(0))
+            return false;
     }
+    else if (!d->loadMeta(&d->ranges, &d->blocks)) {
+        // other sessions may be writing the data, it is kept
+        // and the ranges not known are written again
+        d->ranges.clear();
+        d->blocks.clear();
+        qWarning() << "invalid FTTemp meta file:" << d->metaPath;
+
+        if (!d->metaFile.resize(0))
+            return false;
+    }
+
+    locker.unlock();
 
-    d->tempMeta.set_file_id(d->fileId.toUtf8());
+    d->pending.clear();
+    d->pendingBytes = 0;
+    d->journalCount = 0;
+    d->tempsDirty = true;
+    d->checkpointTimer.start();
 
     if (d->dataFile.open(mode))
         return QIODevice::open(mode);
@@ -162,18 +589,46 @@ void GtFTTemp::close()
     d->metaFile.close();
     d->dataFile.close();
 
-    qDeleteAll(d->tempDatas);
-    d->tempDatas.clear();
+    d->ranges.clear();
+    d->pending.clear();
+    d->tempsDirty = true;
+    d->resetHash();
 }
 
 bool GtFTTemp::flush()
 {
     Q_D(GtFTTemp);
+    return d->saveMeta();
+}
 
-    if (!d->saveMeta())
-        return false;
+bool GtFTTemp::checkpoint()
+{
+    Q_D(GtFTTemp);
+    return d->checkpoint();
+}
+
+qint64 GtFTTemp::checkpointSize() const
+{
+    Q_D(const GtFTTemp);
+    return d->checkpointSize;
+}
+
+void GtFTTemp::setCheckpointSize(qint64 size)
+{
+    Q_D(GtFTTemp);
+    d->checkpointSize = size;
+}
+
+int GtFTTemp::checkpointInterval() const
+{
+    Q_D(const GtFTTemp);
+    return d->checkpointInterval;
+}
 
-    return d->metaFile.flush() && d->dataFile.flush();
+void GtFTTemp::setCheckpointInterval(int msecs)
+{
+    Q_D(GtFTTemp);
+    d->checkpointInterval = msecs;
 }
 
 qint64 GtFTTemp::size() const
@@ -192,116 +647,219 @@ bool GtFTTemp::seek(qint64 pos)
     return QIODevice::seek(pos);
 }
 
-int GtFTTemp::temps_size() const
+const GtFTRanges& GtFTTemp::ranges() const
 {
     Q_D(const GtFTTemp);
-    return d->tempDatas.size();
+    return d->ranges;
 }
 
-const GtFTTempData& GtFTTemp::temps(int index) const
+int GtFTTemp::temps_size() const
 {
     Q_D(const GtFTTemp);
-    return *d->tempDatas[index];
+    return d->ranges.count();
 }
 
-qint64 GtFTTemp::complete(qint64 begin) const
+const GtFTTempData& GtFTTemp::temps(int index) const
 {
     Q_D(const GtFTTemp);
-    return complete(d->tempDatas, begin);
+
+    // built again after the writes, for the callers going
+    // through the ranges by index
+    if (d->tempsDirty) {
+        d->temps.clear();
+        d->temps.reserve(d->ranges.count());
+
+        GtFTRanges::const_iterator it;
+        for (it = d->ranges.begin(); it != d->ranges.end(); ++it) {
+            GtFTTempData data;
+            data.set_offset(it.key());
+            data.set_size(it.value() - it.key());
+            d->temps.append(data);
+        }
+
+        d->tempsDirty = false;
+    }
+
+    return d->temps[index];
 }
 
-bool GtFTTemp::exists() const
+qint64 GtFTTemp::complete(qint64 begin) const
 {
     Q_D(const GtFTTemp);
-    return d->metaFile.exists() && d->dataFile.exists();
+    return d->ranges.complete(begin);
 }
 
-bool GtFTTemp::remove()
+bool GtFTTemp::verify(const QByteArray &merkleRoot)
 {
     Q_D(GtFTTemp);
-    return d->metaFile.remove() && d->dataFile.remove();
+
+    if (d->verified)
+        return true;
+
+    qint64 size = d->dataFile.size();
+    QList<QByteArray> leaves;
+    bool known = d->knownLeaves(size, &leaves);
+
+    // the root of the uploader rejects a broken upload without
+    // reading the data when the writes hashed all the blocks,
+    // it is of the uploader so it doesn't prove the id
+    if (!merkleRoot.isEmpty() && known &&
+        GtFTTemp::merkleRoot(leaves) != merkleRoot)
+    {
+        return false;
+    }
+
+    // the data not written in order is read once, an upload out
+    // of order or resumed after an open reads the whole file
+    if (d->hashPos < size || !known) {
+        if (!d->hashData(size)) {
+            d->fileHash.reset();
+            d->hashPos = 0;
+            return false;
+        }
+    }
+
+    if (!merkleRoot.isEmpty() && !known) {
+        if (!d->knownLeaves(size, &leaves) ||
+            GtFTTemp::merkleRoot(leaves) != merkleRoot)
+        {
+            return false;
+        }
+    }
+
+    d->verified = (QString(d->fileHash.result().toHex()) == d->fileId);
+    return d->verified;
 }
 
-qint64 GtFTTemp::readData(char *data, qint64 maxlen)
+QList<QByteArray> GtFTTemp::blockHashes()
 {
     Q_D(GtFTTemp);
-    return d->dataFile.read(data, maxlen);
+
+    if (!isOpen())
+        return QList<QByteArray>();
+
+    return d->leaves(d->dataFile.size());
 }
 
-qint64 GtFTTemp::writeData(const char *data, qint64 len)
+QByteArray GtFTTemp::merkleRoot(QIODevice *device)
 {
-    Q_D(GtFTTemp);
+    if (!device->isOpen() || !device->isReadable())
+        return QByteArray();
 
-    qint64 pos = d->dataFile.pos();
-    qint64 size = d->dataFile.write(data, len);
+    QList<QByteArray> leaves(blockHashes(device));
+    if (leaves.isEmpty() && device->size() > 0)
+        return QByteArray();
 
-    append(d->tempDatas, pos, pos + size);
-
-    return size;
+    return merkleRoot(leaves);
 }
 
-qint64 GtFTTemp::complete(const QList<GtFTTempData*> &list, qint64 begin)
+QList<QByteArray> GtFTTemp::blockHashes(QIODevice *device)
 {
-    if (list.size() == 0)
-        return begin;
+    if (!device->isOpen() || !device->isReadable())
+        return QList<QByteArray>();
+
+    qint64 pos = device->pos();
+    if (!device->seek(0))
+        return QList<QByteArray>();
+
+    QList<QByteArray> leaves;
+    QByteArray buffer(BlockSize, -1);
+    qint64 length;
+
+    do {
+        length = 0;
+        while (length < BlockSize) {
+            qint64 bytesRead = device->read(buffer.data() + length,
+                                            BlockSize - length);
+            if (bytesRead <= 0)
+                break;
 
-    GtFTTempData *p = list[0];
-    if (p->offset() > begin)
-        return begin;
+            length += bytesRead;
+        }
 
-    qint64 curPos;
-    qint64 maxPos = p->size();
-    foreach(const GtFTTempData *it, list) {
-        if (it->offset() > maxPos && it->offset() > begin)
-            break;
+        if (length > 0) {
+            leaves.append(QCryptographicHash::hash(buffer.left(length),
+                                                   QCryptographicHash::Sha1));
+        }
+    } while (length == BlockSize);
 
-        curPos = it->offset() + it->size();
-        maxPos = MAX(curPos, maxPos);
+    device->seek(pos);
+    return leaves;
+}
+
+QByteArray GtFTTemp::merkleRoot(const QList<QByteArray> &leaves)
+{
+    if (leaves.isEmpty())
+        return QCryptographicHash::hash(QByteArray(), QCryptographicHash::Sha1);
+
+    // the hash of every pair goes up, the odd one as it is
+    QList<QByteArray> level(leaves);
+    while (level.size() > 1) {
+        QList<QByteArray> next;
+
+        for (int i = 0; i < level.size(); i += 2) {
+            if (i + 1 < level.size()) {
+                next.append(QCryptographicHash::hash(level[i] + level[i + 1],
+                                                     QCryptographicHash::Sha1));
+            }
+            else {
+                next.append(level[i]);
+            }
+        }
+
+        level = next;
     }
 
-    return maxPos;
+    return level.first();
 }
 
-void GtFTTemp::append(QList<GtFTTempData*> &list, qint64 begin, qint64 end)
+bool GtFTTemp::exists() const
 {
-    qint64 begin0 = begin;
-    qint64 end0 = end;
-    bool done = false;
+    Q_D(const GtFTTemp);
+    return d->metaFile.exists() && d->dataFile.exists();
+}
 
-    foreach(GtFTTempData *p, list) {
-        qint64 begin1 = p->offset();
-        qint64 end1 = begin1 + p->size();
+int GtFTTemp::handle() const
+{
+    Q_D(const GtFTTemp);
+    return d->dataFile.handle();
+}
 
-        if ((begin0 >= begin1 && begin0 <= end1) ||
-            (end0 >= begin1 && end0 <= end1) ||
-            (begin0 < begin1 && end0 > end1))
-        {
-            qint64 begin2 = MIN(begin0, begin1);
-            qint64 end2 = MAX(end0, end1);
+bool GtFTTemp::remove()
+{
+    Q_D(GtFTTemp);
+    return d->metaFile.remove() && d->dataFile.remove();
+}
 
-            p->set_offset(begin2);
-            p->set_size(end2 - begin2);
+qint64 GtFTTemp::readData(char *data, qint64 maxlen)
+{
+    Q_D(GtFTTemp);
+    return d->dataFile.read(data, maxlen);
+}
 
-            done = true;
-            break;
-        }
-    }
+qint64 GtFTTemp::writeData(const char *data, qint64 len)
+{
+    Q_D(GtFTTemp);
 
-    if (!done) {
-        GtFTTempData *p;
-        int i, count = list.size();
+    qint64 pos = d->dataFile.pos();
+    qint64 size = d->dataFile.write(data, len);
 
-        for (i = 0; i < count; ++i) {
-            p = list[i];
-            if (end < p->offset())
-                break;
-        }
+    if (size > 0) {
+        d->ranges.insert(pos, pos + size);
+        d->pending.insert(pos, pos + size);
+        d->pendingBytes += size;
+        d->tempsDirty = true;
+        d->hashWrite(pos, data, size);
 
-        p = new GtFTTempData();
-        p->set_offset(begin);
-        p->set_size(end - begin);
-        list.insert(i, p);
+        if (d->pendingBytes >= d->checkpointSize ||
+            d->checkpointTimer.elapsed() >= d->checkpointInterval)
+        {
+            if (!d->checkpoint())
+                qWarning() << "FTTemp checkpoint failed:" << d->metaPath;
+        }
     }
+
+    return size;
 }
 
 GT_END_NAMESPACE
@@ -4,6 +4,7 @@
 #ifndef __GT_FT_TEMP_H__
 #define __GT_FT_TEMP_H__
 
+#include "gtftranges.h"
 #include "gtobject.h"
 #include <QtCore/QIODevice>
 
@@ -16,6 +17,17 @@ class GT_SVCE_EXPORT GtFTTemp : public QIODevice, public GtObject
 {
     Q_OBJECT
 
+public:
+    enum {
+        DefaultCheckpointSize = 4 * 1024 * 1024,
+        DefaultCheckpointInterval = 1000
+    };
+
+    // the leaves of the merkle tree
+    enum {
+        BlockSize = 1024 * 1024
+    };
+
 public:
     explicit GtFTTemp(QObject *parent = 0);
     explicit GtFTTemp(const QString &dir,
@@ -29,23 +41,50 @@ public:
     QString metaPath() const;
     QString dataPath() const;
 
+    // file descriptor of the data, -1 if not open
+    int handle() const;
+
     bool open(OpenMode mode);
     void close();
 
+    // writes all the ranges to the meta
     bool flush();
+
+    // appends the ranges written since the last checkpoint to the
+    // meta, done by the writes after the size or the interval
+    bool checkpoint();
+    qint64 checkpointSize() const;
+    void setCheckpointSize(qint64 size);
+    int checkpointInterval() const;
+    void setCheckpointInterval(int msecs);
+
     qint64 size() const;
     bool seek(qint64 pos);
 
+    const GtFTRanges& ranges() const;
     int temps_size() const;
     const GtFTTempData& temps(int index) const;
 
     qint64 complete(qint64 begin = 0) const;
+
+    // checks the data is the file of the id, the SHA-1 of the data.
+    // The data after the writes in order is read once for it, and the
+    // blocks out of order are hashed in the same read. A merkle root
+    // of the uploader is compared with the hashes of the blocks, a
+    // broken upload written in order fails without reading the data.
+    bool verify(const QByteArray &merkleRoot = QByteArray());
+
+    // the leaves of the merkle tree of the data, the blocks
+    // not hashed by the writes are read
+    QList<QByteArray> blockHashes();
+
     bool exists() const;
     bool remove();
 
 public:
-    static qint64 complete(const QList<GtFTTempData*> &list, qint64 begin);
-    static void append(QList<GtFTTempData*> &list, qint64 begin, qint64 end);
+    static QByteArray merkleRoot(QIODevice *device);
+    static QList<QByteArray> blockHashes(QIODevice *device);
+    static QByteArray merkleRoot(const QList<QByteArray> &leaves);
 
 protected:
     qint64 readData(char *data, qint64 maxlen);
@@ -15,6 +15,8 @@ GtRecvBuffer::GtRecvBuffer()
     , m_maxSize(0)
     , m_remain(0)
     , m_received(0)
+    , m_headerSize(GtSvcUtil::headerSize(GtSvcUtil::FramingVersion1))
+    , m_framing(GtSvcUtil::FramingVersion1)
 {
 }
 
@@ -23,39 +25,51 @@ GtRecvBuffer::~GtRecvBuffer()
     delete[] m_buffer;
 }
 
+void GtRecvBuffer::setFraming(int framing)
+{
+    m_framing = framing;
+    m_headerSize = GtSvcUtil::headerSize(framing);
+}
+
 int GtRecvBuffer::read(QAbstractSocket *socket, bool wait)
 {
     qint64 bytesRead;
 
-    if (m_received < sizeof(m_remain)) {
+    if (m_received < m_headerSize) {
         if (wait) {
             if (GtSvcUtil::readData(socket,
-                                    (char *)&m_remain + m_received,
-                                    sizeof(m_remain) - m_received))
+                                    m_header + m_received,
+                                    m_headerSize - m_received))
             {
-                bytesRead = sizeof(m_remain) - m_received;
+                bytesRead = m_headerSize - m_received;
             }
             else {
                 bytesRead = -1;
             }
         }
         else {
-            bytesRead = socket->read((char *)&m_remain + m_received,
-                                     sizeof(m_remain) - m_received);
+            bytesRead = socket->read(m_header + m_received,
+                                     m_headerSize - m_received);
         }
 
         if (bytesRead < 0)
             return ReadError;
 
         m_received += bytesRead;
-        if (m_received < sizeof(m_remain))
+        if (m_received < m_headerSize)
             return 0;
 
-        m_remain = qFromBigEndian<quint16>((const uchar*)&m_remain);
-        if (m_bufferSize < m_remain) {
-            if (m_maxSize > 0 && m_remain > m_maxSize)
-                return ReadError;
+        if (GtSvcUtil::FramingVersion1 == m_framing)
+            m_remain = qFromBigEndian<quint16>((const uchar*)m_header);
+        else
+            m_remain = qFromBigEndian<quint32>((const uchar*)m_header);
 
+        if (m_maxSize > 0 && m_remain > m_maxSize) {
+            qWarning() << "message bigger than limit:" << m_remain << m_maxSize;
+            return ReadError;
+        }
+
+        if (m_bufferSize < m_remain) {
             delete[] m_buffer;
             m_buffer = new char[m_remain];
             m_bufferSize = m_remain;
@@ -65,7 +79,7 @@ int GtRecvBuffer::read(QAbstractSocket *socket, bool wait)
     if (wait) {
         if (GtSvcUtil::readData(socket,
                                 m_buffer + m_received -
-                                sizeof(m_remain), m_remain))
+                                m_headerSize, m_remain))
         {
             bytesRead = m_remain;
         }
@@ -75,7 +89,7 @@ int GtRecvBuffer::read(QAbstractSocket *socket, bool wait)
     }
     else {
         bytesRead = socket->read(m_buffer + m_received -
-                                 sizeof(m_remain), m_remain);
+                                 m_headerSize, m_remain);
     }
 
     if (bytesRead < 0)
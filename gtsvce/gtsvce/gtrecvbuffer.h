@@ -18,12 +18,17 @@ public:
     ~GtRecvBuffer();
 
 public:
-    inline void setMaxSize(quint16 size) { m_maxSize = size; }
-    inline quint16 maxSize() const { return m_maxSize; }
+    // largest message accepted, 0 for no limit
+    inline void setMaxSize(quint32 size) { m_maxSize = size; }
+    inline quint32 maxSize() const { return m_maxSize; }
     inline const char* buffer() const { return m_buffer; }
-    inline quint16 size() const { return m_received - sizeof(m_remain); }
+    inline quint32 size() const { return m_received - m_headerSize; }
     inline void clear() { m_remain = 0; m_received = 0; }
 
+    // framing version of GtSvcUtil, changes only between messages
+    inline int framing() const { return m_framing; }
+    void setFraming(int framing);
+
 public:
     enum {
         ReadMessage = 1,
@@ -34,10 +39,13 @@ public:
 
 private:
     char *m_buffer;
-    quint16 m_bufferSize;
-    quint16 m_maxSize;
-    quint16 m_remain;
-    quint16 m_received;
+    char m_header[sizeof(quint32)];
+    quint32 m_bufferSize;
+    quint32 m_maxSize;
+    quint32 m_remain;
+    quint32 m_received;
+    quint32 m_headerSize;
+    int m_framing;
 
 private:
     Q_DISABLE_COPY(GtRecvBuffer)
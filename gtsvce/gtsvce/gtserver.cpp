@@ -3,6 +3,7 @@
  */
 #include "gtserver_p.h"
 #include "gtsession_p.h"
+#include "gtsvcutil.h"
 #include <QtCore/QDebug>
 #include <QtNetwork/QTcpSocket>
 
@@ -11,6 +12,7 @@ GT_BEGIN_NAMESPACE
 GtServerPrivate::GtServerPrivate(GtServer *q)
     : q_ptr(q)
     , maxThread(0)
+    , maxMessageSize(GtSvcUtil::MaxMessageSize)
     , closing(false)
 {
 }
@@ -52,6 +54,7 @@ void GtServerPrivate::addSession(GtSession *session, qintptr socketDescriptor)
 
     socket->setSocketDescriptor(socketDescriptor);
     session->d_ptr->init(socket, q, thread);
+    session->d_ptr->m_buffer.setMaxSize(maxMessageSize);
 
     qDebug() << "Add session:" << session->peerName();
 
@@ -117,6 +120,18 @@ int GtServer::maxThread() const
     return d->maxThread;
 }
 
+void GtServer::setMaxMessageSize(quint32 size)
+{
+    Q_D(GtServer);
+    d->maxMessageSize = size;
+}
+
+quint32 GtServer::maxMessageSize() const
+{
+    Q_D(const GtServer);
+    return d->maxMessageSize;
+}
+
 void GtServer::close()
 {
     Q_D(GtServer);
@@ -24,6 +24,10 @@ public:
 public:
     void setMaxThread(int count);
     int maxThread() const;
+
+    // largest message a session accepts, 0 for no limit
+    void setMaxMessageSize(quint32 size);
+    quint32 maxMessageSize() const;
     void close();
 
 protected:
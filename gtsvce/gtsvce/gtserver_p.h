@@ -36,6 +36,7 @@ protected:
     QList<GtServerThread*> threads;
     QMutex mutex;
     int maxThread;
+    quint32 maxMessageSize;
     bool closing;
 };
 
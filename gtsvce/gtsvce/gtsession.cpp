@@ -3,6 +3,7 @@
  */
 #include "gtsession_p.h"
 #include "gtserver_p.h"
+#include "gttrace.h"
 #include <QtCore/QDebug>
 #include <QtNetwork/QAbstractSocket>
 
@@ -75,6 +76,24 @@ void GtSession::close()
     deleteLater();
 }
 
+int GtSession::framing() const
+{
+    Q_D(const GtSession);
+    return d->m_buffer.framing();
+}
+
+void GtSession::setFraming(int framing)
+{
+    Q_D(GtSession);
+    d->m_buffer.setFraming(framing);
+}
+
+quint32 GtSession::maxMessageSize() const
+{
+    Q_D(const GtSession);
+    return d->m_buffer.maxSize();
+}
+
 QHostAddress GtSession::peerAddress() const
 {
     Q_D(const GtSession);
@@ -97,6 +116,8 @@ void GtSession::handleRead()
 {
     Q_D(GtSession);
 
+    GT_TRACE_SCOPE("network", "session read");
+
     int result = d->m_buffer.read(d->m_socket, false);
     while (GtRecvBuffer::ReadMessage == result) {
         message(d->m_buffer.buffer(), d->m_buffer.size());
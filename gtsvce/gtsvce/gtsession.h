@@ -31,6 +31,11 @@ public:
     QAbstractSocket* socket() const;
     void close();
 
+    // framing version of the messages, see GtSvcUtil
+    int framing() const;
+    void setFraming(int framing);
+    quint32 maxMessageSize() const;
+
     QHostAddress peerAddress() const;
     quint16 peerPort() const;
     QString peerName() const;
@@ -4,19 +4,21 @@ QT -= gui
 QT += network
 CONFIG += qt debug client server
 INCLUDEPATH += ../message ../../gtbase/gtbase
-HEADERS += gtrecvbuffer.h gtsvcutil.h gtfttemp.h
-SOURCES += gtrecvbuffer.cpp gtsvcutil.cpp gtfttemp.cpp
+HEADERS += gtrecvbuffer.h gtsvcutil.h gtftranges.h gtfttemp.h
+SOURCES += gtrecvbuffer.cpp gtsvcutil.cpp gtftranges.cpp gtfttemp.cpp
 
 CONFIG(client) {
-    HEADERS += gtuserclient.h gtftclient.h
-    SOURCES += gtuserclient.cpp gtftclient.cpp
+    HEADERS += gtuserclient.h gtftclient.h gtftparallel.h
+    SOURCES += gtuserclient.cpp gtftclient.cpp gtftparallel.cpp
 }
 
 CONFIG(server) {
     HEADERS += gtserver.h gtserver_p.h gtsession.h gtsession_p.h \
-        gtuserserver.h gtusersession.h gtftserver.h gtftsession.h
+        gtuserserver.h gtusersession.h gtftserver.h gtftsession.h \
+        gtftstorage.h gtftchunkcache.h
     SOURCES += gtserver.cpp gtsession.cpp gtuserserver.cpp \
-        gtusersession.cpp gtftserver.cpp gtftsession.cpp
+        gtusersession.cpp gtftserver.cpp gtftsession.cpp gtftstorage.cpp \
+        gtftchunkcache.cpp
 }
 
 CONFIG(debug, debug|release) {
@@ -7,8 +7,31 @@
 #include <QtNetwork/QAbstractSocket>
 #include <limits>
 
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#endif
+
 GT_BEGIN_NAMESPACE
 
+int GtSvcUtil::headerSize(int framing)
+{
+    if (FramingVersion1 == framing)
+        return sizeof(quint16);
+
+    return sizeof(quint32);
+}
+
+qint64 GtSvcUtil::maxMessageSize(int framing)
+{
+    if (FramingVersion1 == framing)
+        return std::numeric_limits<quint16>::max();
+
+    return std::numeric_limits<qint32>::max();
+}
+
 bool GtSvcUtil::syncWrite(QAbstractSocket *socket, const char *buffer, int size)
 {
     int bytesWrite = 0;
@@ -27,27 +50,49 @@ bool GtSvcUtil::syncWrite(QAbstractSocket *socket, const char *buffer, int size)
     return true;
 }
 
-bool GtSvcUtil::sendMessage(QAbstractSocket *socket,
-                            int type,
-                            const ::google::protobuf::Message *msg)
+QByteArray GtSvcUtil::packMessage(int type,
+                                  const ::google::protobuf::Message *msg,
+                                  int framing)
 {
     int size = msg ? msg->ByteSize() : 0;
+    int header = headerSize(framing);
+    qint64 length = size + sizeof(quint16);
 
     Q_ASSERT(type <= std::numeric_limits<quint16>::max());
-    Q_ASSERT(size + sizeof(quint16) <= std::numeric_limits<quint16>::max());
 
-    QByteArray bytes(sizeof(quint32) + size, -1);
+    if (length > maxMessageSize(framing)) {
+        qWarning() << "message too big for framing:" << framing << length;
+        return QByteArray();
+    }
+
+    QByteArray bytes(header + length, -1);
     char *data = bytes.data();
 
-    *(quint16*)data = qToBigEndian<quint16>(static_cast<quint16>(size + sizeof(quint16)));
-    *(quint16*)(data + sizeof(quint16)) = qToBigEndian<quint16>(static_cast<quint16>(type));
+    if (FramingVersion1 == framing)
+        *(quint16*)data = qToBigEndian<quint16>(static_cast<quint16>(length));
+    else
+        *(quint32*)data = qToBigEndian<quint32>(static_cast<quint32>(length));
 
-    if (msg && !msg->SerializeToArray(data + sizeof(quint32), size)) {
-        qWarning() << "GtSvcUtil::sendMessage SerializeToArray failed";
-        return false;
+    *(quint16*)(data + header) = qToBigEndian<quint16>(static_cast<quint16>(type));
+
+    if (msg && !msg->SerializeToArray(data + header + sizeof(quint16), size)) {
+        qWarning() << "GtSvcUtil::packMessage SerializeToArray failed";
+        return QByteArray();
     }
 
-    return syncWrite(socket, data, sizeof(quint32) + size);
+    return bytes;
+}
+
+bool GtSvcUtil::sendMessage(QAbstractSocket *socket,
+                            int type,
+                            const ::google::protobuf::Message *msg,
+                            int framing)
+{
+    QByteArray bytes(packMessage(type, msg, framing));
+    if (bytes.isEmpty())
+        return false;
+
+    return syncWrite(socket, bytes.constData(), bytes.size());
 }
 
 bool GtSvcUtil::readData(QAbstractSocket *socket, char *buffer, int size)
@@ -68,14 +113,110 @@ bool GtSvcUtil::readData(QAbstractSocket *socket, char *buffer, int size)
     return true;
 }
 
-int GtSvcUtil::readMessage(QAbstractSocket *socket, char *buffer, int size)
+#ifdef Q_OS_LINUX
+
+static bool waitWritable(int fd)
 {
-    quint16 length;
+    struct pollfd pfd;
+
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
 
-    if (!readData(socket, (char*)&length, sizeof(length)))
+    return poll(&pfd, 1, 30000) > 0 && !(pfd.revents & (POLLERR | POLLHUP));
+}
+
+bool GtSvcUtil::canSendFile()
+{
+    return true;
+}
+
+bool GtSvcUtil::sendFile(QAbstractSocket *socket,
+                         const QByteArray &header,
+                         int fd, qint64 offset, qint64 size)
+{
+    // the buffer of the socket goes before the file
+    while (socket->bytesToWrite() > 0) {
+        if (!socket->waitForBytesWritten())
+            return false;
+    }
+
+    int sock = socket->socketDescriptor();
+    const char *data = header.constData();
+    int remain = header.size();
+
+    while (remain > 0) {
+        ssize_t n = ::send(sock, data, remain, MSG_NOSIGNAL | MSG_MORE);
+        if (n < 0) {
+            if ((errno == EAGAIN || errno == EINTR) && waitWritable(sock))
+                continue;
+
+            qWarning() << "send header failed:" << errno;
+            return false;
+        }
+
+        data += n;
+        remain -= n;
+    }
+
+    off_t pos = offset;
+    while (size > 0) {
+        ssize_t n = ::sendfile(sock, fd, &pos, size);
+        if (n < 0) {
+            if ((errno == EAGAIN || errno == EINTR) && waitWritable(sock))
+                continue;
+
+            qWarning() << "sendfile failed:" << errno;
+            return false;
+        }
+
+        // the file is shorter than it was
+        if (0 == n) {
+            qWarning() << "sendfile end of file:" << pos;
+            return false;
+        }
+
+        size -= n;
+    }
+
+    return true;
+}
+
+#else
+
+bool GtSvcUtil::canSendFile()
+{
+    return false;
+}
+
+bool GtSvcUtil::sendFile(QAbstractSocket *socket,
+                         const QByteArray &header,
+                         int fd, qint64 offset, qint64 size)
+{
+    Q_UNUSED(socket);
+    Q_UNUSED(header);
+    Q_UNUSED(fd);
+    Q_UNUSED(offset);
+    Q_UNUSED(size);
+    return false;
+}
+
+#endif  /* Q_OS_LINUX */
+
+int GtSvcUtil::readMessage(QAbstractSocket *socket, char *buffer, int size,
+                           int framing)
+{
+    uchar header[sizeof(quint32)];
+    qint64 length;
+
+    if (!readData(socket, (char*)header, headerSize(framing)))
         return -1;
 
-    length = qFromBigEndian<quint16>(length);
+    if (FramingVersion1 == framing)
+        length = qFromBigEndian<quint16>(header);
+    else
+        length = qFromBigEndian<quint32>(header);
+
     if (length > size) {
         qWarning() << "message bigger than buffer:" << size << length;
         return -1;
@@ -5,6 +5,8 @@
 #define __GT_SVC_UTIL_H__
 
 #include "gtcommon.h"
+#include "gttrace.h"
+#include <QtCore/QByteArray>
 #include <QtCore/qendian.h>
 #include <QtNetwork/QAbstractSocket>
 #include <google/protobuf/message.h>
@@ -14,12 +16,42 @@ GT_BEGIN_NAMESPACE
 class GT_SVCE_EXPORT GtSvcUtil
 {
 public:
+    // the length in front of every message is 16 bits in the first
+    // framing version and 32 bits in the second. A connection starts
+    // with the first, the peers switch after agreeing on the second.
+    enum {
+        FramingVersion1 = 1,
+        FramingVersion2 = 2,
+        FramingVersion = FramingVersion2
+    };
+
+    // default limit of a received message
+    enum {
+        MaxMessageSize = 16 * 1024 * 1024
+    };
+
+public:
+    static int headerSize(int framing);
+    static qint64 maxMessageSize(int framing);
+
     static bool syncWrite(QAbstractSocket *socket, const char *buffer, int size);
+    static QByteArray packMessage(int type,
+                                  const ::google::protobuf::Message *msg,
+                                  int framing = FramingVersion1);
     static bool sendMessage(QAbstractSocket *socket,
                             int type,
-                            const ::google::protobuf::Message *msg);
+                            const ::google::protobuf::Message *msg,
+                            int framing = FramingVersion1);
     static bool readData(QAbstractSocket *socket, char *buffer, int size);
-    static int readMessage(QAbstractSocket *socket, char *buffer, int size);
+    static int readMessage(QAbstractSocket *socket, char *buffer, int size,
+                           int framing = FramingVersion1);
+
+    // writes the header and then size bytes of the file at offset,
+    // the data goes from the file to the socket in the kernel
+    static bool canSendFile();
+    static bool sendFile(QAbstractSocket *socket,
+                         const QByteArray &header,
+                         int fd, qint64 offset, qint64 size);
 
     template<typename T>
     static bool syncRequest(QAbstractSocket *socket,
@@ -27,7 +59,8 @@ public:
                             const ::google::protobuf::Message *request,
                             int responseType,
                             T *response,
-                            int bufferSize = 0);
+                            int bufferSize = 0,
+                            int framing = FramingVersion1);
 };
 
 template<typename T>
@@ -36,9 +69,12 @@ bool GtSvcUtil::syncRequest(QAbstractSocket *socket,
                             const ::google::protobuf::Message *request,
                             int responseType,
                             T *response,
-                            int bufferSize)
+                            int bufferSize,
+                            int framing)
 {
-    if (!GtSvcUtil::sendMessage(socket, requestType, request))
+    GT_TRACE_SCOPE("network", "sync request");
+
+    if (!GtSvcUtil::sendMessage(socket, requestType, request, framing))
         return false;
 
     if (!socket->waitForBytesWritten())
@@ -57,7 +93,7 @@ bool GtSvcUtil::syncRequest(QAbstractSocket *socket,
         bufferSize = (int)sizeof(temp);
     }
 
-    length = GtSvcUtil::readMessage(socket, buffer, bufferSize);
+    length = GtSvcUtil::readMessage(socket, buffer, bufferSize, framing);
     if (length < (int)sizeof(quint16))
         return false;
 
@@ -2,9 +2,12 @@
  * Copyright (C) 2013 Tom Wong. All rights reserved.
  */
 #include "gtdocument.h"
+#include "gtftchunkcache.h"
 #include "gtftclient.h"
 #include "gtftmessage.pb.h"
+#include "gtftparallel.h"
 #include "gtftserver.h"
+#include "gtftstorage.h"
 #include "gtfttemp.h"
 #include <QtNetwork/QHostAddress>
 #include <QtTest/QtTest>
@@ -35,16 +38,79 @@ public:
     QString uploaded;
 };
 
+class StorageServer : public GtFTServer
+{
+public:
+    void upload(const QString &fileId, QIODevice *device)
+    {
+        // the store fails when the storage is full
+        if (!storage.store(fileId, device))
+            failures.ref();
+    }
+
+    QIODevice* download(const QString &fileId)
+    {
+        return storage.openFile(fileId);
+    }
+
+    bool link(const QString &fileId)
+    {
+        return (storage.ref(fileId) > 0);
+    }
+
+    bool readBlock(const QByteArray &hash, QByteArray *data)
+    {
+        return storage.readBlock(hash, data);
+    }
+
+    int release(const QString &fileId)
+    {
+        return storage.unref(fileId);
+    }
+
+public:
+    GtFTStorage storage;
+    QAtomicInt failures;
+};
+
+static qint64 readFully(QIODevice *device, char *data, qint64 size)
+{
+    qint64 bytesRead = 0;
+    qint64 length;
+
+    while (bytesRead < size) {
+        length = device->read(data + bytesRead, size - bytesRead);
+        if (length <= 0)
+            break;
+
+        bytesRead += length;
+    }
+
+    return bytesRead;
+}
+
 class test_filetrans: public QObject
 {
     Q_OBJECT
 
 private Q_SLOTS:
     void testTempFile();
+    void testTempRanges();
+    void testTempHash();
+    void testStorage();
+    void testChunkCache();
     void testNormalUpload();
     void testBrokenUpload();
+    void testFragmentedUpload();
     void testNormalDownload();
     void testBrokenDownload();
+    void testLargeMessage();
+    void testStreamDownload();
+    void testAsyncUpload();
+    void testForgedUpload();
+    void testParallelTransfer();
+    void testInstantUpload();
+    void testStorageRelease();
     void cleanupTestCase();
 
 private:
@@ -204,6 +270,289 @@ void test_filetrans::testTempFile()
     localFile.close();
 }
 
+void test_filetrans::testTempRanges()
+{
+    GtFTRanges ranges;
+
+    QVERIFY(ranges.isEmpty());
+    QVERIFY(ranges.complete() == 0);
+    QVERIFY(ranges.complete(10) == 10);
+
+    // every other block, then the holes backwards
+    const int count = 10000;
+    for (int i = 0; i < count; i += 2)
+        ranges.insert(i * 100, i * 100 + 100);
+
+    QVERIFY(ranges.count() == count / 2);
+    QVERIFY(ranges.complete() == 100);
+    QVERIFY(ranges.complete(250) == 250);
+    QVERIFY(ranges.contains(400, 500));
+    QVERIFY(!ranges.contains(400, 501));
+
+    for (int i = count - 1; i > 0; i -= 2)
+        ranges.insert(i * 100, i * 100 + 100);
+
+    QVERIFY(ranges.count() == 1);
+    QVERIFY(ranges.complete() == count * 100);
+    QVERIFY(ranges.complete(550) == count * 100);
+
+    // one range covering the others
+    ranges.clear();
+    ranges.insert(10, 20);
+    ranges.insert(30, 40);
+    ranges.insert(50, 60);
+    ranges.insert(15, 55);
+    QVERIFY(ranges.count() == 1);
+    QVERIFY(ranges.begin().key() == 10);
+    QVERIFY(ranges.begin().value() == 60);
+
+    // the checkpoints are in the meta before the close
+    GtFTTemp temp(QDir::tempPath(), "test0416");
+    QVERIFY(temp.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    temp.setCheckpointSize(100);
+
+    char buffer[50];
+    memset(buffer, 'x', sizeof(buffer));
+    for (int i = 9; i >= 0; --i) {
+        QVERIFY(temp.seek(i * 100));
+        QVERIFY(temp.write(buffer, sizeof(buffer)) == sizeof(buffer));
+    }
+
+    QVERIFY(temp.seek(2000));
+    QVERIFY(temp.write(buffer, 10) == 10);
+    QVERIFY(temp.checkpoint());
+
+    GtFTTemp other(QDir::tempPath(), "test0416");
+    QVERIFY(other.open(QIODevice::ReadOnly));
+    QVERIFY(other.temps_size() == 11);
+    QVERIFY(other.temps(0).offset() == 0);
+    QVERIFY(other.temps(0).size() == 50);
+    QVERIFY(other.temps(10).offset() == 2000);
+    QVERIFY(other.complete(900) == 950);
+    other.close();
+
+    QVERIFY(temp.flush());
+    QVERIFY(temp.remove());
+    temp.close();
+}
+
+void test_filetrans::testTempHash()
+{
+    QByteArray data(3 * GtFTTemp::BlockSize + 1000, 0);
+    for (int i = 0; i < data.size(); ++i)
+        data[i] = (char)(i * 29 + i / 4096);
+
+    QBuffer localFile(&data);
+    QVERIFY(localFile.open(QIODevice::ReadOnly));
+    QString fileId(GtDocument::makeFileId(&localFile));
+    QByteArray merkleRoot(GtFTTemp::merkleRoot(&localFile));
+    QVERIFY(localFile.pos() == 0);
+
+    // the leaves of the root
+    QList<QByteArray> leaves;
+    for (int i = 0; i < data.size(); i += GtFTTemp::BlockSize) {
+        leaves.append(QCryptographicHash::hash(data.mid(i, GtFTTemp::BlockSize),
+                                               QCryptographicHash::Sha1));
+    }
+
+    QVERIFY(GtFTTemp::merkleRoot(leaves) == merkleRoot);
+    QVERIFY(GtFTTemp::merkleRoot(leaves.mid(0, 1)) == leaves[0]);
+
+    // written in order, the id is the hash of the writes
+    GtFTTemp temp(QDir::tempPath(), fileId);
+    QVERIFY(temp.open(QIODevice::ReadWrite | QIODevice::Truncate));
+    QVERIFY(temp.write(data.constData(), 5000) == 5000);
+    QVERIFY(!temp.verify());
+    QVERIFY(temp.write(data.constData() + 5000, data.size() - 5000) == data.size() - 5000);
+    QVERIFY(temp.verify());
+    temp.close();
+
+    // written backwards, the root is of the block hashes
+    QVERIFY(temp.open(QIODevice::ReadWrite | QIODevice::Truncate));
+
+    const int chunk = 300000;
+    qint64 pos;
+    for (pos = data.size() - chunk; pos > 0; pos -= chunk) {
+        QVERIFY(temp.seek(pos));
+        QVERIFY(temp.write(data.constData() + pos, chunk) == chunk);
+    }
+
+    QVERIFY(temp.seek(0));
+    QVERIFY(temp.write(data.constData(), pos + chunk) == pos + chunk);
+    QVERIFY(!temp.verify(QByteArray(20, 0)));
+    QVERIFY(temp.verify(merkleRoot));
+    temp.close();
+
+    // the hashes of the blocks are saved with the ranges
+    QVERIFY(temp.open(QIODevice::ReadWrite));
+    QVERIFY(temp.complete() == data.size());
+    QVERIFY(temp.verify(merkleRoot));
+    temp.close();
+
+    // without the root the data is read again
+    QVERIFY(temp.open(QIODevice::ReadWrite));
+    QVERIFY(temp.verify());
+    QVERIFY(temp.remove());
+    temp.close();
+}
+
+void test_filetrans::testStorage()
+{
+    QString path(QDir::temp().filePath("test_filetrans_storage"));
+    QVERIFY(QDir(path).removeRecursively());
+
+    QByteArray data1(300000, 0);
+    QByteArray data2(200000, 0);
+    for (int i = 0; i < data1.size(); ++i)
+        data1[i] = (char)(i * 31 + i / 1024);
+
+    for (int i = 0; i < data2.size(); ++i)
+        data2[i] = (char)(i * 17 + i / 512);
+
+    QBuffer buffer1(&data1);
+    QBuffer buffer2(&data2);
+    QVERIFY(buffer1.open(QIODevice::ReadOnly));
+    QVERIFY(buffer2.open(QIODevice::ReadOnly));
+    QString fileId1(GtDocument::makeFileId(&buffer1));
+    QString fileId2(GtDocument::makeFileId(&buffer2));
+
+    GtFTStorage storage;
+    QVERIFY(storage.open(path));
+    QVERIFY(!storage.store("../test", &buffer1));
+    QVERIFY(storage.openFile(fileId1) == 0);
+
+    // the data of a temp is moved to the storage
+    GtFTTemp temp(QDir::tempPath(), fileId1);
+    QVERIFY(temp.open(QIODevice::ReadWrite | QIODevice::Truncate));
+    QVERIFY(temp.write(data1) == data1.size());
+    QVERIFY(storage.store(fileId1, &temp));
+    QVERIFY(!temp.isOpen());
+    QVERIFY(!temp.exists());
+    QVERIFY(storage.contains(fileId1));
+    QVERIFY(storage.size(fileId1) == data1.size());
+    QVERIFY(storage.refCount(fileId1) == 1);
+    QVERIFY(QFile::exists(storage.filePath(fileId1)));
+    QVERIFY(storage.filePath(fileId1).endsWith(
+                QString("/%1/%2/%3").arg(fileId1.left(2))
+                .arg(fileId1.mid(2, 2)).arg(fileId1)));
+
+    // the same file is stored once
+    QVERIFY(storage.store(fileId1, &buffer1));
+    QVERIFY(storage.refCount(fileId1) == 2);
+    QVERIFY(storage.count() == 1);
+    QVERIFY(storage.usedSize() == data1.size());
+
+    QIODevice *device = storage.openFile(fileId1);
+    QVERIFY(device && device->open(QIODevice::ReadOnly));
+    QVERIFY(device->size() == data1.size());
+    QVERIFY(device->seek(1000));
+    QVERIFY(device->read(10) == data1.mid(1000, 10));
+    QVERIFY(device->seek(0));
+    QVERIFY(device->readAll() == data1);
+    delete device;
+
+    QByteArray block;
+    QByteArray hash(QCryptographicHash::hash(data1, QCryptographicHash::Sha1));
+    QVERIFY(storage.readBlock(hash, &block));
+    QVERIFY(block == data1);
+    QVERIFY(!storage.readBlock(QByteArray(20, 0), &block));
+
+    // the references are loaded again
+    storage.close();
+    QVERIFY(storage.open(path));
+    QVERIFY(storage.refCount(fileId1) == 2);
+
+    // the appended changes and the rewritten index load alike
+    for (int i = 0; i < 100; ++i) {
+        QVERIFY(storage.ref(fileId1) == 3);
+        QVERIFY(storage.unref(fileId1) == 2);
+    }
+
+    QVERIFY(storage.ref(fileId1) == 3);
+    storage.close();
+    QVERIFY(storage.open(path));
+    QVERIFY(storage.refCount(fileId1) == 3);
+    QVERIFY(storage.unref(fileId1) == 2);
+    QVERIFY(storage.unref(fileId1) == 1);
+
+    // only the files without a reference make space
+    storage.setCapacity(data1.size() + data2.size() - 1);
+    QVERIFY(!storage.store(fileId2, &buffer2));
+    QVERIFY(storage.unref(fileId1) == 0);
+    QVERIFY(storage.store(fileId2, &buffer2));
+    QVERIFY(!storage.contains(fileId1));
+    QVERIFY(!QFile::exists(storage.filePath(fileId1)));
+    QVERIFY(storage.usedSize() == data2.size());
+
+    QVERIFY(storage.collect() == 0);
+    QVERIFY(storage.unref(fileId2) == 0);
+    QVERIFY(storage.collect() == data2.size());
+    QVERIFY(storage.count() == 0);
+
+    storage.close();
+    QVERIFY(QDir(path).removeRecursively());
+}
+
+void test_filetrans::testChunkCache()
+{
+    QByteArray data(10000, 0);
+    for (int i = 0; i < data.size(); ++i)
+        data[i] = (char)(i * 7 + i / 256);
+
+    QBuffer device(&data);
+    QVERIFY(device.open(QIODevice::ReadOnly));
+
+    GtFTChunkCache cache;
+    cache.setChunkSize(1000);
+    cache.setReadAhead(1);
+    cache.setCapacity(4000);
+
+    char buffer[2500];
+
+    // the miss reads the next chunk too
+    QVERIFY(cache.read("file", &device, 500, buffer, 1000) == 1000);
+    QVERIFY(memcmp(buffer, data.constData() + 500, 1000) == 0);
+    QVERIFY(cache.misses() == 1 && cache.hits() == 1);
+    QVERIFY(cache.count() == 2 && cache.cachedSize() == 2000);
+
+    QVERIFY(cache.read("file", &device, 1500, buffer, 2500) == 2500);
+    QVERIFY(memcmp(buffer, data.constData() + 1500, 2500) == 0);
+    QVERIFY(cache.misses() == 2 && cache.hits() == 3);
+    QVERIFY(cache.count() == 4);
+
+    // the last chunk is short, the first chunk goes for it
+    QVERIFY(cache.read("file", &device, 9500, buffer, 1000) == 500);
+    QVERIFY(memcmp(buffer, data.constData() + 9500, 500) == 0);
+    QVERIFY(cache.read("file", &device, 10000, buffer, 1000) == 0);
+    QVERIFY(cache.misses() == 3 && cache.count() == 4);
+    QVERIFY(cache.cachedSize() == 3500);
+
+    // the chunk used the longest time ago is the second one
+    QVERIFY(cache.read("file", &device, 0, buffer, 100) == 100);
+    QVERIFY(cache.read("file", &device, 2000, buffer, 100) == 100);
+    QVERIFY(cache.misses() == 4 && cache.hits() == 4);
+    QVERIFY(cache.read("file", &device, 1000, buffer, 100) == 100);
+    QVERIFY(memcmp(buffer, data.constData() + 1000, 100) == 0);
+    QVERIFY(cache.misses() == 5);
+    QCOMPARE(cache.hitRate(), 4.0 / 9);
+
+    // the chunks are of the file id
+    QVERIFY(cache.read("other", &device, 1000, buffer, 100) == 100);
+    QVERIFY(cache.misses() == 6);
+
+    // the chunk itself, for the raw streams
+    qint64 offset = -1;
+    QByteArray chunk(cache.chunk("other", &device, 1250, &offset));
+    QVERIFY(offset == 250 && chunk == data.mid(1000, 1000));
+    QVERIFY(cache.hits() == 5);
+    QVERIFY(cache.chunk("other", &device, 10000, &offset).isEmpty());
+
+    cache.resetStats();
+    cache.clear();
+    QVERIFY(cache.hits() == 0 && cache.misses() == 0);
+    QVERIFY(cache.count() == 0 && cache.cachedSize() == 0);
+}
+
 void test_filetrans::testNormalUpload()
 {
     TestServer server;
@@ -349,6 +698,74 @@ void test_filetrans::testBrokenUpload()
     QVERIFY(temp.remove());
 }
 
+void test_filetrans::testFragmentedUpload()
+{
+    TestServer server;
+    GtFTClient client;
+    QHostAddress host(QHostAddress::LocalHost);
+    QThread thread;
+
+    QVERIFY(server.listen(host, TEST_PORT));
+    server.moveToThread(&thread);
+
+    thread.start();
+
+    const int chunk = 1000;
+    const int holes = 500;
+
+    QByteArray data(2 * holes * chunk, 0);
+    for (int i = 0; i < data.size(); ++i)
+        data[i] = (char)(i * 7 + i / 512);
+
+    QBuffer localFile(&data);
+    QVERIFY(localFile.open(QIODevice::ReadOnly));
+    QString fileId(GtDocument::makeFileId(&localFile));
+
+    // every other chunk, the ranges don't fit a small response
+    client.setFileInfo(fileId, host, TEST_PORT, "testsession");
+    QVERIFY(client.open(QIODevice::WriteOnly));
+
+    for (int i = 0; i < holes; ++i) {
+        qint64 pos = (2 * i + 1) * chunk;
+
+        QVERIFY(client.seek(pos));
+        QVERIFY(client.write(data.constData() + pos, chunk) == chunk);
+    }
+
+    client.close();
+    QVERIFY(client.open(QIODevice::WriteOnly));
+    QVERIFY(client.size() == data.size());
+    QVERIFY(client.complete() == 0);
+
+    for (int i = 0; i < holes; ++i) {
+        qint64 pos = 2 * i * chunk;
+
+        QVERIFY(client.complete(pos) == pos);
+        QVERIFY(client.complete(pos + chunk) == pos + 2 * chunk);
+    }
+
+    for (int i = 0; i < holes; ++i) {
+        qint64 pos = 2 * i * chunk;
+
+        QVERIFY(client.seek(pos));
+        QVERIFY(client.write(data.constData() + pos, chunk) == chunk);
+    }
+
+    QVERIFY(client.complete() == data.size());
+    QVERIFY(client.finish());
+
+    client.close();
+    server.close();
+    localFile.close();
+
+    thread.quit();
+    thread.wait();
+
+    QVERIFY(server.uploaded == fileId);
+    GtFTTemp temp(QDir::tempPath(), fileId);
+    QVERIFY(temp.remove());
+}
+
 void test_filetrans::testNormalDownload()
 {
     TestServer server;
@@ -493,6 +910,519 @@ void test_filetrans::testBrokenDownload()
     QVERIFY(temp.remove());
 }
 
+void test_filetrans::testLargeMessage()
+{
+    TestServer server;
+    GtFTClient client;
+    QHostAddress host(QHostAddress::LocalHost);
+    QThread thread;
+
+    server.setMaxMessageSize(1024 * 1024);
+    QVERIFY(server.listen(host, TEST_PORT));
+    server.moveToThread(&thread);
+
+    thread.start();
+
+    QByteArray data(3 * 1024 * 1024 + 7, 0);
+    for (int i = 0; i < data.size(); ++i)
+        data[i] = (char)(i * 31 + i / 4096);
+
+    QBuffer localFile(&data);
+    QVERIFY(localFile.open(QIODevice::ReadOnly));
+    QString fileId(GtDocument::makeFileId(&localFile));
+
+    // the data is far beyond the 16 bits framing, and
+    // beyond the limit of the server
+    client.setFileInfo(fileId, host, TEST_PORT, "testsession");
+    QVERIFY(client.open(QIODevice::WriteOnly));
+
+    qint64 size = 0;
+    qint64 length;
+    int writes = 0;
+
+    while (size < data.size()) {
+        length = client.write(data.constData() + size, data.size() - size);
+        QVERIFY(length > 64 * 1024 && length <= 1024 * 1024);
+        size += length;
+        ++writes;
+    }
+
+    QVERIFY(writes == 4);
+    QVERIFY(client.finish());
+    client.close();
+
+    // download
+    QByteArray bytes;
+    QVERIFY(client.open(QIODevice::ReadOnly));
+    QVERIFY(client.size() == data.size());
+
+    QScopedArrayPointer<char> buffer(new char[data.size()]);
+    do {
+        length = client.read(buffer.data(), data.size());
+        QVERIFY(length >= 0 && length <= 1024 * 1024);
+        bytes.append(buffer.data(), length);
+    } while (length > 0);
+
+    QVERIFY(bytes == data);
+    client.close();
+    server.close();
+    localFile.close();
+
+    thread.quit();
+    thread.wait();
+
+    QVERIFY(server.uploaded == fileId);
+    GtFTTemp temp(QDir::tempPath(), fileId);
+    QVERIFY(temp.remove());
+}
+
+void test_filetrans::testStreamDownload()
+{
+    TestServer server;
+    GtFTClient client;
+    QHostAddress host(QHostAddress::LocalHost);
+    QThread thread;
+
+    QVERIFY(server.listen(host, TEST_PORT));
+    server.moveToThread(&thread);
+
+    thread.start();
+
+    QByteArray data(1024 * 1024 + 13, 0);
+    for (int i = 0; i < data.size(); ++i)
+        data[i] = (char)(i * 17 + i / 1024);
+
+    QBuffer localFile(&data);
+    QVERIFY(localFile.open(QIODevice::ReadOnly));
+    QString fileId(GtDocument::makeFileId(&localFile));
+
+    // upload
+    client.setFileInfo(fileId, host, TEST_PORT, "testsession");
+    QVERIFY(client.open(QIODevice::WriteOnly));
+    QVERIFY(client.write(data) == data.size());
+    QVERIFY(client.finish());
+    QVERIFY(!client.stream());
+    client.close();
+
+    // the whole file in small chunks and a small window
+    QByteArray bytes;
+    char buffer[10000];
+    qint64 length;
+
+    QVERIFY(client.open(QIODevice::ReadOnly));
+
+    // nothing would be sent without a window
+    QVERIFY(!client.stream(-1, 0));
+    QVERIFY(client.error() == GtFTClient::InvalidState);
+
+    QVERIFY(client.stream(-1, 64 * 1024, 4096));
+    QVERIFY(client.isStreaming());
+    do {
+        length = client.read(buffer, sizeof(buffer));
+        QVERIFY(length >= 0);
+        bytes.append(buffer, length);
+    } while (length > 0);
+
+    QVERIFY(!client.isStreaming());
+    QVERIFY(bytes == data);
+
+    // a range, the reads after it go on request
+    QVERIFY(client.seek(1000));
+    QVERIFY(client.stream(5000, 2048, 1024));
+    QVERIFY(readFully(&client, buffer, 6000) == 6000);
+    QVERIFY(memcmp(buffer, data.constData() + 1000, 6000) == 0);
+
+    // another request ends the stream
+    QVERIFY(client.seek(500000));
+    QVERIFY(client.stream());
+    QVERIFY(readFully(&client, buffer, 100) == 100);
+    QVERIFY(memcmp(buffer, data.constData() + 500000, 100) == 0);
+    QVERIFY(client.size() == data.size());
+    QVERIFY(!client.isStreaming());
+    QVERIFY(readFully(&client, buffer, 100) == 100);
+    QVERIFY(memcmp(buffer, data.constData() + 500100, 100) == 0);
+
+    // the chunks of the cache go raw
+    GtFTChunkCache *cache = server.chunkCache();
+    cache->setCapacity(2 * 1024 * 1024);
+
+    bytes.clear();
+    QVERIFY(client.seek(0));
+    QVERIFY(client.stream(-1, 64 * 1024, 4096, true));
+    do {
+        length = client.read(buffer, sizeof(buffer));
+        QVERIFY(length >= 0);
+        bytes.append(buffer, length);
+    } while (length > 0);
+
+    QVERIFY(bytes == data);
+    QVERIFY(cache->hits() > 0);
+    cache->setCapacity(0);
+
+    client.close();
+    server.close();
+    localFile.close();
+
+    thread.quit();
+    thread.wait();
+
+    QVERIFY(server.uploaded == fileId);
+    GtFTTemp temp(QDir::tempPath(), fileId);
+    QVERIFY(temp.remove());
+}
+
+void test_filetrans::testAsyncUpload()
+{
+    TestServer server;
+    GtFTClient client;
+    QHostAddress host(QHostAddress::LocalHost);
+    QThread thread;
+
+    QVERIFY(server.listen(host, TEST_PORT));
+    server.moveToThread(&thread);
+
+    thread.start();
+
+    QByteArray data(1024 * 1024 + 13, 0);
+    for (int i = 0; i < data.size(); ++i)
+        data[i] = (char)(i * 19 + i / 4096);
+
+    QBuffer localFile(&data);
+    QVERIFY(localFile.open(QIODevice::ReadOnly));
+    QString fileId(GtDocument::makeFileId(&localFile));
+
+    const int chunk = 10000;
+    qint64 half = data.size() / 2;
+
+    client.setFileInfo(fileId, host, TEST_PORT, "testsession");
+    QVERIFY(client.open(QIODevice::WriteOnly));
+    QVERIFY(client.writeAt(0, data.constData(), chunk) == -1);
+    QVERIFY(client.upload(64 * 1024, 16 * 1024));
+    QVERIFY(client.isUploading());
+
+    // the second half backwards, the first chunk is left out
+    qint64 pos;
+    for (pos = data.size() - chunk; pos > half; pos -= chunk) {
+        QVERIFY(client.writeAt(pos, data.constData() + pos, chunk) == chunk);
+    }
+
+    QVERIFY(client.writeAt(half, data.constData() + half, pos + chunk - half) ==
+            pos + chunk - half);
+    QVERIFY(client.sync());
+    QVERIFY(client.pos() == 0);
+
+    // broken in the middle, the server keeps what it received
+    client.close();
+    QVERIFY(client.open(QIODevice::WriteOnly));
+    QVERIFY(client.complete() == 0);
+    QVERIFY(client.complete(half) == data.size());
+
+    QVERIFY(client.upload());
+    QVERIFY(client.seek(chunk));
+    QVERIFY(client.isUploading() == false);
+    QVERIFY(client.upload());
+    QVERIFY(client.write(data.constData() + chunk, half - chunk) == half - chunk);
+    QVERIFY(client.pos() == half);
+    QVERIFY(client.writeAt(0, data.constData(), chunk) == chunk);
+    QVERIFY(client.complete() == data.size());
+    QVERIFY(client.finish());
+    QVERIFY(!client.isUploading());
+
+    client.close();
+    server.close();
+    localFile.close();
+
+    thread.quit();
+    thread.wait();
+
+    QVERIFY(server.uploaded == fileId);
+    GtFTTemp temp(QDir::tempPath(), fileId);
+    QVERIFY(temp.open(QIODevice::ReadOnly));
+    QVERIFY(temp.readAll() == data);
+    temp.close();
+    QVERIFY(temp.remove());
+}
+
+void test_filetrans::testForgedUpload()
+{
+    TestServer server;
+    GtFTClient client;
+    QHostAddress host(QHostAddress::LocalHost);
+    QThread thread;
+
+    QVERIFY(server.listen(host, TEST_PORT));
+    server.moveToThread(&thread);
+
+    thread.start();
+
+    QByteArray data(2 * GtFTTemp::BlockSize + 300, 0);
+    for (int i = 0; i < data.size(); ++i)
+        data[i] = (char)(i * 23 + i / 4096);
+
+    QByteArray other(data);
+    other[0] = ~other[0];
+
+    QBuffer localFile(&other);
+    QVERIFY(localFile.open(QIODevice::ReadOnly));
+    QString fileId(GtDocument::makeFileId(&localFile));
+    localFile.close();
+
+    // the root is of the data, not of the file of the id
+    localFile.setBuffer(&data);
+    QVERIFY(localFile.open(QIODevice::ReadOnly));
+    QByteArray merkleRoot(GtFTTemp::merkleRoot(&localFile));
+
+    const int chunk = 10000;
+    qint64 pos;
+
+    client.setFileInfo(fileId, host, TEST_PORT, "testsession");
+    QVERIFY(client.open(QIODevice::WriteOnly));
+    QVERIFY(client.upload());
+
+    for (pos = data.size() - chunk; pos > 0; pos -= chunk)
+        QVERIFY(client.writeAt(pos, data.constData() + pos, chunk) == chunk);
+
+    QVERIFY(client.writeAt(0, data.constData(), pos + chunk) == pos + chunk);
+    QVERIFY(client.complete() == data.size());
+    QVERIFY(!client.finish(merkleRoot));
+    QVERIFY(client.error() == GtFTClient::InvalidState);
+
+    client.close();
+    server.close();
+    localFile.close();
+
+    thread.quit();
+    thread.wait();
+
+    QVERIFY(server.uploaded.isNull());
+    GtFTTemp temp(QDir::tempPath(), fileId);
+    QVERIFY(temp.remove());
+}
+
+void test_filetrans::testParallelTransfer()
+{
+    TestServer server;
+    GtFTClient client;
+    QHostAddress host(QHostAddress::LocalHost);
+    QThread thread;
+
+    QVERIFY(server.listen(host, TEST_PORT));
+    server.moveToThread(&thread);
+
+    thread.start();
+
+    QByteArray data(3 * 1024 * 1024 + 7, 0);
+    for (int i = 0; i < data.size(); ++i)
+        data[i] = (char)(i * 23 + i / 2048);
+
+    QBuffer localFile(&data);
+    QVERIFY(localFile.open(QIODevice::ReadOnly));
+    QString fileId(GtDocument::makeFileId(&localFile));
+
+    // a broken upload, only the missing ranges go in parallel
+    qint64 begin = 1000000;
+    qint64 end = 2000000;
+
+    client.setFileInfo(fileId, host, TEST_PORT, "testsession");
+    QVERIFY(client.open(QIODevice::WriteOnly));
+    QVERIFY(client.seek(begin));
+    QVERIFY(client.write(data.constData() + begin, end - begin) == end - begin);
+    client.close();
+    QVERIFY(server.uploaded.isNull());
+
+    GtFTParallel parallel(fileId, host, TEST_PORT, "testsession");
+    parallel.setConnections(3);
+    parallel.setRangeSize(100000);
+    QVERIFY(parallel.upload(&localFile));
+    QVERIFY(parallel.error() == GtFTClient::NoError);
+
+    // the download is resumed into a temp with a part of the file
+    GtFTTemp downTemp(QDir::tempPath(), fileId + ".download");
+    QVERIFY(downTemp.open(QIODevice::ReadWrite | QIODevice::Truncate));
+    QVERIFY(downTemp.seek(begin));
+    QVERIFY(downTemp.write(data.constData() + begin, end - begin) == end - begin);
+
+    parallel.setConnections(4);
+    QVERIFY(parallel.download(&downTemp));
+    QVERIFY(downTemp.complete() == data.size());
+    QVERIFY(downTemp.seek(0));
+    QVERIFY(downTemp.readAll() == data);
+    downTemp.close();
+    QVERIFY(downTemp.remove());
+
+    server.close();
+    localFile.close();
+
+    thread.quit();
+    thread.wait();
+
+    QVERIFY(server.uploaded == fileId);
+    GtFTTemp temp(QDir::tempPath(), fileId);
+    QVERIFY(temp.remove());
+}
+
+void test_filetrans::testInstantUpload()
+{
+    QString path(QDir::temp().filePath("test_filetrans_instant"));
+    QVERIFY(QDir(path).removeRecursively());
+
+    StorageServer server;
+    QHostAddress host(QHostAddress::LocalHost);
+    QThread thread;
+
+    QVERIFY(server.storage.open(path));
+    QVERIFY(server.listen(host, TEST_PORT));
+    server.moveToThread(&thread);
+
+    thread.start();
+
+    QByteArray data1(3 * GtFTTemp::BlockSize + 5000, 0);
+    for (int i = 0; i < data1.size(); ++i)
+        data1[i] = (char)(i * 13 + i / 1024);
+
+    // a near duplicate, only the second block differs
+    QByteArray data2(data1);
+    for (int i = 0; i < 100; ++i)
+        data2[GtFTTemp::BlockSize + i] = (char)~data2[GtFTTemp::BlockSize + i];
+
+    QBuffer localFile1(&data1);
+    QBuffer localFile2(&data2);
+    QVERIFY(localFile1.open(QIODevice::ReadOnly));
+    QVERIFY(localFile2.open(QIODevice::ReadOnly));
+    QString fileId1(GtDocument::makeFileId(&localFile1));
+    QString fileId2(GtDocument::makeFileId(&localFile2));
+
+    GtFTParallel parallel(fileId1, host, TEST_PORT, "testsession");
+    QVERIFY(parallel.upload(&localFile1));
+    QVERIFY(server.storage.refCount(fileId1) == 1);
+
+    // the file the server has is done at the open
+    GtFTClient client(fileId1, host, TEST_PORT, "testsession");
+    QVERIFY(client.open(QIODevice::WriteOnly));
+    QVERIFY(client.exists());
+    QVERIFY(client.complete() == data1.size());
+    QVERIFY(client.write(data1.constData(), 100) == -1);
+    client.close();
+    QVERIFY(server.storage.refCount(fileId1) == 2);
+
+    parallel.setFileInfo(fileId1, host, TEST_PORT, "testsession");
+    QVERIFY(parallel.upload(&localFile1));
+    QVERIFY(server.storage.refCount(fileId1) == 3);
+
+    // the blocks in the first file are copied by the server
+    QList<QByteArray> leaves(GtFTTemp::blockHashes(&localFile2));
+    QVERIFY(leaves.size() == 4);
+
+    client.setFileInfo(fileId2, host, TEST_PORT, "testsession");
+    QVERIFY(client.open(QIODevice::WriteOnly));
+    QVERIFY(!client.exists());
+    QVERIFY(client.copyBlocks(leaves) == data2.size() - GtFTTemp::BlockSize);
+    QVERIFY(client.complete() == GtFTTemp::BlockSize);
+    QVERIFY(client.complete(2 * GtFTTemp::BlockSize) == data2.size());
+    client.close();
+
+    parallel.setFileInfo(fileId2, host, TEST_PORT, "testsession");
+    QVERIFY(parallel.upload(&localFile2));
+    QVERIFY(server.storage.contains(fileId2));
+
+    client.setFileInfo(fileId2, host, TEST_PORT, "testsession");
+    QVERIFY(client.open(QIODevice::ReadOnly));
+    QVERIFY(client.size() == data2.size());
+
+    QByteArray received(data2.size(), 0);
+    QVERIFY(readFully(&client, received.data(), received.size()) == data2.size());
+    QVERIFY(received == data2);
+    client.close();
+
+    server.close();
+    localFile1.close();
+    localFile2.close();
+
+    thread.quit();
+    thread.wait();
+
+    QVERIFY(server.failures.load() == 0);
+    server.storage.close();
+    QVERIFY(QDir(path).removeRecursively());
+}
+
+void test_filetrans::testStorageRelease()
+{
+    QString path(QDir::temp().filePath("test_filetrans_release"));
+    QVERIFY(QDir(path).removeRecursively());
+
+    QByteArray data1(100000, 0);
+    for (int i = 0; i < data1.size(); ++i)
+        data1[i] = (char)(i * 11 + i / 1024);
+
+    QByteArray data2(data1);
+    data2[0] = ~data2[0];
+
+    QBuffer localFile1(&data1);
+    QBuffer localFile2(&data2);
+    QVERIFY(localFile1.open(QIODevice::ReadOnly));
+    QVERIFY(localFile2.open(QIODevice::ReadOnly));
+    QString fileId1(GtDocument::makeFileId(&localFile1));
+    QString fileId2(GtDocument::makeFileId(&localFile2));
+
+    // room for one of the files
+    StorageServer server;
+    QHostAddress host(QHostAddress::LocalHost);
+    QThread thread;
+
+    QVERIFY(server.storage.open(path));
+    server.storage.setCapacity(data1.size() * 3 / 2);
+    QVERIFY(server.listen(host, TEST_PORT));
+    server.moveToThread(&thread);
+
+    thread.start();
+
+    GtFTParallel parallel(fileId1, host, TEST_PORT, "testsession");
+    QVERIFY(parallel.upload(&localFile1));
+    QVERIFY(server.storage.contains(fileId1));
+
+    // the full storage rejects the upload
+    parallel.setFileInfo(fileId2, host, TEST_PORT, "testsession");
+    parallel.upload(&localFile2);
+    QVERIFY(!server.storage.contains(fileId2));
+    QVERIFY(server.failures.load() == 1);
+
+    // the released file makes room for it
+    GtFTClient client(fileId1, host, TEST_PORT, "testsession");
+    QVERIFY(client.open(QIODevice::ReadOnly));
+    QVERIFY(client.release() == 0);
+    client.close();
+    QVERIFY(server.storage.refCount(fileId1) == 0);
+
+    QVERIFY(parallel.upload(&localFile2));
+    QVERIFY(server.storage.contains(fileId2));
+    QVERIFY(!server.storage.contains(fileId1));
+    QVERIFY(server.storage.usedSize() == data2.size());
+    QVERIFY(server.failures.load() == 1);
+
+    // the collection removes the files released
+    client.setFileInfo(fileId2, host, TEST_PORT, "testsession");
+    QVERIFY(client.open(QIODevice::ReadOnly));
+    QVERIFY(client.release() == 0);
+    client.close();
+
+    QVERIFY(server.storage.collect() == data2.size());
+    QVERIFY(server.storage.count() == 0);
+    QVERIFY(server.storage.usedSize() == 0);
+
+    server.close();
+    localFile1.close();
+    localFile2.close();
+
+    thread.quit();
+    thread.wait();
+
+    server.storage.close();
+    GtFTTemp temp(QDir::tempPath(), fileId2);
+    temp.remove();
+    QVERIFY(QDir(path).removeRecursively());
+}
+
 void test_filetrans::cleanupTestCase()
 {
 #ifdef GT_DEBUG
@@ -0,0 +1,6 @@
+CONFIG += testcase
+TARGET = test_streaming
+QT = core testlib
+SOURCES = test_streaming.cpp
+
+include(../tests.pri)
@@ -0,0 +1,419 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#include "gtdocument.h"
+#include "gtftchunkcache.h"
+#include "gtftclient.h"
+#include "gtftserver.h"
+#include "gtfttemp.h"
+#include <QtNetwork/QHostAddress>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+#include <QtTest/QtTest>
+#include <ctime>
+
+using namespace Gather;
+
+class TestServer : public GtFTServer
+{
+public:
+    void upload(const QString &fileId, QIODevice *device)
+    {
+        Q_UNUSED(fileId);
+        Q_UNUSED(device);
+    }
+
+    QIODevice* download(const QString &fileId)
+    {
+        GtFTTemp *file = new GtFTTemp(tempPath(), fileId);
+        if (file->exists())
+            return file;
+
+        delete file;
+        return 0;
+    }
+};
+
+// one connection through the proxy, the bytes of both directions
+// are held for the delay before they go on
+class DelayLink : public QObject
+{
+    Q_OBJECT
+
+public:
+    DelayLink(qintptr descriptor, const QHostAddress &host,
+              quint16 port, int delay, QObject *parent)
+        : QObject(parent)
+        , m_delay(delay)
+    {
+        connect(&m_down, SIGNAL(readyRead()), this, SLOT(readDown()));
+        connect(&m_up, SIGNAL(readyRead()), this, SLOT(readUp()));
+        connect(&m_down, SIGNAL(disconnected()), this, SLOT(close()));
+        connect(&m_up, SIGNAL(disconnected()), this, SLOT(close()));
+        connect(&m_timer, SIGNAL(timeout()), this, SLOT(flush()));
+
+        m_down.setSocketDescriptor(descriptor);
+        m_up.connectToHost(host, port);
+
+        m_clock.start();
+        m_timer.setTimerType(Qt::PreciseTimer);
+        m_timer.start(1);
+    }
+
+private Q_SLOTS:
+    void readDown()
+    {
+        m_toUp.append(Packet(m_clock.elapsed() + m_delay, m_down.readAll()));
+    }
+
+    void readUp()
+    {
+        m_toDown.append(Packet(m_clock.elapsed() + m_delay, m_up.readAll()));
+    }
+
+    void flush()
+    {
+        flush(m_toUp, &m_up);
+        flush(m_toDown, &m_down);
+    }
+
+    void close()
+    {
+        m_timer.stop();
+        m_down.disconnectFromHost();
+        m_up.disconnectFromHost();
+    }
+
+private:
+    typedef QPair<qint64, QByteArray> Packet;
+
+    void flush(QList<Packet> &packets, QTcpSocket *socket)
+    {
+        if (socket->state() != QAbstractSocket::ConnectedState)
+            return;
+
+        qint64 now = m_clock.elapsed();
+        while (!packets.isEmpty() && packets.first().first <= now)
+            socket->write(packets.takeFirst().second);
+    }
+
+private:
+    QTcpSocket m_down;
+    QTcpSocket m_up;
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+    QList<Packet> m_toUp;
+    QList<Packet> m_toDown;
+    int m_delay;
+};
+
+class DelayProxy : public QTcpServer
+{
+public:
+    DelayProxy(const QHostAddress &host, quint16 port, int delay)
+        : m_host(host)
+        , m_port(port)
+        , m_delay(delay)
+    {
+    }
+
+protected:
+    void incomingConnection(qintptr descriptor)
+    {
+        new DelayLink(descriptor, m_host, m_port, m_delay, this);
+    }
+
+private:
+    QHostAddress m_host;
+    quint16 m_port;
+    int m_delay;
+};
+
+// a session downloading the whole file at the same time as others
+class DownloadThread : public QThread
+{
+public:
+    DownloadThread(const QString &fileId, quint16 port)
+        : m_fileId(fileId)
+        , m_port(port)
+    {
+    }
+
+public:
+    QByteArray bytes;
+
+protected:
+    void run()
+    {
+        const int chunk = 256 * 1024;
+
+        GtFTClient client(m_fileId, QHostAddress(QHostAddress::LocalHost),
+                          m_port, "testsession");
+        if (!client.open(QIODevice::ReadOnly) ||
+            !client.stream(-1, 4 * 1024 * 1024, chunk, false))
+        {
+            return;
+        }
+
+        QScopedArrayPointer<char> buffer(new char[chunk]);
+        qint64 length;
+
+        while ((length = client.read(buffer.data(), chunk)) > 0)
+            bytes.append(buffer.data(), length);
+
+        client.close();
+    }
+
+private:
+    QString m_fileId;
+    quint16 m_port;
+};
+
+// Download throughput over a link of simulated latency, request
+// per chunk against streams of growing windows, and the cost of
+// the copies on a direct link, and of sessions sharing the chunk cache
+class test_streaming : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void benchDownload_data();
+    void benchDownload();
+    void benchRawDownload_data();
+    void benchRawDownload();
+    void benchCachedDownload_data();
+    void benchCachedDownload();
+    void cleanupTestCase();
+
+private:
+    enum {
+        TEST_PORT = 4005,
+        PROXY_PORT = 4006,
+        DELAY = 10,
+        FILE_SIZE = 16 * 1024 * 1024,
+        SESSIONS = 8
+    };
+
+private:
+    TestServer *m_server;
+    DelayProxy *m_proxy;
+    QThread m_serverThread;
+    QThread m_proxyThread;
+    QByteArray m_data;
+    QString m_fileId;
+};
+
+void test_streaming::initTestCase()
+{
+    QHostAddress host(QHostAddress::LocalHost);
+
+    m_server = new TestServer();
+    QVERIFY(m_server->listen(host, TEST_PORT));
+    m_server->moveToThread(&m_serverThread);
+    m_serverThread.start();
+
+    m_proxy = new DelayProxy(host, TEST_PORT, DELAY);
+    QVERIFY(m_proxy->listen(host, PROXY_PORT));
+    m_proxy->moveToThread(&m_proxyThread);
+    m_proxyThread.start();
+
+    m_data.resize(FILE_SIZE);
+    for (int i = 0; i < m_data.size(); ++i)
+        m_data[i] = (char)(i * 13 + i / 8192);
+
+    QBuffer buffer(&m_data);
+    QVERIFY(buffer.open(QIODevice::ReadOnly));
+    m_fileId = GtDocument::makeFileId(&buffer);
+
+    // upload straight to the server
+    GtFTClient client(m_fileId, host, TEST_PORT, "testsession");
+    QVERIFY(client.open(QIODevice::WriteOnly));
+
+    qint64 size = 0;
+    while (size < m_data.size()) {
+        qint64 length = client.write(m_data.constData() + size,
+                                     m_data.size() - size);
+        QVERIFY(length > 0);
+        size += length;
+    }
+
+    QVERIFY(client.finish());
+    client.close();
+}
+
+void test_streaming::benchDownload_data()
+{
+    QTest::addColumn<int>("window");
+    QTest::addColumn<int>("chunk");
+
+    // no window for a request per chunk
+    QTest::newRow("request 64k") << 0 << 64 * 1024;
+    QTest::newRow("request 1m") << 0 << 1024 * 1024;
+    QTest::newRow("window 256k") << 256 * 1024 << 64 * 1024;
+    QTest::newRow("window 1m") << 1024 * 1024 << 256 * 1024;
+    QTest::newRow("window 4m") << 4 * 1024 * 1024 << 256 * 1024;
+    QTest::newRow("window 16m") << 16 * 1024 * 1024 << 1024 * 1024;
+}
+
+void test_streaming::benchDownload()
+{
+    QFETCH(int, window);
+    QFETCH(int, chunk);
+
+    GtFTClient client(m_fileId, QHostAddress(QHostAddress::LocalHost),
+                      PROXY_PORT, "testsession");
+    QVERIFY(client.open(QIODevice::ReadOnly));
+
+    QScopedArrayPointer<char> buffer(new char[chunk]);
+    QByteArray bytes;
+    qint64 length;
+    QElapsedTimer timer;
+
+    timer.start();
+
+    if (window > 0)
+        QVERIFY(client.stream(-1, window, chunk, false));
+
+    do {
+        length = client.read(buffer.data(), chunk);
+        QVERIFY(length >= 0);
+        bytes.append(buffer.data(), length);
+    } while (length > 0);
+
+    qint64 elapsed = timer.elapsed();
+
+    QVERIFY(bytes == m_data);
+    client.close();
+
+    double seconds = MAX(elapsed, 1) / 1000.0;
+    QTest::setBenchmarkResult(m_data.size() / seconds, QTest::BytesPerSecond);
+    qDebug() << QTest::currentDataTag() << "rtt" << DELAY * 2 << "ms:"
+             << m_data.size() / seconds / (1024 * 1024) << "MB/s";
+}
+
+void test_streaming::benchRawDownload_data()
+{
+    QTest::addColumn<bool>("raw");
+
+    QTest::newRow("messages") << false;
+    QTest::newRow("raw") << true;
+}
+
+void test_streaming::benchRawDownload()
+{
+    QFETCH(bool, raw);
+
+    const int chunk = 256 * 1024;
+
+    GtFTClient client(m_fileId, QHostAddress(QHostAddress::LocalHost),
+                      TEST_PORT, "testsession");
+    QVERIFY(client.open(QIODevice::ReadOnly));
+
+    QScopedArrayPointer<char> buffer(new char[chunk]);
+    QByteArray bytes;
+    qint64 length;
+    QElapsedTimer timer;
+
+    bytes.reserve(m_data.size());
+
+    // the server runs in this process, the clock counts both ends
+    std::clock_t clock = std::clock();
+    timer.start();
+
+    QVERIFY(client.stream(-1, 4 * 1024 * 1024, chunk, raw));
+
+    do {
+        length = client.read(buffer.data(), chunk);
+        QVERIFY(length >= 0);
+        bytes.append(buffer.data(), length);
+    } while (length > 0);
+
+    qint64 elapsed = timer.elapsed();
+    double cpu = (std::clock() - clock) * 1000.0 / CLOCKS_PER_SEC;
+
+    QVERIFY(bytes == m_data);
+    client.close();
+
+    double seconds = MAX(elapsed, 1) / 1000.0;
+    double gigabytes = m_data.size() / (1024.0 * 1024 * 1024);
+    QTest::setBenchmarkResult(m_data.size() / seconds, QTest::BytesPerSecond);
+    qDebug() << QTest::currentDataTag() << ":"
+             << m_data.size() / seconds / (1024 * 1024) << "MB/s,"
+             << cpu / gigabytes << "cpu ms/GB";
+}
+
+void test_streaming::benchCachedDownload_data()
+{
+    QTest::addColumn<qint64>("capacity");
+
+    QTest::newRow("disk") << (qint64)0;
+    QTest::newRow("cache") << (qint64)FILE_SIZE * 2;
+}
+
+void test_streaming::benchCachedDownload()
+{
+    QFETCH(qint64, capacity);
+
+    GtFTChunkCache *cache = m_server->chunkCache();
+    cache->clear();
+    cache->resetStats();
+    cache->setCapacity(capacity);
+
+    QList<DownloadThread*> threads;
+    for (int i = 0; i < SESSIONS; ++i)
+        threads.append(new DownloadThread(m_fileId, TEST_PORT));
+
+    QElapsedTimer timer;
+    timer.start();
+
+    foreach (DownloadThread *thread, threads)
+        thread->start();
+
+    foreach (DownloadThread *thread, threads)
+        thread->wait();
+
+    qint64 elapsed = timer.elapsed();
+
+    foreach (DownloadThread *thread, threads)
+        QVERIFY(thread->bytes == m_data);
+
+    qDeleteAll(threads);
+
+    double hitRate = cache->hitRate();
+    cache->setCapacity(0);
+    cache->clear();
+
+    // all the sessions share one read of every chunk
+    if (capacity > 0)
+        QVERIFY(cache->misses() <= (quint64)FILE_SIZE / GtFTChunkCache::DefaultChunkSize);
+
+    double seconds = MAX(elapsed, 1) / 1000.0;
+    qint64 total = (qint64)m_data.size() * SESSIONS;
+    QTest::setBenchmarkResult(total / seconds, QTest::BytesPerSecond);
+    qDebug() << QTest::currentDataTag() << SESSIONS << "sessions:"
+             << total / seconds / (1024 * 1024) << "MB/s, hit rate"
+             << hitRate;
+}
+
+void test_streaming::cleanupTestCase()
+{
+    m_proxyThread.quit();
+    m_proxyThread.wait();
+    delete m_proxy;
+
+    m_server->close();
+    m_serverThread.quit();
+    m_serverThread.wait();
+    delete m_server;
+
+    GtFTTemp temp(QDir::tempPath(), m_fileId);
+    QVERIFY(temp.remove());
+
+#ifdef GT_DEBUG
+    QVERIFY(GtObject::dumpObjects() == 0);
+#endif
+}
+
+QTEST_MAIN(test_streaming)
+#include "test_streaming.moc"
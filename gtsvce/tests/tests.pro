@@ -1,2 +1,2 @@
 TEMPLATE = subdirs
-SUBDIRS = user filetrans
+SUBDIRS = user filetrans streaming
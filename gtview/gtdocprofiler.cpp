@@ -0,0 +1,351 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#include "gtdocprofiler.h"
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QTextStream>
+#include <QtGui/QPainter>
+#include <algorithm>
+
+GT_BEGIN_NAMESPACE
+
+class GtDocProfilerPrivate
+{
+    Q_DECLARE_PUBLIC(GtDocProfiler)
+
+public:
+    explicit GtDocProfilerPrivate(GtDocProfiler *q);
+    ~GtDocProfilerPrivate();
+
+public:
+    inline qint64 now() const { return m_clock.nsecsElapsed() / 1000; }
+    // the frames oldest first
+    inline const GtDocProfiler::Frame& frame(int i) const {
+        return m_frames[(m_first + i) % m_frames.size()];
+    }
+    QVector<GtDocProfiler::Frame> orderedFrames() const;
+
+protected:
+    GtDocProfiler *q_ptr;
+    QElapsedTimer m_clock;
+
+    // a ring of the last frames, m_first is the oldest once full
+    QVector<GtDocProfiler::Frame> m_frames;
+    GtDocProfiler::Frame m_frame;
+    int m_first;
+    quint64 m_frameCount;
+    int m_maxFrames;
+    bool m_overlayVisible;
+    bool m_inFrame;
+
+    // start of the part being timed, -1 if none
+    qint64 m_inputTime;
+    qint64 m_frameTime;
+    qint64 m_pageTime;
+    qint64 m_imageTime;
+    qint64 m_notesTime;
+};
+
+GtDocProfilerPrivate::GtDocProfilerPrivate(GtDocProfiler *q)
+    : q_ptr(q)
+    , m_first(0)
+    , m_frameCount(0)
+    , m_maxFrames(10000)
+    , m_overlayVisible(false)
+    , m_inFrame(false)
+    , m_inputTime(-1)
+    , m_frameTime(-1)
+    , m_pageTime(-1)
+    , m_imageTime(-1)
+    , m_notesTime(-1)
+{
+    m_clock.start();
+}
+
+GtDocProfilerPrivate::~GtDocProfilerPrivate()
+{
+}
+
+QVector<GtDocProfiler::Frame> GtDocProfilerPrivate::orderedFrames() const
+{
+    QVector<GtDocProfiler::Frame> frames;
+
+    frames.reserve(m_frames.size());
+    for (int i = 0; i < m_frames.size(); ++i)
+        frames.append(frame(i));
+
+    return frames;
+}
+
+GtDocProfiler::GtDocProfiler(QObject *parent)
+    : QObject(parent)
+    , d_ptr(new GtDocProfilerPrivate(this))
+{
+}
+
+GtDocProfiler::~GtDocProfiler()
+{
+}
+
+bool GtDocProfiler::isOverlayVisible() const
+{
+    Q_D(const GtDocProfiler);
+    return d->m_overlayVisible;
+}
+
+void GtDocProfiler::setOverlayVisible(bool visible)
+{
+    Q_D(GtDocProfiler);
+    d->m_overlayVisible = visible;
+}
+
+int GtDocProfiler::maxFrames() const
+{
+    Q_D(const GtDocProfiler);
+    return d->m_maxFrames;
+}
+
+void GtDocProfiler::setMaxFrames(int maxFrames)
+{
+    Q_D(GtDocProfiler);
+
+    // the oldest frames go
+    d->m_maxFrames = MAX(maxFrames, 1);
+    d->m_frames = d->orderedFrames();
+    d->m_first = 0;
+
+    if (d->m_frames.size() > d->m_maxFrames)
+        d->m_frames.remove(0, d->m_frames.size() - d->m_maxFrames);
+}
+
+QVector<GtDocProfiler::Frame> GtDocProfiler::frames() const
+{
+    Q_D(const GtDocProfiler);
+    return d->orderedFrames();
+}
+
+GtDocProfiler::Frame GtDocProfiler::lastFrame() const
+{
+    Q_D(const GtDocProfiler);
+
+    if (d->m_frames.isEmpty())
+        return Frame();
+
+    return d->frame(d->m_frames.size() - 1);
+}
+
+quint64 GtDocProfiler::frameCount() const
+{
+    Q_D(const GtDocProfiler);
+    return d->m_frameCount;
+}
+
+void GtDocProfiler::clear()
+{
+    Q_D(GtDocProfiler);
+
+    d->m_frames.clear();
+    d->m_first = 0;
+    d->m_frameCount = 0;
+    d->m_inputTime = -1;
+}
+
+bool GtDocProfiler::save(const QString &fileName) const
+{
+    Q_D(const GtDocProfiler);
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "open profile file failed:" << fileName;
+        return false;
+    }
+
+    QTextStream stream(&file);
+
+    stream << "time,paint,pages,blank_pages,draw_page,max_page,"
+              "draw_image,notes,input_latency\n";
+
+    for (int i = 0; i < d->m_frames.size(); ++i) {
+        const Frame &frame = d->frame(i);
+
+        stream << frame.time << ','
+               << frame.paint << ','
+               << frame.pages << ','
+               << frame.blankPages << ','
+               << frame.drawPage << ','
+               << frame.maxPage << ','
+               << frame.drawImage << ','
+               << frame.notes << ','
+               << frame.inputLatency << '\n';
+    }
+
+    stream.flush();
+    return file.error() == QFile::NoError;
+}
+
+void GtDocProfiler::inputEvent()
+{
+    Q_D(GtDocProfiler);
+
+    // latency counts from the first input not yet painted
+    if (-1 == d->m_inputTime)
+        d->m_inputTime = d->now();
+}
+
+void GtDocProfiler::beginFrame()
+{
+    Q_D(GtDocProfiler);
+
+    Frame &frame = d->m_frame;
+    qint64 now = d->now();
+
+    frame.time = now;
+    frame.paint = 0;
+    frame.drawPage = 0;
+    frame.maxPage = 0;
+    frame.drawImage = 0;
+    frame.notes = 0;
+    frame.inputLatency = -1;
+    frame.pages = 0;
+    frame.blankPages = 0;
+
+    if (d->m_inputTime != -1) {
+        frame.inputLatency = now - d->m_inputTime;
+        d->m_inputTime = -1;
+    }
+
+    d->m_frameTime = now;
+    d->m_inFrame = true;
+}
+
+void GtDocProfiler::endFrame()
+{
+    Q_D(GtDocProfiler);
+
+    if (!d->m_inFrame)
+        return;
+
+    d->m_frame.paint = d->now() - d->m_frameTime;
+    d->m_inFrame = false;
+
+    // the oldest frame is overwritten once the ring is full
+    if (d->m_frames.size() < d->m_maxFrames) {
+        d->m_frames.append(d->m_frame);
+    }
+    else {
+        d->m_frames[d->m_first] = d->m_frame;
+        d->m_first = (d->m_first + 1) % d->m_frames.size();
+    }
+
+    d->m_frameCount += 1;
+}
+
+void GtDocProfiler::beginPage()
+{
+    Q_D(GtDocProfiler);
+    d->m_pageTime = d->now();
+}
+
+void GtDocProfiler::endPage(bool blank)
+{
+    Q_D(GtDocProfiler);
+
+    qint64 elapsed = d->now() - d->m_pageTime;
+
+    d->m_frame.drawPage += elapsed;
+    d->m_frame.maxPage = MAX(d->m_frame.maxPage, elapsed);
+    d->m_frame.pages += 1;
+
+    if (blank)
+        d->m_frame.blankPages += 1;
+}
+
+void GtDocProfiler::beginImage()
+{
+    Q_D(GtDocProfiler);
+    d->m_imageTime = d->now();
+}
+
+void GtDocProfiler::endImage()
+{
+    Q_D(GtDocProfiler);
+    d->m_frame.drawImage += d->now() - d->m_imageTime;
+}
+
+void GtDocProfiler::beginNotes()
+{
+    Q_D(GtDocProfiler);
+    d->m_notesTime = d->now();
+}
+
+void GtDocProfiler::endNotes()
+{
+    Q_D(GtDocProfiler);
+    d->m_frame.notes += d->now() - d->m_notesTime;
+}
+
+QRect GtDocProfiler::overlayRect() const
+{
+    return QRect(4, 4, 320, 64);
+}
+
+void GtDocProfiler::drawOverlay(QPainter &p)
+{
+    Q_D(GtDocProfiler);
+
+    // statistics of the recent frames
+    const int recentFrames = 120;
+    int count = MIN(d->m_frames.size(), recentFrames);
+    QVector<qint64> paints(count);
+    qint64 latency = 0;
+    int latencyCount = 0;
+    int blankPages = 0;
+
+    for (int i = 0; i < count; ++i) {
+        const Frame &frame = d->frame(d->m_frames.size() - count + i);
+
+        paints[i] = frame.paint;
+        blankPages += frame.blankPages;
+
+        if (frame.inputLatency != -1) {
+            latency += frame.inputLatency;
+            ++latencyCount;
+        }
+    }
+
+    qint64 last = count > 0 ? d->frame(d->m_frames.size() - 1).paint : 0;
+    qint64 p50 = percentile(paints, 50);
+    qint64 p95 = percentile(paints, 95);
+
+    QString text;
+    text += QString("paint %1 ms  p50 %2 ms  p95 %3 ms\n")
+            .arg(last / 1000.0, 0, 'f', 2)
+            .arg(p50 / 1000.0, 0, 'f', 2)
+            .arg(p95 / 1000.0, 0, 'f', 2);
+    text += QString("input %1 ms  blank pages %2  frames %3")
+            .arg(latencyCount ? latency / latencyCount / 1000.0 : 0.0, 0, 'f', 2)
+            .arg(blankPages)
+            .arg(count);
+
+    QRect rect(overlayRect());
+
+    p.save();
+    p.fillRect(rect, QColor(0, 0, 0, 160));
+    p.setPen(Qt::white);
+    p.drawText(rect.adjusted(6, 4, -6, -4), Qt::AlignLeft | Qt::AlignVCenter, text);
+    p.restore();
+}
+
+qint64 GtDocProfiler::percentile(QVector<qint64> values, int percent)
+{
+    if (values.isEmpty())
+        return 0;
+
+    int n = (values.size() - 1) * CLAMP(percent, 0, 100) / 100;
+    std::nth_element(values.begin(), values.begin() + n, values.end());
+    return values[n];
+}
+
+GT_END_NAMESPACE
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#ifndef __GT_DOC_PROFILER_H__
+#define __GT_DOC_PROFILER_H__
+
+#include "gtobject.h"
+#include <QtCore/QObject>
+#include <QtCore/QVector>
+
+class QPainter;
+class QRect;
+
+GT_BEGIN_NAMESPACE
+
+class GtDocProfilerPrivate;
+
+class GT_VIEW_EXPORT GtDocProfiler : public QObject, public GtObject
+{
+    Q_OBJECT
+
+public:
+    // all times are in microseconds
+    struct Frame
+    {
+        qint64 time;
+        qint64 paint;
+        qint64 drawPage;
+        qint64 maxPage;
+        qint64 drawImage;
+        qint64 notes;
+        qint64 inputLatency;
+        int pages;
+        int blankPages;
+    };
+
+public:
+    explicit GtDocProfiler(QObject *parent = 0);
+    ~GtDocProfiler();
+
+public:
+    bool isOverlayVisible() const;
+    void setOverlayVisible(bool visible);
+
+    int maxFrames() const;
+    void setMaxFrames(int maxFrames);
+
+    QVector<Frame> frames() const;
+    Frame lastFrame() const;
+
+    // the frames ended since the clear, the ones dropped included
+    quint64 frameCount() const;
+
+    void clear();
+    bool save(const QString &fileName) const;
+
+    // hooks of the view
+    void inputEvent();
+    void beginFrame();
+    void endFrame();
+    void beginPage();
+    void endPage(bool blank);
+    void beginImage();
+    void endImage();
+    void beginNotes();
+    void endNotes();
+
+    QRect overlayRect() const;
+    void drawOverlay(QPainter &p);
+
+    // the value at percent of the sorted values, 0 if empty
+    static qint64 percentile(QVector<qint64> values, int percent);
+
+private:
+    QScopedPointer<GtDocProfilerPrivate> d_ptr;
+
+private:
+    Q_DISABLE_COPY(GtDocProfiler)
+    Q_DECLARE_PRIVATE(GtDocProfiler)
+};
+
+GT_END_NAMESPACE
+
+#endif  /* __GT_DOC_PROFILER_H__ */
@@ -6,7 +6,10 @@
 #include "gtdocpage.h"
 #include "gtdocview.h"
 #include "gtdocument.h"
+#include "gtmemorygovernor.h"
+#include "gttrace.h"
 #include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QMutex>
 #include <QtCore/QThread>
 #include <QtGui/QColor>
@@ -14,7 +17,7 @@
 
 GT_BEGIN_NAMESPACE
 
-class GtDocRenderCachePrivate
+class GtDocRenderCachePrivate : public GtMemoryClient
 {
     Q_DECLARE_PUBLIC(GtDocRenderCache)
 
@@ -34,6 +37,9 @@ public:
             , page(0)
             , rotation(0)
             , rendered(false)
+            , evicted(false)
+            , cost(0)
+            , lastUse(0)
         {
         }
 
@@ -43,6 +49,9 @@ public:
         int page;
         int rotation;
         bool rendered;
+        bool evicted;
+        qint64 cost;
+        qint64 lastUse;
     };
 
 public:
@@ -59,13 +68,29 @@ public:
         return 0;
     }
 
+    // bytes to charge to the memory governor since the last
+    // call, with the lock held
+    qint64 chargeDelta();
+
+    // the preloaded image farthest from the current page,
+    // with the lock held
+    CacheInfo* victim();
+
+    bool candidate(Candidate *candidate);
+    qint64 evict();
+    qint64 evictAll();
+
 private:
     GtDocRenderCache *q_ptr;
     GtDocView *m_view;
     int m_maxSize;
     int m_index;
     int m_currentPage;
+    int m_beginPage;
+    int m_endPage;
+    qint64 m_charged;
     QVector<CacheInfo> m_caches;
+    GtRenderStats m_stats;
     QMutex m_mutex;
 };
 
@@ -75,11 +100,101 @@ GtDocRenderCachePrivate::GtDocRenderCachePrivate(GtDocRenderCache *parent)
     , m_maxSize(0)
     , m_index(0)
     , m_currentPage(0)
+    , m_beginPage(0)
+    , m_endPage(0)
+    , m_charged(0)
 {
+    m_stats.hits = 0;
+    m_stats.misses = 0;
+    m_stats.renderedPages = 0;
+    m_stats.renderedPixels = 0;
+    m_stats.renderTime = 0;
+
+    GtMemoryGovernor::instance()->addClient(this);
 }
 
 GtDocRenderCachePrivate::~GtDocRenderCachePrivate()
 {
+    GtMemoryGovernor::instance()->removeClient(this);
+}
+
+qint64 GtDocRenderCachePrivate::chargeDelta()
+{
+    qint64 bytes = 0;
+
+    for (int i = 0; i < m_caches.size(); ++i)
+        bytes += m_caches[i].image.byteCount();
+
+    qint64 delta = bytes - m_charged;
+    m_charged = bytes;
+    return delta;
+}
+
+GtDocRenderCachePrivate::CacheInfo* GtDocRenderCachePrivate::victim()
+{
+    CacheInfo *info = 0;
+    int distance = 0;
+
+    // the visible pages never go
+    for (int i = 0; i < m_caches.size(); ++i) {
+        CacheInfo &it = m_caches[i];
+
+        if (it.image.isNull() ||
+            (it.page >= m_beginPage && it.page < m_endPage))
+        {
+            continue;
+        }
+
+        int d = qAbs(it.page - m_currentPage);
+        if (!info || d > distance) {
+            info = &it;
+            distance = d;
+        }
+    }
+
+    return info;
+}
+
+bool GtDocRenderCachePrivate::candidate(Candidate *candidate)
+{
+    QMutexLocker lock(&m_mutex);
+
+    CacheInfo *info = victim();
+    if (!info)
+        return false;
+
+    candidate->bytes = info->image.byteCount();
+    candidate->cost = info->cost;
+    candidate->lastUse = info->lastUse;
+    return true;
+}
+
+qint64 GtDocRenderCachePrivate::evict()
+{
+    QMutexLocker lock(&m_mutex);
+
+    CacheInfo *info = victim();
+    if (!info)
+        return 0;
+
+    // stays rendered, or the render thread would render it
+    // again at once and the charge would evict it again; it
+    // is rendered again when the page range changes
+    qint64 bytes = info->image.byteCount();
+    info->image = QImage();
+    info->evicted = true;
+    m_charged -= bytes;
+    return bytes;
+}
+
+qint64 GtDocRenderCachePrivate::evictAll()
+{
+    QMutexLocker lock(&m_mutex);
+
+    qint64 bytes = m_charged;
+    m_caches.clear();
+    m_charged = 0;
+    return bytes;
 }
 
 int GtDocRenderCachePrivate::pageBytes(int index, double scale, int rotation)
@@ -194,6 +309,9 @@ void GtDocRenderCache::setPageRange(int beginPage, int endPage, int currentPage)
 
     /* Update the cache infos. */
     QMutexLocker lock(&d->m_mutex);
+    d->m_beginPage = beginPage;
+    d->m_endPage = endPage;
+
     int offset = d->m_index - preloadBegin;
     if (offset > 0) {
         d->m_caches.resize(preloadEnd - preloadBegin);
@@ -235,8 +353,17 @@ void GtDocRenderCache::setPageRange(int beginPage, int endPage, int currentPage)
             info.rotation = rotation;
             info.rendered = false;
         }
+
+        if (info.evicted) {
+            info.evicted = false;
+            info.rendered = false;
+        }
     }
 
+    qint64 delta = d->chargeDelta();
+    lock.unlock();
+
+    GtMemoryGovernor::instance()->charge(d, delta);
     QMetaObject::invokeMethod(this, "renderNext", Qt::QueuedConnection);
 }
 
@@ -248,8 +375,15 @@ QImage GtDocRenderCache::image(int index)
     QMutexLocker lock(&d->m_mutex);
 
     GtDocRenderCachePrivate::CacheInfo *info = d->cacheInfo(index);
-    if (info)
+    if (info) {
         image = info->image;
+        info->lastUse = GtMemoryGovernor::now();
+    }
+
+    if (image.isNull())
+        d->m_stats.misses++;
+    else
+        d->m_stats.hits++;
 
     return image;
 }
@@ -258,8 +392,47 @@ void GtDocRenderCache::clear()
 {
     Q_D(GtDocRenderCache);
 
+    qint64 delta;
+
+    if (1) {
+        QMutexLocker lock(&d->m_mutex);
+        d->m_caches.clear();
+        delta = d->chargeDelta();
+    }
+
+    GtMemoryGovernor::instance()->charge(d, delta);
+}
+
+qint64 GtDocRenderCache::memoryUsage()
+{
+    Q_D(GtDocRenderCache);
+    return GtMemoryGovernor::instance()->usage(d);
+}
+
+void GtDocRenderCache::trim()
+{
+    Q_D(GtDocRenderCache);
+    GtMemoryGovernor::instance()->trim(d);
+}
+
+GtRenderStats GtDocRenderCache::stats()
+{
+    Q_D(GtDocRenderCache);
+
+    QMutexLocker lock(&d->m_mutex);
+    return d->m_stats;
+}
+
+void GtDocRenderCache::resetStats()
+{
+    Q_D(GtDocRenderCache);
+
     QMutexLocker lock(&d->m_mutex);
-    d->m_caches.clear();
+    d->m_stats.hits = 0;
+    d->m_stats.misses = 0;
+    d->m_stats.renderedPages = 0;
+    d->m_stats.renderedPixels = 0;
+    d->m_stats.renderTime = 0;
 }
 
 void GtDocRenderCache::renderNext()
@@ -309,23 +482,42 @@ next:
         return;
     }
 
+    QElapsedTimer timer;
+    timer.start();
+
     GtDocPage *page = document->page(pageIndex);
     QSize size = page->size(scale, rotation);
     QImage image(size, QImage::Format_ARGB32);
 
-    image.fill(QColor(255, 255, 255));
-    page->paint(&image, scale, rotation);
+    if (1) {
+        GT_TRACE_SCOPE("render", "render page");
+        image.fill(QColor(255, 255, 255));
+        page->paint(&image, scale, rotation);
+    }
+
+    qint64 elapsed = timer.nsecsElapsed() / 1000;
 
     // Notify UI thread
     GtDocRenderCachePrivate::CacheInfo *info = 0;
+    qint64 delta = 0;
     if (1) {
         QMutexLocker lock(&d->m_mutex);
 
+        d->m_stats.renderedPages++;
+        d->m_stats.renderedPixels += qint64(size.width()) * size.height();
+        d->m_stats.renderTime += elapsed;
+
         info = d->cacheInfo(pageIndex);
-        if (info)
+        if (info) {
             info->image = image;
+            info->cost = elapsed;
+            info->lastUse = GtMemoryGovernor::now();
+            delta = d->chargeDelta();
+        }
     }
 
+    GtMemoryGovernor::instance()->charge(d, delta);
+
     if (info) {
         emit finished(page->index());
     }
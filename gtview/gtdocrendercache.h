@@ -5,7 +5,9 @@
 #define __GT_DOC_RENDER_CACHE_H__
 
 #include "gtobject.h"
+#include "gtrenderstats.h"
 #include <QtCore/QObject>
+#include <QtGui/QImage>
 
 GT_BEGIN_NAMESPACE
 
@@ -21,11 +23,21 @@ public:
     ~GtDocRenderCache();
 
 public:
+    // the bytes of the images around the current page, a cap of
+    // its own, the memory governor may evict them before it
     void setMaxSize(int maxSize);
     void setPageRange(int beginPage, int endPage, int currentPage);
     QImage image(int index);
     void clear();
 
+    // bytes of the rendered images, and dropping all of them
+    // from the memory governor
+    qint64 memoryUsage();
+    void trim();
+
+    GtRenderStats stats();
+    void resetStats();
+
 Q_SIGNALS:
     void finished(int index);
 
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#include "gtdoctrace.h"
+#include <QtCore/QDataStream>
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+
+GT_BEGIN_NAMESPACE
+
+class GtDocTracePrivate
+{
+    Q_DECLARE_PUBLIC(GtDocTrace)
+
+public:
+    enum {
+        Magic = 0x47545452,  // "GTTR"
+        Version = 1
+    };
+
+public:
+    explicit GtDocTracePrivate(GtDocTrace *q);
+    ~GtDocTracePrivate();
+
+protected:
+    GtDocTrace *q_ptr;
+    QElapsedTimer m_clock;
+    QVector<GtDocTrace::Event> m_events;
+    QSize m_viewSize;
+    int m_pageCount;
+
+    // index of the last view state, -1 if none
+    int m_lastState;
+};
+
+GtDocTracePrivate::GtDocTracePrivate(GtDocTrace *q)
+    : q_ptr(q)
+    , m_pageCount(0)
+    , m_lastState(-1)
+{
+    m_clock.start();
+}
+
+GtDocTracePrivate::~GtDocTracePrivate()
+{
+}
+
+GtDocTrace::GtDocTrace(QObject *parent)
+    : QObject(parent)
+    , d_ptr(new GtDocTracePrivate(this))
+{
+}
+
+GtDocTrace::~GtDocTrace()
+{
+}
+
+int GtDocTrace::pageCount() const
+{
+    Q_D(const GtDocTrace);
+    return d->m_pageCount;
+}
+
+void GtDocTrace::setPageCount(int pageCount)
+{
+    Q_D(GtDocTrace);
+    d->m_pageCount = pageCount;
+}
+
+QSize GtDocTrace::viewSize() const
+{
+    Q_D(const GtDocTrace);
+    return d->m_viewSize;
+}
+
+void GtDocTrace::setViewSize(const QSize &size)
+{
+    Q_D(GtDocTrace);
+    d->m_viewSize = size;
+}
+
+QVector<GtDocTrace::Event> GtDocTrace::events() const
+{
+    Q_D(const GtDocTrace);
+    return d->m_events;
+}
+
+void GtDocTrace::clear()
+{
+    Q_D(GtDocTrace);
+
+    d->m_events.clear();
+    d->m_lastState = -1;
+    d->m_clock.start();
+}
+
+bool GtDocTrace::save(const QString &fileName) const
+{
+    Q_D(const GtDocTrace);
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "open trace file failed:" << fileName;
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    stream << quint32(GtDocTracePrivate::Magic)
+           << quint32(GtDocTracePrivate::Version)
+           << qint32(d->m_pageCount)
+           << d->m_viewSize
+           << quint32(d->m_events.size());
+
+    // times are stored as deltas, the state only for ViewState
+    qint64 time = 0;
+    QVector<Event>::const_iterator it;
+    for (it = d->m_events.begin(); it != d->m_events.end(); ++it) {
+        stream << quint8(it->type) << quint32(it->time - time);
+        time = it->time;
+
+        if (it->type != ViewState)
+            continue;
+
+        stream << qint32(it->page)
+               << it->scale
+               << qint16(it->rotation)
+               << qint32(it->scrollX)
+               << qint32(it->scrollY);
+    }
+
+    return stream.status() == QDataStream::Ok;
+}
+
+bool GtDocTrace::load(const QString &fileName)
+{
+    Q_D(GtDocTrace);
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "open trace file failed:" << fileName;
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic, version, count;
+    qint32 pageCount;
+    QSize viewSize;
+
+    stream >> magic >> version;
+    if (magic != GtDocTracePrivate::Magic ||
+        version != GtDocTracePrivate::Version)
+    {
+        qWarning() << "invalid trace file:" << fileName;
+        return false;
+    }
+
+    stream >> pageCount >> viewSize >> count;
+
+    QVector<Event> events;
+    qint64 time = 0;
+
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        Event event;
+        quint8 type;
+        quint32 delta;
+
+        stream >> type >> delta;
+        time += delta;
+
+        event.time = time;
+        event.type = type;
+        event.page = 0;
+        event.scale = 0;
+        event.rotation = 0;
+        event.scrollX = 0;
+        event.scrollY = 0;
+
+        if (type == ViewState) {
+            qint32 page, scrollX, scrollY;
+            qint16 rotation;
+
+            stream >> page >> event.scale >> rotation >> scrollX >> scrollY;
+            event.page = page;
+            event.rotation = rotation;
+            event.scrollX = scrollX;
+            event.scrollY = scrollY;
+        }
+
+        events.append(event);
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        qWarning() << "truncated trace file:" << fileName;
+        return false;
+    }
+
+    d->m_pageCount = pageCount;
+    d->m_viewSize = viewSize;
+    d->m_events = events;
+    d->m_lastState = -1;
+    return true;
+}
+
+void GtDocTrace::inputEvent(EventType type)
+{
+    Q_D(GtDocTrace);
+
+    Event event;
+
+    event.time = d->m_clock.elapsed();
+    event.type = type;
+    event.page = 0;
+    event.scale = 0;
+    event.rotation = 0;
+    event.scrollX = 0;
+    event.scrollY = 0;
+    d->m_events.append(event);
+}
+
+void GtDocTrace::viewState(int page, double scale, int rotation,
+                           int scrollX, int scrollY)
+{
+    Q_D(GtDocTrace);
+
+    // only changes of the state are recorded
+    if (d->m_lastState != -1) {
+        const Event &last = d->m_events[d->m_lastState];
+
+        if (last.page == page &&
+            last.scale == scale &&
+            last.rotation == rotation &&
+            last.scrollX == scrollX &&
+            last.scrollY == scrollY)
+        {
+            return;
+        }
+    }
+
+    Event event;
+
+    event.time = d->m_clock.elapsed();
+    event.type = ViewState;
+    event.page = page;
+    event.scale = scale;
+    event.rotation = rotation;
+    event.scrollX = scrollX;
+    event.scrollY = scrollY;
+
+    d->m_lastState = d->m_events.size();
+    d->m_events.append(event);
+}
+
+GT_END_NAMESPACE
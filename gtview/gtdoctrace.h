@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#ifndef __GT_DOC_TRACE_H__
+#define __GT_DOC_TRACE_H__
+
+#include "gtobject.h"
+#include <QtCore/QObject>
+#include <QtCore/QSize>
+#include <QtCore/QVector>
+
+GT_BEGIN_NAMESPACE
+
+class GtDocTracePrivate;
+
+class GT_VIEW_EXPORT GtDocTrace : public QObject, public GtObject
+{
+    Q_OBJECT
+
+public:
+    enum EventType {
+        KeyInput,
+        MouseInput,
+        WheelInput,
+        ViewState
+    };
+
+    // the state fields are valid for ViewState only, time
+    // is in milliseconds since the recording started
+    struct Event
+    {
+        qint64 time;
+        int type;
+        int page;
+        double scale;
+        int rotation;
+        int scrollX;
+        int scrollY;
+    };
+
+public:
+    explicit GtDocTrace(QObject *parent = 0);
+    ~GtDocTrace();
+
+public:
+    int pageCount() const;
+    void setPageCount(int pageCount);
+
+    QSize viewSize() const;
+    void setViewSize(const QSize &size);
+
+    QVector<Event> events() const;
+    void clear();
+
+    bool save(const QString &fileName) const;
+    bool load(const QString &fileName);
+
+    // hooks of the view
+    void inputEvent(EventType type);
+    void viewState(int page, double scale, int rotation,
+                   int scrollX, int scrollY);
+
+private:
+    QScopedPointer<GtDocTracePrivate> d_ptr;
+
+private:
+    Q_DISABLE_COPY(GtDocTrace)
+    Q_DECLARE_PRIVATE(GtDocTrace)
+};
+
+GT_END_NAMESPACE
+
+#endif  /* __GT_DOC_TRACE_H__ */
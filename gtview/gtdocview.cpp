@@ -8,11 +8,16 @@
 #include "gtdocnote.h"
 #include "gtdocnotes.h"
 #include "gtdocpage.h"
+#include "gtdocprofiler.h"
 #include "gtdocrange.h"
 #include "gtdocrendercache.h"
+#include "gtdoctrace.h"
 #include "gtdocument.h"
 #include "gtlinkdest.h"
+#include "gttrace.h"
 #include <QtCore/QDebug>
+#include <QtCore/QHash>
+#include <QtCore/QPointer>
 #include <QtCore/QTimer>
 #include <QtGui/QClipboard>
 #include <QtGui/QPainter>
@@ -41,15 +46,32 @@ public:
         void height(GtDocument *d, int page,
                     int r, int e, double s,
                     double *h, double *dh);
+        void clear();
+
     private:
         void rebuild();
+        void buildSums();
+        double rowHeight(int row, int swap, int e) const;
 
     private:
         GtDocument *document;
-        int rotation;
-        int evenPageLeft;
-        double *heightToPage;
-        double *dualHeightToPage;
+        int pageCount;
+        bool uniform;
+        double uniformWidth;
+        double uniformHeight;
+        QVector<double> widths;
+        QVector<double> heights;
+
+        // prefix sums of the page heights, indexed by whether width
+        // and height are swapped, the dual page rows also by the
+        // parity of the left page, rotation flips need no rebuild
+        QVector<double> heightToPage[2];
+        QVector<double> dualHeightToRow[2][2];
+    };
+
+    struct PageGeometry {
+        QHash<quint64, QVector<QRect> > lines;
+        QHash<quint64, QRegion> regions;
     };
 
 public:
@@ -79,6 +101,8 @@ public:
 
     void heightToPage(int page, double *height, double *dualHeight);
     int pageYOffset(int page);
+    int pageLowerBound(int y);
+    void pageRangeOfView(int top, int bottom, int *begin, int *end);
     QRect computeBorder(const QSize &size);
 
     inline QSize pageSizeOfView(int index) {
@@ -121,7 +145,15 @@ public:
     void drawPage(QPainter &p, int index, const QRect &pageArea,
                   const QRect &border, const GtDocRange &selRange);
     QVector<QRect> textRects(GtDocPage *page, int begin, int end) const;
+    QVector<QRect> mergeTextRects(GtDocPage *page, int begin, int end) const;
     QRegion rangeRegion(const GtDocRange &range, GtDocPage *page) const;
+    PageGeometry &pageGeometry(int index) const;
+    void clearGeometry();
+    void clearGeometry(const GtDocRange &range);
+
+    static inline quint64 textKey(int begin, int end) {
+        return (quint64(quint32(begin)) << 32) | quint32(end);
+    }
     int pageDistance(int page, const QPoint &point, QPointF *ppoint);
     QTransform pageAreaToView(GtDocPage *page) const;
     QPoint pageViewToView(int index);
@@ -153,8 +185,15 @@ private:
     GtDocModel::MouseMode m_mouseMode;
     HeightCache m_heightCache;
 
+    // merged line rects of text ranges, in page view coordinates
+    mutable QHash<int, PageGeometry> m_geometry;
+    mutable double m_geometryScale;
+    mutable int m_geometryRotation;
+
     GtDocRenderCache *m_renderCache;
     QBasicTimer m_cursorBlinkTimer;
+    QPointer<GtDocProfiler> m_profiler;
+    QPointer<GtDocTrace> m_trace;
 
     // selection
     GtDocPoint m_selectBegin;
@@ -178,146 +217,144 @@ private:
 
 GtDocViewPrivate::HeightCache::HeightCache()
     : document(0)
-    , rotation(0)
-    , evenPageLeft(0)
-    , heightToPage(0)
-    , dualHeightToPage(0)
+    , pageCount(0)
+    , uniform(false)
+    , uniformWidth(0)
+    , uniformHeight(0)
 {
 }
 
 GtDocViewPrivate::HeightCache::~HeightCache()
 {
-    delete[] heightToPage;
-    delete[] dualHeightToPage;
 }
 
 void GtDocViewPrivate::HeightCache::height(GtDocument *d, int page,
                                            int r, int e, double s,
                                            double *h, double *dh)
 {
-    if (d != document || r != rotation || e != evenPageLeft) {
+    // cleared by the view on every change of the document
+    if (!document) {
         document = d;
-        rotation = r;
-        evenPageLeft = e;
-
         rebuild();
     }
 
+    Q_ASSERT(d == document);
+
+    Q_ASSERT(page >= 0 && page <= pageCount);
+
+    int swap = (r == 90 || r == 270) ? 1 : 0;
+
+    // pages of a dual row share its offset, the first row holds
+    // only the first page when even pages are on the left
+    int row = (page + e) / 2;
+
+    if (uniform) {
+        double uh = swap ? uniformWidth : uniformHeight;
+
+        if (h)
+            *h = page * uh * s;
+
+        if (dh)
+            *dh = row * uh * s;
+
+        return;
+    }
+
     if (h)
-        *h = heightToPage[page] * s;
+        *h = heightToPage[swap][page] * s;
 
     if (dh)
-        *dh = dualHeightToPage[page] * s;
+        *dh = dualHeightToRow[swap][e][row] * s;
 }
 
-void GtDocViewPrivate::HeightCache::rebuild()
+void GtDocViewPrivate::HeightCache::clear()
 {
-    delete[] heightToPage;
-    delete[] dualHeightToPage;
+    document = 0;
+    pageCount = 0;
+    uniform = false;
+    widths.clear();
+    heights.clear();
 
-    if (!document) {
-        heightToPage = 0;
-        dualHeightToPage = 0;
-        return;
+    for (int i = 0; i < 2; ++i) {
+        heightToPage[i].clear();
+        dualHeightToRow[i][0].clear();
+        dualHeightToRow[i][1].clear();
     }
+}
 
-    GtDocPage *page;
-    bool swap, uniform;
-    int i, pageCount;
-    double uniformHeight, pageHeight, nextPageHeight;
-    double savedHeight;
-    double uWidth, uHeight;
+void GtDocViewPrivate::HeightCache::rebuild()
+{
+    GtDocument *d = document;
 
-    swap = (rotation == 90 || rotation == 270);
+    clear();
+    document = d;
+
+    if (!document)
+        return;
 
-    uniform = document->isPageSizeUniform();
     pageCount = document->pageCount();
+    uniform = document->isPageSizeUniform();
 
     if (uniform) {
         if (pageCount > 0)
-            document->page(0)->size(&uWidth, &uHeight);
+            document->page(0)->size(&uniformWidth, &uniformHeight);
         else
             qWarning() << "can't get uniform page size";
+
+        return;
     }
 
-    heightToPage = new double[pageCount + 1];
-    dualHeightToPage = new double[pageCount + 2];
-    savedHeight = 0;
+    buildSums();
+}
 
-    for (i = 0; i <= pageCount; ++i) {
-        if (uniform) {
-            uniformHeight = swap ? uWidth : uHeight;
-            heightToPage[i] = i * uniformHeight;
-        }
-        else {
-            if (i < pageCount) {
-                double w, h;
+void GtDocViewPrivate::HeightCache::buildSums()
+{
+    widths.resize(pageCount);
+    heights.resize(pageCount);
 
-                page = document->page(i);
-                page->size(&w, &h);
-                pageHeight = swap ? w : h;
-            }
-            else {
-                pageHeight = 0;
-            }
+    for (int i = 0; i < pageCount; ++i)
+        document->page(i)->size(&widths[i], &heights[i]);
 
-            heightToPage[i] = savedHeight;
-            savedHeight += pageHeight;
-        }
-    }
+    // one more row than needed, so the offset past
+    // the last page can be queried as well
+    int rowCount = (pageCount + 1) / 2 + 1;
 
-    if (evenPageLeft && !uniform) {
-        double w, h;
+    for (int swap = 0; swap < 2; ++swap) {
+        const QVector<double> &sizes = swap ? widths : heights;
+        QVector<double> &sums = heightToPage[swap];
 
-        page = document->page(0);
-        page->size(&w, &h);
-        savedHeight = swap ? w : h;
-    }
-    else {
-        savedHeight = 0;
-    }
+        sums.resize(pageCount + 1);
+        sums[0] = 0;
+
+        for (int i = 0; i < pageCount; ++i)
+            sums[i + 1] = sums[i] + sizes[i];
+
+        for (int e = 0; e < 2; ++e) {
+            QVector<double> &rows = dualHeightToRow[swap][e];
 
-    for (i = evenPageLeft; i < pageCount + 2; i += 2) {
-        if (uniform) {
-            uniformHeight = swap ? uWidth : uHeight;
-            dualHeightToPage[i] = ((i + evenPageLeft) / 2) * uniformHeight;
+            rows.resize(rowCount + 1);
+            rows[0] = 0;
 
-            if (i + 1 < pageCount + 2)
-                dualHeightToPage[i + 1] = ((i + evenPageLeft) / 2) * uniformHeight;
+            for (int i = 0; i < rowCount; ++i)
+                rows[i + 1] = rows[i] + rowHeight(i, swap, e);
         }
-        else {
-            if (i + 1 < pageCount) {
-                double w, h;
+    }
+}
 
-                page = document->page(i + 1);
-                page->size(&w, &h);
-                nextPageHeight = swap ? w : h;
-            }
-            else {
-                nextPageHeight = 0;
-            }
+double GtDocViewPrivate::HeightCache::rowHeight(int row, int swap, int e) const
+{
+    const QVector<double> &sizes = swap ? widths : heights;
+    int left = row * 2 - e;
+    int right = left + 1;
+    double height = 0;
 
-            if (i < pageCount) {
-                double w, h;
+    if (left >= 0 && left < pageCount)
+        height = sizes[left];
 
-                page = document->page(i);
-                page->size(&w, &h);
-                pageHeight = swap ? w : h;
-            }
-            else {
-                pageHeight = 0;
-            }
+    if (right >= 0 && right < pageCount)
+        height = MAX(height, sizes[right]);
 
-            if (i + 1 < pageCount + 2) {
-                dualHeightToPage[i] = savedHeight;
-                dualHeightToPage[i + 1] = savedHeight;
-                savedHeight += MAX(pageHeight, nextPageHeight);
-            }
-            else {
-                dualHeightToPage[i] = savedHeight;
-            }
-        }
-    }
+    return height;
 }
 
 GtDocViewPrivate::GtDocViewPrivate(GtDocView *q, QThread *t)
@@ -339,6 +376,8 @@ GtDocViewPrivate::GtDocViewPrivate(GtDocView *q, QThread *t)
     , m_layoutMode(GtDocModel::SinglePage)
     , m_sizingMode(GtDocModel::FitWidth)
     , m_mouseMode(GtDocModel::BrowseMode)
+    , m_geometryScale(1.0)
+    , m_geometryRotation(0)
     , m_paperColor(255, 255, 255)
     , m_highlightColor(255, 255, 0)
     , m_underlineColor(255, 64, 64)
@@ -527,6 +566,41 @@ int GtDocViewPrivate::pageYOffset(int page)
     return offset;
 }
 
+int GtDocViewPrivate::pageLowerBound(int y)
+{
+    // the first page whose offset is not less than y, the
+    // offsets grow with the page index in continuous mode
+    int low = 0;
+    int high = m_pageCount;
+
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+
+        if (pageYOffset(middle) < y)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+void GtDocViewPrivate::pageRangeOfView(int top, int bottom,
+                                       int *begin, int *end)
+{
+    // pages before the one at the top end above its offset, and
+    // pages of a dual row share the offset of the row
+    int first = pageLowerBound(top + 1) - 1;
+
+    if (first > 0)
+        first = pageLowerBound(pageYOffset(first));
+    else
+        first = 0;
+
+    *begin = first;
+    *end = MAX(first, pageLowerBound(bottom));
+}
+
 QRect GtDocViewPrivate::computeBorder(const QSize &size)
 {
     QRect rect(1, 1, 0, 0);
@@ -895,6 +969,7 @@ void GtDocViewPrivate::drawPage(QPainter &p, int index, const QRect &pageArea,
                                 const QRect &border, const GtDocRange &selRange)
 {
     GtDocPage *page = m_document->page(index);
+    GtDocProfiler *profiler = m_profiler;
     QRect realArea(pageArea.x() + border.left(),
                    pageArea.y() + border.top(),
                    pageArea.width() - border.left() - border.right(),
@@ -902,6 +977,9 @@ void GtDocViewPrivate::drawPage(QPainter &p, int index, const QRect &pageArea,
     QPoint offset(pageArea.x() + border.left(),
                   pageArea.y() + border.top());
 
+    if (profiler)
+        profiler->beginPage();
+
     // draw border and background
     int levels = border.right() - border.left();
     int x = realArea.x();
@@ -933,11 +1011,23 @@ void GtDocViewPrivate::drawPage(QPainter &p, int index, const QRect &pageArea,
     QImage image = m_renderCache->image(index);
     if (image.isNull()) {
         p.fillRect(realArea, m_paperColor);
+
+        if (profiler)
+            profiler->endPage(true);
+
         return;
     }
 
+    if (profiler)
+        profiler->beginImage();
+
     p.drawImage(realArea, image);
 
+    if (profiler) {
+        profiler->endImage();
+        profiler->beginNotes();
+    }
+
     // draw page notes
     if (m_notes) {
         QList<GtDocNote*> notes = m_notes->pageNotes(index);
@@ -952,9 +1042,28 @@ void GtDocViewPrivate::drawPage(QPainter &p, int index, const QRect &pageArea,
     QRegion selRegion(rangeRegion(selRange, page));
     selRegion.translate(offset);
     fillRegion(p, selRegion, m_selBgColor);
+
+    if (profiler) {
+        profiler->endNotes();
+        profiler->endPage(false);
+    }
 }
 
 QVector<QRect> GtDocViewPrivate::textRects(GtDocPage *page, int begin, int end) const
+{
+    PageGeometry &geometry = pageGeometry(page->index());
+    quint64 key = textKey(begin, end);
+
+    QHash<quint64, QVector<QRect> >::const_iterator it = geometry.lines.find(key);
+    if (it != geometry.lines.end())
+        return it.value();
+
+    QVector<QRect> rects(mergeTextRects(page, begin, end));
+    geometry.lines.insert(key, rects);
+    return rects;
+}
+
+QVector<QRect> GtDocViewPrivate::mergeTextRects(GtDocPage *page, int begin, int end) const
 {
     GtDocTextPointer text(page->text());
     const QRectF *rect = text->rects() + begin;
@@ -1022,12 +1131,22 @@ QRegion GtDocViewPrivate::rangeRegion(const GtDocRange &range,
             QPoint selText(range.intersectedText(page));
 
             if (selText.y() > selText.x()) {
+                PageGeometry &geometry = pageGeometry(page->index());
+                quint64 key = textKey(selText.x(), selText.y());
+
+                QHash<quint64, QRegion>::const_iterator cached;
+                cached = geometry.regions.find(key);
+                if (cached != geometry.regions.end())
+                    return cached.value();
+
                 QVector<QRect> rects;
 
                 rects = (textRects(page, selText.x(), selText.y()));
                 QVector<QRect>::iterator it;
                 for (it = rects.begin(); it != rects.end(); ++it)
                     region += *it;
+
+                geometry.regions.insert(key, region);
             }
         }
         break;
@@ -1044,6 +1163,41 @@ QRegion GtDocViewPrivate::rangeRegion(const GtDocRange &range,
     return region;
 }
 
+GtDocViewPrivate::PageGeometry &GtDocViewPrivate::pageGeometry(int index) const
+{
+    // the rects are in page view coordinates, only the
+    // scale and rotation matter, not the page position
+    if (m_geometryScale != m_scale || m_geometryRotation != m_rotation) {
+        m_geometry.clear();
+        m_geometryScale = m_scale;
+        m_geometryRotation = m_rotation;
+    }
+
+    // dragging a selection leaves a trail of stale ranges
+    const int maxEntries = 1024;
+    PageGeometry &geometry = m_geometry[index];
+    if (geometry.lines.size() + geometry.regions.size() > maxEntries) {
+        geometry.lines.clear();
+        geometry.regions.clear();
+    }
+
+    return geometry;
+}
+
+void GtDocViewPrivate::clearGeometry()
+{
+    m_geometry.clear();
+}
+
+void GtDocViewPrivate::clearGeometry(const GtDocRange &range)
+{
+    if (range.isEmpty())
+        return;
+
+    for (int i = range.begin().page(); i <= range.end().page(); ++i)
+        m_geometry.remove(i);
+}
+
 int GtDocViewPrivate::pageDistance(int page, const QPoint &point, QPointF *ppoint)
 {
     QRect rect(pageExtents(page));
@@ -1419,6 +1573,55 @@ void GtDocView::setRenderCacheSize(int size)
     d->m_renderCache->setMaxSize(size);
 }
 
+GtDocView::RenderStats GtDocView::renderStats() const
+{
+    Q_D(const GtDocView);
+    return d->m_renderCache->stats();
+}
+
+void GtDocView::resetRenderStats()
+{
+    Q_D(GtDocView);
+    d->m_renderCache->resetStats();
+}
+
+void GtDocView::trimMemory()
+{
+    Q_D(GtDocView);
+    d->m_renderCache->trim();
+}
+
+GtDocProfiler* GtDocView::profiler() const
+{
+    Q_D(const GtDocView);
+    return d->m_profiler;
+}
+
+void GtDocView::setProfiler(GtDocProfiler *profiler)
+{
+    Q_D(GtDocView);
+
+    d->m_profiler = profiler;
+    viewport()->update();
+}
+
+GtDocTrace* GtDocView::trace() const
+{
+    Q_D(const GtDocView);
+    return d->m_trace;
+}
+
+void GtDocView::setTrace(GtDocTrace *trace)
+{
+    Q_D(GtDocView);
+
+    d->m_trace = trace;
+    if (trace && d->m_model && d->m_model->document()) {
+        trace->setPageCount(d->m_model->document()->pageCount());
+        trace->setViewSize(viewport()->size());
+    }
+}
+
 void GtDocView::lockPageUpdate()
 {
     Q_D(GtDocView);
@@ -1772,6 +1975,8 @@ void GtDocView::documentChanged(GtDocument *document)
     d->m_document = document;
     d->m_pageCount = d->isDocLoaded() ? d->m_document->pageCount() : 0;
     d->m_renderCache->clear();
+    d->m_heightCache.clear();
+    d->clearGeometry();
     d->m_selectBegin = GtDocPoint();
     d->m_selectEnd = GtDocPoint();
 
@@ -1794,6 +1999,8 @@ void GtDocView::documentLoaded(GtDocument *document)
 
     d->m_pageCount = d->m_document->pageCount();
     d->m_currentPage = d->m_model->page();
+    d->m_heightCache.clear();
+    d->clearGeometry();
 
     d->relayoutPagesLater();
 }
@@ -1820,6 +2027,7 @@ void GtDocView::notesChanged(GtDocNotes *notes)
     }
 
     d->m_notes = notes;
+    d->clearGeometry();
     if (d->m_notes) {
         connect(d->m_notes, SIGNAL(added(GtDocNote*)),
                 this, SLOT(noteUpdated(GtDocNote*)));
@@ -1834,6 +2042,7 @@ void GtDocView::notesChanged(GtDocNotes *notes)
 void GtDocView::noteUpdated(GtDocNote *note)
 {
     Q_D(GtDocView);
+    d->clearGeometry(note->range());
     d->repaintDocRange(note->range());
 }
 
@@ -1962,6 +2171,9 @@ void GtDocView::relayoutPages()
     d->resizeContentArea(size);
 
     scrollTo(hsbar->maximum() * dx + 0.5, vsbar->maximum() * dy + 0.5);
+
+    // the pixels on screen belong to the old layout, don't blit them
+    viewport()->update();
 }
 
 void GtDocView::updateVisiblePages(int newValue)
@@ -1984,14 +2196,19 @@ void GtDocView::updateVisiblePages(int newValue)
         bool found = false;
         int areaMax = -1, area;
         int bestCurrentPage = -1;
-        int i, j = 0;
+        int i, first, last;
 
         const QRect viewportRect(horizontalScrollBar()->value(),
                                  verticalScrollBar()->value(),
                                  viewport()->width(),
                                  viewport()->height());
 
-        for (i = 0; i < d->m_pageCount; ++i) {
+        // only the pages overlapping the viewport vertically
+        d->pageRangeOfView(viewportRect.top(),
+                           viewportRect.top() + viewportRect.height(),
+                           &first, &last);
+
+        for (i = first; i < last; ++i) {
             pageArea = d->pageExtents(i);
             unused = viewportRect.intersected(pageArea);
 
@@ -2011,17 +2228,6 @@ void GtDocView::updateVisiblePages(int newValue)
                 }
 
                 d->m_endPage = i + 1;
-                j = 0;
-            }
-            else if (found && d->m_currentPage < d->m_endPage) {
-                if (d->dualPage() && j < 1) {
-                    /* In dual mode we stop searching
-                     * after two consecutive non-visible pages.
-                     */
-                    j++;
-                    continue;
-                }
-                break;
             }
         }
 
@@ -2124,8 +2330,41 @@ void GtDocView::resizeEvent(QResizeEvent *e)
     d->relayoutPagesLater();
 }
 
+void GtDocView::showEvent(QShowEvent *e)
+{
+    QAbstractScrollArea::showEvent(e);
+
+    // render the pages dropped by trimMemory()
+    QMetaObject::invokeMethod(this, "updateVisiblePages", Qt::QueuedConnection);
+}
+
+void GtDocView::scrollContentsBy(int dx, int dy)
+{
+    Q_D(GtDocView);
+
+    // move the composited pixels and repaint the exposed strip only,
+    // the pages are opaque and static in the contents coordinates
+    viewport()->scroll(dx, dy);
+
+    // the overlay stays in place, repaint it and its moved copy
+    if (d->m_profiler && d->m_profiler->isOverlayVisible()) {
+        QRect rect(d->m_profiler->overlayRect());
+
+        viewport()->update(rect);
+        viewport()->update(rect.translated(dx, dy));
+    }
+}
+
 void GtDocView::keyPressEvent(QKeyEvent *e)
 {
+    Q_D(GtDocView);
+
+    if (d->m_profiler)
+        d->m_profiler->inputEvent();
+
+    if (d->m_trace)
+        d->m_trace->inputEvent(GtDocTrace::KeyInput);
+
     e->accept();
 
     switch (e->key()) {
@@ -2252,6 +2491,12 @@ void GtDocView::paintEvent(QPaintEvent *e)
     if (!contentsRect.isValid())
         return;
 
+    GT_TRACE_SCOPE("view", "paint");
+
+    GtDocProfiler *profiler = d->m_profiler;
+    if (profiler)
+        profiler->beginFrame();
+
     QPainter p(viewport());
     int scrollX = horizontalScrollBar()->value();
     int scrollY = verticalScrollBar()->value();
@@ -2277,6 +2522,19 @@ void GtDocView::paintEvent(QPaintEvent *e)
 
     // fill with background color the unpainted area
     d->fillRegion(p, remainingArea, d->m_backColor);
+
+    if (profiler) {
+        profiler->endFrame();
+
+        if (profiler->isOverlayVisible())
+            profiler->drawOverlay(p);
+    }
+
+    // the state resulting from the inputs since the last frame
+    if (d->m_trace) {
+        d->m_trace->viewState(d->m_currentPage, d->m_scale,
+                              d->m_rotation, scrollX, scrollY);
+    }
 }
 
 void GtDocView::mouseMoveEvent(QMouseEvent *e)
@@ -2383,6 +2641,40 @@ void GtDocView::timerEvent(QTimerEvent *)
 
 bool GtDocView::viewportEvent(QEvent *e)
 {
+    Q_D(GtDocView);
+
+    if (d->m_profiler) {
+        switch (e->type()) {
+        case QEvent::MouseButtonPress:
+        case QEvent::MouseButtonRelease:
+        case QEvent::MouseButtonDblClick:
+        case QEvent::MouseMove:
+        case QEvent::Wheel:
+            d->m_profiler->inputEvent();
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    if (d->m_trace) {
+        switch (e->type()) {
+        case QEvent::MouseButtonPress:
+        case QEvent::MouseButtonRelease:
+        case QEvent::MouseButtonDblClick:
+            d->m_trace->inputEvent(GtDocTrace::MouseInput);
+            break;
+
+        case QEvent::Wheel:
+            d->m_trace->inputEvent(GtDocTrace::WheelInput);
+            break;
+
+        default:
+            break;
+        }
+    }
+
     return QAbstractScrollArea::viewportEvent(e);
 }
 
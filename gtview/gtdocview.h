@@ -5,6 +5,7 @@
 #define __GT_DOC_VIEW_H__
 
 #include "gtobject.h"
+#include "gtrenderstats.h"
 #include <QtWidgets/QAbstractScrollArea>
 
 class QUndoStack;
@@ -17,6 +18,8 @@ class GtDocRange;
 class GtBookmarks;
 class GtDocNote;
 class GtDocNotes;
+class GtDocProfiler;
+class GtDocTrace;
 class GtDocument;
 class GtLinkDest;
 class GtDocViewPrivate;
@@ -38,6 +41,8 @@ public:
 
     Q_DECLARE_FLAGS(SyncFlags, SyncFlag)
 
+    typedef GtRenderStats RenderStats;
+
 public:
     explicit GtDocView(QThread *thread = 0, QWidget *parent = 0);
     ~GtDocView();
@@ -53,6 +58,18 @@ public:
     void setUndoStack(QUndoStack *undoStack);
 
     void setRenderCacheSize(int size);
+    RenderStats renderStats() const;
+    void resetRenderStats();
+
+    // drops the rendered pages, e.g. of a view in the background,
+    // they render again when the view shows
+    void trimMemory();
+
+    GtDocProfiler* profiler() const;
+    void setProfiler(GtDocProfiler *profiler);
+
+    GtDocTrace* trace() const;
+    void setTrace(GtDocTrace *trace);
 
     void lockPageUpdate();
     void unlockPageUpdate(bool update = true);
@@ -117,6 +134,8 @@ private Q_SLOTS:
 
 protected:
     void resizeEvent(QResizeEvent *);
+    void showEvent(QShowEvent *);
+    void scrollContentsBy(int dx, int dy);
 
     // mouse / keyboard events
     void keyPressEvent(QKeyEvent *);
@@ -0,0 +1,23 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#ifndef __GT_RENDER_STATS_H__
+#define __GT_RENDER_STATS_H__
+
+#include "gtcommon.h"
+
+GT_BEGIN_NAMESPACE
+
+// work of the render cache, render time is in microseconds
+struct GtRenderStats
+{
+    int hits;
+    int misses;
+    int renderedPages;
+    qint64 renderedPixels;
+    qint64 renderTime;
+};
+
+GT_END_NAMESPACE
+
+#endif  /* __GT_RENDER_STATS_H__ */
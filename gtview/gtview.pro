@@ -1,10 +1,11 @@
 TEMPLATE = lib
 CONFIG += qt debug
 QT += widgets
-HEADERS += gtdocview.h gtdoccommand.h gtdocrendercache.h \
-    gttocmodel.h gttocdelegate.h gttocview.h
-SOURCES += gtdocview.cpp gtdoccommand.cpp gtdocrendercache.cpp \
-    gttocmodel.cpp gttocdelegate.cpp gttocview.cpp
+HEADERS += gtdocview.h gtdoccommand.h gtdocrendercache.h gtdocprofiler.h \
+    gtdoctrace.h gtrenderstats.h gttocmodel.h gttocdelegate.h \
+    gttocview.h
+SOURCES += gtdocview.cpp gtdoccommand.cpp gtdocrendercache.cpp gtdocprofiler.cpp \
+    gtdoctrace.cpp gttocmodel.cpp gttocdelegate.cpp gttocview.cpp
 INCLUDEPATH += ../gtbase/gtbase
 
 CONFIG(debug, debug|release) {
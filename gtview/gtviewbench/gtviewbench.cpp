@@ -0,0 +1,415 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#include "gtdocloader.h"
+#include "gtdocmodel.h"
+#include "gtdocprofiler.h"
+#include "gtdoctrace.h"
+#include "gtdocument.h"
+#include "gtdocview.h"
+#include <QtArg/Arg>
+#include <QtArg/CmdLine>
+#include <QtArg/Help>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QTextStream>
+#include <QtCore/QThread>
+#include <QtWidgets/QApplication>
+
+using namespace Gather;
+
+struct Action
+{
+    QString name;
+    double args[2];
+};
+
+static const char defaultScript[] =
+    "page 0\n"
+    "scrollby 40 50\n"
+    "page 10\n"
+    "scale 2\n"
+    "scrollby 80 25\n"
+    "scale 0.5\n"
+    "rotate 90\n"
+    "scrollby 120 25\n"
+    "rotate 0\n"
+    "scale 1\n"
+    "page -1\n"
+    "scrollby -200 25\n"
+    "page 0\n";
+
+static bool parseScript(const QString &text, QList<Action> &actions)
+{
+    QStringList lines(text.split(QLatin1Char('\n')));
+
+    for (int i = 0; i < lines.size(); ++i) {
+        QString line(lines[i].trimmed());
+        if (line.isEmpty() || line.startsWith(QLatin1Char('#')))
+            continue;
+
+        QStringList words(line.split(QLatin1Char(' '), QString::SkipEmptyParts));
+        Action action;
+        bool ok = true;
+
+        action.name = words[0];
+        action.args[0] = 0;
+        action.args[1] = 1;
+
+        for (int j = 1; j < words.size() && j < 3 && ok; ++j)
+            action.args[j - 1] = words[j].toDouble(&ok);
+
+        if (!ok) {
+            qWarning() << "invalid script line" << i + 1 << ":" << line;
+            return false;
+        }
+
+        // scrollby repeats the step, expand it here
+        if (action.name == QLatin1String("scrollby")) {
+            int count = int(action.args[1]);
+            for (int j = 0; j < count; ++j)
+                actions.append(action);
+            continue;
+        }
+
+        if (action.name != QLatin1String("scroll") &&
+            action.name != QLatin1String("scale") &&
+            action.name != QLatin1String("rotate") &&
+            action.name != QLatin1String("page") &&
+            action.name != QLatin1String("wait"))
+        {
+            qWarning() << "unknown script action" << i + 1 << ":" << line;
+            return false;
+        }
+
+        actions.append(action);
+    }
+
+    return true;
+}
+
+static QList<Action> traceActions(const GtDocTrace &trace)
+{
+    QVector<GtDocTrace::Event> events(trace.events());
+    QList<Action> actions;
+    qint64 time = 0;
+
+    // keep the pace of the recording, inputs only lead to
+    // the states following them
+    for (int i = 0; i < events.size(); ++i) {
+        const GtDocTrace::Event &event = events[i];
+        if (event.type != GtDocTrace::ViewState)
+            continue;
+
+        if (event.time > time) {
+            Action wait;
+
+            wait.name = QLatin1String("wait");
+            wait.args[0] = event.time - time;
+            wait.args[1] = 0;
+            actions.append(wait);
+            time = event.time;
+        }
+
+        Action state;
+
+        state.name = QLatin1String("state");
+        state.args[0] = i;
+        state.args[1] = 0;
+        actions.append(state);
+    }
+
+    return actions;
+}
+
+static void apply(GtDocView &view, const Action &action, int pageCount)
+{
+    if (action.name == QLatin1String("scroll")) {
+        view.scrollTo(int(action.args[0]), int(action.args[1]));
+    }
+    else if (action.name == QLatin1String("scrollby")) {
+        QPoint pos(view.scrollPoint());
+        view.scrollTo(pos.x(), pos.y() + int(action.args[0]));
+    }
+    else if (action.name == QLatin1String("scale")) {
+        view.setSizingMode(GtDocModel::FreeSize);
+        view.setScale(action.args[0]);
+    }
+    else if (action.name == QLatin1String("rotate")) {
+        view.setRotation(int(action.args[0]));
+    }
+    else if (action.name == QLatin1String("page")) {
+        // negative page counts from the end
+        int page = int(action.args[0]);
+        if (page < 0)
+            page += pageCount;
+
+        page = CLAMP(page, 0, pageCount - 1);
+        view.scrollTo(view.pageExtents(page).topLeft());
+    }
+}
+
+static void paint(GtDocView &view, bool full)
+{
+    QCoreApplication::processEvents();
+
+    if (full)
+        view.viewport()->update();
+
+    QCoreApplication::sendPostedEvents(&view, QEvent::UpdateRequest);
+}
+
+int main(int argc, char *argv[])
+{
+    // run without a display unless told otherwise
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty())
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication app(argc, argv);
+    QtArgCmdLine cmd(app.arguments());
+
+    QtArg argFile(QLatin1Char('f'),
+                  QLatin1String("file"),
+                  QLatin1String("Document to load"),
+                  true, true);
+    QtArg argLoader(QLatin1Char('l'),
+                    QLatin1String("loader"),
+                    QLatin1String("Loader plugin path"),
+                    false, true);
+    QtArg argScript(QLatin1Char('s'),
+                    QLatin1String("script"),
+                    QLatin1String("Script of view actions"),
+                    false, true);
+    QtArg argTrace(QLatin1Char('r'),
+                   QLatin1String("replay"),
+                   QLatin1String("Replay a recorded navigation trace"),
+                   false, true);
+    QtArg argWidth(QLatin1Char('W'),
+                   QLatin1String("width"),
+                   QLatin1String("Viewport width"),
+                   false, true);
+    QtArg argHeight(QLatin1Char('H'),
+                    QLatin1String("height"),
+                    QLatin1String("Viewport height"),
+                    false, true);
+    QtArg argOutput(QLatin1Char('o'),
+                    QLatin1String("output"),
+                    QLatin1String("Write the frames to a CSV file"),
+                    false, true);
+    cmd.addArg(argFile);
+    cmd.addArg(argLoader);
+    cmd.addArg(argScript);
+    cmd.addArg(argTrace);
+    cmd.addArg(argWidth);
+    cmd.addArg(argHeight);
+    cmd.addArg(argOutput);
+
+    QtArgHelp help(&cmd);
+    help.printer()->setProgramDescription(QLatin1String("Gather document view benchmark."));
+    help.printer()->setExecutableName(QLatin1String(argv[0]));
+
+    cmd.addArg(help);
+
+    try {
+        cmd.parse();
+    }
+    catch (const QtArgHelpHasPrintedEx &x)
+    {
+        return 0;
+    }
+    catch (const QtArgBaseException &x)
+    {
+        qDebug() << x.what();
+        return -1;
+    }
+
+    QString script(QLatin1String(defaultScript));
+    if (!argScript.value().isNull()) {
+        QFile file(argScript.value().toString());
+        if (!file.open(QIODevice::ReadOnly)) {
+            qWarning() << "open script failed:" << file.fileName();
+            return -1;
+        }
+
+        script = QString::fromUtf8(file.readAll());
+    }
+
+    QList<Action> actions;
+    GtDocTrace trace;
+
+    if (!argTrace.value().isNull()) {
+        if (!trace.load(argTrace.value().toString()))
+            return -1;
+
+        actions = traceActions(trace);
+    }
+    else if (!parseScript(script, actions)) {
+        return -1;
+    }
+
+    QString loaderPath(QDir(app.applicationDirPath()).filePath("loader"));
+    if (!argLoader.value().isNull())
+        loaderPath = argLoader.value().toString();
+
+    GtDocLoader docLoader(0);
+    if (docLoader.registerLoaders(loaderPath) == 0) {
+        qWarning() << "no loader found:" << loaderPath;
+        return -1;
+    }
+
+    GtDocument *document = docLoader.loadDocument(argFile.value().toString());
+    if (!document || !document->isLoaded() || document->pageCount() == 0) {
+        qWarning() << "load document failed:" << argFile.value().toString();
+        delete document;
+        return -1;
+    }
+
+    int pageCount = document->pageCount();
+    QSize size(1920, 1080);
+
+    // replay in the size the trace was recorded with by default
+    if (!argTrace.value().isNull()) {
+        if (trace.pageCount() != pageCount) {
+            qWarning() << "trace recorded with" << trace.pageCount()
+                       << "pages, document has" << pageCount;
+        }
+
+        if (trace.viewSize().isValid())
+            size = trace.viewSize();
+    }
+
+    int width = argWidth.value().isNull() ? size.width() : argWidth.value().toInt();
+    int height = argHeight.value().isNull() ? size.height() : argHeight.value().toInt();
+
+    QThread renderThread;
+    renderThread.start();
+
+    GtDocModel model;
+    model.setDocument(document);
+
+    GtDocProfiler profiler;
+    GtDocView *view = new GtDocView(&renderThread);
+    view->resize(width, height);
+    view->setProfiler(&profiler);
+    view->setModel(&model);
+    view->show();
+    paint(*view, true);
+
+    // the frame right after an action is what the user waits on,
+    // the following frames until no page is blank give the time
+    // to sharp pages, they aren't counted as action frames
+    const qint64 sharpTimeout = 5000;
+    QVector<qint64> frameTimes;
+    QVector<qint64> sharpTimes;
+    QElapsedTimer clock;
+    int timeouts = 0;
+
+    view->resetRenderStats();
+
+    for (int i = 0; i < actions.size(); ++i) {
+        const Action &action = actions[i];
+
+        if (action.name == QLatin1String("wait")) {
+            clock.start();
+            while (clock.elapsed() < qint64(action.args[0]))
+                paint(*view, false);
+            continue;
+        }
+
+        // a recorded state replaces the whole view state
+        if (action.name == QLatin1String("state")) {
+            const GtDocTrace::Event &event = trace.events()[int(action.args[0])];
+
+            quint64 frameCount = profiler.frameCount();
+
+            clock.start();
+            view->setSizingMode(GtDocModel::FreeSize);
+            view->setRotation(event.rotation);
+            view->setScale(event.scale);
+            view->scrollTo(event.scrollX, event.scrollY);
+            paint(*view, false);
+
+            // nothing painted when the state didn't change
+            if (profiler.frameCount() > frameCount)
+                frameTimes.append(profiler.lastFrame().paint);
+
+            continue;
+        }
+
+        quint64 frameCount = profiler.frameCount();
+
+        clock.start();
+        apply(*view, action, pageCount);
+        paint(*view, false);
+
+        if (profiler.frameCount() == frameCount)
+            continue;
+
+        frameTimes.append(profiler.lastFrame().paint);
+
+        bool sharp = profiler.lastFrame().blankPages == 0;
+        while (!sharp && clock.elapsed() < sharpTimeout) {
+            QThread::msleep(1);
+            paint(*view, true);
+            sharp = profiler.lastFrame().blankPages == 0;
+        }
+
+        if (sharp)
+            sharpTimes.append(clock.nsecsElapsed() / 1000);
+        else
+            ++timeouts;
+    }
+
+    QTextStream out(stdout);
+
+    out << "document: " << argFile.value().toString()
+        << " (" << pageCount << " pages)\n"
+        << "viewport: " << width << "x" << height
+        << ", " << frameTimes.size() << " actions\n";
+    out << QString("frame ms: p50 %1  p95 %2  p99 %3\n")
+           .arg(GtDocProfiler::percentile(frameTimes, 50) / 1000.0, 0, 'f', 3)
+           .arg(GtDocProfiler::percentile(frameTimes, 95) / 1000.0, 0, 'f', 3)
+           .arg(GtDocProfiler::percentile(frameTimes, 99) / 1000.0, 0, 'f', 3);
+    out << QString("time to sharp ms: p50 %1  p95 %2  max %3  timeouts %4\n")
+           .arg(GtDocProfiler::percentile(sharpTimes, 50) / 1000.0, 0, 'f', 3)
+           .arg(GtDocProfiler::percentile(sharpTimes, 95) / 1000.0, 0, 'f', 3)
+           .arg(GtDocProfiler::percentile(sharpTimes, 100) / 1000.0, 0, 'f', 3)
+           .arg(timeouts);
+
+    // blank frames and render work of the whole run
+    GtDocView::RenderStats stats = view->renderStats();
+    QVector<GtDocProfiler::Frame> frames(profiler.frames());
+    int lookups = stats.hits + stats.misses;
+    int blankFrames = 0;
+
+    for (int i = 0; i < frames.size(); ++i) {
+        if (frames[i].blankPages > 0)
+            ++blankFrames;
+    }
+
+    out << QString("cache: hit rate %1%  hits %2  misses %3\n")
+           .arg(lookups ? 100.0 * stats.hits / lookups : 0.0, 0, 'f', 1)
+           .arg(stats.hits)
+           .arg(stats.misses);
+    out << QString("frames: %1  blank %2\n")
+           .arg(frames.size())
+           .arg(blankFrames);
+    out << QString("render: %1 pages  %2 Mpixels  %3 ms\n")
+           .arg(stats.renderedPages)
+           .arg(stats.renderedPixels / 1000000.0, 0, 'f', 1)
+           .arg(stats.renderTime / 1000.0, 0, 'f', 1);
+    out.flush();
+
+    if (!argOutput.value().isNull())
+        profiler.save(argOutput.value().toString());
+
+    // the view holds pages of the model, release it first
+    delete view;
+    model.setDocument(0);
+
+    renderThread.quit();
+    renderThread.wait();
+    return timeouts ? 1 : 0;
+}
@@ -0,0 +1,17 @@
+TEMPLATE = app
+TARGET = gtviewbench
+CONFIG += qt debug
+QT += widgets
+HEADERS +=
+SOURCES += gtviewbench.cpp
+INCLUDEPATH += $$PWD/../../gtbase/gtbase
+INCLUDEPATH += $$PWD/..
+INCLUDEPATH += $$PWD/../../
+
+CONFIG(debug, debug|release) {
+    DESTDIR = ../../build/debug
+} else {
+    DESTDIR = ../../build/release
+}
+
+unix: LIBS += -L$$DESTDIR -lgtview -lgtbase -lprotobuf
@@ -0,0 +1,6 @@
+CONFIG += testcase
+TARGET = test_doctrace
+QT = core gui widgets testlib
+SOURCES = test_doctrace.cpp
+
+include(../tests.pri)
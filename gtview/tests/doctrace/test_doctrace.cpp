@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#include "gtdoctrace.h"
+#include <QtTest/QtTest>
+
+using namespace Gather;
+
+class test_doctrace : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testRecord();
+    void testSaveLoad();
+    void testInvalidFile();
+    void cleanupTestCase();
+};
+
+void test_doctrace::testRecord()
+{
+    GtDocTrace trace;
+
+    trace.viewState(0, 1.0, 0, 0, 0);
+    trace.inputEvent(GtDocTrace::WheelInput);
+
+    // the same state again is left out
+    trace.viewState(0, 1.0, 0, 0, 0);
+    trace.viewState(1, 1.0, 0, 0, 800);
+
+    QVector<GtDocTrace::Event> events(trace.events());
+    QVERIFY(events.size() == 3);
+    QVERIFY(events[0].type == GtDocTrace::ViewState);
+    QVERIFY(events[1].type == GtDocTrace::WheelInput);
+    QVERIFY(events[2].type == GtDocTrace::ViewState);
+    QVERIFY(events[2].page == 1 && events[2].scrollY == 800);
+
+    trace.clear();
+    QVERIFY(trace.events().isEmpty());
+}
+
+void test_doctrace::testSaveLoad()
+{
+    GtDocTrace trace;
+
+    trace.setPageCount(120);
+    trace.setViewSize(QSize(1024, 768));
+    trace.viewState(0, 1.0, 0, 0, 0);
+    QTest::qWait(20);
+    trace.inputEvent(GtDocTrace::KeyInput);
+    trace.inputEvent(GtDocTrace::MouseInput);
+    QTest::qWait(20);
+    trace.viewState(7, 1.5, 90, -12, 123456);
+    trace.inputEvent(GtDocTrace::WheelInput);
+    trace.viewState(8, 0.25, 270, 40, 2000000);
+
+    QString fileName(QDir::temp().filePath("test_doctrace.trace"));
+    QVERIFY(trace.save(fileName));
+
+    GtDocTrace loaded;
+    QVERIFY(loaded.load(fileName));
+    QVERIFY(loaded.pageCount() == 120);
+    QVERIFY(loaded.viewSize() == QSize(1024, 768));
+
+    // the times are deltas in the file, the sums come back
+    QVector<GtDocTrace::Event> events(trace.events());
+    QVector<GtDocTrace::Event> result(loaded.events());
+    QVERIFY(result.size() == events.size());
+
+    for (int i = 0; i < events.size(); ++i) {
+        const GtDocTrace::Event &a = events[i];
+        const GtDocTrace::Event &b = result[i];
+
+        QVERIFY(a.time == b.time);
+        QVERIFY(a.type == b.type);
+        QVERIFY(a.page == b.page);
+        QVERIFY(a.scale == b.scale);
+        QVERIFY(a.rotation == b.rotation);
+        QVERIFY(a.scrollX == b.scrollX);
+        QVERIFY(a.scrollY == b.scrollY);
+    }
+
+    QVERIFY(result[3].time >= 40);
+    QVERIFY(QFile::remove(fileName));
+}
+
+void test_doctrace::testInvalidFile()
+{
+    GtDocTrace trace;
+    QString fileName(QDir::temp().filePath("test_doctrace.trace"));
+
+    trace.setPageCount(10);
+    trace.viewState(3, 1.0, 0, 0, 300);
+    trace.inputEvent(GtDocTrace::KeyInput);
+    QVERIFY(trace.save(fileName));
+
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QByteArray data(file.readAll());
+    file.close();
+
+    // a truncated file leaves the trace as it was
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    QVERIFY(file.write(data.left(data.size() - 4)) == data.size() - 4);
+    file.close();
+
+    GtDocTrace loaded;
+    loaded.setPageCount(5);
+    QVERIFY(!loaded.load(fileName));
+    QVERIFY(loaded.pageCount() == 5);
+    QVERIFY(loaded.events().isEmpty());
+
+    // not a trace
+    data[0] = ~data[0];
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    QVERIFY(file.write(data) == data.size());
+    file.close();
+    QVERIFY(!loaded.load(fileName));
+
+    QVERIFY(QFile::remove(fileName));
+    QVERIFY(!loaded.load(fileName));
+}
+
+void test_doctrace::cleanupTestCase()
+{
+#ifdef GT_DEBUG
+    QVERIFY(GtObject::dumpObjects() == 0);
+#endif
+}
+
+QTEST_MAIN(test_doctrace)
+#include "test_doctrace.moc"
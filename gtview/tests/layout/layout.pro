@@ -0,0 +1,8 @@
+CONFIG += testcase
+TARGET = test_layout
+QT = core gui widgets testlib
+HEADERS = ../../../gtbase/tests/testpdf.h
+SOURCES = test_layout.cpp ../../../gtbase/tests/testpdf.cpp
+INCLUDEPATH += ../../../gtbase/tests
+
+include(../tests.pri)
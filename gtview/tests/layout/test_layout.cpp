@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#include "gtdocloader.h"
+#include "gtdocmodel.h"
+#include "gtdocument.h"
+#include "gtdocview.h"
+#include "gtmemorygovernor.h"
+#include "testpdf.h"
+#include <QtTest/QtTest>
+#include <QtWidgets/QScrollBar>
+
+using namespace Gather;
+
+class test_layout : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void testScroll_data();
+    void testScroll();
+    void testScrollPaint_data();
+    void testScrollPaint();
+    void testRenderBudget();
+    void cleanupTestCase();
+
+private:
+    static bool writePdf(const QString &fileName, int pageCount);
+
+private:
+    GtDocLoader *m_docLoader;
+};
+
+bool test_layout::writePdf(const QString &fileName, int pageCount)
+{
+    // the page sizes differ so the layout isn't uniform
+    TestPdf::Spec spec;
+    spec.pageCount = pageCount;
+    spec.mixedSizes = true;
+    return TestPdf::write(fileName, spec);
+}
+
+void test_layout::initTestCase()
+{
+    m_docLoader = new GtDocLoader(0, this);
+
+    QDir dir(QCoreApplication::applicationDirPath());
+    QVERIFY(dir.cd("loader"));
+    QVERIFY(m_docLoader->registerLoaders(dir.absolutePath()) == 1);
+}
+
+void test_layout::testScroll_data()
+{
+    QTest::addColumn<int>("pageCount");
+
+    QTest::newRow("1k") << 1000;
+    QTest::newRow("10k") << 10000;
+    QTest::newRow("100k") << 100000;
+}
+
+void test_layout::testScroll()
+{
+    QFETCH(int, pageCount);
+
+    QString fileName(QDir::temp().filePath(
+                         QString("test_layout_%1.pdf").arg(pageCount)));
+    QVERIFY(writePdf(fileName, pageCount));
+
+    GtDocument *doc = m_docLoader->loadDocument(fileName);
+    QVERIFY(doc && doc->isLoaded());
+    QVERIFY(doc->pageCount() == pageCount);
+
+    GtDocModel model;
+    model.setDocument(doc);
+
+    GtDocView view;
+    view.resize(800, 600);
+    view.setModel(&model);
+    view.show();
+    QVERIFY(QTest::qWaitForWindowExposed(&view));
+
+    QScrollBar *bar = view.verticalScrollBar();
+    QTRY_VERIFY(bar->maximum() > 0);
+
+    // the page at the top of the view becomes the current one
+    for (int i = 0; i < 10; ++i) {
+        int page = pageCount / 10 * i;
+
+        bar->setValue(view.pageExtents(page).y());
+        QVERIFY(model.page() == page);
+    }
+
+    bar->setValue(bar->maximum());
+    QVERIFY(model.page() >= pageCount - 2);
+
+    // scroll across the whole document, the lookup of the
+    // visible pages shouldn't grow with the page count
+    const int steps = 1000;
+    int maximum = bar->maximum();
+
+    QBENCHMARK {
+        for (int i = 0; i <= steps; ++i)
+            bar->setValue(qint64(maximum) * i / steps);
+    }
+
+    // the model holds the last reference of the document
+    view.setModel(0);
+    model.setDocument(0);
+    QVERIFY(QFile::remove(fileName));
+}
+
+void test_layout::testScrollPaint_data()
+{
+    QTest::addColumn<bool>("fullRepaint");
+
+    QTest::newRow("blit") << false;
+    QTest::newRow("full") << true;
+}
+
+void test_layout::testScrollPaint()
+{
+    QFETCH(bool, fullRepaint);
+
+    const int pageCount = 100;
+    QString fileName(QDir::temp().filePath("test_layout_paint.pdf"));
+    QVERIFY(writePdf(fileName, pageCount));
+
+    GtDocument *doc = m_docLoader->loadDocument(fileName);
+    QVERIFY(doc && doc->isLoaded());
+
+    GtDocModel model;
+    model.setDocument(doc);
+
+    // frames of a 4K viewport, scrolling a few rows at a time
+    GtDocView view;
+    view.resize(3840, 2160);
+    view.setModel(&model);
+    view.show();
+    QVERIFY(QTest::qWaitForWindowExposed(&view));
+
+    QScrollBar *bar = view.verticalScrollBar();
+    QTRY_VERIFY(bar->maximum() > 0);
+    QTest::qWait(200);
+
+    const int frames = 100;
+    const int step = 20;
+    int value = 0;
+
+    QBENCHMARK {
+        for (int i = 0; i < frames; ++i) {
+            value = (value + step) % bar->maximum();
+            bar->setValue(value);
+
+            if (fullRepaint)
+                view.viewport()->update();
+
+            // paint the frame now, updates are posted to the window
+            QCoreApplication::sendPostedEvents(&view, QEvent::UpdateRequest);
+        }
+    }
+
+    view.setModel(0);
+    model.setDocument(0);
+    QVERIFY(QFile::remove(fileName));
+}
+
+void test_layout::testRenderBudget()
+{
+    const int pageCount = 20;
+    QString fileName(QDir::temp().filePath("test_layout_budget.pdf"));
+    QVERIFY(writePdf(fileName, pageCount));
+
+    GtDocument *doc = m_docLoader->loadDocument(fileName);
+    QVERIFY(doc && doc->isLoaded());
+
+    GtDocModel model;
+    model.setDocument(doc);
+
+    // a budget smaller than the preloaded pages, they are
+    // evicted as soon as they are rendered
+    GtMemoryGovernor *governor = GtMemoryGovernor::instance();
+    qint64 budget = governor->budget();
+    governor->setBudget(1);
+
+    GtDocView view;
+    view.resize(800, 600);
+    view.setRenderCacheSize(64 * 1024 * 1024);
+    view.setModel(&model);
+    view.show();
+    QVERIFY(QTest::qWaitForWindowExposed(&view));
+    QTRY_VERIFY(view.renderStats().renderedPages > 0);
+
+    // the evicted pages wait for the next page range
+    QTest::qWait(200);
+    int rendered = view.renderStats().renderedPages;
+    QVERIFY(rendered <= pageCount);
+
+    QTest::qWait(200);
+    QVERIFY(view.renderStats().renderedPages == rendered);
+
+    // the page range changes, the evicted pages render once more
+    QScrollBar *bar = view.verticalScrollBar();
+    bar->setValue(view.pageExtents(pageCount / 2).y());
+    QTRY_VERIFY(view.renderStats().renderedPages > rendered);
+
+    QTest::qWait(200);
+    rendered = view.renderStats().renderedPages;
+    QTest::qWait(200);
+    QVERIFY(view.renderStats().renderedPages == rendered);
+
+    governor->setBudget(budget);
+
+    view.setModel(0);
+    model.setDocument(0);
+    QVERIFY(QFile::remove(fileName));
+}
+
+void test_layout::cleanupTestCase()
+{
+    delete m_docLoader;
+
+#ifdef GT_DEBUG
+    QVERIFY(GtObject::dumpObjects() == 0);
+#endif
+}
+
+QTEST_MAIN(test_layout)
+#include "test_layout.moc"
@@ -0,0 +1,6 @@
+CONFIG += testcase
+TARGET = test_profiler
+QT = core gui widgets testlib
+SOURCES = test_profiler.cpp
+
+include(../tests.pri)
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2013 Tom Wong. All rights reserved.
+ */
+#include "gtdocprofiler.h"
+#include <QtTest/QtTest>
+
+using namespace Gather;
+
+class test_profiler : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testFrames();
+    void testRing();
+    void testSave();
+    void testPercentile();
+    void cleanupTestCase();
+
+private:
+    static void paintFrame(GtDocProfiler *profiler, int pages, int blankPages);
+};
+
+void test_profiler::paintFrame(GtDocProfiler *profiler,
+                               int pages, int blankPages)
+{
+    profiler->beginFrame();
+
+    for (int i = 0; i < pages; ++i) {
+        profiler->beginPage();
+        profiler->endPage(i < blankPages);
+    }
+
+    profiler->endFrame();
+}
+
+void test_profiler::testFrames()
+{
+    GtDocProfiler profiler;
+
+    // a frame not begun is not counted
+    profiler.endFrame();
+    QVERIFY(profiler.frames().isEmpty());
+
+    paintFrame(&profiler, 3, 1);
+    profiler.inputEvent();
+    paintFrame(&profiler, 2, 0);
+
+    QVector<GtDocProfiler::Frame> frames(profiler.frames());
+    QVERIFY(frames.size() == 2);
+    QVERIFY(frames[0].pages == 3 && frames[0].blankPages == 1);
+    QVERIFY(frames[0].inputLatency == -1);
+    QVERIFY(frames[1].pages == 2 && frames[1].blankPages == 0);
+    QVERIFY(frames[1].inputLatency >= 0);
+    QVERIFY(frames[0].time <= frames[1].time);
+    QVERIFY(frames[0].maxPage <= frames[0].drawPage);
+    QVERIFY(frames[0].drawPage <= frames[0].paint);
+
+    profiler.clear();
+    QVERIFY(profiler.frames().isEmpty());
+}
+
+void test_profiler::testRing()
+{
+    GtDocProfiler profiler;
+
+    // the page counts tell the frames apart
+    profiler.setMaxFrames(4);
+    for (int i = 0; i < 10; ++i)
+        paintFrame(&profiler, i, 0);
+
+    QVector<GtDocProfiler::Frame> frames(profiler.frames());
+    QVERIFY(frames.size() == 4);
+    for (int i = 0; i < 4; ++i)
+        QVERIFY(frames[i].pages == 6 + i);
+
+    // the count goes on past the ring
+    QVERIFY(profiler.frameCount() == 10);
+    QVERIFY(profiler.lastFrame().pages == 9);
+
+    // the oldest frames go when shrinking, the ring grows again
+    profiler.setMaxFrames(2);
+    frames = profiler.frames();
+    QVERIFY(frames.size() == 2);
+    QVERIFY(frames[0].pages == 8 && frames[1].pages == 9);
+
+    profiler.setMaxFrames(3);
+    paintFrame(&profiler, 10, 0);
+    paintFrame(&profiler, 11, 0);
+
+    frames = profiler.frames();
+    QVERIFY(frames.size() == 3);
+    for (int i = 0; i < 3; ++i)
+        QVERIFY(frames[i].pages == 9 + i);
+}
+
+void test_profiler::testSave()
+{
+    GtDocProfiler profiler;
+
+    profiler.setMaxFrames(3);
+    for (int i = 0; i < 5; ++i)
+        paintFrame(&profiler, i, 0);
+
+    QString fileName(QDir::temp().filePath("test_profiler.csv"));
+    QVERIFY(profiler.save(fileName));
+
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+
+    // the header and the frames oldest first
+    QList<QByteArray> lines(file.readAll().split('\n'));
+    QVERIFY(lines.size() == 5 && lines.last().isEmpty());
+    QVERIFY(lines[0].startsWith("time,paint,pages,"));
+    for (int i = 0; i < 3; ++i)
+        QVERIFY(lines[i + 1].split(',').at(2).toInt() == 2 + i);
+
+    file.close();
+    QVERIFY(QFile::remove(fileName));
+}
+
+void test_profiler::testPercentile()
+{
+    QVector<qint64> values;
+    QVERIFY(GtDocProfiler::percentile(values, 50) == 0);
+
+    for (int i = 100; i > 0; --i)
+        values.append(i);
+
+    QVERIFY(GtDocProfiler::percentile(values, 0) == 1);
+    QVERIFY(GtDocProfiler::percentile(values, 50) == 50);
+    QVERIFY(GtDocProfiler::percentile(values, 95) == 95);
+    QVERIFY(GtDocProfiler::percentile(values, 100) == 100);
+
+    // the values of the caller are left as they are
+    QVERIFY(values.first() == 100);
+}
+
+void test_profiler::cleanupTestCase()
+{
+#ifdef GT_DEBUG
+    QVERIFY(GtObject::dumpObjects() == 0);
+#endif
+}
+
+QTEST_MAIN(test_profiler)
+#include "test_profiler.moc"
@@ -0,0 +1,11 @@
+CONFIG += debug
+INCLUDEPATH += ../..
+INCLUDEPATH += ../../../gtbase/gtbase
+
+CONFIG(debug, debug|release) {
+    DESTDIR = ../../../build/debug
+} else {
+    DESTDIR = ../../../build/release
+}
+
+unix: LIBS += -L$$DESTDIR -lgtview -lgtbase -lprotobuf
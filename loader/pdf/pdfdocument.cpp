@@ -64,9 +64,14 @@ PdfDocument::LabelRange::LabelRange(pdf_obj *d, int b)
 }
 
 PdfDocument::PdfDocument()
-    : _context(0)
+    : heapSize(0)
+    , _context(0)
     , document(0)
 {
+    alloc.user = this;
+    alloc.malloc = PdfDocument::allocMemory;
+    alloc.realloc = PdfDocument::reallocMemory;
+    alloc.free = PdfDocument::freeMemory;
 }
 
 PdfDocument::~PdfDocument()
@@ -88,7 +93,9 @@ bool PdfDocument::load(QIODevice *device)
 {
     fz_stream *stream;
 
-    _context = fz_new_context(NULL, NULL, 8 << 20);
+    // the store keeps its own cap, the memory governor sees it
+    // through cacheSize() and empties it with shrinkCache()
+    _context = fz_new_context(&alloc, NULL, 8 << 20);
     stream = fz_new_stream(_context, device,
                            PdfDocument::readPdfStream,
                            PdfDocument::closePdfStream);
@@ -169,6 +176,17 @@ GtAbstractPage* PdfDocument::loadPage(int index)
     return new PdfPage(_context, document, page, label);
 }
 
+qint64 PdfDocument::cacheSize()
+{
+    return heapSize;
+}
+
+void PdfDocument::shrinkCache(int percent)
+{
+    if (_context)
+        fz_shrink_store(_context, percent);
+}
+
 GtAbstractOutline* PdfDocument::loadOutline()
 {
     fz_outline *outline = fz_load_outline(document);
@@ -298,6 +316,60 @@ void PdfDocument::closePdfStream(fz_context*, void *state)
     device->close();
 }
 
+// every block keeps its size in front, so that the heap of the
+// document can be counted
+union PdfMemoryHeader
+{
+    unsigned int size;
+    double align;
+};
+
+void* PdfDocument::allocMemory(void *user, unsigned int size)
+{
+    PdfDocument *self = static_cast<PdfDocument*>(user);
+    PdfMemoryHeader *header;
+
+    header = (PdfMemoryHeader*)malloc(sizeof(PdfMemoryHeader) + size);
+    if (!header)
+        return 0;
+
+    header->size = size;
+    self->heapSize += size;
+    return header + 1;
+}
+
+void* PdfDocument::reallocMemory(void *user, void *old, unsigned int size)
+{
+    PdfDocument *self = static_cast<PdfDocument*>(user);
+    PdfMemoryHeader *header;
+
+    if (!old)
+        return allocMemory(user, size);
+
+    header = (PdfMemoryHeader*)old - 1;
+    unsigned int oldSize = header->size;
+
+    header = (PdfMemoryHeader*)realloc(header, sizeof(PdfMemoryHeader) + size);
+    if (!header)
+        return 0;
+
+    header->size = size;
+    self->heapSize += (qint64)size - oldSize;
+    return header + 1;
+}
+
+void PdfDocument::freeMemory(void *user, void *ptr)
+{
+    PdfDocument *self = static_cast<PdfDocument*>(user);
+
+    if (!ptr)
+        return;
+
+    PdfMemoryHeader *header = (PdfMemoryHeader*)ptr - 1;
+    self->heapSize -= header->size;
+    free(header);
+}
+
 QString PdfDocument::objToString(pdf_obj *obj)
 {
     QString buffer(pdf_to_str_len(obj) + 1, 0);
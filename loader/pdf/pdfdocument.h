@@ -25,6 +25,8 @@ public:
     int countPages();
     GtAbstractPage* loadPage(int index);
     GtAbstractOutline* loadOutline();
+    qint64 cacheSize();
+    void shrinkCache(int percent);
 
 protected:
     void parseLabels(pdf_obj *tree);
@@ -37,11 +39,16 @@ protected:
     static QString objToString(pdf_obj *obj);
     static QString toRoman(int number, bool uppercase);
     static QString toLatin(int number, bool uppercase);
+    static void* allocMemory(void *user, unsigned int size);
+    static void* reallocMemory(void *user, void *old, unsigned int size);
+    static void freeMemory(void *user, void *ptr);
 
 protected:
     class LabelRange;
 
 private:
+    fz_alloc_context alloc;
+    qint64 heapSize;
     fz_context *_context;
     fz_document *document;
     QList<LabelRange*> labelRanges;